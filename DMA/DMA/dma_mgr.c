@@ -0,0 +1,387 @@
+#include "dma_mgr.h"
+#include "stm32f10x_dma.h"
+#include "stm32f10x_rcc.h"
+#include "misc.h"
+#include <string.h>
+
+#define DMAMGR_QUEUE_LEN		4		/* Chains waiting per channel */
+#define DMAMGR_CHAIN_MAX		32		/* Longer chains are taken for a pNext loop */
+
+struct DMAMgr_Chan {
+	DMA_Channel_TypeDef *pRegs;
+	uint8_t u8Index;					/* 0 for channel 1 */
+	uint8_t u8Used;
+	uint8_t u8Mem;						/* Allocated for memory to memory */
+	uint32_t u32Periph;					/* Peripheral data register of the line */
+	DMAMgr_Desc_t *pCur;				/* Running descriptor */
+	DMAMgr_Desc_t *Queue[DMAMGR_QUEUE_LEN];
+	uint8_t u8QHead;
+	uint8_t u8QTail;
+};
+
+static DMAMgr_Chan_t Chans[DMAMGR_CHANNELS];
+
+/* Channel of every request line, 0 for any */
+static const uint8_t u8LineChannel[DMAMGR_LINES] = {
+	0,		/* MEM */
+	1,		/* ADC1 */
+	2,		/* SPI1_RX */
+	3,		/* SPI1_TX */
+	2,		/* USART3_TX */
+	3,		/* USART3_RX */
+	4,		/* SPI2_RX */
+	5,		/* SPI2_TX */
+	4,		/* USART1_TX */
+	5,		/* USART1_RX */
+	6,		/* I2C1_TX */
+	7,		/* I2C1_RX */
+	6,		/* USART2_RX */
+	7		/* USART2_TX */
+};
+
+static uint32_t DMAMgr_LineAddr(DMAMgr_Line_t eLine)
+{
+	switch (eLine) {
+	case DMAMGR_LINE_ADC1:			return (uint32_t)&ADC1->DR;
+	case DMAMGR_LINE_SPI1_RX:
+	case DMAMGR_LINE_SPI1_TX:		return (uint32_t)&SPI1->DR;
+	case DMAMGR_LINE_SPI2_RX:
+	case DMAMGR_LINE_SPI2_TX:		return (uint32_t)&SPI2->DR;
+	case DMAMGR_LINE_USART1_TX:
+	case DMAMGR_LINE_USART1_RX:		return (uint32_t)&USART1->DR;
+	case DMAMGR_LINE_USART2_TX:
+	case DMAMGR_LINE_USART2_RX:		return (uint32_t)&USART2->DR;
+	case DMAMGR_LINE_USART3_TX:
+	case DMAMGR_LINE_USART3_RX:		return (uint32_t)&USART3->DR;
+	case DMAMGR_LINE_I2C1_TX:
+	case DMAMGR_LINE_I2C1_RX:		return (uint32_t)&I2C1->DR;
+	default:						return 0;
+	}
+}
+
+static void DMAMgr_Start(DMAMgr_Chan_t *pChan, DMAMgr_Desc_t *pDesc)
+{
+	DMA_InitTypeDef DMA_InitStruct;
+	static const uint32_t u32PSize[5] = {0, DMA_PeripheralDataSize_Byte, DMA_PeripheralDataSize_HalfWord, 0, DMA_PeripheralDataSize_Word};
+	static const uint32_t u32MSize[5] = {0, DMA_MemoryDataSize_Byte, DMA_MemoryDataSize_HalfWord, 0, DMA_MemoryDataSize_Word};
+
+	pChan->pCur = pDesc;
+	DMA_Cmd(pChan->pRegs, DISABLE);
+
+	DMA_InitStruct.DMA_MemoryBaseAddr = (uint32_t)pDesc->pBuf;
+	DMA_InitStruct.DMA_BufferSize = pDesc->u16Count;
+	DMA_InitStruct.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	DMA_InitStruct.DMA_MemoryDataSize = u32MSize[pDesc->u8Width];
+	DMA_InitStruct.DMA_PeripheralDataSize = u32PSize[pDesc->u8Width];
+	DMA_InitStruct.DMA_Mode = pDesc->u8Circular ? DMA_Mode_Circular : DMA_Mode_Normal;
+	DMA_InitStruct.DMA_Priority = DMA_Priority_Medium;
+	if (pChan->u8Mem) {
+		//The source is on the peripheral side, it increments too
+		DMA_InitStruct.DMA_PeripheralBaseAddr = (uint32_t)pDesc->pSrc;
+		DMA_InitStruct.DMA_PeripheralInc = DMA_PeripheralInc_Enable;
+		DMA_InitStruct.DMA_DIR = DMA_DIR_PeripheralSRC;
+		DMA_InitStruct.DMA_M2M = DMA_M2M_Enable;
+	} else {
+		DMA_InitStruct.DMA_PeripheralBaseAddr = pChan->u32Periph;
+		DMA_InitStruct.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+		DMA_InitStruct.DMA_DIR = (pDesc->u8Dir == DMAMGR_FROM_MEM) ? DMA_DIR_PeripheralDST : DMA_DIR_PeripheralSRC;
+		DMA_InitStruct.DMA_M2M = DMA_M2M_Disable;
+	}
+	DMA_Init(pChan->pRegs, &DMA_InitStruct);
+	DMA_ITConfig(pChan->pRegs, DMA_IT_TC | DMA_IT_TE, ENABLE);
+	DMA_Cmd(pChan->pRegs, ENABLE);
+}
+
+/* Next descriptor of the chain, or the head of the next queued chain */
+static void DMAMgr_StartNext(DMAMgr_Chan_t *pChan, DMAMgr_Desc_t *pNext)
+{
+	while (!pNext && pChan->u8QTail != pChan->u8QHead) {
+		pNext = pChan->Queue[pChan->u8QTail];
+		pChan->u8QTail = (pChan->u8QTail + 1) % DMAMGR_QUEUE_LEN;
+	}
+	if (pNext) {
+		DMAMgr_Start(pChan, pNext);
+	} else {
+		pChan->pCur = 0;
+	}
+}
+
+static void DMAMgr_Done(DMAMgr_Desc_t *pDesc, uint8_t u8Error)
+{
+	pDesc->u8Error = u8Error;
+	pDesc->u8Busy = 0;
+	if (pDesc->pfDone) {
+		pDesc->pfDone(pDesc);
+	}
+}
+
+static void DMAMgr_Irq(DMAMgr_Chan_t *pChan)
+{
+	DMAMgr_Desc_t *pDesc = pChan->pCur;
+	uint32_t u32Flags = DMA1->ISR >> (pChan->u8Index * 4);
+
+	DMA1->IFCR = DMA1_FLAG_GL1 << (pChan->u8Index * 4);
+	if (!pDesc) {
+		return;
+	}
+
+	if (u32Flags & DMA1_FLAG_TE1) {
+		//The channel disables itself on an error, the rest of the chain would run on bad data
+		DMA_Cmd(pChan->pRegs, DISABLE);
+		DMAMgr_Done(pDesc, 1);
+		for (pDesc = pDesc->pNext; pDesc; pDesc = pDesc->pNext) {
+			DMAMgr_Done(pDesc, 1);
+		}
+		DMAMgr_StartNext(pChan, 0);
+	} else if (u32Flags & DMA1_FLAG_TC1) {
+		if (pDesc->u8Circular) {
+			if (pDesc->pfDone) {
+				pDesc->pfDone(pDesc);
+			}
+			return;
+		}
+		DMA_Cmd(pChan->pRegs, DISABLE);
+		DMAMgr_Done(pDesc, 0);
+		DMAMgr_StartNext(pChan, pDesc->pNext);
+	}
+}
+
+void DMAMgr_Init(void)
+{
+	uint8_t i;
+
+	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+	memset(Chans, 0, sizeof(Chans));
+	for (i = 0; i < DMAMGR_CHANNELS; i++) {
+		Chans[i].pRegs = (DMA_Channel_TypeDef *)(DMA1_Channel1_BASE + i * (DMA1_Channel2_BASE - DMA1_Channel1_BASE));
+		Chans[i].u8Index = i;
+		DMA_DeInit(Chans[i].pRegs);
+	}
+}
+
+DMAMgr_Chan_t *DMAMgr_Alloc(DMAMgr_Line_t eLine)
+{
+	NVIC_InitTypeDef NVIC_InitStruct;
+	DMAMgr_Chan_t *pChan = 0;
+	uint32_t u32Primask;
+	int8_t i;
+
+	if (eLine >= DMAMGR_LINES) {
+		return 0;
+	}
+
+	u32Primask = __get_PRIMASK();
+	__disable_irq();
+	if (eLine == DMAMGR_LINE_MEM) {
+		//From channel 7 down, on equal priority the lower channel wins and those carry peripherals
+		for (i = DMAMGR_CHANNELS - 1; i >= 0; i--) {
+			if (!Chans[i].u8Used) {
+				pChan = &Chans[i];
+				break;
+			}
+		}
+	} else if (!Chans[u8LineChannel[eLine] - 1].u8Used) {
+		pChan = &Chans[u8LineChannel[eLine] - 1];
+	}
+	if (pChan) {
+		pChan->u8Used = 1;
+	}
+	__set_PRIMASK(u32Primask);
+
+	if (!pChan) {
+		return 0;
+	}
+	pChan->u8Mem = (eLine == DMAMGR_LINE_MEM);
+	pChan->u32Periph = DMAMgr_LineAddr(eLine);
+	pChan->pCur = 0;
+	pChan->u8QHead = 0;
+	pChan->u8QTail = 0;
+
+	NVIC_InitStruct.NVIC_IRQChannel = DMA1_Channel1_IRQn + pChan->u8Index;
+	NVIC_InitStruct.NVIC_IRQChannelPreemptionPriority = DMAMGR_IRQ_PRIORITY;
+	NVIC_InitStruct.NVIC_IRQChannelSubPriority = 0x00;
+	NVIC_InitStruct.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVIC_InitStruct);
+	return pChan;
+}
+
+void DMAMgr_Free(DMAMgr_Chan_t *pChan)
+{
+	DMAMgr_Abort(pChan);
+	NVIC_DisableIRQ((IRQn_Type)(DMA1_Channel1_IRQn + pChan->u8Index));
+	pChan->u8Used = 0;
+}
+
+static DMAMgr_Status_t DMAMgr_Check(DMAMgr_Chan_t *pChan, const DMAMgr_Desc_t *pDesc)
+{
+	uint8_t u8Width = pDesc->u8Width;
+
+	if (pDesc->u8Busy) {
+		return DMAMGR_BUSY;
+	}
+	if ((u8Width != 1 && u8Width != 2 && u8Width != 4) || !pDesc->u16Count || !pDesc->pBuf) {
+		return DMAMGR_INVALID;
+	}
+	if ((uint32_t)pDesc->pBuf & (u8Width - 1)) {
+		return DMAMGR_INVALID;
+	}
+	if (pDesc->u8Dir != DMAMGR_TO_MEM && pDesc->u8Dir != DMAMGR_FROM_MEM) {
+		return DMAMGR_INVALID;
+	}
+	if (pChan->u8Mem) {
+		//Memory to memory cannot run circular and always writes pBuf
+		if (!pDesc->pSrc || ((uint32_t)pDesc->pSrc & (u8Width - 1)) || pDesc->u8Circular || pDesc->u8Dir != DMAMGR_TO_MEM) {
+			return DMAMGR_INVALID;
+		}
+	}
+	if ((uint32_t)pDesc->u16Count * u8Width > pDesc->u16BufSize) {
+		return DMAMGR_OVERRUN;
+	}
+	return DMAMGR_OK;
+}
+
+/* A circular descriptor never completes, nothing queued behind it would start */
+static uint8_t DMAMgr_Looping(DMAMgr_Chan_t *pChan)
+{
+	DMAMgr_Desc_t *p = pChan->pCur;
+	uint8_t i = pChan->u8QTail;
+
+	while (p) {
+		while (p->pNext) {
+			p = p->pNext;
+		}
+		if (p->u8Circular) {
+			return 1;
+		}
+		p = (i != pChan->u8QHead) ? pChan->Queue[i] : 0;
+		i = (i + 1) % DMAMGR_QUEUE_LEN;
+	}
+	return 0;
+}
+
+DMAMgr_Status_t DMAMgr_Submit(DMAMgr_Chan_t *pChan, DMAMgr_Desc_t *pDesc)
+{
+	DMAMgr_Desc_t *p;
+	DMAMgr_Status_t eStatus;
+	uint32_t u32Primask;
+	uint8_t u8Next;
+	uint8_t n = 0;
+
+	if (!pChan || !pChan->u8Used || !pDesc) {
+		return DMAMGR_INVALID;
+	}
+	for (p = pDesc; p; p = p->pNext) {
+		if (++n > DMAMGR_CHAIN_MAX) {
+			return DMAMGR_INVALID;
+		}
+		eStatus = DMAMgr_Check(pChan, p);
+		if (eStatus != DMAMGR_OK) {
+			return eStatus;
+		}
+		//Only the last descriptor of a chain can loop on itself
+		if (p->u8Circular && p->pNext) {
+			return DMAMGR_INVALID;
+		}
+	}
+
+	u32Primask = __get_PRIMASK();
+	__disable_irq();
+	u8Next = (pChan->u8QHead + 1) % DMAMGR_QUEUE_LEN;
+	if (pChan->pCur && (u8Next == pChan->u8QTail || DMAMgr_Looping(pChan))) {
+		__set_PRIMASK(u32Primask);
+		return DMAMGR_BUSY;
+	}
+	for (p = pDesc; p; p = p->pNext) {
+		p->u8Error = 0;
+		p->u8Busy = 1;
+	}
+	if (!pChan->pCur) {
+		DMAMgr_Start(pChan, pDesc);
+	} else {
+		pChan->Queue[pChan->u8QHead] = pDesc;
+		pChan->u8QHead = u8Next;
+	}
+	__set_PRIMASK(u32Primask);
+	return DMAMGR_OK;
+}
+
+void DMAMgr_Abort(DMAMgr_Chan_t *pChan)
+{
+	DMAMgr_Desc_t *p;
+	uint32_t u32Primask = __get_PRIMASK();
+
+	__disable_irq();
+	DMA_Cmd(pChan->pRegs, DISABLE);
+	DMA1->IFCR = DMA1_FLAG_GL1 << (pChan->u8Index * 4);
+	for (p = pChan->pCur; p; p = p->pNext) {
+		p->u8Busy = 0;
+	}
+	while (pChan->u8QTail != pChan->u8QHead) {
+		for (p = pChan->Queue[pChan->u8QTail]; p; p = p->pNext) {
+			p->u8Busy = 0;
+		}
+		pChan->u8QTail = (pChan->u8QTail + 1) % DMAMGR_QUEUE_LEN;
+	}
+	pChan->pCur = 0;
+	__set_PRIMASK(u32Primask);
+}
+
+void DMAMgr_Copy(void *pDst, const void *pSrc, uint32_t u32Len)
+{
+	DMAMgr_Chan_t *pChan;
+	DMAMgr_Desc_t Desc;
+	uint32_t u32Align = (uint32_t)pDst | (uint32_t)pSrc | u32Len;
+	uint32_t u32Chunk;
+	uint8_t u8Width;
+
+	if (u32Len < DMAMGR_COPY_MIN || (pChan = DMAMgr_Alloc(DMAMGR_LINE_MEM)) == 0) {
+		memcpy(pDst, pSrc, u32Len);
+		return;
+	}
+
+	//Widest element all three are aligned to, a word moves in one bus cycle each way
+	u8Width = !(u32Align & 3) ? 4 : !(u32Align & 1) ? 2 : 1;
+	memset(&Desc, 0, sizeof(Desc));
+	Desc.u8Width = u8Width;
+	Desc.u8Dir = DMAMGR_TO_MEM;
+
+	while (u32Len) {
+		u32Chunk = u32Len / u8Width;
+		if (u32Chunk > 0xFFFF / u8Width) {
+			u32Chunk = 0xFFFF / u8Width;
+		}
+		Desc.pBuf = pDst;
+		Desc.pSrc = pSrc;
+		Desc.u16Count = u32Chunk;
+		Desc.u16BufSize = u32Chunk * u8Width;
+		if (DMAMgr_Submit(pChan, &Desc) != DMAMGR_OK) {
+			break;
+		}
+		while (Desc.u8Busy);
+		if (Desc.u8Error) {
+			break;
+		}
+		pDst = (uint8_t *)pDst + u32Chunk * u8Width;
+		pSrc = (const uint8_t *)pSrc + u32Chunk * u8Width;
+		u32Len -= u32Chunk * u8Width;
+	}
+	DMAMgr_Free(pChan);
+
+	//Whatever the DMA did not move
+	if (u32Len) {
+		memcpy(pDst, pSrc, u32Len);
+	}
+}
+
+uint16_t DMAMgr_Remaining(DMAMgr_Chan_t *pChan)
+{
+	return pChan->pCur ? DMA_GetCurrDataCounter(pChan->pRegs) : 0;
+}
+
+void DMA1_Channel1_IRQHandler(void) { DMAMgr_Irq(&Chans[0]); }
+void DMA1_Channel2_IRQHandler(void) { DMAMgr_Irq(&Chans[1]); }
+void DMA1_Channel3_IRQHandler(void) { DMAMgr_Irq(&Chans[2]); }
+void DMA1_Channel4_IRQHandler(void) { DMAMgr_Irq(&Chans[3]); }
+void DMA1_Channel5_IRQHandler(void) { DMAMgr_Irq(&Chans[4]); }
+void DMA1_Channel6_IRQHandler(void) { DMAMgr_Irq(&Chans[5]); }
+void DMA1_Channel7_IRQHandler(void) { DMAMgr_Irq(&Chans[6]); }
@@ -0,0 +1,97 @@
+#ifndef DMA_MGR_H
+#define DMA_MGR_H
+
+#include "stm32f10x.h"
+
+/*
+ * DMA1 channel manager
+ *
+ * On the F103 every peripheral request is wired to one fixed DMA1 channel.
+ * A channel is allocated for a request line, the peripheral address comes
+ * from the line. Transfers are described by descriptors, a descriptor can
+ * point to the next one and more can be queued while the channel runs: the
+ * transfer complete interrupt starts the next descriptor, so a chain runs
+ * without the caller in between. Every descriptor is checked against the
+ * size of its buffer before anything is started.
+ *
+ * Memory to memory transfers can run on any free channel, DMAMgr_Copy uses
+ * one for large copies. The manager owns the DMA1 channel interrupt
+ * handlers, pfDone is called from them.
+ */
+#define DMAMGR_CHANNELS			7
+#define DMAMGR_COPY_MIN			64		/* Shorter copies are cheaper with memcpy */
+#define DMAMGR_IRQ_PRIORITY		0x01
+
+typedef enum {
+	DMAMGR_LINE_MEM = 0,				/* Memory to memory, any channel */
+	DMAMGR_LINE_ADC1,					/* Channel 1 */
+	DMAMGR_LINE_SPI1_RX,				/* Channel 2 */
+	DMAMGR_LINE_SPI1_TX,				/* Channel 3 */
+	DMAMGR_LINE_USART3_TX,				/* Channel 2 */
+	DMAMGR_LINE_USART3_RX,				/* Channel 3 */
+	DMAMGR_LINE_SPI2_RX,				/* Channel 4 */
+	DMAMGR_LINE_SPI2_TX,				/* Channel 5 */
+	DMAMGR_LINE_USART1_TX,				/* Channel 4 */
+	DMAMGR_LINE_USART1_RX,				/* Channel 5 */
+	DMAMGR_LINE_I2C1_TX,				/* Channel 6 */
+	DMAMGR_LINE_I2C1_RX,				/* Channel 7 */
+	DMAMGR_LINE_USART2_RX,				/* Channel 6 */
+	DMAMGR_LINE_USART2_TX,				/* Channel 7 */
+	DMAMGR_LINES
+} DMAMgr_Line_t;
+
+typedef enum {
+	DMAMGR_OK = 0,
+	DMAMGR_BUSY,						/* Descriptor still queued, the queue full or a circular one ahead */
+	DMAMGR_INVALID,						/* Bad width, alignment, length or direction */
+	DMAMGR_OVERRUN						/* u16Count elements do not fit into u16BufSize bytes */
+} DMAMgr_Status_t;
+
+#define DMAMGR_TO_MEM			0		/* Peripheral, or pSrc for memory to memory, to pBuf */
+#define DMAMGR_FROM_MEM			1		/* pBuf to the peripheral */
+
+typedef struct DMAMgr_Desc {
+	void *pBuf;
+	uint16_t u16BufSize;				/* Bytes available at pBuf */
+	uint16_t u16Count;					/* Elements to move */
+	uint8_t u8Width;					/* Element size, 1, 2 or 4 bytes */
+	uint8_t u8Dir;						/* DMAMGR_TO_MEM or DMAMGR_FROM_MEM */
+	uint8_t u8Circular;					/* Restart at the end, pfDone at every lap, pNext is never reached */
+	const void *pSrc;					/* Memory to memory only, read with the same width */
+	struct DMAMgr_Desc *pNext;			/* Started from the transfer complete interrupt */
+	void (*pfDone)(struct DMAMgr_Desc *pDesc);
+	volatile uint8_t u8Busy;			/* Set by DMAMgr_Submit, cleared when done */
+	volatile uint8_t u8Error;			/* Transfer error, the rest of the chain is dropped */
+} DMAMgr_Desc_t;
+
+typedef struct DMAMgr_Chan DMAMgr_Chan_t;
+
+void DMAMgr_Init(void);
+
+/* Returns 0 when the channel of the line (or every channel, for memory) is taken */
+DMAMgr_Chan_t *DMAMgr_Alloc(DMAMgr_Line_t eLine);
+void DMAMgr_Free(DMAMgr_Chan_t *pChan);
+
+/*
+ * Check a chain and queue it behind what the channel still has to do.
+ * Nothing is queued if any descriptor in it is bad, or behind a circular
+ * descriptor running or queued: that one only stops with DMAMgr_Abort. The
+ * descriptors and buffers must stay valid until u8Busy of the last one
+ * clears.
+ */
+DMAMgr_Status_t DMAMgr_Submit(DMAMgr_Chan_t *pChan, DMAMgr_Desc_t *pDesc);
+
+/* Stop the channel and drop everything queued, u8Busy is cleared without pfDone */
+void DMAMgr_Abort(DMAMgr_Chan_t *pChan);
+
+/*
+ * Blocking copy, by DMA on a free channel for DMAMGR_COPY_MIN bytes and
+ * more, with memcpy otherwise or when no channel is free. Thread context
+ * only, it waits for the DMA interrupt.
+ */
+void DMAMgr_Copy(void *pDst, const void *pSrc, uint32_t u32Len);
+
+/* Elements the running transfer of the channel still has to move */
+uint16_t DMAMgr_Remaining(DMAMgr_Chan_t *pChan);
+
+#endif
@@ -24,7 +24,7 @@ void DMA_Config(){
 	DMA_InitStruct.DMA_Mode = DMA_Mode_Normal;
 	DMA_InitStruct.DMA_DIR = DMA_DIR_PeripheralSRC;//huong truyen tu ngoai vi ve memory
 	DMA_InitStruct.DMA_M2M = DMA_M2M_Disable;
-	DMA_InitStruct.DMA_BufferSize = 14;//so luong phan tu (hay don vi) muon gui nhan qua DMA
+	DMA_InitStruct.DMA_BufferSize = sizeof(data);//so luong phan tu (hay don vi) muon gui nhan qua DMA, khong vuot qua mang data
 	DMA_InitStruct.DMA_MemoryBaseAddr = (uint32_t)data;// dia chi khi nhan du lieu tu DMA se luu vao bien data (dia chi trong bo nho)
 	DMA_InitStruct.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;//data 8bit = 1byte
 	DMA_InitStruct.DMA_MemoryInc = DMA_MemoryInc_Enable;
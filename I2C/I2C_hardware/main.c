@@ -9,7 +9,18 @@
 #define I2C_GPIO_CLK       RCC_APB2Periph_GPIOB
 #define I2C_CLK            RCC_APB1Periph_I2C1
 #define I2C                I2C1
-#define EEPROM_ADDRESS     0x50  // 7-bit address shifted left for R/W
+#define EEPROM_ADDRESS     0xA0  // 7-bit address 0x50 shifted left, I2C_Send7bitAddress sets the R/W bit
+
+#define I2C_SPEED_STANDARD 100000
+#define I2C_SPEED_FAST     400000  // Highest rate on F1, it has no Fm+ (1 MHz) drive
+#define I2C_TIMEOUT        0xFFFF
+#define I2C_PROBE_TRIES    8
+#define EEPROM_TWR_MS      10   // Write cycle time, data sheet maximum, bounds the ACK polling
+
+static const uint32_t i2c_rates[] = { I2C_SPEED_FAST, 200000, I2C_SPEED_STANDARD };
+
+void I2C1_SetSpeed(uint32_t speed);
+uint8_t I2C_Ping(void);
 
 void delay_ms(uint16_t ms) {
     for(uint32_t i = 0; i < ms * 1000; i++) {
@@ -17,7 +28,14 @@ void delay_ms(uint16_t ms) {
     }
 }
 
-void I2C1_Init(void) {
+// DWT cycle counter, times the ACK polling whatever the bus rate
+void DWT_Config(void) {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+void I2C1_Init(uint32_t speed) {
     GPIO_InitTypeDef GPIO_InitStructure;
     I2C_InitTypeDef I2C_InitStructure;
 
@@ -31,19 +49,59 @@ void I2C1_Init(void) {
     GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
     GPIO_Init(I2C_GPIO_PORT, &GPIO_InitStructure);
 
-    // Configure I2C
+    // Configure I2C, I2C_Init sets FREQ and a first CCR/TRISE
     I2C_InitStructure.I2C_Mode = I2C_Mode_I2C;
     I2C_InitStructure.I2C_DutyCycle = I2C_DutyCycle_2;
     I2C_InitStructure.I2C_OwnAddress1 = 0x00;
     I2C_InitStructure.I2C_Ack = I2C_Ack_Enable;
     I2C_InitStructure.I2C_AcknowledgedAddress = I2C_AcknowledgedAddress_7bit;
-    I2C_InitStructure.I2C_ClockSpeed = 100000;  // Set speed to 100kHz
+    I2C_InitStructure.I2C_ClockSpeed = I2C_SPEED_STANDARD;
     I2C_Init(I2C, &I2C_InitStructure);
 
     I2C_Cmd(I2C, ENABLE);
+    I2C1_SetSpeed(speed);
 }
 
-uint8_t I2C_Write(uint8_t addr, uint8_t data) {
+// CCR/TRISE from RM0008. CCR is rounded up so SCL stays at or below the
+// rate asked for. In fast mode 16/9 duty is used when it gets at least as
+// close as duty 2, it only hits 400 kHz exactly with PCLK1 a multiple of 10 MHz.
+void I2C1_SetSpeed(uint32_t speed) {
+    RCC_ClocksTypeDef clocks;
+    uint32_t freq_mhz, ccr, ccr_169;
+
+    if (speed > I2C_SPEED_FAST) {
+        speed = I2C_SPEED_FAST;
+    }
+    RCC_GetClocksFreq(&clocks);
+    freq_mhz = clocks.PCLK1_Frequency / 1000000;
+
+    I2C_Cmd(I2C, DISABLE);  // CCR and TRISE are only writable with PE = 0
+    if (speed <= I2C_SPEED_STANDARD) {
+        ccr = (clocks.PCLK1_Frequency + 2 * speed - 1) / (2 * speed);
+        if (ccr < 4) {
+            ccr = 4;
+        }
+        I2C->TRISE = freq_mhz + 1;              // 1000 ns max rise time
+    } else {
+        ccr = (clocks.PCLK1_Frequency + 3 * speed - 1) / (3 * speed);
+        ccr_169 = (clocks.PCLK1_Frequency + 25 * speed - 1) / (25 * speed);
+        if (ccr_169 < 1) {
+            ccr_169 = 1;
+        }
+        if (25 * ccr_169 <= 3 * ccr) {
+            ccr = ccr_169 | I2C_CCR_DUTY;      // Tlow/Thigh = 16/9
+        }
+        ccr |= I2C_CCR_FS;
+        I2C->TRISE = freq_mhz * 300 / 1000 + 1; // 300 ns max rise time
+    }
+    I2C->CCR = ccr;
+    I2C_Cmd(I2C, ENABLE);
+    I2C_AcknowledgeConfig(I2C, ENABLE);       // ACK is cleared with PE
+}
+
+uint8_t I2C_Write(uint16_t addr, uint8_t data) {
+    uint32_t start;
+
     // Send START condition
     I2C_GenerateSTART(I2C, ENABLE);
     while (!I2C_CheckEvent(I2C, I2C_EVENT_MASTER_MODE_SELECT));
@@ -52,8 +110,10 @@ uint8_t I2C_Write(uint8_t addr, uint8_t data) {
     I2C_Send7bitAddress(I2C, EEPROM_ADDRESS, I2C_Direction_Transmitter);
     while (!I2C_CheckEvent(I2C, I2C_EVENT_MASTER_TRANSMITTER_MODE_SELECTED));
 
-    // Send memory address
-    I2C_SendData(I2C, addr);
+    // Send memory address, the AT24C32 takes 12 bits in two bytes, high byte first
+    I2C_SendData(I2C, addr >> 8);
+    while (!I2C_CheckEvent(I2C, I2C_EVENT_MASTER_BYTE_TRANSMITTING));
+    I2C_SendData(I2C, addr & 0xFF);
     while (!I2C_CheckEvent(I2C, I2C_EVENT_MASTER_BYTE_TRANSMITTING));
 
     // Send data
@@ -63,11 +123,18 @@ uint8_t I2C_Write(uint8_t addr, uint8_t data) {
     // Send STOP condition
     I2C_GenerateSTOP(I2C, ENABLE);
 
-    delay_ms(5);  // EEPROM write delay
-    return 0;
+    // ACK polling instead of a fixed delay, the EEPROM NACKs until its write cycle ends.
+    // A poll takes far less at 400 kHz than at 100 kHz, so the limit is time, not a count
+    start = DWT->CYCCNT;
+    do {
+        if (I2C_Ping()) {
+            return 0;
+        }
+    } while (DWT->CYCCNT - start < SystemCoreClock / 1000 * EEPROM_TWR_MS);
+    return 1;
 }
 
-uint8_t I2C_Read(uint8_t addr) {
+uint8_t I2C_Read(uint16_t addr) {
     uint8_t data;
 
     // Send START condition
@@ -78,8 +145,10 @@ uint8_t I2C_Read(uint8_t addr) {
     I2C_Send7bitAddress(I2C, EEPROM_ADDRESS, I2C_Direction_Transmitter);
     while (!I2C_CheckEvent(I2C, I2C_EVENT_MASTER_TRANSMITTER_MODE_SELECTED));
 
-    // Send memory address
-    I2C_SendData(I2C, addr);
+    // Send memory address, high byte first
+    I2C_SendData(I2C, addr >> 8);
+    while (!I2C_CheckEvent(I2C, I2C_EVENT_MASTER_BYTE_TRANSMITTING));
+    I2C_SendData(I2C, addr & 0xFF);
     while (!I2C_CheckEvent(I2C, I2C_EVENT_MASTER_BYTE_TRANSMITTED));
 
     // Send repeated START condition
@@ -100,12 +169,65 @@ uint8_t I2C_Read(uint8_t addr) {
     return data;
 }
 
+// Address only write, returns 1 if the device ACKs
+uint8_t I2C_Ping(void) {
+    uint32_t timeout;
+    uint8_t ack = 0;
+
+    I2C_GenerateSTART(I2C, ENABLE);
+    timeout = I2C_TIMEOUT;
+    while (!I2C_CheckEvent(I2C, I2C_EVENT_MASTER_MODE_SELECT)) {
+        if (--timeout == 0) {
+            I2C_GenerateSTOP(I2C, ENABLE);
+            return 0;
+        }
+    }
+
+    I2C_Send7bitAddress(I2C, EEPROM_ADDRESS, I2C_Direction_Transmitter);
+    timeout = I2C_TIMEOUT;
+    while (--timeout) {
+        if (I2C_CheckEvent(I2C, I2C_EVENT_MASTER_TRANSMITTER_MODE_SELECTED)) {
+            ack = 1;
+            break;
+        }
+        if (I2C_GetFlagStatus(I2C, I2C_FLAG_AF)) {
+            I2C_ClearFlag(I2C, I2C_FLAG_AF);
+            break;
+        }
+    }
+
+    I2C_GenerateSTOP(I2C, ENABLE);
+    timeout = I2C_TIMEOUT;
+    while ((I2C->CR1 & I2C_CR1_STOP) && --timeout);  // A stuck bus must not hang the caller
+    return ack;
+}
+
+// Highest rate the EEPROM ACKs at every time, falls back to 100 kHz
+uint32_t I2C_Probe(void) {
+    uint8_t i, j;
+
+    for (i = 0; i < sizeof(i2c_rates) / sizeof(i2c_rates[0]); i++) {
+        I2C1_SetSpeed(i2c_rates[i]);
+        for (j = 0; j < I2C_PROBE_TRIES; j++) {
+            if (!I2C_Ping()) {
+                break;
+            }
+        }
+        if (j == I2C_PROBE_TRIES) {
+            return i2c_rates[i];
+        }
+    }
+    I2C1_SetSpeed(I2C_SPEED_STANDARD);
+    return 0;
+}
+
 int main(void) {
-    I2C1_Init();  // Initialize I2C
+    DWT_Config();
+    I2C1_Init(I2C_SPEED_STANDARD);  // Initialize I2C
+    I2C_Probe();                    // Run at the fastest rate the EEPROM takes
 
-    I2C_Write(0x00, 0x55);  // Write 0x55 to address 0x00
-    delay_ms(10);           // Delay to ensure write complete
-    uint8_t read_data = I2C_Read(0x00);  // Read from address 0x00
+    I2C_Write(0x0000, 0x55);  // Write 0x55 to address 0x0000, returns once the write cycle is done
+    uint8_t read_data = I2C_Read(0x0000);  // Read from address 0x0000
 
     while (1) {
         // Main loop, can use read_data for debugging or processing
@@ -1,17 +1,25 @@
 #include "stm32f10x.h"                  // Device header
 #include "stm32f10x_gpio.h"             // Keil::Device:StdPeriph Drivers:GPIO
 #include "stm32f10x_rcc.h"              // Keil::Device:StdPeriph Drivers:RCC
-#include "stm32f10x_tim.h"              // Keil::Device:StdPeriph Drivers:TIM
 
 #define I2C_SCL      GPIO_Pin_6
 #define I2C_SDA      GPIO_Pin_7
 #define I2C_GPIO     GPIOB
 
-#define WRITE_SDA_0  GPIO_ResetBits(I2C_GPIO, I2C_SDA)
-#define WRITE_SDA_1  GPIO_SetBits(I2C_GPIO, I2C_SDA)
-#define WRITE_SCL_0  GPIO_ResetBits(I2C_GPIO, I2C_SCL)
-#define WRITE_SCL_1  GPIO_SetBits(I2C_GPIO, I2C_SCL)
-#define READ_SDA_VAL GPIO_ReadInputDataBit(I2C_GPIO, I2C_SDA)
+// Direct register access, one store per edge instead of a library call
+#define WRITE_SDA_0  (I2C_GPIO->BRR = I2C_SDA)
+#define WRITE_SDA_1  (I2C_GPIO->BSRR = I2C_SDA)
+#define WRITE_SCL_0  (I2C_GPIO->BRR = I2C_SCL)
+#define WRITE_SCL_1  (I2C_GPIO->BSRR = I2C_SCL)
+#define READ_SDA_VAL (I2C_GPIO->IDR & I2C_SDA)
+
+// Fast mode timing, tLOW >= 1.3 us and tHIGH >= 0.6 us; 1.3 + 1.2 us gives 400 kHz.
+// Needs pull-ups strong enough for the rise time, 2.2k on a short bus.
+#define I2C_T_LOW_NS   1300
+#define I2C_T_HIGH_NS  1200
+
+#define AT24C32_PAGE_SIZE  32
+#define AT24C32_TWR_MS     10   // Write cycle time, data sheet maximum, bounds the ACK polling
 
 typedef enum {
     NOT_OK, OK
@@ -21,9 +29,12 @@ typedef enum {
     NOT_ACK, ACK
 } ACK_Bit;
 
+static uint32_t u32Low;     // tLOW in CPU cycles
+static uint32_t u32High;    // tHIGH in CPU cycles
+static uint32_t u32Edge;    // DWT time of the last edge, the next one is paced from it
+
 void RCC_Config() {
     RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOB, ENABLE);//cap xung clock a b6 -scl b7 -sda
-    RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2, ENABLE);
 }
 
 void GPIO_Config() {
@@ -35,48 +46,53 @@ void GPIO_Config() {
     GPIO_Init(I2C_GPIO, &GPIO_InitStructure);
 }
 
-void TIMER_config(void) {
-    TIM_TimeBaseInitTypeDef TIM_InitStruct;
+// DWT cycle counter, free running at the core clock
+void DWT_Config(void) {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
 
-    TIM_InitStruct.TIM_ClockDivision = TIM_CKD_DIV2;
-    TIM_InitStruct.TIM_Prescaler = 36 - 1;
-    TIM_InitStruct.TIM_Period = 0xFFFF;
-    TIM_InitStruct.TIM_CounterMode = TIM_CounterMode_Up;
-    TIM_TimeBaseInit(TIM2, &TIM_InitStruct);
-
-    TIM_Cmd(TIM2, ENABLE);
+    u32Low = SystemCoreClock / 1000000 * I2C_T_LOW_NS / 1000;
+    u32High = SystemCoreClock / 1000000 * I2C_T_HIGH_NS / 1000;
 }
 
-void delay_us(uint16_t timedelay) {
-    TIM_SetCounter(TIM2, 0);
-    while (TIM_GetCounter(TIM2) < timedelay) {}
+// Wait until a fixed time after the previous edge, the code between edges does not add up.
+// If an interrupt already held us past that point, the edge is now: catching up
+// would cut the following phases below their minimum
+static void I2C_Wait(uint32_t u32Cycles) {
+    uint32_t u32Now = DWT->CYCCNT;
+
+    u32Edge += u32Cycles;
+    if ((int32_t)(u32Now - u32Edge) > 0) {
+        u32Edge = u32Now;
+        return;
+    }
+    while ((int32_t)(DWT->CYCCNT - u32Edge) < 0) {}
 }
 
 void I2C_Config() {
     WRITE_SDA_1;
-    delay_us(1);
     WRITE_SCL_1;
-    delay_us(1);
 }
 
 void I2C_Start() {// khi bat dau truyen tao tin hieu start
-    WRITE_SCL_1;// keo len 1 de dam bao sda o muc cao 
-    delay_us(3);
+    u32Edge = DWT->CYCCNT;
     WRITE_SDA_1;
-    delay_us(3);
+    I2C_Wait(u32Low);
+    WRITE_SCL_1;
+    I2C_Wait(u32High);// START setup, also for a repeated START
     WRITE_SDA_0;// keo sda xuong 0 truoc scl 1 khoang delay
-    delay_us(3);
+    I2C_Wait(u32High);// START hold
     WRITE_SCL_0;
-    delay_us(3);
 }
 
 void I2C_Stop() {// tin hieu stop ket thuc truyen nhan
     WRITE_SDA_0;// keo sda xuong de dam bao scl duoc keo len truoc
-    delay_us(3);
+    I2C_Wait(u32Low);
     WRITE_SCL_1;// keo scl len truoc sda 1 khoang delay
-    delay_us(3);
+    I2C_Wait(u32High);// STOP setup
     WRITE_SDA_1;
-    delay_us(3);
+    I2C_Wait(u32Low);// bus free time before the next START
 }
 
 status I2C_Write(uint8_t u8Data) {
@@ -88,27 +104,23 @@ status I2C_Write(uint8_t u8Data) {
         } else {
             WRITE_SDA_0;
         }
-        delay_us(3);
+        I2C_Wait(u32Low);
         WRITE_SCL_1;
-        delay_us(5);
+        I2C_Wait(u32High);
         WRITE_SCL_0;
-        delay_us(2);
         u8Data <<= 1;
     }
     WRITE_SDA_1;
-    delay_us(3);
+    I2C_Wait(u32Low);
     WRITE_SCL_1;
-    delay_us(3);
+    I2C_Wait(u32High);
 
     if (READ_SDA_VAL) {
         stRet = NOT_OK;
     } else {
         stRet = OK;
     }
-
-    delay_us(2);
     WRITE_SCL_0;
-    delay_us(5);
 
     return stRet;
 }
@@ -117,17 +129,15 @@ uint8_t I2C_Read(ACK_Bit _ACK) {
     uint8_t i;
     uint8_t u8Ret = 0x00;
     WRITE_SDA_1;
-    delay_us(3);
     for (i = 0; i < 8; ++i) {
         u8Ret <<= 1;
+        I2C_Wait(u32Low);
         WRITE_SCL_1;
-        delay_us(3);
-        if (READ_SDA_VAL) {
+        I2C_Wait(u32High);
+        if (READ_SDA_VAL) {// lay mau cuoi pha cao
             u8Ret |= 0x01;
         }
-        delay_us(2);
         WRITE_SCL_0;
-        delay_us(5);
     }
 
     if (_ACK) {
@@ -135,18 +145,19 @@ uint8_t I2C_Read(ACK_Bit _ACK) {
     } else {
         WRITE_SDA_1;
     }
-    delay_us(3);
-
+    I2C_Wait(u32Low);
     WRITE_SCL_1;
-    delay_us(5);
+    I2C_Wait(u32High);
     WRITE_SCL_0;
-    delay_us(5);
 
     return u8Ret;
 }
 
 status at24c32_read(uint16_t u16Address, uint8_t slaveaddress, uint16_t u16Num, uint8_t *pu8Data) {
     uint16_t i;
+    if (u16Num == 0) {
+        return OK;
+    }
     I2C_Start();
     if (I2C_Write(slaveaddress) == NOT_OK) {  // ia chi slave
         I2C_Stop();
@@ -173,18 +184,35 @@ status at24c32_read(uint16_t u16Address, uint8_t slaveaddress, uint16_t u16Num,
     return OK;
 }
 
-status at24c32_write(uint16_t u16Address, uint8_t slaveaddress, uint16_t u16Num, uint8_t *pu8Data) {
+// Address only write, the chip NACKs while its write cycle runs.
+// A poll takes as long as the bit timing makes it, so the limit is time, not a count
+status at24c32_wait_ready(uint8_t slaveaddress) {
+    uint32_t u32Start = DWT->CYCCNT;
+    status stRet;
+    do {
+        I2C_Start();
+        stRet = I2C_Write(slaveaddress);
+        I2C_Stop();
+        if (stRet == OK) {
+            return OK;
+        }
+    } while (DWT->CYCCNT - u32Start < SystemCoreClock / 1000 * AT24C32_TWR_MS);
+    return NOT_OK;
+}
+
+// One page at most, the chip wraps inside the page past its end
+static status at24c32_write_page(uint16_t u16Address, uint8_t slaveaddress, uint16_t u16Num, uint8_t *pu8Data) {
     uint16_t i;
     I2C_Start();
-    if (I2C_Write(slaveaddress) == NOT_OK) {  // ?a ch? slave
+    if (I2C_Write(slaveaddress) == NOT_OK) {
         I2C_Stop();
         return NOT_OK;
     }
-    if (I2C_Write(u16Address >> 8) == NOT_OK) {  // G?i byte cao c?a d?a ch?
+    if (I2C_Write(u16Address >> 8) == NOT_OK) {
         I2C_Stop();
         return NOT_OK;
     }
-    if (I2C_Write(u16Address) == NOT_OK) {  // G?i byte th?p c?a d?a ch?
+    if (I2C_Write(u16Address) == NOT_OK) {
         I2C_Stop();
         return NOT_OK;
     }
@@ -195,7 +223,23 @@ status at24c32_write(uint16_t u16Address, uint8_t slaveaddress, uint16_t u16Num,
         }
     }
     I2C_Stop();
-    delay_us(10000);  // ?i th?i gian ghi (10ms cho AT24C32)
+    return at24c32_wait_ready(slaveaddress);
+}
+
+status at24c32_write(uint16_t u16Address, uint8_t slaveaddress, uint16_t u16Num, uint8_t *pu8Data) {
+    uint16_t chunk;
+    while (u16Num) {
+        chunk = AT24C32_PAGE_SIZE - (u16Address % AT24C32_PAGE_SIZE);  // Den cuoi trang
+        if (chunk > u16Num) {
+            chunk = u16Num;
+        }
+        if (at24c32_write_page(u16Address, slaveaddress, chunk, pu8Data) == NOT_OK) {
+            return NOT_OK;
+        }
+        u16Address += chunk;
+        pu8Data += chunk;
+        u16Num -= chunk;
+    }
     return OK;
 }
 
@@ -207,7 +251,7 @@ int main() {
 
     RCC_Config();
     GPIO_Config();
-    TIMER_config();
+    DWT_Config();
     I2C_Config();
 
     // Ghi d? li?u vo EEPROM
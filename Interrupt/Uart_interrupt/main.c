@@ -3,15 +3,38 @@
 #include "stm32f10x_rcc.h"              // Keil::Device:StdPeriph Drivers:RCC
 #include "stm32f10x_usart.h"            // Keil::Device:StdPeriph Drivers:USART
 #include "stm32f10x_tim.h"              // Keil::Device:StdPeriph Drivers:TIM
-
-volatile uint8_t receivedData = 0x00; // Variable to store received data
-volatile uint8_t dataBuffer[10];      // Buffer to store received data (example size)
-volatile uint8_t bufferIndex = 0;     // Index to track position in buffer
+#include "stm32f10x_dma.h"              // Keil::Device:StdPeriph Drivers:DMA
+
+/*
+ * RX runs on DMA1 channel 5 in circular mode. The half transfer, transfer
+ * complete and USART IDLE interrupts all drain what the DMA wrote since
+ * the last time into the message being built, IDLE (one idle frame on the
+ * line) also closes it. So there are at most a few interrupts per message
+ * instead of one per byte, and nothing is lost as long as the consumer
+ * keeps up with RX_MSG_COUNT messages.
+ */
+#define RX_DMA_SIZE   64   // Circular DMA buffer, drained at each half
+#define RX_MSG_SIZE   64   // Longer messages are delivered in pieces
+#define RX_MSG_COUNT  4    // Messages waiting for the consumer
+
+typedef struct {
+    uint16_t len;
+    uint8_t data[RX_MSG_SIZE];
+} RxMsg_t;
+
+uint8_t rxDmaBuffer[RX_DMA_SIZE];       // Written by the DMA only
+RxMsg_t rxMsg[RX_MSG_COUNT];            // Message queue, rxMsgHead is being built
+volatile uint8_t rxMsgHead = 0;
+volatile uint8_t rxMsgTail = 0;
+uint16_t rxDmaPos = 0;                  // Next byte of rxDmaBuffer to take
+volatile uint32_t rxDropped = 0;        // Bytes lost because the queue was full
+volatile uint32_t rxIrqCount = 0;       // RX interrupts, to compare with the byte count
 
 void RCC_Config(void) {
-    // Enable clocks for USART1, GPIOA, and TIM2
+    // Enable clocks for USART1, GPIOA, TIM2 and DMA1
     RCC_APB2PeriphClockCmd(RCC_APB2Periph_USART1 | RCC_APB2Periph_GPIOA, ENABLE);
     RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2, ENABLE);
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
 }
 
 void GPIO_Config(void) {
@@ -52,11 +75,34 @@ void UART_Config(void) {
     USART_InitStruct.USART_Parity = USART_Parity_No;
     USART_Init(USART1, &USART_InitStruct);
 
-    // Enable USART1 RXNE interrupt
-    USART_ITConfig(USART1, USART_IT_RXNE, ENABLE);
+    // DMA takes every byte, only the idle line interrupts the CPU
+    USART_DMACmd(USART1, USART_DMAReq_Rx, ENABLE);
+    USART_ITConfig(USART1, USART_IT_IDLE, ENABLE);
     USART_Cmd(USART1, ENABLE);
 }
 
+void DMA_Config(void) {
+    DMA_InitTypeDef DMA_InitStruct;
+
+    // USART1_RX is DMA1 channel 5
+    DMA_DeInit(DMA1_Channel5);
+    DMA_InitStruct.DMA_PeripheralBaseAddr = (uint32_t)&USART1->DR;
+    DMA_InitStruct.DMA_MemoryBaseAddr = (uint32_t)rxDmaBuffer;
+    DMA_InitStruct.DMA_DIR = DMA_DIR_PeripheralSRC;
+    DMA_InitStruct.DMA_BufferSize = RX_DMA_SIZE;
+    DMA_InitStruct.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    DMA_InitStruct.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStruct.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+    DMA_InitStruct.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+    DMA_InitStruct.DMA_Mode = DMA_Mode_Circular;
+    DMA_InitStruct.DMA_Priority = DMA_Priority_High;
+    DMA_InitStruct.DMA_M2M = DMA_M2M_Disable;
+    DMA_Init(DMA1_Channel5, &DMA_InitStruct);
+
+    DMA_ITConfig(DMA1_Channel5, DMA_IT_HT | DMA_IT_TC, ENABLE);
+    DMA_Cmd(DMA1_Channel5, ENABLE);
+}
+
 void NVIC_Config(void) {
     NVIC_InitTypeDef NVIC_InitStruct;
 
@@ -66,25 +112,86 @@ void NVIC_Config(void) {
     NVIC_InitStruct.NVIC_IRQChannelSubPriority = 0x00;
     NVIC_InitStruct.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStruct);
+
+    // Same priority for the DMA, the two handlers never preempt each other
+    NVIC_InitStruct.NVIC_IRQChannel = DMA1_Channel5_IRQn;
+    NVIC_Init(&NVIC_InitStruct);
 }
 
-void USART1_IRQHandler(void) {
-    if (USART_GetITStatus(USART1, USART_IT_RXNE) != RESET) {
-        receivedData = USART_ReceiveData(USART1); // Store received data
+// Close the message being built and start the next one, drops bytes when the queue is full
+static void RX_EndMessage(void) {
+    uint8_t next = (rxMsgHead + 1) % RX_MSG_COUNT;
 
-        // Store data in buffer and manage buffer index
-        if (bufferIndex < sizeof(dataBuffer)) {
-            dataBuffer[bufferIndex++] = receivedData;
+    if (rxMsg[rxMsgHead].len == 0) {
+        return;
+    }
+    if (next == rxMsgTail) {
+        rxDropped += rxMsg[rxMsgHead].len;
+        rxMsg[rxMsgHead].len = 0;
+        return;
+    }
+    rxMsgHead = next;
+    rxMsg[rxMsgHead].len = 0;
+}
+
+// Move the bytes the DMA wrote since the last call into the current message
+static void RX_Drain(void) {
+    uint16_t pos = RX_DMA_SIZE - DMA_GetCurrDataCounter(DMA1_Channel5);
+    RxMsg_t *msg;
+
+    if (pos == RX_DMA_SIZE) {
+        pos = 0;
+    }
+    while (rxDmaPos != pos) {
+        msg = &rxMsg[rxMsgHead];
+        msg->data[msg->len++] = rxDmaBuffer[rxDmaPos];
+        rxDmaPos = (rxDmaPos + 1) % RX_DMA_SIZE;
+        if (msg->len == RX_MSG_SIZE) {
+            RX_EndMessage();
         }
+    }
+}
 
-        // Optionally process or print received data here
-        // Example: echo received data back
-        while (USART_GetFlagStatus(USART1, USART_FLAG_TXE) == RESET);
-        USART_SendData(USART1, receivedData);
+void USART1_IRQHandler(void) {
+    if (USART_GetITStatus(USART1, USART_IT_IDLE) != RESET) {
+        // IDLE is cleared by reading SR then DR
+        (void)USART1->SR;
+        (void)USART1->DR;
+        ++rxIrqCount;
+        RX_Drain();
+        RX_EndMessage();
+    }
+}
+
+void DMA1_Channel5_IRQHandler(void) {
+    if (DMA_GetITStatus(DMA1_IT_HT5) != RESET || DMA_GetITStatus(DMA1_IT_TC5) != RESET) {
+        DMA_ClearITPendingBit(DMA1_IT_HT5 | DMA1_IT_TC5);
+        ++rxIrqCount;
+        RX_Drain();
+    }
+}
+
+// Copy the oldest complete message, returns its length or 0 if there is none
+uint16_t UART_GetMessage(uint8_t *data) {
+    uint16_t len;
+    uint16_t i;
+
+    if (rxMsgTail == rxMsgHead) {
+        return 0;
+    }
+    len = rxMsg[rxMsgTail].len;
+    for (i = 0; i < len; i++) {
+        data[i] = rxMsg[rxMsgTail].data[i];
     }
+    rxMsgTail = (rxMsgTail + 1) % RX_MSG_COUNT;
+    return len;
+}
 
-    // Clear the RXNE interrupt pending bit
-    USART_ClearITPendingBit(USART1, USART_IT_RXNE);
+void UART_Send(const uint8_t *data, uint16_t len) {
+    while (len--) {
+        while (USART_GetFlagStatus(USART1, USART_FLAG_TXE) == RESET);
+        USART_SendData(USART1, *data++);
+    }
 }
 
 void delay_ms(uint16_t timedelay) {
@@ -93,15 +200,23 @@ void delay_ms(uint16_t timedelay) {
 }
 
 int main(void) {
+    uint8_t message[RX_MSG_SIZE];
+    uint16_t len;
+
     // Initialize peripherals
     RCC_Config();
     GPIO_Config();
+    DMA_Config();
     UART_Config();
     TIMER_Config();
-    NVIC_Config(); // Initialize NVIC for USART interrupts
+    NVIC_Config(); // Initialize NVIC for USART and DMA interrupts
 
     // Main loop
     while (1) {
-        // Main loop does nothing, all work is done in the interrupt handler
+        // Echo every message back, the receive side keeps running meanwhile
+        len = UART_GetMessage(message);
+        if (len) {
+            UART_Send(message, len);
+        }
     }
 }
@@ -2,39 +2,113 @@
 #include "stm32f10x_rcc.h"
 #include "stm32f10x_gpio.h"
 #include "stm32f10x_tim.h"
-#include "delay.h"
+
+#define SERVO_MAX_PULSE		1999	// TIM2 period
+#define SERVO_SPEED			200		// Speed limit, CCR counts per second
+#define SERVO_ACCEL			400		// CCR counts per second^2
+#define SERVO_TICKS_PER_S	500		// TIM2 update rate, 1 MHz / 2000
 
 void PWM_Init(void);
+void Servo_MoveTo(uint16_t u16Pulse, uint16_t u16Speed, void (*pfDone)(void));
+static void Sweep_Done(void);
+
+// Motion state, position and speed in CCR counts Q16
+static volatile int32_t i32Pos;
+static int32_t i32Target;
+static int32_t i32Vel;
+static uint32_t u32VMax;
+static uint32_t u32Accel;
+static void (*pfMoveDone)(void);
 
 int main(void)
 {
-	DelayInit();
-	
 	// Initialize PWM
 	PWM_Init();
 	
+	// CCR1 is stepped from the TIM2 update interrupt, the CPU sleeps in between
+	Servo_MoveTo(SERVO_MAX_PULSE, SERVO_SPEED, Sweep_Done);
+	
 	while (1)
 	{
-		for (int i = 0; i <= 1999; i += 20)  // Tang t?c nhanh hon, tang bu?c ln 200
-		{
-			TIM2->CCR1 = i;  // Tang d?n gi tr? CCR1 (duty cycle)
-			DelayMs(100);     // Gi?m th?i gian d?ng xu?ng d? d?ng co ph?n ?ng nhanh hon
-		}
-		
-		for (int i = 1999; i >= 0; i -= 20)  // Gi?m t?c nhanh hon
-		{
-			TIM2->CCR1 = i;  // Gi?m d?n gi tr? CCR1 (duty cycle)
-			DelayMs(100);     // Gi?m th?i gian d?ng xu?ng d? d?ng co ph?n ?ng nhanh hon
-		}
+		__WFI();
 	}
 }
 
+// Called at the end of each move, sweep back the other way
+static void Sweep_Done(void)
+{
+	Servo_MoveTo((i32Target != 0) ? 0 : SERVO_MAX_PULSE, SERVO_SPEED, Sweep_Done);
+}
+
+void Servo_MoveTo(uint16_t u16Pulse, uint16_t u16Speed, void (*pfDone)(void))
+{
+	TIM_ITConfig(TIM2, TIM_IT_Update, DISABLE);
+	i32Target = (int32_t)((u16Pulse > SERVO_MAX_PULSE) ? SERVO_MAX_PULSE : u16Pulse) << 16;
+	u32VMax = ((uint32_t)u16Speed << 16) / SERVO_TICKS_PER_S;
+	u32Accel = ((uint32_t)SERVO_ACCEL << 16) / (SERVO_TICKS_PER_S * SERVO_TICKS_PER_S);
+	if (u32VMax == 0) u32VMax = 1;
+	if (u32Accel == 0) u32Accel = 1;
+	pfMoveDone = pfDone;
+	TIM_ClearITPendingBit(TIM2, TIM_IT_Update);
+	TIM_ITConfig(TIM2, TIM_IT_Update, ENABLE);
+}
+
+// Trapezoidal profile: accelerate to the speed limit, brake when v^2 / 2a reaches the distance left
+void TIM2_IRQHandler(void)
+{
+	void (*pfDone)(void);
+	int32_t i32Rem, i32Dir, i32Speed;
+	uint32_t u32Dist;
+	
+	if (TIM_GetITStatus(TIM2, TIM_IT_Update) == RESET)
+	{
+		return;
+	}
+	TIM_ClearITPendingBit(TIM2, TIM_IT_Update);
+	
+	i32Rem = i32Target - i32Pos;
+	i32Dir = (i32Rem < 0) ? -1 : 1;
+	u32Dist = i32Rem * i32Dir;
+	i32Speed = i32Vel * i32Dir;		// Positive towards the target
+	
+	if (i32Speed > 0 && (uint64_t)i32Speed * i32Speed >= (uint64_t)2 * u32Accel * u32Dist)
+	{
+		i32Speed -= u32Accel;
+		if (i32Speed < (int32_t)u32Accel) i32Speed = u32Accel;
+	}
+	else
+	{
+		i32Speed += u32Accel;
+		if (i32Speed > (int32_t)u32VMax) i32Speed = u32VMax;
+	}
+	
+	if (i32Speed > 0 && u32Dist <= (uint32_t)i32Speed)
+	{
+		i32Pos = i32Target;
+		i32Vel = 0;
+		TIM2->CCR1 = i32Pos >> 16;
+		TIM_ITConfig(TIM2, TIM_IT_Update, DISABLE);
+		pfDone = pfMoveDone;
+		pfMoveDone = 0;
+		if (pfDone) pfDone();
+		return;
+	}
+	
+	i32Vel = i32Speed * i32Dir;
+	i32Pos += i32Vel;
+	// A reversal still carries speed away from the target, never past the ends of travel
+	if (i32Pos < 0) i32Pos = 0;
+	if (i32Pos > ((int32_t)SERVO_MAX_PULSE << 16)) i32Pos = (int32_t)SERVO_MAX_PULSE << 16;
+	TIM2->CCR1 = (i32Pos + 0x8000) >> 16;
+}
+
 void PWM_Init()
 {
 	// Initialization struct
 	TIM_TimeBaseInitTypeDef TIM_TimeBaseInitStruct;
 	TIM_OCInitTypeDef TIM_OCInitStruct;
 	GPIO_InitTypeDef GPIO_InitStruct;
+	NVIC_InitTypeDef NVIC_InitStruct;
 	
 	// Step 1: Initialize TIM2
 	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2, ENABLE);
@@ -55,7 +129,14 @@ void PWM_Init()
 	TIM_OC1Init(TIM2, &TIM_OCInitStruct);
 	TIM_OC1PreloadConfig(TIM2, TIM_OCPreload_Enable);
 	
-	// Step 3: Initialize GPIOA (PA0)
+	// Step 3: TIM2 update interrupt for the motion profile
+	NVIC_InitStruct.NVIC_IRQChannel = TIM2_IRQn;
+	NVIC_InitStruct.NVIC_IRQChannelPreemptionPriority = 0;
+	NVIC_InitStruct.NVIC_IRQChannelSubPriority = 0;
+	NVIC_InitStruct.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVIC_InitStruct);
+	
+	// Step 4: Initialize GPIOA (PA0)
 	RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOA, ENABLE);
 	GPIO_InitStruct.GPIO_Pin = GPIO_Pin_0;
 	GPIO_InitStruct.GPIO_Mode = GPIO_Mode_AF_PP;
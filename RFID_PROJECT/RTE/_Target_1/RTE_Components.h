@@ -18,6 +18,12 @@
 
 /*  Keil::Device:StdPeriph Drivers:Framework:3.6.0 */
 #define RTE_DEVICE_STDPERIPH_FRAMEWORK
+/*  Keil::Device:StdPeriph Drivers:DMA:3.6.0 */
+#define RTE_DEVICE_STDPERIPH_DMA
+/*  Keil::Device:StdPeriph Drivers:EXTI:3.6.0 */
+#define RTE_DEVICE_STDPERIPH_EXTI
+/*  Keil::Device:StdPeriph Drivers:Flash:3.6.0 */
+#define RTE_DEVICE_STDPERIPH_FLASH
 /*  Keil::Device:StdPeriph Drivers:GPIO:3.6.0 */
 #define RTE_DEVICE_STDPERIPH_GPIO
 /*  Keil::Device:StdPeriph Drivers:I2C:3.6.0 */
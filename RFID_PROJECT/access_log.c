@@ -0,0 +1,363 @@
+#include "access_log.h"
+#include "sd_card.h"
+#include "delay.h"
+#include <string.h>
+
+#define LOG_SECTOR_SIZE			512
+#define LOG_RECORDS_PER_SECTOR	(LOG_SECTOR_SIZE / ACCESS_LOG_RECORD_SIZE)
+#define LOG_SEQ_EMPTY			0xFFFFFFFFUL	/* Sequence number of an unwritten record */
+#define LOG_FILE_NAME			SD_CARD_LOG_VOLUME "LOG0.BIN"
+
+static FIL LogFil;
+static DWORD LogClmt[ACCESS_LOG_CLMT_SIZE];	/* Cluster link map of LogFil */
+static AccessLog_Record_t LogBuff[LOG_RECORDS_PER_SECTOR];	/* Sector being filled */
+static uint16_t u16BuffCount;		/* Records in LogBuff */
+static uint16_t u16Written;			/* Records of LogBuff already on the card */
+static uint32_t u32SectorRec;		/* File record index of LogBuff[0] */
+static uint32_t u32NextSeq;
+static uint32_t u32PendingTick;		/* Time of the oldest unwritten record */
+static uint8_t u8FileIdx;
+static uint8_t u8FileOpen;			/* LogFil is open, not between closing a full file and opening the next */
+static uint8_t u8Ready;
+static AccessLog_Stats_t LogStats;
+
+static void AccessLog_FileName(char* name, uint8_t idx)
+{
+	strcpy(name, LOG_FILE_NAME);
+	name[sizeof(LOG_FILE_NAME) - 6] = '0' + idx;	/* The digit before ".BIN" */
+}
+
+/* Switch a file to fast seek, it keeps walking the FAT if the map does not fit */
+static void AccessLog_LinkMap(FIL* fp, DWORD* clmt)
+{
+	clmt[0] = ACCESS_LOG_CLMT_SIZE;
+	fp->cltbl = clmt;
+	if (f_lseek(fp, CREATE_LINKMAP) != FR_OK) {
+		fp->cltbl = 0;
+	}
+}
+
+static uint8_t AccessLog_ReadRecord(FIL* fp, uint32_t index, AccessLog_Record_t* rec)
+{
+	UINT br;
+
+	if (f_lseek(fp, (FSIZE_t)index * ACCESS_LOG_RECORD_SIZE) != FR_OK) {
+		return 0;
+	}
+	if (f_read(fp, rec, ACCESS_LOG_RECORD_SIZE, &br) != FR_OK || br != ACCESS_LOG_RECORD_SIZE) {
+		return 0;
+	}
+	return 1;
+}
+
+/* Write LogBuff to its sector, unused slots are written as empty records */
+static FRESULT AccessLog_WriteSector(void)
+{
+	FRESULT fr;
+	UINT bw;
+	uint32_t u32Start = Delay_GetTick();
+
+	memset(&LogBuff[u16BuffCount], 0xFF, (LOG_RECORDS_PER_SECTOR - u16BuffCount) * ACCESS_LOG_RECORD_SIZE);
+
+	fr = f_lseek(&LogFil, (FSIZE_t)u32SectorRec * ACCESS_LOG_RECORD_SIZE);
+	if (fr == FR_OK) {
+		fr = f_write(&LogFil, LogBuff, LOG_SECTOR_SIZE, &bw);
+		if (fr == FR_OK && bw != LOG_SECTOR_SIZE) {
+			fr = FR_DISK_ERR;
+		}
+	}
+
+	if (fr == FR_OK) {
+		++LogStats.u32Flushes;
+		if (Delay_GetTick() - u32Start > LogStats.u32MaxFlushMs) {
+			LogStats.u32MaxFlushMs = Delay_GetTick() - u32Start;
+		}
+	} else {
+		++LogStats.u32Errors;
+	}
+	return fr;
+}
+
+/* Create (or overwrite) a ring file and allocate it contiguously */
+static FRESULT AccessLog_OpenFile(uint8_t idx)
+{
+	FRESULT fr;
+	char name[sizeof(LOG_FILE_NAME)];
+
+	AccessLog_FileName(name, idx);
+	fr = f_open(&LogFil, name, FA_READ | FA_WRITE | FA_CREATE_ALWAYS);
+	if (fr != FR_OK) {
+		return fr;
+	}
+	u8FileOpen = 1;
+
+	/* Without a contiguous free area the file simply grows cluster by cluster */
+	if (f_expand(&LogFil, ACCESS_LOG_FILE_SIZE, 1) == FR_OK) {
+		AccessLog_LinkMap(&LogFil, LogClmt);
+	}
+
+	u8FileIdx = idx;
+	u32SectorRec = 0;
+	u16Written = 0;
+
+	/* Records buffered while the file could not be opened go to its first sector,
+	   the rest of it is marked empty so a stale file start is never taken as newest */
+	fr = AccessLog_WriteSector();
+	if (fr == FR_OK) {
+		u16Written = u16BuffCount;
+		fr = f_sync(&LogFil);
+	}
+	return fr;
+}
+
+/* Switch to the next ring file once the current one is full, retried until it opens */
+static FRESULT AccessLog_Rotate(void)
+{
+	FRESULT fr;
+
+	if (u32SectorRec < ACCESS_LOG_RECORDS_PER_FILE) {
+		return FR_OK;
+	}
+	if (u8FileOpen) {
+		fr = f_close(&LogFil);
+		if (fr != FR_OK) {
+			return fr;
+		}
+		u8FileOpen = 0;
+	}
+	fr = AccessLog_OpenFile((u8FileIdx + 1) % ACCESS_LOG_FILES);
+	if (u8FileOpen) {
+		++LogStats.u32Rotations;
+	}
+	return fr;
+}
+
+/* Finish a pending rotation, then write a full LogBuff and start the next sector.
+   LogBuff is kept if the write fails */
+static FRESULT AccessLog_NextSector(void)
+{
+	FRESULT fr;
+
+	fr = AccessLog_Rotate();
+	if (fr != FR_OK || u16BuffCount < LOG_RECORDS_PER_SECTOR) {
+		return fr;
+	}
+	fr = AccessLog_WriteSector();
+	if (fr != FR_OK) {
+		return fr;
+	}
+	u32SectorRec += LOG_RECORDS_PER_SECTOR;
+	u16BuffCount = 0;
+	u16Written = 0;
+	return AccessLog_Rotate();
+}
+
+/* Number of valid records in LogFil, starting at sequence number u32Base */
+static uint32_t AccessLog_FindEnd(uint32_t u32Base)
+{
+	AccessLog_Record_t rec;
+	uint32_t lo = 0, hi = ACCESS_LOG_RECORDS_PER_FILE, mid;
+
+	/* Record lo is valid, record hi is not */
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if (AccessLog_ReadRecord(&LogFil, mid, &rec) && rec.u32Seq == u32Base + mid) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	return hi;
+}
+
+FRESULT AccessLog_Init(void)
+{
+	FRESULT fr;
+	AccessLog_Record_t rec;
+	char name[sizeof(LOG_FILE_NAME)];
+	uint8_t i;
+	int8_t best = -1;
+	uint32_t u32BestSeq = 0;
+	uint32_t u32Count;
+	UINT br;
+
+	u8Ready = 0;
+	fr = sd_card_mount();
+	if (fr != FR_OK) {
+		return fr;
+	}
+
+	/* The newest file is the one whose first record has the highest number */
+	for (i = 0; i < ACCESS_LOG_FILES; i++) {
+		AccessLog_FileName(name, i);
+		if (f_open(&LogFil, name, FA_READ) != FR_OK) {
+			continue;
+		}
+		if (AccessLog_ReadRecord(&LogFil, 0, &rec) && rec.u32Seq != LOG_SEQ_EMPTY
+			&& (best < 0 || rec.u32Seq > u32BestSeq)) {
+			best = i;
+			u32BestSeq = rec.u32Seq;
+		}
+		f_close(&LogFil);
+	}
+
+	if (best < 0) {
+		u32NextSeq = 0;
+		u16BuffCount = 0;
+		fr = AccessLog_OpenFile(0);
+	} else {
+		AccessLog_FileName(name, best);
+		fr = f_open(&LogFil, name, FA_READ | FA_WRITE);
+		if (fr == FR_OK) {
+			u8FileOpen = 1;
+			/* A file that could not be preallocated still has to grow, no fast seek */
+			if (f_size(&LogFil) >= ACCESS_LOG_FILE_SIZE) {
+				AccessLog_LinkMap(&LogFil, LogClmt);
+			}
+			u8FileIdx = best;
+			u32Count = AccessLog_FindEnd(u32BestSeq);
+			u32NextSeq = u32BestSeq + u32Count;
+
+			/* Reload the partly filled last sector */
+			u32SectorRec = u32Count - (u32Count % LOG_RECORDS_PER_SECTOR);
+			u16BuffCount = u32Count - u32SectorRec;
+			u16Written = u16BuffCount;
+			if (u16BuffCount) {
+				fr = f_lseek(&LogFil, (FSIZE_t)u32SectorRec * ACCESS_LOG_RECORD_SIZE);
+				if (fr == FR_OK) {
+					fr = f_read(&LogFil, LogBuff, u16BuffCount * ACCESS_LOG_RECORD_SIZE, &br);
+				}
+				if (fr == FR_OK && br != u16BuffCount * ACCESS_LOG_RECORD_SIZE) {
+					fr = FR_DISK_ERR;
+				}
+			}
+			if (fr == FR_OK) {
+				fr = AccessLog_Rotate();
+			}
+		}
+	}
+
+	if (fr == FR_OK) {
+		u8Ready = 1;
+	}
+	return fr;
+}
+
+FRESULT AccessLog_Append(const uint8_t* uid, uint8_t uidLen, AccessLog_Decision_t decision)
+{
+	FRESULT fr = FR_OK;
+	AccessLog_Record_t* rec;
+
+	if (!u8Ready) {
+		return FR_NOT_READY;
+	}
+
+	/* A full sector whose write failed is retried first, the record has no room before it */
+	if (u16BuffCount == LOG_RECORDS_PER_SECTOR) {
+		fr = AccessLog_NextSector();
+		if (u16BuffCount == LOG_RECORDS_PER_SECTOR) {
+			++LogStats.u32Dropped;
+			return fr;
+		}
+	}
+
+	if (uidLen > ACCESS_LOG_UID_LEN) {
+		uidLen = ACCESS_LOG_UID_LEN;
+	}
+	rec = &LogBuff[u16BuffCount];
+	rec->u32Seq = u32NextSeq++;
+	rec->u32Time = Delay_GetTick();
+	memset(rec->u8Uid, 0, ACCESS_LOG_UID_LEN);
+	memcpy(rec->u8Uid, uid, uidLen);
+	rec->u8Info = ACCESS_LOG_INFO(uidLen, decision);
+	memset(rec->u8Reserved, 0xFF, sizeof(rec->u8Reserved));
+
+	if (u16BuffCount++ == u16Written) {
+		u32PendingTick = rec->u32Time;
+	}
+
+	/* Full sector: write it and move on, the file is already allocated. If the write
+	   or the rotation fails the records stay in RAM, the next append or flush retries it */
+	AccessLog_NextSector();
+	++LogStats.u32Records;
+	return FR_OK;
+}
+
+FRESULT AccessLog_Flush(void)
+{
+	FRESULT fr;
+
+	if (!u8Ready) {
+		return FR_NOT_READY;
+	}
+
+	fr = AccessLog_NextSector();
+	if (fr == FR_OK && u16BuffCount > u16Written) {
+		/* Partial sector is rewritten in place until it fills up */
+		fr = AccessLog_WriteSector();
+		if (fr == FR_OK) {
+			u16Written = u16BuffCount;
+		}
+	}
+	if (fr == FR_OK) {
+		fr = f_sync(&LogFil);
+	}
+	return fr;
+}
+
+void AccessLog_Poll(void)
+{
+	if (!u8Ready) {
+		return;
+	}
+	if ((u16BuffCount > u16Written && Delay_GetTick() - u32PendingTick >= ACCESS_LOG_FLUSH_MS) || u32SectorRec >= ACCESS_LOG_RECORDS_PER_FILE) {
+		AccessLog_Flush();
+	}
+}
+
+void AccessLog_GetStats(AccessLog_Stats_t* stats)
+{
+	*stats = LogStats;
+}
+
+uint32_t AccessLog_GetNextSeq(void)
+{
+	return u32NextSeq;
+}
+
+void AccessLog_OpenReader(AccessLog_Reader_t* rd)
+{
+	rd->u32Block = LOG_SEQ_EMPTY;
+}
+
+void AccessLog_CloseReader(AccessLog_Reader_t* rd)
+{
+	if (rd->u32Block != LOG_SEQ_EMPTY) {
+		f_close(&rd->Fil);
+		rd->u32Block = LOG_SEQ_EMPTY;
+	}
+}
+
+FRESULT AccessLog_ReadRecordAt(AccessLog_Reader_t* rd, uint32_t seq, AccessLog_Record_t* rec)
+{
+	FRESULT fr;
+	char name[sizeof(LOG_FILE_NAME)];
+	uint32_t u32Block = seq / ACCESS_LOG_RECORDS_PER_FILE;
+
+	/* A ring file is recreated for every new block, so the map is per block */
+	if (rd->u32Block != u32Block) {
+		AccessLog_CloseReader(rd);
+		AccessLog_FileName(name, u32Block % ACCESS_LOG_FILES);
+		fr = f_open(&rd->Fil, name, FA_READ);
+		if (fr != FR_OK) {
+			return fr;
+		}
+		AccessLog_LinkMap(&rd->Fil, rd->Clmt);
+		rd->u32Block = u32Block;
+	}
+
+	if (!AccessLog_ReadRecord(&rd->Fil, seq % ACCESS_LOG_RECORDS_PER_FILE, rec) || rec->u32Seq != seq) {
+		return FR_NO_FILE;
+	}
+	return FR_OK;
+}
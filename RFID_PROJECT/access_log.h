@@ -0,0 +1,129 @@
+#ifndef ACCESS_LOG_H_
+#define ACCESS_LOG_H_
+
+#include "stm32f10x.h"
+#include "mfrc522.h"
+#include "ff.h"
+
+/**
+ * Streaming card event log on the SD card
+ *
+ * Records are buffered in one 512 byte sector and written sector aligned
+ * into files preallocated with f_expand, so appending never walks or
+ * updates the FAT. Files LOG0.BIN .. LOG<n-1>.BIN on SD_CARD_LOG_VOLUME are
+ * used as a ring.
+ */
+
+#define ACCESS_LOG_FILES				4			/* Number of files in the ring */
+#define ACCESS_LOG_FILE_SIZE			0x40000UL	/* Preallocated size of each file (256 KB) */
+#define ACCESS_LOG_FLUSH_MS				2000		/* Max age of a buffered record */
+
+#define ACCESS_LOG_UID_LEN				MFRC522_UID_MAX_LEN	/* Longest UID stored in a record */
+#define ACCESS_LOG_CLMT_SIZE			16			/* Cluster link map items, 4 for a contiguous file */
+
+/* Decision stored in a record */
+typedef enum {
+	ACCESS_LOG_DENIED = 0,
+	ACCESS_LOG_GRANTED,
+	ACCESS_LOG_UNKNOWN
+} AccessLog_Decision_t;
+
+/**
+ * Log record, 32 bytes, 16 records per sector
+ *
+ * Records of a file carry consecutive sequence numbers, the first record
+ * whose number breaks the sequence marks the end of the valid data.
+ */
+typedef struct {
+	uint32_t u32Seq;					/* Record number, continues across files */
+	uint32_t u32Time;					/* Delay_GetTick() at the event */
+	uint8_t u8Uid[ACCESS_LOG_UID_LEN];	/* Card UID, zero padded */
+	uint8_t u8Info;						/* b7..4: UID length, b3..0: decision */
+	uint8_t u8Reserved[13];				/* 0xFF, pads the record to a power of two */
+} AccessLog_Record_t;
+
+#define ACCESS_LOG_RECORD_SIZE			sizeof(AccessLog_Record_t)
+#define ACCESS_LOG_RECORDS_PER_FILE		(ACCESS_LOG_FILE_SIZE / ACCESS_LOG_RECORD_SIZE)
+
+#define ACCESS_LOG_INFO(len, decision)	((uint8_t)(((len) << 4) | ((decision) & 0x0F)))
+#define ACCESS_LOG_UID_LENGTH(rec)		((rec)->u8Info >> 4)
+#define ACCESS_LOG_DECISION(rec)		((AccessLog_Decision_t)((rec)->u8Info & 0x0F))
+
+/**
+ * Random access to logged records
+ *
+ * The reader keeps one log file open with a cluster link map (fast seek),
+ * so locating a record never follows the FAT chain.
+ */
+typedef struct {
+	FIL Fil;
+	DWORD Clmt[ACCESS_LOG_CLMT_SIZE];	/* Cluster link map of Fil */
+	uint32_t u32Block;					/* seq / ACCESS_LOG_RECORDS_PER_FILE of the open file, 0xFFFFFFFF if none */
+} AccessLog_Reader_t;
+
+/* Counters to check the log keeps up with the reader */
+typedef struct {
+	uint32_t u32Records;		/* Records appended since init */
+	uint32_t u32Flushes;		/* Sector writes */
+	uint32_t u32Rotations;		/* Switches to the next file */
+	uint32_t u32Errors;			/* Failed sector writes, the records stay in RAM and are retried */
+	uint32_t u32Dropped;		/* Records not logged, the sector buffer was full and could not be written */
+	uint32_t u32MaxFlushMs;		/* Worst case flush time */
+} AccessLog_Stats_t;
+
+/**
+ * Mount the card and continue the newest log file
+ *
+ * Returns FR_OK when the log is ready
+ */
+extern FRESULT AccessLog_Init(void);
+
+/**
+ * Append a card event
+ *
+ * Parameters:
+ * 	- uint8_t* uid, uint8_t uidLen:
+ * 		Card UID, at most ACCESS_LOG_UID_LEN bytes are stored
+ * 	- AccessLog_Decision_t decision:
+ * 		Result of the access check
+ *
+ * Only writes to the card when the sector buffer is full. A failed write
+ * keeps the sector in RAM, it is retried by the next append or flush.
+ *
+ * Returns FR_OK when the record is logged or buffered, an error when it
+ * was dropped because the full buffer still could not be written
+ */
+extern FRESULT AccessLog_Append(const uint8_t* uid, uint8_t uidLen, AccessLog_Decision_t decision);
+
+/**
+ * Write the buffered records to the card and sync the file
+ */
+extern FRESULT AccessLog_Flush(void);
+
+/**
+ * Flush records buffered longer than ACCESS_LOG_FLUSH_MS, call from the main loop
+ */
+extern void AccessLog_Poll(void);
+
+extern void AccessLog_GetStats(AccessLog_Stats_t* stats);
+
+/**
+ * Sequence number the next appended record will get
+ */
+extern uint32_t AccessLog_GetNextSeq(void);
+
+extern void AccessLog_OpenReader(AccessLog_Reader_t* rd);
+extern void AccessLog_CloseReader(AccessLog_Reader_t* rd);
+
+/**
+ * Read the record with a given sequence number
+ *
+ * Every file holds ACCESS_LOG_RECORDS_PER_FILE consecutive records, so the
+ * file and offset follow from the number and the read costs one sector.
+ * Records still buffered in RAM must be flushed first.
+ *
+ * Returns FR_OK, or FR_NO_FILE if the record was overwritten or not written yet
+ */
+extern FRESULT AccessLog_ReadRecordAt(AccessLog_Reader_t* rd, uint32_t seq, AccessLog_Record_t* rec);
+
+#endif
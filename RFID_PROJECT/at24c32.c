@@ -0,0 +1,109 @@
+#include "at24c32.h"
+#include "i2c.h"
+#include "delay.h"
+#include <string.h>
+
+static uint8_t u8PageBuf[2 + AT24C32_PAGE_SIZE];
+
+/* I2C1 wants the whole write in one buffer, the header is copied in front of the data */
+static uint8_t AT24C32_I2C1Write(uint8_t u8Addr, const uint8_t* pHdr, uint8_t u8HdrLen, const uint8_t* pData, uint16_t u16Len)
+{
+	if (u8HdrLen + u16Len > sizeof(u8PageBuf)) {
+		return 0;
+	}
+	memcpy(u8PageBuf, pHdr, u8HdrLen);
+	memcpy(&u8PageBuf[u8HdrLen], pData, u16Len);
+	return I2C_Write(u8Addr, u8PageBuf, u8HdrLen + u16Len) == Success;
+}
+
+/* Address write and read are two transactions, the chip keeps the address across the STOP */
+static uint8_t AT24C32_I2C1Read(uint8_t u8Addr, const uint8_t* pHdr, uint8_t u8HdrLen, uint8_t* pData, uint16_t u16Len)
+{
+	if (u8HdrLen > sizeof(u8PageBuf)) {
+		return 0;
+	}
+	memcpy(u8PageBuf, pHdr, u8HdrLen);
+	if (I2C_Write(u8Addr, u8PageBuf, u8HdrLen) != Success) {
+		return 0;
+	}
+	return I2C_Read(u8Addr, pData, u16Len) == Success;
+}
+
+const AT24C32_Bus_t AT24C32_I2C1Bus = {
+	AT24C32_I2C1Write,
+	AT24C32_I2C1Read
+};
+
+void AT24C32_Init(AT24C32_t* dev, const AT24C32_Bus_t* bus, uint8_t addr)
+{
+	dev->pBus = bus;
+	dev->u8Addr = addr;
+	dev->u32Pages = 0;
+	dev->u32Polls = 0;
+}
+
+AT24C32_Status_t AT24C32_WaitReady(AT24C32_t* dev)
+{
+	uint32_t u32Start = Delay_GetTick();
+
+	//The chip does not ACK its address during the write cycle
+	while (!dev->pBus->pfWrite(dev->u8Addr, 0, 0, 0, 0)) {
+		++dev->u32Polls;
+		//One tick more, the tick may advance right after the start
+		if (Delay_GetTick() - u32Start > AT24C32_TWR_MS) {
+			return AT24C32_TIMEOUT;
+		}
+	}
+	return AT24C32_OK;
+}
+
+AT24C32_Status_t AT24C32_Read(AT24C32_t* dev, uint16_t address, uint8_t* data, uint16_t len)
+{
+	uint8_t hdr[2];
+
+	if (address + (uint32_t)len > AT24C32_SIZE) {
+		return AT24C32_RANGE;
+	}
+	if (!len) {
+		return AT24C32_OK;
+	}
+	hdr[0] = address >> 8;
+	hdr[1] = address;
+	return dev->pBus->pfRead(dev->u8Addr, hdr, 2, data, len) ? AT24C32_OK : AT24C32_NACK;
+}
+
+AT24C32_Status_t AT24C32_Write(AT24C32_t* dev, uint16_t address, const uint8_t* data, uint16_t len)
+{
+	AT24C32_Status_t status;
+	uint8_t hdr[2];
+	uint16_t chunk;
+
+	if (address + (uint32_t)len > AT24C32_SIZE) {
+		return AT24C32_RANGE;
+	}
+
+	while (len) {
+		//Up to the end of the page the address is in
+		chunk = AT24C32_PAGE_SIZE - (address % AT24C32_PAGE_SIZE);
+		if (chunk > len) {
+			chunk = len;
+		}
+
+		hdr[0] = address >> 8;
+		hdr[1] = address;
+		if (!dev->pBus->pfWrite(dev->u8Addr, hdr, 2, data, chunk)) {
+			return AT24C32_NACK;
+		}
+		++dev->u32Pages;
+
+		status = AT24C32_WaitReady(dev);
+		if (status != AT24C32_OK) {
+			return status;
+		}
+
+		address += chunk;
+		data += chunk;
+		len -= chunk;
+	}
+	return AT24C32_OK;
+}
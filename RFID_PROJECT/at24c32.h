@@ -0,0 +1,63 @@
+#ifndef AT24C32_H_
+#define AT24C32_H_
+
+#include "stm32f10x.h"
+
+/**
+ * AT24C32 / AT24C64 serial EEPROM
+ *
+ * Writes are split at the 32 byte page boundaries, a page write that runs
+ * past the end of a page wraps to its start inside the chip. After every
+ * page the chip is polled with its address until it ACKs again, so a
+ * write costs the real write cycle time and not the 10 ms maximum.
+ * Reads of any length are one transaction.
+ *
+ * The driver only needs the two bus operations below, it runs on the
+ * interrupt driven I2C1 (AT24C32_I2C1Bus) or on a bit-banged bus.
+ */
+
+#define AT24C32_ADDR				0xA0	/* A2..A0 low */
+#define AT24C32_SIZE				4096
+#define AT24C32_PAGE_SIZE			32
+#define AT24C32_TWR_MS				10		/* Write cycle time, data sheet maximum */
+
+typedef enum {
+	AT24C32_OK = 0,
+	AT24C32_NACK,			/* Device or bus did not answer */
+	AT24C32_TIMEOUT,		/* Still busy AT24C32_TWR_MS after a page write */
+	AT24C32_RANGE			/* Beyond AT24C32_SIZE */
+} AT24C32_Status_t;
+
+typedef struct {
+	/**
+	 * One write transaction: START, address, pHdr, pData, STOP. With no bytes
+	 * at all only the address is sent. Returns 1 if every byte was ACKed.
+	 */
+	uint8_t (*pfWrite)(uint8_t u8Addr, const uint8_t* pHdr, uint8_t u8HdrLen, const uint8_t* pData, uint16_t u16Len);
+	/**
+	 * Write pHdr, then read u16Len bytes, the last one NACKed. A repeated
+	 * START or a STOP and a new START between the two both work.
+	 */
+	uint8_t (*pfRead)(uint8_t u8Addr, const uint8_t* pHdr, uint8_t u8HdrLen, uint8_t* pData, uint16_t u16Len);
+} AT24C32_Bus_t;
+
+typedef struct {
+	const AT24C32_Bus_t* pBus;
+	uint8_t u8Addr;
+	uint32_t u32Pages;			/* Page writes done */
+	uint32_t u32Polls;			/* Address polls while the chip was busy */
+} AT24C32_t;
+
+extern const AT24C32_Bus_t AT24C32_I2C1Bus;
+
+extern void AT24C32_Init(AT24C32_t* dev, const AT24C32_Bus_t* bus, uint8_t addr);
+
+/**
+ * Wait for the end of a write cycle, returns AT24C32_OK once the chip ACKs
+ */
+extern AT24C32_Status_t AT24C32_WaitReady(AT24C32_t* dev);
+
+extern AT24C32_Status_t AT24C32_Read(AT24C32_t* dev, uint16_t address, uint8_t* data, uint16_t len);
+extern AT24C32_Status_t AT24C32_Write(AT24C32_t* dev, uint16_t address, const uint8_t* data, uint16_t len);
+
+#endif
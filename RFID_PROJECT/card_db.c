@@ -0,0 +1,340 @@
+#include "card_db.h"
+#include "sd_card.h"
+#include "stm32f10x_flash.h"
+#include <string.h>
+
+#define DB_MAGIC				0x31424443UL	/* "CDB1" */
+#define DB_SLOT_EMPTY			0xFF			/* Length byte of an erased slot */
+#define DB_SLOT_REVOKED			0x00			/* Length byte of a tombstone */
+#define DB_FNV_OFFSET			2166136261UL
+#define DB_FNV_PRIME			16777619UL
+
+/* Header in slot 0, the signature is programmed last so an interrupted rebuild is redone */
+typedef struct {
+	uint32_t u32Magic;
+	uint32_t u32Signature;		/* Hash of CARD_DB_FILE the table was built from */
+} CardDB_Header_t;
+
+typedef union {
+	uint8_t u8[CARD_DB_SLOT_SIZE];		/* Length, UID zero padded */
+	uint16_t u16[CARD_DB_SLOT_SIZE / 2];
+} CardDB_Slot_t;
+
+static uint8_t Bloom[CARD_DB_BLOOM_BITS / 8];
+static CardDB_Stats_t DbStats;
+
+#define DB_HEADER				((const CardDB_Header_t*)CARD_DB_FLASH_BASE)
+#define DB_SLOT_ADDR(i)			(CARD_DB_FLASH_BASE + ((uint32_t)(i) + 1) * CARD_DB_SLOT_SIZE)
+#define DB_SLOT(i)				((const uint8_t*)DB_SLOT_ADDR(i))
+
+static uint32_t CardDB_HashBytes(uint32_t h, const uint8_t* data, uint16_t len)
+{
+	while (len--) {
+		h = (h ^ *data++) * DB_FNV_PRIME;
+	}
+	return h;
+}
+
+static uint32_t CardDB_Hash(const uint8_t* uid, uint8_t uidLen)
+{
+	return CardDB_HashBytes(DB_FNV_OFFSET ^ uidLen, uid, uidLen);
+}
+
+/* Double hashing, the second hash is odd so the k bits differ */
+static void CardDB_BloomAdd(uint32_t h)
+{
+	uint32_t h2 = ((h >> 17) | (h << 15)) | 1;
+	uint32_t bit;
+	uint8_t i;
+
+	for (i = 0; i < CARD_DB_BLOOM_HASHES; i++) {
+		bit = (h + i * h2) % CARD_DB_BLOOM_BITS;
+		Bloom[bit / 8] |= 1 << (bit % 8);
+	}
+}
+
+static uint8_t CardDB_BloomTest(uint32_t h)
+{
+	uint32_t h2 = ((h >> 17) | (h << 15)) | 1;
+	uint32_t bit;
+	uint8_t i;
+
+	for (i = 0; i < CARD_DB_BLOOM_HASHES; i++) {
+		bit = (h + i * h2) % CARD_DB_BLOOM_BITS;
+		if (!(Bloom[bit / 8] & (1 << (bit % 8)))) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Program halfwords from the last to the first, the length byte of a slot goes last */
+static CardDB_Status_t CardDB_Program(uint32_t addr, const uint16_t* data, uint8_t count)
+{
+	FLASH_Status st = FLASH_COMPLETE;
+
+	FLASH_Unlock();
+	FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_PGERR | FLASH_FLAG_WRPRTERR);
+	while (count-- && st == FLASH_COMPLETE) {
+		st = FLASH_ProgramHalfWord(addr + count * 2, data[count]);
+	}
+	FLASH_Lock();
+
+	return (st == FLASH_COMPLETE) ? CARD_DB_OK : CARD_DB_FLASH_ERR;
+}
+
+/* Zero is the only value that can be programmed over a written halfword */
+static CardDB_Status_t CardDB_Kill(uint32_t slot)
+{
+	static const uint16_t zero[CARD_DB_SLOT_SIZE / 2] = {0};
+
+	++DbStats.u32Revoked;
+	return CardDB_Program(DB_SLOT_ADDR(slot), zero, CARD_DB_SLOT_SIZE / 2);
+}
+
+static int32_t CardDB_Find(const uint8_t* uid, uint8_t uidLen, uint32_t h)
+{
+	const uint8_t* p;
+	uint32_t i = h % CARD_DB_SLOTS;
+	uint32_t n;
+
+	for (n = 0; n < CARD_DB_SLOTS; n++) {
+		p = DB_SLOT(i);
+		++DbStats.u32Probes;
+		if (p[0] == DB_SLOT_EMPTY) {
+			return -1;
+		}
+		if (p[0] == uidLen && !memcmp(&p[1], uid, uidLen)) {
+			return i;
+		}
+		if (++i == CARD_DB_SLOTS) {
+			i = 0;
+		}
+	}
+	return -1;
+}
+
+/* Count the slots and fill the bloom filter from the table */
+static void CardDB_Scan(void)
+{
+	const uint8_t* p;
+	uint32_t i;
+
+	memset(Bloom, 0, sizeof(Bloom));
+	DbStats.u32Entries = 0;
+	DbStats.u32Revoked = 0;
+	for (i = 0; i < CARD_DB_SLOTS; i++) {
+		p = DB_SLOT(i);
+		if (p[0] >= 1 && p[0] <= CARD_DB_UID_LEN) {
+			CardDB_BloomAdd(CardDB_Hash(&p[1], p[0]));
+			++DbStats.u32Entries;
+		} else if (p[0] != DB_SLOT_EMPTY) {
+			++DbStats.u32Revoked;
+		}
+	}
+}
+
+static uint8_t CardDB_HexValue(char c)
+{
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	if (c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	}
+	if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	return 0xFF;
+}
+
+/* Hash the whole file, with build set also add every UID line to the table */
+static FRESULT CardDB_ReadFile(FIL* fp, uint8_t build, uint32_t* signature)
+{
+	FRESULT fr;
+	char buff[64];
+	uint8_t uid[CARD_DB_UID_LEN];
+	uint8_t digits = 0, skip = 0, v;
+	uint32_t h = DB_FNV_OFFSET ^ CARD_DB_SLOTS;
+	UINT br, i;
+
+	do {
+		fr = f_read(fp, buff, sizeof(buff), &br);
+		if (fr != FR_OK) {
+			return fr;
+		}
+		h = CardDB_HashBytes(h, (const uint8_t*)buff, br);
+		if (!build) {
+			continue;
+		}
+
+		/* A line is one UID in hex, anything else on it discards it */
+		for (i = 0; i <= br; i++) {
+			if (i == br) {
+				if (br == sizeof(buff)) {
+					break;
+				}
+			} else if (buff[i] != '\n') {
+				v = CardDB_HexValue(buff[i]);
+				if (v == 0xFF) {
+					if (buff[i] != '\r' && buff[i] != ' ') {
+						skip = 1;
+					}
+				} else if (digits >= 2 * CARD_DB_UID_LEN) {
+					skip = 1;
+				} else {
+					uid[digits / 2] = (digits & 1) ? (uid[digits / 2] | v) : (v << 4);
+					++digits;
+				}
+				continue;
+			}
+			if (!skip && digits >= 2 && !(digits & 1)) {
+				CardDB_Add(uid, digits / 2);
+			}
+			digits = 0;
+			skip = 0;
+		}
+	} while (br == sizeof(buff));
+
+	*signature = h;
+	return FR_OK;
+}
+
+static CardDB_Status_t CardDB_Rebuild(FIL* fp)
+{
+	CardDB_Header_t header;
+	uint16_t u16Header[sizeof(header) / 2];
+	uint16_t i;
+
+	FLASH_Unlock();
+	FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_PGERR | FLASH_FLAG_WRPRTERR);
+	for (i = 0; i < CARD_DB_FLASH_PAGES; i++) {
+		if (FLASH_ErasePage(CARD_DB_FLASH_BASE + i * CARD_DB_PAGE_SIZE) != FLASH_COMPLETE) {
+			FLASH_Lock();
+			return CARD_DB_FLASH_ERR;
+		}
+	}
+	FLASH_Lock();
+	CardDB_Scan();
+
+	if (f_lseek(fp, 0) != FR_OK || CardDB_ReadFile(fp, 1, &header.u32Signature) != FR_OK) {
+		return CARD_DB_FLASH_ERR;
+	}
+	header.u32Magic = DB_MAGIC;
+	/* Copied, not cast: the stores above may not be seen through a uint16_t pointer */
+	memcpy(u16Header, &header, sizeof(header));
+	return CardDB_Program(CARD_DB_FLASH_BASE, u16Header, sizeof(header) / 2);
+}
+
+FRESULT CardDB_Init(void)
+{
+	FRESULT fr;
+	FIL fil;
+	uint32_t u32Signature;
+
+	DbStats.u32Slots = CARD_DB_SLOTS;
+	CardDB_Scan();
+
+	fr = sd_card_mount();
+	if (fr == FR_OK) {
+		fr = f_open(&fil, CARD_DB_FILE, FA_READ);
+	}
+	if (fr != FR_OK) {
+		return fr;
+	}
+
+	fr = CardDB_ReadFile(&fil, 0, &u32Signature);
+	if (fr == FR_OK && (DB_HEADER->u32Magic != DB_MAGIC || DB_HEADER->u32Signature != u32Signature)) {
+		if (CardDB_Rebuild(&fil) != CARD_DB_OK) {
+			fr = FR_DISK_ERR;
+		}
+	}
+	f_close(&fil);
+
+	return fr;
+}
+
+uint8_t CardDB_Lookup(const uint8_t* uid, uint8_t uidLen)
+{
+	uint32_t h;
+
+	if (uidLen == 0 || uidLen > CARD_DB_UID_LEN) {
+		return 0;
+	}
+	++DbStats.u32Lookups;
+	h = CardDB_Hash(uid, uidLen);
+	if (!CardDB_BloomTest(h)) {
+		++DbStats.u32BloomRejects;
+		return 0;
+	}
+	return CardDB_Find(uid, uidLen, h) >= 0;
+}
+
+CardDB_Status_t CardDB_Add(const uint8_t* uid, uint8_t uidLen)
+{
+	CardDB_Status_t status;
+	CardDB_Slot_t slot;
+	const uint8_t* p;
+	uint32_t h;
+	uint32_t i, n;
+	uint8_t k;
+
+	if (uidLen == 0 || uidLen > CARD_DB_UID_LEN) {
+		return CARD_DB_INVALID;
+	}
+	h = CardDB_Hash(uid, uidLen);
+	if (CardDB_Find(uid, uidLen, h) >= 0) {
+		return CARD_DB_OK;
+	}
+
+	memset(slot.u8, 0, sizeof(slot));
+	slot.u8[0] = uidLen;
+	memcpy(&slot.u8[1], uid, uidLen);
+
+	i = h % CARD_DB_SLOTS;
+	for (n = 0; n < CARD_DB_SLOTS; n++) {
+		/* Tombstones are never reused, only a rebuild frees them */
+		if (DbStats.u32Entries + DbStats.u32Revoked >= CARD_DB_MAX_ENTRIES) {
+			return CARD_DB_FULL;
+		}
+		p = DB_SLOT(i);
+		if (p[0] == DB_SLOT_EMPTY) {
+			for (k = 1; k < CARD_DB_SLOT_SIZE && p[k] == 0xFF; k++);
+			if (k == CARD_DB_SLOT_SIZE) {
+				status = CardDB_Program(DB_SLOT_ADDR(i), slot.u16, CARD_DB_SLOT_SIZE / 2);
+				if (status == CARD_DB_OK) {
+					CardDB_BloomAdd(h);
+					++DbStats.u32Entries;
+				}
+				return status;
+			}
+			/* Left over from an interrupted add, cannot be programmed again */
+			CardDB_Kill(i);
+		}
+		if (++i == CARD_DB_SLOTS) {
+			i = 0;
+		}
+	}
+	return CARD_DB_FULL;
+}
+
+CardDB_Status_t CardDB_Revoke(const uint8_t* uid, uint8_t uidLen)
+{
+	int32_t i;
+
+	if (uidLen == 0 || uidLen > CARD_DB_UID_LEN) {
+		return CARD_DB_INVALID;
+	}
+	i = CardDB_Find(uid, uidLen, CardDB_Hash(uid, uidLen));
+	if (i < 0) {
+		return CARD_DB_NOT_FOUND;
+	}
+	/* The bloom bits stay set, lookups of the card go on to find the tombstone */
+	--DbStats.u32Entries;
+	return CardDB_Kill(i);
+}
+
+void CardDB_GetStats(CardDB_Stats_t* stats)
+{
+	*stats = DbStats;
+}
@@ -0,0 +1,83 @@
+#ifndef CARD_DB_H_
+#define CARD_DB_H_
+
+#include "stm32f10x.h"
+#include "mfrc522.h"
+#include "ff.h"
+
+/**
+ * Authorised card database
+ *
+ * Open addressing hash table of UIDs in the last pages of internal flash,
+ * linear probing. A slot is 12 bytes: UID length and up to 10 UID bytes,
+ * so single, double and triple size UIDs are all stored.
+ * Erased slots (0xFF) end a probe sequence, revoked slots are programmed
+ * to 0x00 and skipped, so add and revoke never need a page erase.
+ * A bloom filter in RAM answers most lookups of unknown cards without
+ * reading the table.
+ *
+ * CARD_DB_FILE on the SD card holds one UID per line in hex, lines starting
+ * with '#' are ignored. The table is rebuilt from it at boot when the file
+ * changed, cards added or revoked at run time survive until then.
+ *
+ * The 8 KB left at the end of the 64 KB F103C8 hold 510 cards. The area and
+ * the bloom filter can be set from the compiler command line for a part
+ * with more flash, about 16 bytes of flash and 10 bits of RAM per card.
+ */
+
+#define CARD_DB_FILE				"CARDS.TXT"
+#ifndef CARD_DB_FLASH_BASE
+#define CARD_DB_FLASH_BASE			0x0800E000UL	/* Excluded from IROM1 in the project */
+#endif
+#ifndef CARD_DB_FLASH_PAGES
+#define CARD_DB_FLASH_PAGES			8
+#endif
+#ifndef CARD_DB_PAGE_SIZE
+#define CARD_DB_PAGE_SIZE			1024
+#endif
+#define CARD_DB_UID_LEN				MFRC522_UID_MAX_LEN
+#define CARD_DB_SLOT_SIZE			12
+/* Slot 0 of the area holds the header */
+#define CARD_DB_SLOTS				((uint32_t)CARD_DB_FLASH_PAGES * CARD_DB_PAGE_SIZE / CARD_DB_SLOT_SIZE - 1)
+#define CARD_DB_MAX_ENTRIES			(CARD_DB_SLOTS * 3 / 4)		/* Load limit, probes stay short */
+#ifndef CARD_DB_BLOOM_BITS
+#define CARD_DB_BLOOM_BITS			8192
+#endif
+#define CARD_DB_BLOOM_HASHES		3
+
+typedef enum {
+	CARD_DB_OK = 0,
+	CARD_DB_NOT_FOUND,
+	CARD_DB_FULL,			/* Load limit reached, rebuild from the file */
+	CARD_DB_FLASH_ERR,
+	CARD_DB_INVALID			/* UID longer than CARD_DB_UID_LEN */
+} CardDB_Status_t;
+
+typedef struct {
+	uint32_t u32Entries;		/* Authorised cards */
+	uint32_t u32Revoked;		/* Tombstones, freed by the next rebuild */
+	uint32_t u32Slots;
+	uint32_t u32Lookups;
+	uint32_t u32BloomRejects;	/* Lookups answered by the bloom filter alone */
+	uint32_t u32Probes;			/* Flash slots compared */
+} CardDB_Stats_t;
+
+/**
+ * Check the table against CARD_DB_FILE, rebuild it if needed and fill the bloom filter
+ *
+ * Returns FR_OK, or the FatFs error of the file. The table in flash is used as it is
+ * when the file cannot be read.
+ */
+extern FRESULT CardDB_Init(void);
+
+/**
+ * Returns 1 if the card is authorised
+ */
+extern uint8_t CardDB_Lookup(const uint8_t* uid, uint8_t uidLen);
+
+extern CardDB_Status_t CardDB_Add(const uint8_t* uid, uint8_t uidLen);
+extern CardDB_Status_t CardDB_Revoke(const uint8_t* uid, uint8_t uidLen);
+
+extern void CardDB_GetStats(CardDB_Stats_t* stats);
+
+#endif
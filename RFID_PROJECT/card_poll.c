@@ -0,0 +1,183 @@
+#include "card_poll.h"
+#include "delay.h"
+
+#define CMD_POWER_DOWN			0x10	/* CommandReg PowerDown bit */
+
+typedef enum {
+	CARD_POLL_SLEEP = 0,		/* Antenna off, soft power-down */
+	CARD_POLL_WAKE,				/* Waiting for the oscillator */
+	CARD_POLL_FIELD,			/* Antenna on, waiting for the card to power up */
+	CARD_POLL_READ				/* TM_MFRC522_EnumeratePoll running */
+} CardPoll_State_t;
+
+static CardPoll_State_t PollState;
+static uint32_t u32NextPoll;
+static uint32_t u32StateTick;
+static uint32_t u32WakeTick;
+static TM_MFRC522_Uid_t Found[CARD_POLL_MAX_CARDS];		/* Filled by the running poll */
+static TM_MFRC522_Uid_t NewCards[CARD_POLL_MAX_CARDS];	/* Found by the last poll, not yet returned */
+static uint8_t u8NewCount;
+static uint8_t u8NewNext;
+static CardPoll_Stats_t PollStats;
+
+typedef struct {
+	TM_MFRC522_Uid_t Uid;
+	uint32_t u32Seen;			/* Tick of the last poll that read it */
+	uint8_t u8Valid;
+} CardPoll_CacheEntry_t;
+
+static CardPoll_CacheEntry_t UidCache[CARD_POLL_CACHE_SIZE];
+
+static uint8_t CardPoll_SameUid(const TM_MFRC522_Uid_t* a, const TM_MFRC522_Uid_t* b)
+{
+	uint8_t i;
+
+	if (a->size != b->size) {
+		return 0;
+	}
+	for (i = 0; i < a->size; i++) {
+		if (a->uidByte[i] != b->uidByte[i]) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Record a sighting, returns 1 if the UID was already cached */
+static uint8_t CardPoll_CacheSeen(const TM_MFRC522_Uid_t* uid, uint32_t u32Now)
+{
+	uint8_t i, victim = 0;
+
+	for (i = 0; i < CARD_POLL_CACHE_SIZE; i++) {
+		if (UidCache[i].u8Valid && u32Now - UidCache[i].u32Seen >= CARD_POLL_CACHE_MS) {
+			UidCache[i].u8Valid = 0;
+		}
+		if (UidCache[i].u8Valid && CardPoll_SameUid(&UidCache[i].Uid, uid)) {
+			UidCache[i].u32Seen = u32Now;
+			return 1;
+		}
+	}
+
+	/* Free slot first, otherwise the entry seen longest ago */
+	for (i = 0; i < CARD_POLL_CACHE_SIZE; i++) {
+		if (!UidCache[i].u8Valid) {
+			victim = i;
+			break;
+		}
+		if (u32Now - UidCache[i].u32Seen > u32Now - UidCache[victim].u32Seen) {
+			victim = i;
+		}
+	}
+	UidCache[victim].Uid = *uid;
+	UidCache[victim].u32Seen = u32Now;
+	UidCache[victim].u8Valid = 1;
+	return 0;
+}
+
+static void CardPoll_Sleep(void)
+{
+	TM_MFRC522_AntennaOff();
+	TM_MFRC522_SetBitMask(MFRC522_REG_COMMAND, CMD_POWER_DOWN);
+	PollStats.u32AwakeMs += Delay_GetTick() - u32WakeTick;
+	PollState = CARD_POLL_SLEEP;
+}
+
+void CardPoll_Init(void)
+{
+	PollStats.u16Interval = CARD_POLL_MIN_MS;
+	u32WakeTick = Delay_GetTick();
+	u32NextPoll = u32WakeTick;
+	u8NewCount = 0;
+	u8NewNext = 0;
+	CardPoll_Sleep();
+}
+
+TM_MFRC522_Status_t CardPoll_Task(TM_MFRC522_Uid_t* uid)
+{
+	uint32_t u32Now = Delay_GetTick();
+	uint8_t i, count;
+
+	if (u8NewNext < u8NewCount) {
+		*uid = NewCards[u8NewNext++];
+		return MI_OK;
+	}
+
+	switch (PollState) {
+		case CARD_POLL_SLEEP:
+			if ((int32_t)(u32Now - u32NextPoll) < 0) {
+				return MI_NOTAGERR;
+			}
+			u32WakeTick = u32Now;
+			TM_MFRC522_ClearBitMask(MFRC522_REG_COMMAND, CMD_POWER_DOWN);
+			PollState = CARD_POLL_WAKE;
+			return MI_BUSY;
+
+		case CARD_POLL_WAKE:
+			/* PowerDown reads 1 until the oscillator is running again */
+			if (TM_MFRC522_ReadRegister(MFRC522_REG_COMMAND) & CMD_POWER_DOWN) {
+				if (u32Now - u32WakeTick < CARD_POLL_WAKE_TIMEOUT_MS) {
+					return MI_BUSY;
+				}
+				CardPoll_Sleep();
+				u32NextPoll = u32Now + PollStats.u16Interval;
+				return MI_ERR;
+			}
+			TM_MFRC522_AntennaOn();
+			u32StateTick = u32Now;
+			PollState = CARD_POLL_FIELD;
+			return MI_BUSY;
+
+		case CARD_POLL_FIELD:
+			if (u32Now - u32StateTick < CARD_POLL_FIELD_MS) {
+				return MI_BUSY;
+			}
+			//The main loop may still be talking to a card, try again on the next call
+			if (TM_MFRC522_EnumerateStart(Found, CARD_POLL_MAX_CARDS) != MI_OK) {
+				return MI_BUSY;
+			}
+			PollState = CARD_POLL_READ;
+			return MI_BUSY;
+
+		case CARD_POLL_READ:
+			if (TM_MFRC522_EnumeratePoll(&count) == MI_BUSY) {
+				return MI_BUSY;
+			}
+			break;
+	}
+
+	PollStats.u32FieldOnMs += Delay_GetTick() - u32StateTick;
+	++PollStats.u32Polls;
+	CardPoll_Sleep();
+
+	u8NewCount = 0;
+	u8NewNext = 0;
+	for (i = 0; i < count; i++) {
+		if (CardPoll_CacheSeen(&Found[i], u32Now)) {
+			++PollStats.u32CacheHits;
+		} else {
+			NewCards[u8NewCount++] = Found[i];
+			++PollStats.u32Detections;
+		}
+	}
+
+	if (count) {
+		PollStats.u16Interval = CARD_POLL_MIN_MS;
+	} else if (PollStats.u16Interval < CARD_POLL_MAX_MS) {
+		PollStats.u16Interval *= 2;
+		if (PollStats.u16Interval > CARD_POLL_MAX_MS) {
+			PollStats.u16Interval = CARD_POLL_MAX_MS;
+		}
+	}
+	u32NextPoll = u32Now + PollStats.u16Interval;
+
+	if (u8NewNext < u8NewCount) {
+		*uid = NewCards[u8NewNext++];
+		return MI_OK;
+	}
+	return MI_NOTAGERR;
+}
+
+void CardPoll_GetStats(CardPoll_Stats_t* stats)
+{
+	*stats = PollStats;
+}
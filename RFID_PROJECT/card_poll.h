@@ -0,0 +1,65 @@
+#ifndef CARD_POLL_H_
+#define CARD_POLL_H_
+
+#include "stm32f10x.h"
+#include "mfrc522.h"
+
+/**
+ * Low-power card presence polling
+ *
+ * Between polls the antenna is off and the MFRC522 is in soft power-down.
+ * A poll powers the reader up, gives a card CARD_POLL_FIELD_MS in the field
+ * and reads the UIDs of all cards in the field. The poll interval drops to
+ * the minimum after a detection and doubles on every empty poll up to the
+ * maximum.
+ *
+ * CardPoll_Task never waits: each call does at most one step of the poll,
+ * one register read while the oscillator starts or one reader command of
+ * the enumeration (TM_MFRC522_EnumeratePoll), so the main loop keeps
+ * running and sleeping while a poll is in progress.
+ *
+ * Field off resets the cards, so a card left on the reader answers every
+ * poll. UIDs seen within CARD_POLL_CACHE_MS are kept in a small cache and
+ * only cards missing from it are reported.
+ */
+
+#define CARD_POLL_MIN_MS				50		/* Interval while cards are being presented */
+#define CARD_POLL_MAX_MS				400		/* Interval after a quiet period */
+#define CARD_POLL_FIELD_MS				5		/* Field on before REQA, card power-up */
+#define CARD_POLL_WAKE_TIMEOUT_MS		5		/* Oscillator start after soft power-down */
+#define CARD_POLL_MAX_CARDS				4		/* Cards read in one poll */
+#define CARD_POLL_CACHE_SIZE			8		/* UIDs remembered */
+#define CARD_POLL_CACHE_MS				1000	/* UID forgotten this long after it was last seen */
+
+/* Counters for detection latency vs. energy */
+typedef struct {
+	uint32_t u32Polls;			/* Poll cycles run */
+	uint32_t u32Detections;		/* Cards reported */
+	uint32_t u32CacheHits;		/* Cards read but already reported */
+	uint32_t u32FieldOnMs;		/* Total time with the antenna on */
+	uint32_t u32AwakeMs;		/* Total time out of soft power-down */
+	uint16_t u16Interval;		/* Current poll interval, worst case detection latency */
+} CardPoll_Stats_t;
+
+/**
+ * Switch the reader to the power-down state, call after TM_MFRC522_Init
+ */
+extern void CardPoll_Init(void);
+
+/**
+ * Run the poll scheduler, call from the main loop
+ *
+ * Parameters:
+ * 	- TM_MFRC522_Uid_t* uid:
+ * 		Pointer to memory to store the card UID in
+ *
+ * Returns MI_OK once per card presentation, a card that stays in the field
+ * is not reported again. Several new cards from one poll are returned by
+ * consecutive calls. Returns MI_BUSY while a poll is in progress and
+ * MI_NOTAGERR otherwise.
+ */
+extern TM_MFRC522_Status_t CardPoll_Task(TM_MFRC522_Uid_t* uid);
+
+extern void CardPoll_GetStats(CardPoll_Stats_t* stats);
+
+#endif
@@ -1,5 +1,7 @@
 #include "delay.h"
 
+static volatile uint32_t u32Tick;
+
 static void Timer_Init(void)
 {
 	TIM_TimeBaseInitTypeDef  TIM_TimeBaseStructure;
@@ -24,6 +26,32 @@ static void Timer_Init(void)
 void Delay_Init(void)
 {
 	Timer_Init();
+	
+	/* 1 ms system tick for timestamps and timeouts */
+	SysTick_Config(SystemCoreClock / 1000);
+}
+
+uint32_t Delay_GetTick(void)
+{
+	return u32Tick;
+}
+
+/* Microsecond timestamp from the tick and the SysTick down counter, wraps after 71 minutes */
+uint32_t Delay_GetMicros(void)
+{
+	uint32_t u32Ms, u32Val;
+
+	do {
+		u32Ms = u32Tick;
+		u32Val = SysTick->VAL;
+	} while (u32Ms != u32Tick);
+
+	return u32Ms * 1000 + (SysTick->LOAD - u32Val) / (SystemCoreClock / 1000000);
+}
+
+void SysTick_Handler(void)
+{
+	++u32Tick;
 }
 
 void Delay_Us(uint32_t u32DelayInUs)
@@ -9,5 +9,7 @@
 void Delay_Init(void);
 void Delay_Us(uint32_t u32DelayInUs);
 void Delay_Ms(uint32_t u32DelayInMs);
+uint32_t Delay_GetTick(void);
+uint32_t Delay_GetMicros(void);
 
 #endif
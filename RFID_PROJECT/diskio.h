@@ -13,6 +13,17 @@ extern "C" {
 /* Status of Disk Functions */
 typedef BYTE	DSTATUS;
 
+/* Sector I/O counters of the MMC/SDC module (MMC_GET_IOSTAT) */
+typedef struct {
+	DWORD	rd_cmd;		/* Read commands issued (CMD17/CMD18) */
+	DWORD	rd_sect;	/* Sectors read from the card */
+	DWORD	wr_cmd;		/* Write commands issued (CMD24/CMD25) */
+	DWORD	wr_sect;	/* Sectors written to the card */
+	DWORD	wr_merge;	/* Cache write backs merged into one CMD25 */
+	DWORD	hit;		/* Single sector accesses served by the cache */
+	DWORD	miss;		/* Single sector accesses that missed the cache */
+} MMC_IOSTAT;
+
 /* Results of Disk Functions */
 typedef enum {
 	RES_OK = 0,		/* 0: Successful */
@@ -67,6 +78,7 @@ DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff);
 #define ISDIO_READ			55	/* Read data form SD iSDIO register */
 #define ISDIO_WRITE			56	/* Write data to SD iSDIO register */
 #define ISDIO_MRITE			57	/* Masked write data to SD iSDIO register */
+#define MMC_GET_IOSTAT		58	/* Get sector I/O counters (MMC_IOSTAT) */
 
 /* ATA/CF specific command (Not used by FatFs) */
 #define ATA_GET_REV			60	/* Get F/W revision */
@@ -4,6 +4,33 @@
 
 #define FFCONF_DEF	86606	/* Revision ID */
 
+/*---------------------------------------------------------------------------/
+/ Build Profile
+/---------------------------------------------------------------------------*/
+
+#ifndef FF_PROFILE
+#define FF_PROFILE		1
+#endif
+/* This option selects a preset for the LFN and volume options below. It can be
+/  overridden from the compiler command line (e.g. FF_PROFILE=2 in the Keil C/C++
+/  Define field).
+/
+/   1: Minimal logger. 8.3 names and a single volume.
+/   2: LFN with static working buffer. ffunicode.c (CP437 only) is compiled in
+/      and the buffer takes (FF_MAX_LFN + 1) * 2 = 130 bytes of BSS.
+/   3: Multi-partition. Two FAT volumes on the card mapped by VolToPart[] in
+/      sd_card.c, each mounted with its own FATFS object by sd_card_mount().
+/      The access log goes to "1:", CARDS.TXT stays on "0:".
+/
+/  Object sizes on a 32-bit target with these settings (FF_FS_TINY 1):
+/
+/   Profile   FATFS   FIL   FILINFO   Static
+/      1       560     44      24        4
+/      2       564     44      88      134
+/      3     2x560    44      24        8 + VolToPart[]
+*/
+
+
 /*---------------------------------------------------------------------------/
 / Function Configurations
 /---------------------------------------------------------------------------*/
@@ -38,15 +65,18 @@
 /  f_findnext(). (0:Disable, 1:Enable 2:Enable with matching altname[] too) */
 
 
+#ifndef FF_USE_MKFS
 #define FF_USE_MKFS		0
-/* This option switches f_mkfs() function. (0:Disable or 1:Enable) */
+#endif
+/* This option switches f_mkfs() function. (0:Disable or 1:Enable) The host
+/  tests enable it from the command line to format the emulated card. */
 
 
-#define FF_USE_FASTSEEK	0
+#define FF_USE_FASTSEEK	1
 /* This option switches fast seek function. (0:Disable or 1:Enable) */
 
 
-#define FF_USE_EXPAND	0
+#define FF_USE_EXPAND	1
 /* This option switches f_expand function. (0:Disable or 1:Enable) */
 
 
@@ -68,7 +98,7 @@
 / Locale and Namespace Configurations
 /---------------------------------------------------------------------------*/
 
-#define FF_CODE_PAGE	932
+#define FF_CODE_PAGE	437
 /* This option specifies the OEM code page to be used on the target system.
 /  Incorrect code page setting can cause a file open failure.
 /
@@ -97,8 +127,13 @@
 */
 
 
+#if FF_PROFILE == 2
+#define FF_USE_LFN		1
+#define FF_MAX_LFN		64
+#else
 #define FF_USE_LFN		0
 #define FF_MAX_LFN		255
+#endif
 /* The FF_USE_LFN switches the support for LFN (long file name).
 /
 /   0: Disable LFN. FF_MAX_LFN has no effect.
@@ -129,7 +164,7 @@
 /  When LFN is not enabled, this option has no effect. */
 
 
-#define FF_LFN_BUF		255
+#define FF_LFN_BUF		FF_MAX_LFN
 #define FF_SFN_BUF		12
 /* This set of options defines size of file name members in the FILINFO structure
 /  which is used to read out directory items. These values should be suffcient for
@@ -163,7 +198,11 @@
 / Drive/Volume Configurations
 /---------------------------------------------------------------------------*/
 
+#if FF_PROFILE == 3
+#define FF_VOLUMES		2
+#else
 #define FF_VOLUMES		1
+#endif
 /* Number of volumes (logical drives) to be used. (1-10) */
 
 
@@ -181,7 +220,11 @@
 */
 
 
+#if FF_PROFILE == 3
+#define FF_MULTI_PARTITION	1
+#else
 #define FF_MULTI_PARTITION	0
+#endif
 /* This option switches support for multiple volumes on the physical drive.
 /  By default (0), each logical drive number is bound to the same physical drive
 /  number and only an FAT volume found on the physical drive will be mounted.
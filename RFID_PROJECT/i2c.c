@@ -2,30 +2,57 @@
 #include <stm32f10x_i2c.h>
 #include <stm32f10x_rcc.h>
 #include <stm32f10x_gpio.h>
+#include <stm32f10x_dma.h>
 
-#include "I2C.h"
+#include "i2c.h"
+#include "delay.h"
+
+static Status I2C_Transfer(uint8_t Address, uint8_t u8Dir, uint8_t *pData, uint16_t length);
+static void I2C_ApplySpeed(uint32_t u32Hz);
 
 void My_I2C_Init(void)
 {
-	lib_I2C_LowLevel_Init(I2C1, 100000, 0x00);
+	NVIC_InitTypeDef NVIC_InitStructure;
+
+	lib_I2C_LowLevel_Init(I2C1, I2C_SPEED_STANDARD, 0x00);
+	I2C_ApplySpeed(I2C_SPEED_STANDARD);
+
+	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+	DMA_ITConfig(DMA1_Channel7, DMA_IT_TC, ENABLE);
+
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0;
+	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_InitStructure.NVIC_IRQChannel = I2C1_EV_IRQn;
+	NVIC_Init(&NVIC_InitStructure);
+	NVIC_InitStructure.NVIC_IRQChannel = I2C1_ER_IRQn;
+	NVIC_Init(&NVIC_InitStructure);
+	NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel7_IRQn;
+	NVIC_Init(&NVIC_InitStructure);
 }
 
-uint8_t I2C_Write(uint8_t Address, uint8_t *pData, uint8_t length)
+/* Blocking wrappers, the CPU sleeps while the transaction runs */
+uint8_t I2C_Write(uint8_t Address, uint8_t *pData, uint16_t length)
 {
-	return lib_I2C_Write(I2C1, pData, length, Address);
+	return I2C_Transfer(Address, I2C_XFER_WRITE, pData, length);
 }
 
-uint8_t I2C_Read(uint8_t Address, uint8_t *pData, uint8_t length)
+uint8_t I2C_Read(uint8_t Address, uint8_t *pData, uint16_t length)
 {
-	return lib_I2C_Read(I2C1, pData, length, Address);
+	return I2C_Transfer(Address, I2C_XFER_READ, pData, length);
 }
 
-#define Timed(x) Timeout = 0xFFFF; while (x) { if (Timeout-- == 0) goto errReturn;}
+#define I2C_DMA_TX			DMA1_Channel6
+#define I2C_DMA_RX			DMA1_Channel7
+#define I2C_SCL_PIN			GPIO_Pin_6
+#define I2C_SDA_PIN			GPIO_Pin_7
+#define I2C_RECOVER_HALF_US	5		/* Half SCL period of the recovery clock, 100 kHz */
+#define I2C_FAST_MIN_PCLK1	4000000	/* Lowest APB1 clock of fast mode */
 
 /* 
  *  See AN2824 STM32F10xxx I2C optimized examples
  *
- *  This code implements polling based solution
+ *  This code implements the interrupt + DMA solution
  *
  */
 
@@ -41,188 +68,595 @@ uint8_t I2C_Read(uint8_t Address, uint8_t *pData, uint8_t length)
  *     
  **/
 
-
-
 /*
- *  Read process is documented in RM008
+ *  Transfer modes
  *
- *   There are three cases  -- read  1 byte  AN2824 Figure 2 
- *                             read  2 bytes AN2824 Figure 2
- *                             read >2 bytes AN2824 Figure 1
- */  
+ *   write 1 byte   TXE interrupt, STOP on BTF (EV8_2)
+ *   write >1 bytes DMA feeds DR, STOP on BTF once the DMA counter is 0
+ *   read  1 byte   EV6_1: clear ACK, clear ADDR and program STOP atomically,
+ *                  then RXNE interrupt -- AN2824 Figure 2
+ *   read  >1 bytes DMA with LAST set so the last byte is NACKed,
+ *                  STOP from the DMA transfer complete interrupt
+ *
+ *  The event and error interrupts and the DMA RX interrupt run at the
+ *  highest priority, the EV6_1 sequence is still done with IRQs masked
+ *  as AN2824 requires.
+ */
 
-Status lib_I2C_Read(I2C_TypeDef* I2Cx, uint8_t *buf,uint32_t nbyte, uint8_t SlaveAddress)
+static I2C_Xfer_t *XferQueue[I2C_QUEUE_LEN];
+static uint8_t u8QHead;
+static uint8_t u8QTail;
+static I2C_Xfer_t *volatile pCur;		/* Transaction on the bus */
+
+typedef struct {
+	uint8_t u8Addr;
+	uint8_t u8Errors;					/* Failed transactions in a row */
+	uint32_t u32Hz;
+} I2C_Device_t;
+
+static I2C_Device_t Devices[I2C_MAX_DEVICES];
+static uint8_t u8Devices;
+static uint32_t u32BusHz;				/* Rate the timing registers are set for */
+static uint32_t u32XferTick;			/* Start of the transaction on the bus */
+static uint32_t u32XferLimit;			/* ms it may take, grows with the length */
+static volatile uint8_t u8Recovering;	/* Holds the queue while the bus is recovered */
+static uint8_t u8IdleBusy;				/* BUSY seen with the bus idle */
+static uint32_t u32IdleBusyTick;
+static I2C_Stats_t Stats;
+
+/* Rates tried by I2C_Probe and stepped down through on errors, highest first */
+static const uint32_t u32Rates[] = {I2C_SPEED_FAST, 200000, I2C_SPEED_STANDARD};
+
+static void I2C_StartNext(void);
+
+static I2C_Device_t *I2C_FindDevice(uint8_t Address)
 {
-  __IO uint32_t Timeout = 0;
-
-  //    I2Cx->CR2 |= I2C_IT_ERR;  interrupts for errors 
-
-  if (!nbyte)
-    return Success;
-
+	uint8_t i;
 
+	for (i = 0; i < u8Devices; i++) {
+		if (Devices[i].u8Addr == (Address & 0xFE)) {
+			return &Devices[i];
+		}
+	}
+	return 0;
+}
 
-  // Wait for idle I2C interface
+static uint32_t I2C_LowerRate(uint32_t u32Hz)
+{
+	uint8_t i;
 
-  Timed(I2C_GetFlagStatus(I2Cx, I2C_FLAG_BUSY));
+	for (i = 0; i < sizeof(u32Rates) / sizeof(u32Rates[0]); i++) {
+		if (u32Rates[i] < u32Hz) {
+			return u32Rates[i];
+		}
+	}
+	return I2C_SPEED_STANDARD;
+}
 
-  // Enable Acknowledgement, clear POS flag
+/*
+ * CCR and TRISE for a rate, see RM0008 I2C_CCR / I2C_TRISE
+ *
+ *   standard  Thigh = Tlow = CCR * Tpclk1, rise time 1000 ns
+ *   fast      duty 2:    Thigh = CCR * Tpclk1,  Tlow = 2 * Thigh
+ *             duty 16/9: Thigh = 9 * CCR * Tpclk1, Tlow = 16 * CCR * Tpclk1
+ *             rise time 300 ns
+ *
+ * CCR is rounded up so SCL never runs above the rate asked for. Only
+ * PCLK1 at a multiple of 10 MHz gives exactly 400 kHz with 16/9, so in
+ * fast mode the duty cycle that comes closer is used. Fast mode needs
+ * PCLK1 at 4 MHz or more (I2C_CR2 FREQ), below it the bus runs standard.
+ */
+static void I2C_CalcTiming(uint32_t u32Pclk1, uint32_t u32Hz, uint16_t *pu16Ccr, uint16_t *pu16Trise)
+{
+	uint32_t u32FreqMhz = u32Pclk1 / 1000000;
+	uint32_t u32Ccr;
+	uint32_t u32Ccr169;
 
-  I2C_AcknowledgeConfig(I2Cx, ENABLE);
-  I2C_NACKPositionConfig(I2Cx, I2C_NACKPosition_Current);
+	if (u32Pclk1 < I2C_FAST_MIN_PCLK1 && u32Hz > I2C_SPEED_STANDARD) {
+		u32Hz = I2C_SPEED_STANDARD;
+	}
+	if (u32Hz <= I2C_SPEED_STANDARD) {
+		u32Ccr = (u32Pclk1 + 2 * u32Hz - 1) / (2 * u32Hz);
+		if (u32Ccr < 4) {
+			u32Ccr = 4;
+		}
+		if (u32Ccr > I2C_CCR_CCR) {
+			u32Ccr = I2C_CCR_CCR;
+		}
+		*pu16Trise = u32FreqMhz + 1;
+	} else {
+		u32Ccr = (u32Pclk1 + 3 * u32Hz - 1) / (3 * u32Hz);
+		u32Ccr169 = (u32Pclk1 + 25 * u32Hz - 1) / (25 * u32Hz);
+		if (u32Ccr169 < 1) {
+			u32Ccr169 = 1;
+		}
+		if (25 * u32Ccr169 <= 3 * u32Ccr) {
+			u32Ccr = u32Ccr169 | I2C_CCR_DUTY;
+		}
+		u32Ccr |= I2C_CCR_FS;
+		*pu16Trise = u32FreqMhz * 300 / 1000 + 1;
+	}
+	*pu16Ccr = u32Ccr;
+}
 
-  // Intiate Start Sequence (wait for EV5
+/* Reprogram the bus timing, only between transactions */
+static void I2C_ApplySpeed(uint32_t u32Hz)
+{
+	RCC_ClocksTypeDef Clocks;
+	uint16_t u16Ccr;
+	uint16_t u16Trise;
 
-  I2C_GenerateSTART(I2Cx, ENABLE);
-  Timed(!I2C_CheckEvent(I2Cx, I2C_EVENT_MASTER_MODE_SELECT));
+	RCC_GetClocksFreq(&Clocks);
+	I2C_CalcTiming(Clocks.PCLK1_Frequency, u32Hz, &u16Ccr, &u16Trise);
 
-  // Send Address
+	// CCR and TRISE can only be written with the peripheral disabled
 
-  I2C_Send7bitAddress(I2Cx, SlaveAddress, I2C_Direction_Receiver);
+	I2C_Cmd(I2C1, DISABLE);
+	I2C1->CCR = u16Ccr;
+	I2C1->TRISE = u16Trise;
+	I2C_Cmd(I2C1, ENABLE);
+	u32BusHz = u32Hz;
+}
 
-  // EV6
-  
-  Timed(!I2C_GetFlagStatus(I2Cx, I2C_FLAG_ADDR));
+Status I2C_SetSpeed(uint8_t Address, uint32_t u32Hz)
+{
+	uint32_t u32Primask = __get_PRIMASK();
+	I2C_Device_t *pDev;
+	Status eResult = Success;
 
-  if (nbyte == 1)
-    {
+	if (u32Hz > I2C_SPEED_FAST) {
+		u32Hz = I2C_SPEED_FAST;
+	}
 
-      // Clear Ack bit      
+	__disable_irq();
+	pDev = I2C_FindDevice(Address);
+	if (!pDev && u8Devices < I2C_MAX_DEVICES) {
+		pDev = &Devices[u8Devices++];
+		pDev->u8Addr = Address & 0xFE;
+	}
+	if (pDev) {
+		pDev->u32Hz = u32Hz;
+		pDev->u8Errors = 0;
+	} else {
+		eResult = Error;
+	}
+	__set_PRIMASK(u32Primask);
+	return eResult;
+}
 
-      I2C_AcknowledgeConfig(I2Cx, DISABLE);       
+uint32_t I2C_GetSpeed(uint8_t Address)
+{
+	I2C_Device_t *pDev = I2C_FindDevice(Address);
 
-      // EV6_1 -- must be atomic -- Clear ADDR, generate STOP
+	return pDev ? pDev->u32Hz : I2C_SPEED_STANDARD;
+}
 
-      __disable_irq();
-      (void) I2Cx->SR2;                           
-      I2C_GenerateSTOP(I2Cx,ENABLE);      
-      __enable_irq();
+uint32_t I2C_Probe(uint8_t Address, uint32_t u32MaxHz)
+{
+	uint8_t u8Data;
+	uint8_t i, j;
+
+	for (i = 0; i < sizeof(u32Rates) / sizeof(u32Rates[0]); i++) {
+		if (u32Rates[i] > u32MaxHz) {
+			continue;
+		}
+		if (I2C_SetSpeed(Address, u32Rates[i]) != Success) {
+			return 0;
+		}
+		for (j = 0; j < I2C_PROBE_TRIES; j++) {
+			if (I2C_Read(Address, &u8Data, 1) != Success) {
+				break;
+			}
+		}
+		if (j == I2C_PROBE_TRIES) {
+			return u32Rates[i];
+		}
+	}
+	I2C_SetSpeed(Address, I2C_SPEED_STANDARD);
+	return 0;
+}
 
-      // Receive data   EV7
+static void I2C_DmaSetup(DMA_Channel_TypeDef *Channel, uint32_t u32Dir, uint8_t *pData, uint16_t u16Len)
+{
+	DMA_InitTypeDef DMA_InitStructure;
+
+	DMA_Cmd(Channel, DISABLE);
+	DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&I2C1->DR;
+	DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)pData;
+	DMA_InitStructure.DMA_DIR = u32Dir;
+	DMA_InitStructure.DMA_BufferSize = u16Len;
+	DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+	DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+	DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+	DMA_InitStructure.DMA_Priority = DMA_Priority_VeryHigh;
+	DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+	DMA_Init(Channel, &DMA_InitStructure);
+	DMA_Cmd(Channel, ENABLE);
+}
 
-      Timed(!I2C_GetFlagStatus(I2Cx, I2C_FLAG_RXNE));
-      *buf++ = I2C_ReceiveData(I2Cx);
+/* End the current transaction and start the next one, called with the I2C interrupts blocked */
+static void I2C_Finish(Status eResult)
+{
+	I2C_Xfer_t *pXfer = pCur;
+	I2C_Device_t *pDev;
+	void (*pfDone)(I2C_Xfer_t *pXfer);
+
+	I2C_ITConfig(I2C1, I2C_IT_EVT | I2C_IT_BUF | I2C_IT_ERR, DISABLE);
+	I2C_DMACmd(I2C1, DISABLE);
+	I2C_DMALastTransferCmd(I2C1, DISABLE);
+	DMA_Cmd(I2C_DMA_TX, DISABLE);
+	DMA_Cmd(I2C_DMA_RX, DISABLE);
+	pCur = 0;
+
+	if (pXfer) {
+		// A NACK to an address only write is a busy device, not a bad bus
+
+		pDev = I2C_FindDevice(pXfer->u8Addr);
+		if (pDev && pXfer->u16Len) {
+			if (eResult == Success) {
+				pDev->u8Errors = 0;
+			} else if (++pDev->u8Errors >= I2C_FALLBACK_ERRORS && pDev->u32Hz > I2C_SPEED_STANDARD) {
+				pDev->u32Hz = I2C_LowerRate(pDev->u32Hz);
+				pDev->u8Errors = 0;
+			}
+		}
+
+		pfDone = pXfer->pfDone;
+		pXfer->eResult = eResult;
+		pXfer->u8Busy = 0;
+		if (pfDone) {
+			pfDone(pXfer);
+		}
+	}
+	I2C_StartNext();
+}
 
-    }
-  else if (nbyte == 2)
-    {
-      // Set POS flag
+static void I2C_StartNext(void)
+{
+	I2C_Xfer_t *pXfer;
+
+	while (!pCur && !u8Recovering && u8QTail != u8QHead) {
+		// The STOP of the previous transaction must be on the bus before the
+		// next START. Its end raises no interrupt in master mode, I2C_Watchdog
+		// starts the transaction instead of spinning here in the ISR
+
+		if (I2C1->CR1 & I2C_CR1_STOP) {
+			return;
+		}
+		pXfer = XferQueue[u8QTail];
+		u8QTail = (u8QTail + 1) % I2C_QUEUE_LEN;
+		if (!pXfer) {
+			continue;						/* Aborted while queued */
+		}
+		if (!pXfer->u16Len && pXfer->u8Dir == I2C_XFER_READ) {
+			pXfer->eResult = Success;
+			pXfer->u8Busy = 0;
+			if (pXfer->pfDone) {
+				pXfer->pfDone(pXfer);
+			}
+			continue;
+		}
+		pCur = pXfer;
+		++Stats.u32Transfers;
+
+		if (I2C_GetSpeed(pXfer->u8Addr) != u32BusHz) {
+			I2C_ApplySpeed(I2C_GetSpeed(pXfer->u8Addr));
+		}
+		u32XferTick = Delay_GetTick();
+		u32XferLimit = I2C_TIMEOUT_MS + pXfer->u16Len * 9 / (u32BusHz / 1000);
+
+		I2C_NACKPositionConfig(I2C1, I2C_NACKPosition_Current);
+		I2C_AcknowledgeConfig(I2C1, ENABLE);
+
+		if (pXfer->u16Len >= 2) {
+			if (pXfer->u8Dir == I2C_XFER_READ) {
+				I2C_DmaSetup(I2C_DMA_RX, DMA_DIR_PeripheralSRC, pXfer->pData, pXfer->u16Len);
+				I2C_DMALastTransferCmd(I2C1, ENABLE);
+			} else {
+				I2C_DmaSetup(I2C_DMA_TX, DMA_DIR_PeripheralDST, pXfer->pData, pXfer->u16Len);
+			}
+			I2C_DMACmd(I2C1, ENABLE);
+			I2C_ITConfig(I2C1, I2C_IT_EVT | I2C_IT_ERR, ENABLE);
+		} else if (pXfer->u16Len) {
+			I2C_ITConfig(I2C1, I2C_IT_EVT | I2C_IT_BUF | I2C_IT_ERR, ENABLE);
+		} else {
+			I2C_ITConfig(I2C1, I2C_IT_EVT | I2C_IT_ERR, ENABLE);
+		}
+
+		I2C_GenerateSTART(I2C1, ENABLE);
+	}
+}
 
-      I2C_NACKPositionConfig(I2Cx, I2C_NACKPosition_Next);
+Status I2C_Submit(I2C_Xfer_t *pXfer)
+{
+	uint32_t u32Primask = __get_PRIMASK();
+	uint8_t u8Next;
+	Status eResult = Error;
+
+	pXfer->u8Busy = 1;
+	__disable_irq();
+	u8Next = (u8QHead + 1) % I2C_QUEUE_LEN;
+	if (u8Next != u8QTail) {
+		XferQueue[u8QHead] = pXfer;
+		u8QHead = u8Next;
+		eResult = Success;
+		I2C_StartNext();
+	}
+	__set_PRIMASK(u32Primask);
 
-      // EV6_1 -- must be atomic and in this order
+	if (eResult != Success) {
+		pXfer->u8Busy = 0;
+		pXfer->eResult = Error;
+	}
+	return eResult;
+}
 
-      __disable_irq();
-      (void) I2Cx->SR2;                           // Clear ADDR flag
-      I2C_AcknowledgeConfig(I2Cx, DISABLE);       // Clear Ack bit
-      __enable_irq();
+void I2C_Abort(I2C_Xfer_t *pXfer)
+{
+	uint32_t u32Primask = __get_PRIMASK();
+	uint8_t i;
+
+	__disable_irq();
+	if (pCur == pXfer) {
+		I2C_GenerateSTOP(I2C1, ENABLE);
+		I2C_Finish(Error);
+	} else if (pXfer->u8Busy) {
+		for (i = 0; i < I2C_QUEUE_LEN; i++) {
+			if (XferQueue[i] == pXfer) {
+				XferQueue[i] = 0;
+			}
+		}
+		pXfer->eResult = Error;
+		pXfer->u8Busy = 0;
+	}
+	__set_PRIMASK(u32Primask);
+}
 
-      // EV7_3  -- Wait for BTF, program stop, read data twice
+void I2C1_EV_IRQHandler(void)
+{
+	I2C_Xfer_t *pXfer = pCur;
+	uint16_t u16SR1 = I2C1->SR1;
 
-      Timed(!I2C_GetFlagStatus(I2Cx, I2C_FLAG_BTF));
+	if (!pXfer) {
+		I2C_ITConfig(I2C1, I2C_IT_EVT | I2C_IT_BUF, DISABLE);
+		return;
+	}
 
-      __disable_irq();
-      I2C_GenerateSTOP(I2Cx,ENABLE);
-      *buf++ = I2Cx->DR;
-      __enable_irq();
+	// EV5 -- send address
 
-      *buf++ = I2Cx->DR;
+	if (u16SR1 & I2C_SR1_SB) {
+		I2C_Send7bitAddress(I2C1, pXfer->u8Addr,
+			(pXfer->u8Dir == I2C_XFER_READ) ? I2C_Direction_Receiver : I2C_Direction_Transmitter);
+		return;
+	}
 
-    }
-  else 
-    {
-      (void) I2Cx->SR2;                           // Clear ADDR flag
-      while (nbyte-- != 3)
-	{
-	  // EV7 -- cannot guarantee 1 transfer completion time, wait for BTF 
-          //        instead of RXNE
+	// EV6
 
-	  Timed(!I2C_GetFlagStatus(I2Cx, I2C_FLAG_BTF)); 
-	  *buf++ = I2C_ReceiveData(I2Cx);
+	if (u16SR1 & I2C_SR1_ADDR) {
+		if (pXfer->u8Dir == I2C_XFER_READ && pXfer->u16Len == 1) {
+
+			// EV6_1 -- must be atomic -- Clear ADDR, generate STOP
+
+			I2C_AcknowledgeConfig(I2C1, DISABLE);
+			__disable_irq();
+			(void) I2C1->SR2;
+			I2C_GenerateSTOP(I2C1, ENABLE);
+			__enable_irq();
+		} else {
+			(void) I2C1->SR2;
+			if (!pXfer->u16Len) {
+				// Address only write, the device is there and ready
+				I2C_GenerateSTOP(I2C1, ENABLE);
+				I2C_Finish(Success);
+			}
+		}
+		return;
 	}
 
-      Timed(!I2C_GetFlagStatus(I2Cx, I2C_FLAG_BTF));  
-
-      // EV7_2 -- Figure 1 has an error, doesn't read N-2 !
+	if (pXfer->u8Dir == I2C_XFER_READ) {
 
-      I2C_AcknowledgeConfig(I2Cx, DISABLE);           // clear ack bit
+		// EV7 -- single byte read, DMA handles the rest
 
-      __disable_irq();
-      *buf++ = I2C_ReceiveData(I2Cx);             // receive byte N-2
-      I2C_GenerateSTOP(I2Cx,ENABLE);                  // program stop
-      __enable_irq();
+		if ((u16SR1 & I2C_SR1_RXNE) && pXfer->u16Len == 1) {
+			pXfer->pData[0] = I2C_ReceiveData(I2C1);
+			I2C_Finish(Success);
+		}
+		return;
+	}
 
-      *buf++ = I2C_ReceiveData(I2Cx);             // receive byte N-1
+	// EV8_2 -- last byte shifted out
 
-      // wait for byte N
+	if ((u16SR1 & I2C_SR1_BTF) && (pXfer->u16Len == 1 || DMA_GetCurrDataCounter(I2C_DMA_TX) == 0)) {
+		I2C_GenerateSTOP(I2C1, ENABLE);
+		I2C_Finish(Success);
+		return;
+	}
 
-      Timed(!I2C_CheckEvent(I2Cx, I2C_EVENT_MASTER_BYTE_RECEIVED)); 
-      *buf++ = I2C_ReceiveData(I2Cx);
+	// EV8_1 -- single byte write
 
-      nbyte = 0;
+	if ((u16SR1 & I2C_SR1_TXE) && pXfer->u16Len == 1) {
+		I2C_SendData(I2C1, pXfer->pData[0]);
+		I2C_ITConfig(I2C1, I2C_IT_BUF, DISABLE);
+	}
+}
 
-    }
+void I2C1_ER_IRQHandler(void)
+{
+	uint16_t u16SR1 = I2C1->SR1;
 
-  // Wait for stop
+	if (u16SR1 & I2C_SR1_AF) {
+		++Stats.u32Nacks;
+	}
+	if (u16SR1 & I2C_SR1_ARLO) {
+		++Stats.u32ArbLost;
+	}
+	if (u16SR1 & (I2C_SR1_BERR | I2C_SR1_OVR | I2C_SR1_TIMEOUT)) {
+		++Stats.u32BusErrors;
+	}
 
-  Timed(I2C_GetFlagStatus(I2Cx, I2C_FLAG_STOPF));
-  return Success;
+	// Error flags are cleared by writing 0
 
- errReturn:
+	I2C1->SR1 = (uint16_t)~(u16SR1 & (I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_AF | I2C_SR1_OVR | I2C_SR1_TIMEOUT));
 
-  // Any cleanup here
-  return Error;
+	// NACK: the master still owns the bus and has to release it. ARLO: it does not
 
+	if (u16SR1 & (I2C_SR1_AF | I2C_SR1_BERR)) {
+		I2C_GenerateSTOP(I2C1, ENABLE);
+	}
+	I2C_Finish(Error);
 }
 
-/*
- * Read buffer of bytes -- AN2824 Figure 3
- */
-
-Status lib_I2C_Write(I2C_TypeDef* I2Cx, const uint8_t* buf,  uint32_t nbyte, uint8_t SlaveAddress)
+void DMA1_Channel7_IRQHandler(void)
 {
-    __IO uint32_t Timeout = 0;
+	if (DMA_GetITStatus(DMA1_IT_TC7) != RESET) {
+		DMA_ClearITPendingBit(DMA1_IT_TC7);
 
-    /* Enable Error IT (used in all modes: DMA, Polling and Interrupts */
-    //    I2Cx->CR2 |= I2C_IT_ERR;
+		// Last byte NACKed through LAST, program STOP
 
-    if (nbyte)
-      {
-	Timed(I2C_GetFlagStatus(I2Cx, I2C_FLAG_BUSY));
+		I2C_GenerateSTOP(I2C1, ENABLE);
+		I2C_Finish(Success);
+	}
+}
 
-	// Intiate Start Sequence
+static Status I2C_Transfer(uint8_t Address, uint8_t u8Dir, uint8_t *pData, uint16_t length)
+{
+	I2C_Xfer_t Xfer;
+
+	Xfer.u8Addr = Address;
+	Xfer.u8Dir = u8Dir;
+	Xfer.pData = pData;
+	Xfer.u16Len = length;
+	Xfer.pfDone = 0;
+	if (I2C_Submit(&Xfer) != Success) {
+		return Error;
+	}
 
-	I2C_GenerateSTART(I2Cx, ENABLE);
-	Timed(!I2C_CheckEvent(I2Cx, I2C_EVENT_MASTER_MODE_SELECT));
+	// A hung transaction, ours or one queued before it, ends through the watchdog.
+	// A START held back for a STOP has no interrupt to wake on, poll it
 
-	// Send Address  EV5
+	while (Xfer.u8Busy) {
+		I2C_Watchdog();
+		if (pCur) {
+			__WFI();
+		} else {
+			Delay_Us(1);
+		}
+	}
+	return Xfer.eResult;
+}
 
-	I2C_Send7bitAddress(I2Cx, SlaveAddress, I2C_Direction_Transmitter);
-	Timed(!I2C_CheckEvent(I2Cx, I2C_EVENT_MASTER_TRANSMITTER_MODE_SELECTED));
+/*
+ *  Bus recovery
+ *
+ *  A slave reset or glitched in the middle of a read keeps SDA low until
+ *  it has clocked out the rest of its byte. With the pins as GPIO, SCL is
+ *  pulsed until SDA is released (9 pulses at most), then a STOP is sent.
+ *  The peripheral is reset afterwards, this also clears a BUSY flag latched
+ *  by the analog filter (see the F10x errata sheet).
+ *
+ *  Takes about 100 us, runs in thread context with the queue held.
+ */
+void I2C_Recover(void)
+{
+	GPIO_InitTypeDef GPIO_InitStructure;
+	uint32_t u32Primask = __get_PRIMASK();
+	uint8_t i;
+
+	__disable_irq();
+	u8Recovering = 1;
+	if (pCur) {
+		I2C_Finish(Error);
+	}
+	__set_PRIMASK(u32Primask);
+
+	I2C_Cmd(I2C1, DISABLE);
+	GPIO_SetBits(GPIOB, I2C_SCL_PIN | I2C_SDA_PIN);
+	GPIO_InitStructure.GPIO_Pin = I2C_SCL_PIN | I2C_SDA_PIN;
+	GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+	GPIO_InitStructure.GPIO_Mode = GPIO_Mode_Out_OD;
+	GPIO_Init(GPIOB, &GPIO_InitStructure);
+	Delay_Us(I2C_RECOVER_HALF_US);
+
+	for (i = 0; i < 9 && !GPIO_ReadInputDataBit(GPIOB, I2C_SDA_PIN); i++) {
+		GPIO_ResetBits(GPIOB, I2C_SCL_PIN);
+		Delay_Us(I2C_RECOVER_HALF_US);
+		GPIO_SetBits(GPIOB, I2C_SCL_PIN);
+		Delay_Us(I2C_RECOVER_HALF_US);
+	}
 
-	// EV6
+	// STOP: SDA rises while SCL is high
 
-	// Write first byte EV8_1
+	GPIO_ResetBits(GPIOB, I2C_SCL_PIN);
+	Delay_Us(I2C_RECOVER_HALF_US);
+	GPIO_ResetBits(GPIOB, I2C_SDA_PIN);
+	Delay_Us(I2C_RECOVER_HALF_US);
+	GPIO_SetBits(GPIOB, I2C_SCL_PIN);
+	Delay_Us(I2C_RECOVER_HALF_US);
+	GPIO_SetBits(GPIOB, I2C_SDA_PIN);
+	Delay_Us(I2C_RECOVER_HALF_US);
 
-	I2C_SendData(I2Cx, *buf++);
+	if (!GPIO_ReadInputDataBit(GPIOB, I2C_SDA_PIN)) {
+		++Stats.u32StuckSda;
+	}
 
-	while (--nbyte) {
+	I2C_SoftwareResetCmd(I2C1, ENABLE);
+	I2C_SoftwareResetCmd(I2C1, DISABLE);
+	lib_I2C_LowLevel_Init(I2C1, I2C_SPEED_STANDARD, 0x00);
+	I2C_ApplySpeed(u32BusHz);
+	++Stats.u32Recoveries;
+	u8IdleBusy = 0;
+
+	__disable_irq();
+	u8Recovering = 0;
+	I2C_StartNext();
+	__set_PRIMASK(u32Primask);
+}
 
-	  // wait on BTF
+void I2C_Watchdog(void)
+{
+	uint32_t u32Primask = __get_PRIMASK();
+	uint8_t u8Stuck = 0;
 
-	  Timed(!I2C_GetFlagStatus(I2Cx, I2C_FLAG_BTF));  
-	  I2C_SendData(I2Cx, *buf++);
+	__disable_irq();
+	if (!pCur) {
+		I2C_StartNext();					/* Held back for the STOP of the last one */
+	}
+	if (pCur) {
+		u8IdleBusy = 0;						/* The STOP seen pending went out */
+		if (Delay_GetTick() - u32XferTick >= u32XferLimit) {
+			++Stats.u32Timeouts;
+			u8Stuck = 1;
+		}
+	} else if ((I2C1->SR2 & I2C_SR2_BUSY) || (I2C1->CR1 & I2C_CR1_STOP)) {
+		// Idle but BUSY, or a STOP that never got onto the bus, for more than
+		// a tick rules out a STOP still in progress
+
+		if (!u8IdleBusy) {
+			u8IdleBusy = 1;
+			u32IdleBusyTick = Delay_GetTick();
+		} else if (Delay_GetTick() - u32IdleBusyTick >= 2) {
+			u8Stuck = 1;
+		}
+	} else {
+		u8IdleBusy = 0;
 	}
+	__set_PRIMASK(u32Primask);
 
-	Timed(!I2C_GetFlagStatus(I2Cx, I2C_FLAG_BTF));  
-	I2C_GenerateSTOP(I2Cx, ENABLE);
-	Timed(I2C_GetFlagStatus(I2C1, I2C_FLAG_STOPF));
-      }
-    return Success;
- errReturn:
-    return Error;
+	if (u8Stuck) {
+		I2C_Recover();
+	}
 }
 
+void I2C_GetStats(I2C_Stats_t *pStats)
+{
+	uint32_t u32Primask = __get_PRIMASK();
+
+	__disable_irq();
+	*pStats = Stats;
+	__set_PRIMASK(u32Primask);
+}
 
 void lib_I2C_LowLevel_Init(I2C_TypeDef* I2Cx, int ClockSpeed, int OwnAddress)
 {
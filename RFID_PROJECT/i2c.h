@@ -5,12 +5,81 @@
 
 typedef enum {Error = 0, Success = !Error } Status;
 
+/*
+ * I2C1 master driven by the event/error interrupts, payloads of 2 bytes
+ * or more are moved by DMA1 channel 6 (TX) and 7 (RX). Transactions are
+ * queued and run one after the other, pfDone is called from interrupt
+ * context when one ends.
+ */
+#define I2C_QUEUE_LEN		8
+#define I2C_TIMEOUT_MS		20		/* Allowed on top of the byte time of a transaction */
+
+#define I2C_XFER_WRITE		0
+#define I2C_XFER_READ		1
+
+/*
+ * Bus speed is chosen per device and the timing is reprogrammed between
+ * transactions when the next device runs at another rate. Devices not
+ * registered run at I2C_SPEED_STANDARD. Fast mode uses duty 2 unless the
+ * 16/9 duty cycle gets at least as close to the rate, see I2C_CalcTiming.
+ * The F1 I2C has no Fm+ drive, requests above 400 kHz are clamped.
+ */
+#define I2C_SPEED_STANDARD	100000
+#define I2C_SPEED_FAST		400000
+#define I2C_MAX_DEVICES		4
+#define I2C_PROBE_TRIES		8		/* Reads that must all pass for a rate to be kept */
+#define I2C_FALLBACK_ERRORS	3		/* Errors in a row before a device drops to the next lower rate */
+
+typedef struct I2C_Xfer {
+	uint8_t u8Addr;						/* 8 bit address, bit 0 is ignored */
+	uint8_t u8Dir;						/* I2C_XFER_WRITE or I2C_XFER_READ */
+	uint8_t *pData;
+	uint16_t u16Len;					/* A 0 byte write only sends the address, for ACK polling */
+	void (*pfDone)(struct I2C_Xfer *pXfer);
+	volatile uint8_t u8Busy;			/* Set by I2C_Submit, cleared when done */
+	Status eResult;
+} I2C_Xfer_t;
+
 void My_I2C_Init(void);
-uint8_t I2C_Write(uint8_t Address, uint8_t *pData, uint8_t length);
-uint8_t I2C_Read(uint8_t Address, uint8_t *pData, uint8_t length);
+uint8_t I2C_Write(uint8_t Address, uint8_t *pData, uint16_t length);
+uint8_t I2C_Read(uint8_t Address, uint8_t *pData, uint16_t length);
+
+/* Queue a transaction, the descriptor and data must stay valid until u8Busy clears */
+Status I2C_Submit(I2C_Xfer_t *pXfer);
+void I2C_Abort(I2C_Xfer_t *pXfer);
+
+/* Bus health, kept since init */
+typedef struct {
+	uint32_t u32Transfers;
+	uint32_t u32Nacks;
+	uint32_t u32ArbLost;
+	uint32_t u32BusErrors;				/* BERR, OVR, TIMEOUT */
+	uint32_t u32Timeouts;				/* Transactions that overran their byte time + I2C_TIMEOUT_MS */
+	uint32_t u32Recoveries;
+	uint32_t u32StuckSda;				/* Recoveries after which SDA was still low */
+} I2C_Stats_t;
+
+/* Register a device at a rate, returns Error when the device table is full */
+Status I2C_SetSpeed(uint8_t Address, uint32_t u32Hz);
+uint32_t I2C_GetSpeed(uint8_t Address);
+
+/*
+ * Find the highest rate a device answers reliably at, starting at u32MaxHz.
+ * Every try is a 1 byte read, only use it on devices where a read has no
+ * side effects. Returns the rate kept, 0 if the device never answered.
+ */
+uint32_t I2C_Probe(uint8_t Address, uint32_t u32MaxHz);
+
+/*
+ * Call every few ms from thread context. Starts a queued transaction
+ * held back for the STOP of the one before, which ends without an
+ * interrupt. Recovers the bus when a transaction overruns its byte time
+ * by I2C_TIMEOUT_MS or BUSY stays set while idle.
+ */
+void I2C_Watchdog(void);
+void I2C_Recover(void);
+void I2C_GetStats(I2C_Stats_t *pStats);
 
-Status lib_I2C_Read(I2C_TypeDef* I2Cx, uint8_t* buf, uint32_t nbuf, uint8_t SlaveAddress);
-Status lib_I2C_Write(I2C_TypeDef* I2Cx, const uint8_t* buf, uint32_t nbuf,  uint8_t SlaveAddress);
 void lib_I2C_LowLevel_Init(I2C_TypeDef* I2Cx, int ClockSpeed, int OwnAddress);
 
 #endif
@@ -1,196 +1,209 @@
 #include "i2c.h"
 #include "i2c_lcd.h"
 
-static uint8_t u8LCD_Buff[8];//bo nho dem luu lai toan bo
-static uint8_t u8LcdTmp;
+/*
+ * Every PCF8574 output byte is precomputed: a nibble becomes an EN-high and
+ * an EN-low byte, and a whole string is sent as one I2C transaction. At
+ * 100 kHz one byte takes 90 us, longer than the 37 us a character or
+ * command needs, so the busy flag is not read. Clear waits 2 ms instead.
+ *
+ * A copy of the visible characters is kept, characters that are already
+ * on the display are skipped. I2C_LCD_PutLine rewrites a whole line
+ * without a clear, only the characters that changed go on the bus.
+ */
+
+static uint8_t u8NibbleMap[16];		//nibble -> D4..D7 output bits
+static uint8_t u8LcdBl;				//backlight output bit
+static uint8_t u8LcdSeq[LCD_SEQ_LEN];
+static char szLcdFrame[LCD_ROWS][LCD_COLS];
+static uint8_t u8Row;
+static uint8_t u8Col;
+static uint8_t u8LcdAddrValid;		//the LCD address counter is at u8Row/u8Col
+static uint32_t u32Transfers;
+static uint32_t u32Bytes;
 
 #define	MODE_4_BIT		0x28
 #define	CLR_SCR			0x01
 #define	DISP_ON			0x0C
 #define	CURSOR_ON		0x0E
 #define	CURSOR_HOME		0x80
+#define	LINE_2			0x40
 
-static void I2C_LCD_Write_4bit(uint8_t u8Data);
-static void I2C_LCD_FlushVal(void);
+static void I2C_LCD_Send(uint8_t *pSeq, uint8_t u8Len);
+static uint8_t *I2C_LCD_PutNibble(uint8_t *p, uint8_t u8Nibble, uint8_t u8Rs);
+static uint8_t *I2C_LCD_PutByte(uint8_t *p, uint8_t u8Val, uint8_t u8Rs);
 static void I2C_LCD_WriteCmd(uint8_t u8Cmd);
 
-void I2C_LCD_FlushVal(void)
+void I2C_LCD_Send(uint8_t *pSeq, uint8_t u8Len)
 {
-	uint8_t i;
-	
-	for (i = 0; i < 8; ++i) {
-		u8LcdTmp >>= 1;
-		if(u8LCD_Buff[i]) {
-			u8LcdTmp |= 0x80;
-		}
+	if (u8Len) {
+		I2C_Write(I2C_LCD_ADDR, pSeq, u8Len);
+		++u32Transfers;
+		u32Bytes += u8Len;
+	}
+}
+
+uint8_t *I2C_LCD_PutNibble(uint8_t *p, uint8_t u8Nibble, uint8_t u8Rs)
+{
+	uint8_t u8Out = u8NibbleMap[u8Nibble & 0x0F] | u8LcdBl;
+
+	if (u8Rs) {
+		u8Out |= 1 << LCD_RS;
 	}
-	I2C_Write(I2C_LCD_ADDR, &u8LcdTmp, 1);
+	//data is latched on the falling edge of EN
+	*p++ = u8Out | (1 << LCD_EN);
+	*p++ = u8Out;
+	return p;
+}
+
+uint8_t *I2C_LCD_PutByte(uint8_t *p, uint8_t u8Val, uint8_t u8Rs)
+{
+	p = I2C_LCD_PutNibble(p, u8Val >> 4, u8Rs);
+	return I2C_LCD_PutNibble(p, u8Val, u8Rs);
 }
 
 void I2C_LCD_Init(void)
 {
 	uint8_t i;
-	
+	uint8_t *p;
+
 	I2C_LCD_Delay_Ms(50);
-	
+
 	My_I2C_Init();
-	
-	for (i = 0; i < 8; ++i) {
-		u8LCD_Buff[i] = 0;
+
+	for (i = 0; i < 16; ++i) {
+		u8NibbleMap[i] = ((i & 0x01) ? 1 << LCD_D4 : 0) | ((i & 0x02) ? 1 << LCD_D5 : 0)
+			| ((i & 0x04) ? 1 << LCD_D6 : 0) | ((i & 0x08) ? 1 << LCD_D7 : 0);
 	}
-	
-	I2C_LCD_FlushVal();
-	
-	u8LCD_Buff[LCD_RS] = 0;
-	I2C_LCD_FlushVal();
-	
-	u8LCD_Buff[LCD_RW] = 0;
-	I2C_LCD_FlushVal();
-	
-	I2C_LCD_Write_4bit(0x03);
+	u8LcdBl = 0;
+
+	//all outputs low, RW stays 0 from here on
+	u8LcdSeq[0] = 0;
+	I2C_LCD_Send(u8LcdSeq, 1);
+
+	//8 bit mode reset sequence, then switch to 4 bit
+	p = I2C_LCD_PutNibble(u8LcdSeq, 0x03, 0);
+	I2C_LCD_Send(u8LcdSeq, p - u8LcdSeq);
 	I2C_LCD_Delay_Ms(5);
-	
-	I2C_LCD_Write_4bit(0x03);
-	I2C_LCD_Delay_Ms(1);
-	
-	I2C_LCD_Write_4bit(0x03);
+
+	I2C_LCD_Send(u8LcdSeq, p - u8LcdSeq);
 	I2C_LCD_Delay_Ms(1);
-	
-	I2C_LCD_Write_4bit(MODE_4_BIT >> 4);
+
+	I2C_LCD_Send(u8LcdSeq, p - u8LcdSeq);
 	I2C_LCD_Delay_Ms(1);
-	
-	I2C_LCD_WriteCmd(MODE_4_BIT);
-	I2C_LCD_WriteCmd(DISP_ON);
-	I2C_LCD_WriteCmd(CURSOR_ON);
-	I2C_LCD_WriteCmd(CLR_SCR);
-}
 
-void I2C_LCD_Write_4bit(uint8_t u8Data)
-{
-	//4 bit can ghi chinh la 4 5 6 7
-	//dau tien gan LCD_E=1
-	//ghi du lieu
-	//sau do gan LCD_E=0
+	p = I2C_LCD_PutNibble(u8LcdSeq, MODE_4_BIT >> 4, 0);
+	I2C_LCD_Send(u8LcdSeq, p - u8LcdSeq);
+	I2C_LCD_Delay_Ms(1);
 
-	if(u8Data & 0x08) {
-		u8LCD_Buff[LCD_D7] = 1;
-	} else {
-		u8LCD_Buff[LCD_D7] = 0;
-	}
-	if(u8Data & 0x04) {
-		u8LCD_Buff[LCD_D6] = 1;
-	} else {
-		u8LCD_Buff[LCD_D6] = 0;
-	}
-	if(u8Data & 0x02) {
-		u8LCD_Buff[LCD_D5] = 1;
-	} else {
-		u8LCD_Buff[LCD_D5] = 0;
-	}
-	if(u8Data & 0x01) {
-		u8LCD_Buff[LCD_D4] = 1;
-	} else {
-		u8LCD_Buff[LCD_D4] = 0;
-	}
-	
-	u8LCD_Buff[LCD_EN] = 1;
-	I2C_LCD_FlushVal();	
-	
-	u8LCD_Buff[LCD_EN] = 0;
-	I2C_LCD_FlushVal();
-	
-}
+	p = I2C_LCD_PutByte(u8LcdSeq, MODE_4_BIT, 0);
+	p = I2C_LCD_PutByte(p, DISP_ON, 0);
+	p = I2C_LCD_PutByte(p, CURSOR_ON, 0);
+	I2C_LCD_Send(u8LcdSeq, p - u8LcdSeq);
 
-void LCD_WaitBusy(void)
-{
-	char temp;
-	
-	//dau tien ghi tat ca 4 bit thap bang 1
-	u8LCD_Buff[LCD_D4] = 1;
-	u8LCD_Buff[LCD_D5] = 1;
-	u8LCD_Buff[LCD_D6] = 1;
-	u8LCD_Buff[LCD_D7] = 1;
-	I2C_LCD_FlushVal();
-	
-	u8LCD_Buff[LCD_RS] = 0;
-	I2C_LCD_FlushVal();
-	
-	u8LCD_Buff[LCD_RW] = 1;
-	I2C_LCD_FlushVal();
-	
-	do {
-		u8LCD_Buff[LCD_EN] = 1;
-		I2C_LCD_FlushVal();
-		I2C_Read(I2C_LCD_ADDR + 1, &temp, 1);
-		
-		u8LCD_Buff[LCD_EN] = 0;
-		I2C_LCD_FlushVal();
-		u8LCD_Buff[LCD_EN] = 1;
-		I2C_LCD_FlushVal();
-		u8LCD_Buff[LCD_EN] = 0;
-		I2C_LCD_FlushVal();
-	} while (temp & 0x08);
+	I2C_LCD_Clear();
 }
 
 void I2C_LCD_WriteCmd(uint8_t u8Cmd)
 {
-	
-	LCD_WaitBusy();
-
-	u8LCD_Buff[LCD_RS] = 0;
-	I2C_LCD_FlushVal();
-	
-	u8LCD_Buff[LCD_RW] = 0;
-	I2C_LCD_FlushVal();
-	
-	I2C_LCD_Write_4bit(u8Cmd >> 4);
-	I2C_LCD_Write_4bit(u8Cmd);
-}
+	uint8_t *p;
 
-void LCD_Write_Chr(char chr)
-{
-	
-	LCD_WaitBusy();
-	u8LCD_Buff[LCD_RS] = 1;
-	I2C_LCD_FlushVal();
-	u8LCD_Buff[LCD_RW] = 0;
-	I2C_LCD_FlushVal();
-	I2C_LCD_Write_4bit(chr >> 4);
-	I2C_LCD_Write_4bit(chr);
-	
+	p = I2C_LCD_PutByte(u8LcdSeq, u8Cmd, 0);
+	I2C_LCD_Send(u8LcdSeq, p - u8LcdSeq);
 }
 
 void I2C_LCD_Puts(char *sz)
 {
-	
-	while (1) {
-		if (*sz) {
-			LCD_Write_Chr(*sz++);
+	uint8_t *p = u8LcdSeq;
+	uint8_t u8Synced = u8LcdAddrValid;		//LCD address counter is at u8Row/u8Col
+
+	while (*sz) {
+		if (u8Col < LCD_COLS && szLcdFrame[u8Row][u8Col] == *sz) {
+			u8Synced = 0;
 		} else {
-			break;
+			//room for the character and the address command in front of it
+			if (p + (u8Synced ? 4 : 8) > u8LcdSeq + LCD_SEQ_LEN) {
+				I2C_LCD_Send(u8LcdSeq, p - u8LcdSeq);
+				p = u8LcdSeq;
+			}
+			if (!u8Synced) {
+				p = I2C_LCD_PutByte(p, CURSOR_HOME | (u8Row ? LINE_2 : 0) | u8Col, 0);
+				u8Synced = 1;
+			}
+			p = I2C_LCD_PutByte(p, *sz, 1);
+			if (u8Col < LCD_COLS) {
+				szLcdFrame[u8Row][u8Col] = *sz;
+			}
 		}
+		++u8Col;
+		++sz;
 	}
+	I2C_LCD_Send(u8LcdSeq, p - u8LcdSeq);
+
+	//the address is only sent again in front of the next character written
+	u8LcdAddrValid = u8Synced;
+}
+
+void I2C_LCD_PutLine(uint8_t u8Line, char *sz)
+{
+	char szLine[LCD_COLS + 1];
+	uint8_t i;
+
+	for (i = 0; i < LCD_COLS && sz[i]; ++i) {
+		szLine[i] = sz[i];
+	}
+	for (; i < LCD_COLS; ++i) {
+		szLine[i] = ' ';
+	}
+	szLine[LCD_COLS] = 0;
+
+	u8Row = u8Line ? 1 : 0;
+	u8Col = 0;
+	u8LcdAddrValid = 0;
+	I2C_LCD_Puts(szLine);
 }
 
 void I2C_LCD_Clear(void)
 {
-	
+	uint8_t i, j;
+
 	I2C_LCD_WriteCmd(CLR_SCR);
+	for (i = 0; i < LCD_ROWS; ++i) {
+		for (j = 0; j < LCD_COLS; ++j) {
+			szLcdFrame[i][j] = ' ';
+		}
+	}
+	u8Row = 0;
+	u8Col = 0;
+	u8LcdAddrValid = 1;
+
+	//clear takes 1.52 ms
+	I2C_LCD_Delay_Ms(2);
 }
 
 void I2C_LCD_NewLine(void)
 {
-	
-	I2C_LCD_WriteCmd(0xc0);
+
+	I2C_LCD_WriteCmd(CURSOR_HOME | LINE_2);
+	u8Row = 1;
+	u8Col = 0;
+	u8LcdAddrValid = 1;
 }
 
 void I2C_LCD_BackLight(uint8_t u8BackLight)
 {
-	
+
 	if(u8BackLight) {
-		u8LCD_Buff[LCD_BL] = 1;
+		u8LcdBl = 1 << LCD_BL;
 	} else {
-		u8LCD_Buff[LCD_BL] = 0;
+		u8LcdBl = 0;
 	}
-	I2C_LCD_FlushVal();
+	u8LcdSeq[0] = u8LcdBl;
+	I2C_LCD_Send(u8LcdSeq, 1);
+}
+
+void I2C_LCD_GetStats(uint32_t *pu32Transfers, uint32_t *pu32Bytes)
+{
+	*pu32Transfers = u32Transfers;
+	*pu32Bytes = u32Bytes;
 }
@@ -19,10 +19,17 @@
 #define LCD_D7 7
 #define LCD_BL 3
 
+#define LCD_ROWS 2
+#define LCD_COLS 16
+#define LCD_SEQ_LEN (4 * (LCD_COLS + 1))	/* PCF8574 bytes in one I2C transaction: an address command and a line, 4 each */
+
 void I2C_LCD_Init(void);
 void I2C_LCD_Puts(char *szStr);
+/* Line 0 or 1 from column 0, padded with spaces or cut to LCD_COLS */
+void I2C_LCD_PutLine(uint8_t u8Line, char *szStr);
 void I2C_LCD_Clear(void);
 void I2C_LCD_NewLine(void);
 void I2C_LCD_BackLight(uint8_t u8BackLight);
+void I2C_LCD_GetStats(uint32_t *pu32Transfers, uint32_t *pu32Bytes);
 
 #endif
@@ -0,0 +1,340 @@
+#include "kv_store.h"
+#include "delay.h"
+#include <string.h>
+
+#define KV_KEY_EMPTY			0xFF	/* Erased EEPROM */
+#define KV_LEN_DELETED			0xFF	/* Tombstone, the key was deleted */
+#define KV_SCAN_SLOTS			8		/* Slots read per transaction at boot */
+
+/* One slot, byte arrays so the layout does not depend on the compiler */
+typedef struct {
+	uint8_t u8Key;
+	uint8_t u8Len;
+	uint8_t u8Seq[2];
+	uint8_t u8Data[KV_VALUE_MAX];
+	uint8_t u8Crc[2];					/* CRC-16/CCITT of the bytes before it */
+} KV_Record_t;
+
+typedef struct {
+	uint8_t u8Key;
+	uint8_t u8Len;
+	uint16_t u16Slot;
+	uint16_t u16Seq;
+} KV_Entry_t;
+
+static AT24C32_t* Eeprom;
+static KV_Entry_t Index[KV_MAX_KEYS];
+static uint8_t u8Keys;
+static uint16_t u16Head;				/* Next slot to write */
+static uint16_t u16Tail;				/* Oldest slot that may hold a live record */
+static uint16_t u16Used;				/* Slots from tail to head */
+static uint16_t u16NextSeq;
+static uint8_t u8Ready;
+static KV_Record_t ScanBuf[KV_SCAN_SLOTS];
+static KV_Stats_t Stats;
+
+static uint16_t KV_Crc16(const uint8_t* data, uint8_t len)
+{
+	uint16_t crc = 0xFFFF;
+	uint8_t i;
+
+	while (len--) {
+		crc ^= (uint16_t)*data++ << 8;
+		for (i = 0; i < 8; i++) {
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+static uint8_t KV_RecordValid(const KV_Record_t* rec)
+{
+	uint16_t crc;
+
+	if (rec->u8Key == KV_KEY_EMPTY || rec->u8Key == 0) {
+		return 0;
+	}
+	if (rec->u8Len > KV_VALUE_MAX && rec->u8Len != KV_LEN_DELETED) {
+		return 0;
+	}
+	crc = KV_Crc16((const uint8_t*)rec, KV_SLOT_SIZE - 2);
+	return rec->u8Crc[0] == (uint8_t)crc && rec->u8Crc[1] == (uint8_t)(crc >> 8);
+}
+
+static KV_Entry_t* KV_Find(uint8_t key)
+{
+	uint8_t i;
+
+	for (i = 0; i < u8Keys; i++) {
+		if (Index[i].u8Key == key) {
+			return &Index[i];
+		}
+	}
+	return 0;
+}
+
+static KV_Status_t KV_ReadSlot(const KV_Entry_t* e, KV_Record_t* rec)
+{
+	if (AT24C32_Read(Eeprom, KV_BASE + e->u16Slot * KV_SLOT_SIZE, (uint8_t*)rec, KV_SLOT_SIZE) != AT24C32_OK) {
+		return KV_IO_ERR;
+	}
+	if (!KV_RecordValid(rec) || rec->u8Key != e->u8Key) {
+		return KV_IO_ERR;
+	}
+	return KV_OK;
+}
+
+/* Write the record of e at the head, e gets the new slot and sequence number */
+static KV_Status_t KV_Append(KV_Entry_t* e, const uint8_t* data)
+{
+	KV_Record_t rec;
+	uint16_t crc;
+
+	memset(&rec, 0xFF, sizeof(rec));
+	rec.u8Key = e->u8Key;
+	rec.u8Len = e->u8Len;
+	rec.u8Seq[0] = (uint8_t)u16NextSeq;
+	rec.u8Seq[1] = (uint8_t)(u16NextSeq >> 8);
+	if (e->u8Len != KV_LEN_DELETED) {
+		memcpy(rec.u8Data, data, e->u8Len);
+	}
+	crc = KV_Crc16((const uint8_t*)&rec, KV_SLOT_SIZE - 2);
+	rec.u8Crc[0] = (uint8_t)crc;
+	rec.u8Crc[1] = (uint8_t)(crc >> 8);
+
+	//A slot never crosses a page, this is one page write
+	if (AT24C32_Write(Eeprom, KV_BASE + u16Head * KV_SLOT_SIZE, (const uint8_t*)&rec, KV_SLOT_SIZE) != AT24C32_OK) {
+		return KV_IO_ERR;
+	}
+
+	e->u16Slot = u16Head;
+	e->u16Seq = u16NextSeq++;
+	u16Head = (u16Head + 1) % KV_SLOTS;
+	++u16Used;
+	++Stats.u32Appends;
+	return KV_OK;
+}
+
+/* Free slots until KV_GC_RESERVE are left, live records at the tail move to the head */
+static KV_Status_t KV_Collect(void)
+{
+	KV_Record_t rec;
+	KV_Entry_t* e;
+	KV_Status_t status;
+	uint8_t i;
+
+	while (KV_SLOTS - u16Used < KV_GC_RESERVE) {
+		e = 0;
+		for (i = 0; i < u8Keys; i++) {
+			if (Index[i].u16Slot == u16Tail) {
+				e = &Index[i];
+				break;
+			}
+		}
+		if (e) {
+			status = KV_ReadSlot(e, &rec);
+			if (status == KV_OK) {
+				status = KV_Append(e, rec.u8Data);
+			}
+			if (status != KV_OK) {
+				return status;
+			}
+			++Stats.u32Relocations;
+		}
+		u16Tail = (u16Tail + 1) % KV_SLOTS;
+		--u16Used;
+	}
+	return KV_OK;
+}
+
+KV_Status_t KV_Init(AT24C32_t* dev)
+{
+	KV_Record_t* rec;
+	KV_Entry_t* e;
+	uint32_t u32Start = Delay_GetTick();
+	uint16_t slot, seq, age, maxAge;
+	uint16_t newest = 0;
+	uint16_t newestSlot = 0;
+	uint8_t found = 0;
+	uint8_t i;
+
+	Eeprom = dev;
+	u8Ready = 0;
+	u8Keys = 0;
+	memset(&Stats, 0, sizeof(Stats));
+
+	//Newest record of every key, tombstones included
+	for (slot = 0; slot < KV_SLOTS; slot += KV_SCAN_SLOTS) {
+		if (AT24C32_Read(dev, KV_BASE + slot * KV_SLOT_SIZE, (uint8_t*)ScanBuf, sizeof(ScanBuf)) != AT24C32_OK) {
+			return KV_IO_ERR;
+		}
+		for (i = 0; i < KV_SCAN_SLOTS; i++) {
+			rec = &ScanBuf[i];
+			if (!KV_RecordValid(rec)) {
+				continue;
+			}
+			//Every slot is rewritten once a lap, all sequence numbers on the chip are within KV_SLOTS
+			seq = rec->u8Seq[0] | (rec->u8Seq[1] << 8);
+			if (!found || (int16_t)(seq - newest) > 0) {
+				newest = seq;
+				newestSlot = slot + i;
+				found = 1;
+			}
+
+			e = KV_Find(rec->u8Key);
+			if (!e) {
+				if (u8Keys == KV_MAX_KEYS) {
+					continue;
+				}
+				e = &Index[u8Keys++];
+				e->u8Key = rec->u8Key;
+			} else if ((int16_t)(seq - e->u16Seq) <= 0) {
+				continue;
+			}
+			e->u8Len = rec->u8Len;
+			e->u16Slot = slot + i;
+			e->u16Seq = seq;
+		}
+	}
+
+	//Deleted keys leave the index
+	for (i = 0; i < u8Keys; ) {
+		if (Index[i].u8Len == KV_LEN_DELETED) {
+			Index[i] = Index[--u8Keys];
+		} else {
+			i++;
+		}
+	}
+
+	if (found) {
+		u16Head = (newestSlot + 1) % KV_SLOTS;
+		u16NextSeq = newest + 1;
+	} else {
+		u16Head = 0;
+		u16NextSeq = 0;
+	}
+
+	//The tail is the oldest live record, everything from the head up to it is free
+	u16Tail = u16Head;
+	u16Used = 0;
+	maxAge = 0;
+	for (i = 0; i < u8Keys; i++) {
+		age = u16NextSeq - Index[i].u16Seq;
+		if (age > maxAge) {
+			maxAge = age;
+			u16Tail = Index[i].u16Slot;
+		}
+	}
+	if (u8Keys) {
+		u16Used = (u16Head + KV_SLOTS - u16Tail) % KV_SLOTS;
+		if (!u16Used) {
+			u16Used = KV_SLOTS;
+		}
+	}
+
+	Stats.u32BootMs = Delay_GetTick() - u32Start;
+	u8Ready = 1;
+	return KV_OK;
+}
+
+KV_Status_t KV_Get(uint8_t key, void* data, uint8_t size, uint8_t* len)
+{
+	KV_Record_t rec;
+	KV_Entry_t* e;
+	KV_Status_t status;
+
+	if (!u8Ready) {
+		return KV_IO_ERR;
+	}
+	e = KV_Find(key);
+	if (!e) {
+		return KV_NOT_FOUND;
+	}
+	status = KV_ReadSlot(e, &rec);
+	if (status != KV_OK) {
+		return status;
+	}
+	memcpy(data, rec.u8Data, (rec.u8Len < size) ? rec.u8Len : size);
+	if (len) {
+		*len = rec.u8Len;
+	}
+	return KV_OK;
+}
+
+KV_Status_t KV_Set(uint8_t key, const void* data, uint8_t len)
+{
+	KV_Record_t rec;
+	KV_Entry_t* e;
+	KV_Status_t status;
+
+	if (!u8Ready) {
+		return KV_IO_ERR;
+	}
+	if (key == 0 || key == KV_KEY_EMPTY || len > KV_VALUE_MAX) {
+		return KV_INVALID;
+	}
+
+	e = KV_Find(key);
+	if (e) {
+		//Rewriting the same value only costs wear
+		if (e->u8Len == len && KV_ReadSlot(e, &rec) == KV_OK && !memcmp(rec.u8Data, data, len)) {
+			++Stats.u32Unchanged;
+			return KV_OK;
+		}
+	} else if (u8Keys == KV_MAX_KEYS) {
+		return KV_FULL;
+	}
+
+	status = KV_Collect();
+	if (status != KV_OK) {
+		return status;
+	}
+
+	if (!e) {
+		e = &Index[u8Keys];
+		e->u8Key = key;
+		e->u8Len = len;
+		status = KV_Append(e, data);
+		if (status == KV_OK) {
+			++u8Keys;
+		}
+		return status;
+	}
+	e->u8Len = len;
+	return KV_Append(e, data);
+}
+
+KV_Status_t KV_Delete(uint8_t key)
+{
+	KV_Entry_t* e;
+	KV_Entry_t tomb;
+	KV_Status_t status;
+
+	if (!u8Ready) {
+		return KV_IO_ERR;
+	}
+	e = KV_Find(key);
+	if (!e) {
+		return KV_NOT_FOUND;
+	}
+
+	status = KV_Collect();
+	if (status != KV_OK) {
+		return status;
+	}
+	//Not indexed, the garbage collection drops it when it reaches the tail
+	tomb.u8Key = key;
+	tomb.u8Len = KV_LEN_DELETED;
+	status = KV_Append(&tomb, 0);
+	if (status == KV_OK) {
+		*e = Index[--u8Keys];
+	}
+	return status;
+}
+
+void KV_GetStats(KV_Stats_t* stats)
+{
+	*stats = Stats;
+	stats->u16Keys = u8Keys;
+	stats->u16Free = KV_SLOTS - u16Used;
+}
@@ -0,0 +1,74 @@
+#ifndef KV_STORE_H_
+#define KV_STORE_H_
+
+#include "stm32f10x.h"
+#include "at24c32.h"
+
+/**
+ * Key-value store on the AT24C32
+ *
+ * The EEPROM is a ring of 16 byte record slots, two per page. Every update
+ * appends a record at the head, so it is one page write and the writes go
+ * round the whole chip instead of hitting the same cells. Records carry a
+ * sequence number and a CRC, the newest valid record of a key wins and a
+ * torn write is ignored. At boot the chip is scanned once to rebuild the
+ * index in RAM.
+ *
+ * The slots from the head up to the oldest live record are free. When
+ * fewer than KV_GC_RESERVE are left, the record at the tail is copied to
+ * the head if it is still live and the tail moves on.
+ */
+
+#define KV_BASE						0x0000		/* EEPROM address of slot 0 */
+#define KV_SLOT_SIZE				16
+#define KV_SLOTS					(AT24C32_SIZE / KV_SLOT_SIZE)
+#define KV_VALUE_MAX				10			/* Value bytes in a slot */
+#define KV_MAX_KEYS					32
+#define KV_GC_RESERVE				2			/* Free slots kept for a relocation and the new record */
+
+/* Keys 0x00 and 0xFF are reserved */
+#define KV_KEY_SERVO_CAL			0x01		/* Closed and open pulse, 2 x uint16_t */
+
+typedef enum {
+	KV_OK = 0,
+	KV_NOT_FOUND,
+	KV_FULL,				/* KV_MAX_KEYS keys in use */
+	KV_INVALID,				/* Reserved key or value longer than KV_VALUE_MAX */
+	KV_IO_ERR				/* EEPROM did not answer or the record read back bad */
+} KV_Status_t;
+
+typedef struct {
+	uint16_t u16Keys;
+	uint16_t u16Free;			/* Free slots */
+	uint32_t u32Appends;		/* Records written, relocations included */
+	uint32_t u32Relocations;	/* Live records copied by the garbage collection */
+	uint32_t u32Unchanged;		/* KV_Set calls skipped because the value was the same */
+	uint32_t u32BootMs;			/* Scan and index rebuild time */
+} KV_Stats_t;
+
+/**
+ * Scan the EEPROM and build the index, the device has to stay valid
+ */
+extern KV_Status_t KV_Init(AT24C32_t* dev);
+
+/**
+ * Read the value of a key
+ *
+ * Parameters:
+ * 	- void* data, uint8_t size:
+ * 		Buffer for the value, a longer value is cut to size
+ * 	- uint8_t* len:
+ * 		Length of the stored value, may be 0
+ */
+extern KV_Status_t KV_Get(uint8_t key, void* data, uint8_t size, uint8_t* len);
+
+/**
+ * Store a value, nothing is written if it is the same as the stored one
+ */
+extern KV_Status_t KV_Set(uint8_t key, const void* data, uint8_t len);
+
+extern KV_Status_t KV_Delete(uint8_t key);
+
+extern void KV_GetStats(KV_Stats_t* stats);
+
+#endif
@@ -5,15 +5,84 @@
 #include <stdio.h>
 #include "servo.h"
 #include "sd_card.h"
+#include "access_log.h"
+#include "card_poll.h"
+#include "card_db.h"
+#include "at24c32.h"
+#include "kv_store.h"
 void My_GPIO_Init(void);
 
-uint8_t CardID[5];
+/*
+ * Access pipeline: detect -> lookup -> actuate -> log -> display
+ *
+ * Every stage is a short task run by the tick scheduler below. Stages hand
+ * work on through a badge queue and flags, no task waits for the door, so
+ * cards keep being read while it moves.
+ */
+#define DOOR_HOLD_MS		3000	/* Door stays open after the last granted badge */
+#define BADGE_QUEUE_LEN		4
+#define DISPLAY_SCROLL_MS	400		/* A UID line wider than the display moves one column this often */
+
+typedef struct {
+	void (*pfTask)(void);
+	uint16_t u16PeriodMs;
+	uint32_t u32Due;
+} Task_t;
+
+typedef enum {
+	DOOR_CLOSED = 0,
+	DOOR_OPENING,
+	DOOR_OPEN,
+	DOOR_CLOSING
+} DoorState_t;
+
+static void Task_Detect(void);
+static void Task_Access(void);
+static void Task_Door(void);
+static void Task_Display(void);
+static void Task_Log(void);
+static void Task_Bus(void);
+static void Config_Load(void);
+
+static Task_t Tasks[] = {
+	{Task_Detect,	1,				0},		/* A reader step per call, a poll takes a few ms */
+	{Task_Access,	10,				0},
+	{Task_Door,		20,				0},
+	{Task_Display,	50,				0},
+	{Task_Log,		100,			0},
+	{Task_Bus,		10,				0}
+};
+
+static TM_MFRC522_Uid_t BadgeQueue[BADGE_QUEUE_LEN];
+static uint8_t u8BadgeHead;
+static uint8_t u8BadgeTail;
+static DoorState_t DoorState;
+static uint32_t u32DoorTick;
+static uint8_t u8DoorRequest;
+static TM_MFRC522_Uid_t Card;
+static uint8_t u8Granted;
+static uint8_t u8ShowCard;
+static uint8_t u8LineLen;
+static uint8_t u8ScrollPos;
+static uint32_t u32ScrollTick;
+static AT24C32_t Eeprom;
+static uint16_t u16PulseClosed = SERVO_PULSE_CLOSED;
+static uint16_t u16PulseOpen = SERVO_PULSE_OPEN;
 char szBuff[100];
 
+/* Pipeline health, for the debugger watch window */
+uint32_t u32MaxLateMs;		/* Worst delay of a task past its due tick, bounds detection latency */
+uint32_t u32Badges;			/* Badges processed */
+uint32_t u32LogLost;		/* Badges the access log could not keep */
+
 int main() {
+	uint32_t u32Now;
+	uint8_t i;
+
 	Delay_Init();
 	My_GPIO_Init();
 	TM_MFRC522_Init();
+	CardPoll_Init();
 	PWM_Init();
 	I2C_LCD_Init();
 	I2C_LCD_Clear();
@@ -21,27 +90,163 @@ int main() {
 	I2C_LCD_Puts("STM32 - MFRC522");
 	I2C_LCD_NewLine();
 	I2C_LCD_Puts("RFID_PROJECT");
-	
+	CardDB_Init();
+	AccessLog_Init();
+	Config_Load();
+
+	u32Now = Delay_GetTick();
+	for (i = 0; i < sizeof(Tasks) / sizeof(Tasks[0]); i++) {
+		Tasks[i].u32Due = u32Now;
+	}
+
 	while(1) {
-		if (TM_MFRC522_Check(CardID) == MI_OK) {
-			sprintf(szBuff, "ID: 0x%02X%02X%02X%02X%02X", CardID[0], CardID[1], CardID[2], CardID[3], CardID[4]);
-			I2C_LCD_Clear();
-			I2C_LCD_Puts("STM32 - MFRC522");
-			I2C_LCD_NewLine();
-			I2C_LCD_Puts(szBuff);
-			ServoOn();
+		for (i = 0; i < sizeof(Tasks) / sizeof(Tasks[0]); i++) {
+			u32Now = Delay_GetTick();
+			if ((int32_t)(u32Now - Tasks[i].u32Due) >= 0) {
+				if (u32Now - Tasks[i].u32Due > u32MaxLateMs) {
+					u32MaxLateMs = u32Now - Tasks[i].u32Due;
+				}
+				Tasks[i].u32Due = u32Now + Tasks[i].u16PeriodMs;
+				Tasks[i].pfTask();
+			}
+		}
+		__WFI();	/* SysTick wakes the loop every 1 ms */
+	}
+}
+
+/* Card detect: queue every new badge, a full queue drops it */
+static void Task_Detect(void) {
+	TM_MFRC522_Uid_t uid;
+	uint8_t next;
+
+	while (CardPoll_Task(&uid) == MI_OK) {
+		next = (u8BadgeHead + 1) % BADGE_QUEUE_LEN;
+		if (next != u8BadgeTail) {
+			BadgeQueue[u8BadgeHead] = uid;
+			u8BadgeHead = next;
+		}
+	}
+}
+
+/* Lookup, log, and hand the result to the door and the display */
+static void Task_Access(void) {
+	if (u8BadgeTail == u8BadgeHead) {
+		return;
+	}
+	Card = BadgeQueue[u8BadgeTail];
+	u8BadgeTail = (u8BadgeTail + 1) % BADGE_QUEUE_LEN;
+	++u32Badges;
+
+	u8Granted = CardDB_Lookup(Card.uidByte, Card.size);
+	if (AccessLog_Append(Card.uidByte, Card.size, u8Granted ? ACCESS_LOG_GRANTED : ACCESS_LOG_DENIED) != FR_OK) {
+		++u32LogLost;
+	}
+	if (u8Granted) {
+		u8DoorRequest = 1;
+	}
+	u8ShowCard = 1;
+}
+
+/* Actuate: a badge granted while the door moves or stands open restarts the hold time */
+static void Task_Door(void) {
+	uint32_t u32Now = Delay_GetTick();
+
+	if (u8DoorRequest) {
+		u8DoorRequest = 0;
+		u32DoorTick = u32Now;
+		if (DoorState != DOOR_OPEN) {
+			DoorState = DOOR_OPENING;
+			Servo_MoveTo(u16PulseOpen, SERVO_SPEED, 0);
 			GPIO_SetBits(GPIOC, GPIO_Pin_13);
-			Delay_Ms(3000);
-			GPIO_ResetBits(GPIOC, GPIO_Pin_13);
-			ServoOff();
 		}
-		
+	}
+
+	switch (DoorState) {
+		case DOOR_OPENING:
+			if (!Servo_IsMoving()) {
+				DoorState = DOOR_OPEN;
+				u32DoorTick = u32Now;
+			}
+			break;
+		case DOOR_OPEN:
+			if (u32Now - u32DoorTick >= DOOR_HOLD_MS) {
+				DoorState = DOOR_CLOSING;
+				Servo_MoveTo(u16PulseClosed, SERVO_SPEED, 0);
+				GPIO_ResetBits(GPIOC, GPIO_Pin_13);
+			}
+			break;
+		case DOOR_CLOSING:
+			if (!Servo_IsMoving()) {
+				DoorState = DOOR_CLOSED;
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+/* Both lines are rewritten in place, a UID longer than the display scrolls */
+static void Task_Display(void) {
+	char szLine[LCD_COLS + 1];
+	uint32_t u32Now = Delay_GetTick();
+	uint8_t i, pos;
+
+	if (u8ShowCard) {
+		u8ShowCard = 0;
+		sprintf(szBuff, "ID:");
+		for (i = 0; i < Card.size; i++) {
+			sprintf(&szBuff[3 + 2 * i], "%02X", Card.uidByte[i]);
+		}
+		u8LineLen = 3 + 2 * Card.size;
+		u8ScrollPos = 0;
+		u32ScrollTick = u32Now;
+		I2C_LCD_PutLine(0, u8Granted ? "Access granted" : "Access denied");
+	} else if (u8LineLen <= LCD_COLS || u32Now - u32ScrollTick < DISPLAY_SCROLL_MS) {
+		return;
+	} else {
+		u32ScrollTick = u32Now;
+		u8ScrollPos = (u8ScrollPos + 1) % (u8LineLen + 1);
+	}
+
+	if (u8LineLen <= LCD_COLS) {
+		I2C_LCD_PutLine(1, szBuff);
+		return;
+	}
+	//the text and a space go round through the window
+	for (i = 0, pos = u8ScrollPos; i < LCD_COLS; i++) {
+		szLine[i] = (pos < u8LineLen) ? szBuff[pos] : ' ';
+		pos = (pos < u8LineLen) ? pos + 1 : 0;
+	}
+	szLine[LCD_COLS] = 0;
+	I2C_LCD_PutLine(1, szLine);
+}
+
+static void Task_Log(void) {
+	AccessLog_Poll();
+}
+
+static void Task_Bus(void) {
+	I2C_Watchdog();
+}
+
+/* Settings kept in the EEPROM, the defaults stay when it is missing */
+static void Config_Load(void) {
+	uint16_t u16Cal[2];
+	uint8_t len;
+
+	AT24C32_Init(&Eeprom, &AT24C32_I2C1Bus, AT24C32_ADDR);
+	if (!I2C_Probe(AT24C32_ADDR, I2C_SPEED_FAST) || KV_Init(&Eeprom) != KV_OK) {
+		return;
+	}
+	if (KV_Get(KV_KEY_SERVO_CAL, u16Cal, sizeof(u16Cal), &len) == KV_OK && len == sizeof(u16Cal)) {
+		u16PulseClosed = u16Cal[0];
+		u16PulseOpen = u16Cal[1];
 	}
 }
 
 void My_GPIO_Init(void) {
 	GPIO_InitTypeDef gpioInit;
-	
+
 	RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOC, ENABLE);
 	gpioInit.GPIO_Mode=GPIO_Mode_Out_PP;
 	gpioInit.GPIO_Speed=GPIO_Speed_50MHz;
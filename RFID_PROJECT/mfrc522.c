@@ -18,6 +18,15 @@
  */
 #include "mfrc522.h"
 #include "spi.h"
+#include "delay.h"
+
+/* State of the command started by TM_MFRC522_ToCardStart */
+static volatile uint8_t u8IrqPending;
+static uint8_t u8Busy;
+static uint8_t u8Command;
+static uint8_t u8IrqEn;
+static uint8_t u8WaitIRq;
+static uint32_t u32StartTick;
 
 void TM_MFRC522_Init(void) {
 	TM_MFRC522_InitPins();
@@ -25,6 +34,12 @@ void TM_MFRC522_Init(void) {
 
 	TM_MFRC522_Reset();
 
+#if MFRC522_USE_IRQ
+	/* Push-pull IRQ output, wired to MFRC522_IRQ_PIN */
+	TM_MFRC522_WriteRegister(MFRC522_REG_DIV1_EN, 0x80);
+	TM_MFRC522_InitIrqPin();
+#endif
+
 	TM_MFRC522_WriteRegister(MFRC522_REG_T_MODE, 0x8D);
 	TM_MFRC522_WriteRegister(MFRC522_REG_T_PRESCALER, 0x3E);
 	TM_MFRC522_WriteRegister(MFRC522_REG_T_RELOAD_L, 30);           
@@ -90,6 +105,38 @@ uint8_t TM_MFRC522_ReadRegister(uint8_t addr) {
 	return val;	
 }
 
+void TM_MFRC522_WriteRegisterBurst(uint8_t addr, uint8_t* val, uint8_t len) {
+	uint8_t i;
+	//CS low
+	MFRC522_CS_LOW;
+	//Send address once, the chip keeps writing to the same register
+	TM_SPI_Send((addr << 1) & 0x7E);
+	for (i = 0; i < len; i++) {
+		TM_SPI_Send(val[i]);
+	}
+	//CS high
+	MFRC522_CS_HIGH;
+}
+
+void TM_MFRC522_ReadRegisterBurst(uint8_t addr, uint8_t* val, uint8_t len) {
+	uint8_t i;
+	uint8_t cmd = ((addr << 1) & 0x7E) | 0x80;
+
+	if (len == 0) {
+		return;
+	}
+	//CS low
+	MFRC522_CS_LOW;
+	//Each byte clocked in is the address of the next read, 0 ends the sequence
+	TM_SPI_Send(cmd);
+	for (i = 0; i < len - 1; i++) {
+		val[i] = TM_SPI_Send(cmd);
+	}
+	val[i] = TM_SPI_Send(MFRC522_DUMMY);
+	//CS high
+	MFRC522_CS_HIGH;
+}
+
 void TM_MFRC522_SetBitMask(uint8_t reg, uint8_t mask) {
 	TM_MFRC522_WriteRegister(reg, TM_MFRC522_ReadRegister(reg) | mask);
 }
@@ -117,53 +164,58 @@ void TM_MFRC522_Reset(void) {
 
 TM_MFRC522_Status_t TM_MFRC522_Request(uint8_t reqMode, uint8_t* TagType) {
 	TM_MFRC522_Status_t status;  
-	uint16_t backBits;			//The received data bits
+	uint16_t backBits = 0;			//The received data bits
 
 	TM_MFRC522_WriteRegister(MFRC522_REG_BIT_FRAMING, 0x07);		//TxLastBists = BitFramingReg[2..0]	???
 
 	TagType[0] = reqMode;
 	status = TM_MFRC522_ToCard(PCD_TRANSCEIVE, TagType, 1, TagType, &backBits);
 
-	if ((status != MI_OK) || (backBits != 0x10)) {    
+	//Different ATQAs from several cards collide, there still are cards to select
+	if (status == MI_COLLISION) {
+		status = MI_OK;
+	} else if ((status != MI_OK) || (backBits != 0x10)) {    
 		status = MI_ERR;
 	}
 
 	return status;
 }
 
-TM_MFRC522_Status_t TM_MFRC522_ToCard(uint8_t command, uint8_t* sendData, uint8_t sendLen, uint8_t* backData, uint16_t* backLen) {
-	TM_MFRC522_Status_t status = MI_ERR;
-	uint8_t irqEn = 0x00;
-	uint8_t waitIRq = 0x00;
-	uint8_t lastBits;
-	uint8_t n;
-	uint16_t i;
+TM_MFRC522_Status_t TM_MFRC522_ToCardStart(uint8_t command, uint8_t* sendData, uint8_t sendLen) {
+	//One command at a time, the running one is collected by its owner first
+	if (u8Busy) {
+		return MI_BUSY;
+	}
+
+	u8IrqEn = 0x00;
+	u8WaitIRq = 0x00;
 
 	switch (command) {
 		case PCD_AUTHENT: {
-			irqEn = 0x12;
-			waitIRq = 0x10;
+			u8IrqEn = 0x12;
+			u8WaitIRq = 0x10;
 			break;
 		}
 		case PCD_TRANSCEIVE: {
-			irqEn = 0x77;
-			waitIRq = 0x30;
+			u8IrqEn = 0x77;
+			u8WaitIRq = 0x30;
 			break;
 		}
 		default:
 			break;
 	}
+	u8Command = command;
 
-	TM_MFRC522_WriteRegister(MFRC522_REG_COMM_IE_N, irqEn | 0x80);
+	//Only completion, error and timer events drive the IRQ pin (IRqInv=1: active low)
+	u8IrqPending = 0;
+	TM_MFRC522_WriteRegister(MFRC522_REG_COMM_IE_N, (u8IrqEn & 0x33) | 0x01 | 0x80);
 	TM_MFRC522_ClearBitMask(MFRC522_REG_COMM_IRQ, 0x80);
 	TM_MFRC522_SetBitMask(MFRC522_REG_FIFO_LEVEL, 0x80);
 
 	TM_MFRC522_WriteRegister(MFRC522_REG_COMMAND, PCD_IDLE);
 
 	//Writing data to the FIFO
-	for (i = 0; i < sendLen; i++) {   
-		TM_MFRC522_WriteRegister(MFRC522_REG_FIFO_DATA, sendData[i]);    
-	}
+	TM_MFRC522_WriteRegisterBurst(MFRC522_REG_FIFO_DATA, sendData, sendLen);
 
 	//Execute the command
 	TM_MFRC522_WriteRegister(MFRC522_REG_COMMAND, command);
@@ -171,25 +223,64 @@ TM_MFRC522_Status_t TM_MFRC522_ToCard(uint8_t command, uint8_t* sendData, uint8_
 		TM_MFRC522_SetBitMask(MFRC522_REG_BIT_FRAMING, 0x80);		//StartSend=1,transmission of data starts  
 	}   
 
-	//Waiting to receive data to complete
-	i = 2000;	//i according to the clock frequency adjustment, the operator M1 card maximum waiting time 25ms???
-	do {
-		//CommIrqReg[7..0]
-		//Set1 TxIRq RxIRq IdleIRq HiAlerIRq LoAlertIRq ErrIRq TimerIRq
-		n = TM_MFRC522_ReadRegister(MFRC522_REG_COMM_IRQ);
-		i--;
-	} while ((i!=0) && !(n&0x01) && !(n&waitIRq));
+	u32StartTick = Delay_GetTick();
+	u8Busy = 1;
+
+	return MI_OK;
+}
+
+TM_MFRC522_Status_t TM_MFRC522_ToCardPoll(uint8_t* backData, uint16_t* backLen) {
+	TM_MFRC522_Status_t status = MI_ERR;
+	uint8_t timeout;
+	uint8_t lastBits;
+	uint8_t n;
+	uint8_t err;
+
+	if (!u8Busy) {
+		return MI_ERR;
+	}
+
+	timeout = (Delay_GetTick() - u32StartTick) >= MFRC522_TIMEOUT_MS;
+#if MFRC522_USE_IRQ
+	//No SPI traffic until the reader pulls its IRQ line
+	if (!u8IrqPending && !timeout) {
+		return MI_BUSY;
+	}
+	//Cleared before the read: an edge during the read sets it again and is not lost
+	u8IrqPending = 0;
+#endif
+
+	//CommIrqReg[7..0]
+	//Set1 TxIRq RxIRq IdleIRq HiAlerIRq LoAlertIRq ErrIRq TimerIRq
+	n = TM_MFRC522_ReadRegister(MFRC522_REG_COMM_IRQ);
+	if (!(n&0x01) && !(n&u8WaitIRq)) {
+		if (!timeout) {
+#if MFRC522_USE_IRQ
+			//ErrIRq (a collision) holds the line low, the end of the command then makes no edge
+			if (GPIO_ReadInputDataBit(MFRC522_IRQ_PORT, MFRC522_IRQ_PIN) == Bit_RESET) {
+				u8IrqPending = 1;
+			}
+#endif
+			return MI_BUSY;
+		}
+	}
+	u8Busy = 0;
 
 	TM_MFRC522_ClearBitMask(MFRC522_REG_BIT_FRAMING, 0x80);			//StartSend=0
 
-	if (i != 0)  {
-		if (!(TM_MFRC522_ReadRegister(MFRC522_REG_ERROR) & 0x1B)) {
-			status = MI_OK;
-			if (n & irqEn & 0x01) {   
+	if ((n&0x01) || (n&u8WaitIRq))  {
+		//ErrorReg: BufferOvfl CollErr CRCErr ParityErr ProtocolErr, CRCErr only with RxCRCEn
+		err = TM_MFRC522_ReadRegister(MFRC522_REG_ERROR) & 0x1F;
+		//A bit collision still delivers the bits before it, anticollision needs them
+		if (!err || (err == 0x08 && u8Command == PCD_TRANSCEIVE)) {
+			status = err ? MI_COLLISION : MI_OK;
+			//MFAuthent has no TimerIEn: ended by the timer alone, the card did not answer.
+			//MFCrypto1On can still be set by the sector before, it does not tell.
+			if ((n & u8IrqEn & 0x01) || !(n & u8WaitIRq)) {   
 				status = MI_NOTAGERR;			
 			}
 
-			if (command == PCD_TRANSCEIVE) {
+			if (u8Command == PCD_TRANSCEIVE) {
 				n = TM_MFRC522_ReadRegister(MFRC522_REG_FIFO_LEVEL);
 				lastBits = TM_MFRC522_ReadRegister(MFRC522_REG_CONTROL) & 0x07;
 				if (lastBits) {   
@@ -206,9 +297,7 @@ TM_MFRC522_Status_t TM_MFRC522_ToCard(uint8_t command, uint8_t* sendData, uint8_
 				}
 
 				//Reading the received data in FIFO
-				for (i = 0; i < n; i++) {   
-					backData[i] = TM_MFRC522_ReadRegister(MFRC522_REG_FIFO_DATA);    
-				}
+				TM_MFRC522_ReadRegisterBurst(MFRC522_REG_FIFO_DATA, backData, n);
 			}
 		} else {   
 			status = MI_ERR;  
@@ -218,6 +307,25 @@ TM_MFRC522_Status_t TM_MFRC522_ToCard(uint8_t command, uint8_t* sendData, uint8_
 	return status;
 }
 
+TM_MFRC522_Status_t TM_MFRC522_ToCard(uint8_t command, uint8_t* sendData, uint8_t sendLen, uint8_t* backData, uint16_t* backLen) {
+	TM_MFRC522_Status_t status;
+
+	if (TM_MFRC522_ToCardStart(command, sendData, sendLen) != MI_OK) {
+		return MI_BUSY;
+	}
+	while ((status = TM_MFRC522_ToCardPoll(backData, backLen)) == MI_BUSY) {
+#if MFRC522_USE_IRQ
+		__WFI();			//Sleep until the reader IRQ (or the 1 ms tick)
+#endif
+	}
+
+	return status;
+}
+
+void TM_MFRC522_IRQHandler(void) {
+	u8IrqPending = 1;
+}
+
 TM_MFRC522_Status_t TM_MFRC522_Anticoll(uint8_t* serNum) {
 	TM_MFRC522_Status_t status;
 	uint8_t i;
@@ -242,17 +350,184 @@ TM_MFRC522_Status_t TM_MFRC522_Anticoll(uint8_t* serNum) {
 	return status;
 } 
 
+/* CRC_A (ISO 14443-3): x^16 + x^12 + x^5 + 1 LSB first, preset 0x6363. Row k advances a byte k places */
+static const uint16_t CrcATable[4][256] = {
+	{
+		0x0000, 0x1189, 0x2312, 0x329B, 0x4624, 0x57AD, 0x6536, 0x74BF,
+		0x8C48, 0x9DC1, 0xAF5A, 0xBED3, 0xCA6C, 0xDBE5, 0xE97E, 0xF8F7,
+		0x1081, 0x0108, 0x3393, 0x221A, 0x56A5, 0x472C, 0x75B7, 0x643E,
+		0x9CC9, 0x8D40, 0xBFDB, 0xAE52, 0xDAED, 0xCB64, 0xF9FF, 0xE876,
+		0x2102, 0x308B, 0x0210, 0x1399, 0x6726, 0x76AF, 0x4434, 0x55BD,
+		0xAD4A, 0xBCC3, 0x8E58, 0x9FD1, 0xEB6E, 0xFAE7, 0xC87C, 0xD9F5,
+		0x3183, 0x200A, 0x1291, 0x0318, 0x77A7, 0x662E, 0x54B5, 0x453C,
+		0xBDCB, 0xAC42, 0x9ED9, 0x8F50, 0xFBEF, 0xEA66, 0xD8FD, 0xC974,
+		0x4204, 0x538D, 0x6116, 0x709F, 0x0420, 0x15A9, 0x2732, 0x36BB,
+		0xCE4C, 0xDFC5, 0xED5E, 0xFCD7, 0x8868, 0x99E1, 0xAB7A, 0xBAF3,
+		0x5285, 0x430C, 0x7197, 0x601E, 0x14A1, 0x0528, 0x37B3, 0x263A,
+		0xDECD, 0xCF44, 0xFDDF, 0xEC56, 0x98E9, 0x8960, 0xBBFB, 0xAA72,
+		0x6306, 0x728F, 0x4014, 0x519D, 0x2522, 0x34AB, 0x0630, 0x17B9,
+		0xEF4E, 0xFEC7, 0xCC5C, 0xDDD5, 0xA96A, 0xB8E3, 0x8A78, 0x9BF1,
+		0x7387, 0x620E, 0x5095, 0x411C, 0x35A3, 0x242A, 0x16B1, 0x0738,
+		0xFFCF, 0xEE46, 0xDCDD, 0xCD54, 0xB9EB, 0xA862, 0x9AF9, 0x8B70,
+		0x8408, 0x9581, 0xA71A, 0xB693, 0xC22C, 0xD3A5, 0xE13E, 0xF0B7,
+		0x0840, 0x19C9, 0x2B52, 0x3ADB, 0x4E64, 0x5FED, 0x6D76, 0x7CFF,
+		0x9489, 0x8500, 0xB79B, 0xA612, 0xD2AD, 0xC324, 0xF1BF, 0xE036,
+		0x18C1, 0x0948, 0x3BD3, 0x2A5A, 0x5EE5, 0x4F6C, 0x7DF7, 0x6C7E,
+		0xA50A, 0xB483, 0x8618, 0x9791, 0xE32E, 0xF2A7, 0xC03C, 0xD1B5,
+		0x2942, 0x38CB, 0x0A50, 0x1BD9, 0x6F66, 0x7EEF, 0x4C74, 0x5DFD,
+		0xB58B, 0xA402, 0x9699, 0x8710, 0xF3AF, 0xE226, 0xD0BD, 0xC134,
+		0x39C3, 0x284A, 0x1AD1, 0x0B58, 0x7FE7, 0x6E6E, 0x5CF5, 0x4D7C,
+		0xC60C, 0xD785, 0xE51E, 0xF497, 0x8028, 0x91A1, 0xA33A, 0xB2B3,
+		0x4A44, 0x5BCD, 0x6956, 0x78DF, 0x0C60, 0x1DE9, 0x2F72, 0x3EFB,
+		0xD68D, 0xC704, 0xF59F, 0xE416, 0x90A9, 0x8120, 0xB3BB, 0xA232,
+		0x5AC5, 0x4B4C, 0x79D7, 0x685E, 0x1CE1, 0x0D68, 0x3FF3, 0x2E7A,
+		0xE70E, 0xF687, 0xC41C, 0xD595, 0xA12A, 0xB0A3, 0x8238, 0x93B1,
+		0x6B46, 0x7ACF, 0x4854, 0x59DD, 0x2D62, 0x3CEB, 0x0E70, 0x1FF9,
+		0xF78F, 0xE606, 0xD49D, 0xC514, 0xB1AB, 0xA022, 0x92B9, 0x8330,
+		0x7BC7, 0x6A4E, 0x58D5, 0x495C, 0x3DE3, 0x2C6A, 0x1EF1, 0x0F78
+	},
+	{
+		0x0000, 0x19D8, 0x33B0, 0x2A68, 0x6760, 0x7EB8, 0x54D0, 0x4D08,
+		0xCEC0, 0xD718, 0xFD70, 0xE4A8, 0xA9A0, 0xB078, 0x9A10, 0x83C8,
+		0x9591, 0x8C49, 0xA621, 0xBFF9, 0xF2F1, 0xEB29, 0xC141, 0xD899,
+		0x5B51, 0x4289, 0x68E1, 0x7139, 0x3C31, 0x25E9, 0x0F81, 0x1659,
+		0x2333, 0x3AEB, 0x1083, 0x095B, 0x4453, 0x5D8B, 0x77E3, 0x6E3B,
+		0xEDF3, 0xF42B, 0xDE43, 0xC79B, 0x8A93, 0x934B, 0xB923, 0xA0FB,
+		0xB6A2, 0xAF7A, 0x8512, 0x9CCA, 0xD1C2, 0xC81A, 0xE272, 0xFBAA,
+		0x7862, 0x61BA, 0x4BD2, 0x520A, 0x1F02, 0x06DA, 0x2CB2, 0x356A,
+		0x4666, 0x5FBE, 0x75D6, 0x6C0E, 0x2106, 0x38DE, 0x12B6, 0x0B6E,
+		0x88A6, 0x917E, 0xBB16, 0xA2CE, 0xEFC6, 0xF61E, 0xDC76, 0xC5AE,
+		0xD3F7, 0xCA2F, 0xE047, 0xF99F, 0xB497, 0xAD4F, 0x8727, 0x9EFF,
+		0x1D37, 0x04EF, 0x2E87, 0x375F, 0x7A57, 0x638F, 0x49E7, 0x503F,
+		0x6555, 0x7C8D, 0x56E5, 0x4F3D, 0x0235, 0x1BED, 0x3185, 0x285D,
+		0xAB95, 0xB24D, 0x9825, 0x81FD, 0xCCF5, 0xD52D, 0xFF45, 0xE69D,
+		0xF0C4, 0xE91C, 0xC374, 0xDAAC, 0x97A4, 0x8E7C, 0xA414, 0xBDCC,
+		0x3E04, 0x27DC, 0x0DB4, 0x146C, 0x5964, 0x40BC, 0x6AD4, 0x730C,
+		0x8CCC, 0x9514, 0xBF7C, 0xA6A4, 0xEBAC, 0xF274, 0xD81C, 0xC1C4,
+		0x420C, 0x5BD4, 0x71BC, 0x6864, 0x256C, 0x3CB4, 0x16DC, 0x0F04,
+		0x195D, 0x0085, 0x2AED, 0x3335, 0x7E3D, 0x67E5, 0x4D8D, 0x5455,
+		0xD79D, 0xCE45, 0xE42D, 0xFDF5, 0xB0FD, 0xA925, 0x834D, 0x9A95,
+		0xAFFF, 0xB627, 0x9C4F, 0x8597, 0xC89F, 0xD147, 0xFB2F, 0xE2F7,
+		0x613F, 0x78E7, 0x528F, 0x4B57, 0x065F, 0x1F87, 0x35EF, 0x2C37,
+		0x3A6E, 0x23B6, 0x09DE, 0x1006, 0x5D0E, 0x44D6, 0x6EBE, 0x7766,
+		0xF4AE, 0xED76, 0xC71E, 0xDEC6, 0x93CE, 0x8A16, 0xA07E, 0xB9A6,
+		0xCAAA, 0xD372, 0xF91A, 0xE0C2, 0xADCA, 0xB412, 0x9E7A, 0x87A2,
+		0x046A, 0x1DB2, 0x37DA, 0x2E02, 0x630A, 0x7AD2, 0x50BA, 0x4962,
+		0x5F3B, 0x46E3, 0x6C8B, 0x7553, 0x385B, 0x2183, 0x0BEB, 0x1233,
+		0x91FB, 0x8823, 0xA24B, 0xBB93, 0xF69B, 0xEF43, 0xC52B, 0xDCF3,
+		0xE999, 0xF041, 0xDA29, 0xC3F1, 0x8EF9, 0x9721, 0xBD49, 0xA491,
+		0x2759, 0x3E81, 0x14E9, 0x0D31, 0x4039, 0x59E1, 0x7389, 0x6A51,
+		0x7C08, 0x65D0, 0x4FB8, 0x5660, 0x1B68, 0x02B0, 0x28D8, 0x3100,
+		0xB2C8, 0xAB10, 0x8178, 0x98A0, 0xD5A8, 0xCC70, 0xE618, 0xFFC0
+	},
+	{
+		0x0000, 0x5ADC, 0xB5B8, 0xEF64, 0x6361, 0x39BD, 0xD6D9, 0x8C05,
+		0xC6C2, 0x9C1E, 0x737A, 0x29A6, 0xA5A3, 0xFF7F, 0x101B, 0x4AC7,
+		0x8595, 0xDF49, 0x302D, 0x6AF1, 0xE6F4, 0xBC28, 0x534C, 0x0990,
+		0x4357, 0x198B, 0xF6EF, 0xAC33, 0x2036, 0x7AEA, 0x958E, 0xCF52,
+		0x033B, 0x59E7, 0xB683, 0xEC5F, 0x605A, 0x3A86, 0xD5E2, 0x8F3E,
+		0xC5F9, 0x9F25, 0x7041, 0x2A9D, 0xA698, 0xFC44, 0x1320, 0x49FC,
+		0x86AE, 0xDC72, 0x3316, 0x69CA, 0xE5CF, 0xBF13, 0x5077, 0x0AAB,
+		0x406C, 0x1AB0, 0xF5D4, 0xAF08, 0x230D, 0x79D1, 0x96B5, 0xCC69,
+		0x0676, 0x5CAA, 0xB3CE, 0xE912, 0x6517, 0x3FCB, 0xD0AF, 0x8A73,
+		0xC0B4, 0x9A68, 0x750C, 0x2FD0, 0xA3D5, 0xF909, 0x166D, 0x4CB1,
+		0x83E3, 0xD93F, 0x365B, 0x6C87, 0xE082, 0xBA5E, 0x553A, 0x0FE6,
+		0x4521, 0x1FFD, 0xF099, 0xAA45, 0x2640, 0x7C9C, 0x93F8, 0xC924,
+		0x054D, 0x5F91, 0xB0F5, 0xEA29, 0x662C, 0x3CF0, 0xD394, 0x8948,
+		0xC38F, 0x9953, 0x7637, 0x2CEB, 0xA0EE, 0xFA32, 0x1556, 0x4F8A,
+		0x80D8, 0xDA04, 0x3560, 0x6FBC, 0xE3B9, 0xB965, 0x5601, 0x0CDD,
+		0x461A, 0x1CC6, 0xF3A2, 0xA97E, 0x257B, 0x7FA7, 0x90C3, 0xCA1F,
+		0x0CEC, 0x5630, 0xB954, 0xE388, 0x6F8D, 0x3551, 0xDA35, 0x80E9,
+		0xCA2E, 0x90F2, 0x7F96, 0x254A, 0xA94F, 0xF393, 0x1CF7, 0x462B,
+		0x8979, 0xD3A5, 0x3CC1, 0x661D, 0xEA18, 0xB0C4, 0x5FA0, 0x057C,
+		0x4FBB, 0x1567, 0xFA03, 0xA0DF, 0x2CDA, 0x7606, 0x9962, 0xC3BE,
+		0x0FD7, 0x550B, 0xBA6F, 0xE0B3, 0x6CB6, 0x366A, 0xD90E, 0x83D2,
+		0xC915, 0x93C9, 0x7CAD, 0x2671, 0xAA74, 0xF0A8, 0x1FCC, 0x4510,
+		0x8A42, 0xD09E, 0x3FFA, 0x6526, 0xE923, 0xB3FF, 0x5C9B, 0x0647,
+		0x4C80, 0x165C, 0xF938, 0xA3E4, 0x2FE1, 0x753D, 0x9A59, 0xC085,
+		0x0A9A, 0x5046, 0xBF22, 0xE5FE, 0x69FB, 0x3327, 0xDC43, 0x869F,
+		0xCC58, 0x9684, 0x79E0, 0x233C, 0xAF39, 0xF5E5, 0x1A81, 0x405D,
+		0x8F0F, 0xD5D3, 0x3AB7, 0x606B, 0xEC6E, 0xB6B2, 0x59D6, 0x030A,
+		0x49CD, 0x1311, 0xFC75, 0xA6A9, 0x2AAC, 0x7070, 0x9F14, 0xC5C8,
+		0x09A1, 0x537D, 0xBC19, 0xE6C5, 0x6AC0, 0x301C, 0xDF78, 0x85A4,
+		0xCF63, 0x95BF, 0x7ADB, 0x2007, 0xAC02, 0xF6DE, 0x19BA, 0x4366,
+		0x8C34, 0xD6E8, 0x398C, 0x6350, 0xEF55, 0xB589, 0x5AED, 0x0031,
+		0x4AF6, 0x102A, 0xFF4E, 0xA592, 0x2997, 0x734B, 0x9C2F, 0xC6F3
+	},
+	{
+		0x0000, 0x1CBB, 0x3976, 0x25CD, 0x72EC, 0x6E57, 0x4B9A, 0x5721,
+		0xE5D8, 0xF963, 0xDCAE, 0xC015, 0x9734, 0x8B8F, 0xAE42, 0xB2F9,
+		0xC3A1, 0xDF1A, 0xFAD7, 0xE66C, 0xB14D, 0xADF6, 0x883B, 0x9480,
+		0x2679, 0x3AC2, 0x1F0F, 0x03B4, 0x5495, 0x482E, 0x6DE3, 0x7158,
+		0x8F53, 0x93E8, 0xB625, 0xAA9E, 0xFDBF, 0xE104, 0xC4C9, 0xD872,
+		0x6A8B, 0x7630, 0x53FD, 0x4F46, 0x1867, 0x04DC, 0x2111, 0x3DAA,
+		0x4CF2, 0x5049, 0x7584, 0x693F, 0x3E1E, 0x22A5, 0x0768, 0x1BD3,
+		0xA92A, 0xB591, 0x905C, 0x8CE7, 0xDBC6, 0xC77D, 0xE2B0, 0xFE0B,
+		0x16B7, 0x0A0C, 0x2FC1, 0x337A, 0x645B, 0x78E0, 0x5D2D, 0x4196,
+		0xF36F, 0xEFD4, 0xCA19, 0xD6A2, 0x8183, 0x9D38, 0xB8F5, 0xA44E,
+		0xD516, 0xC9AD, 0xEC60, 0xF0DB, 0xA7FA, 0xBB41, 0x9E8C, 0x8237,
+		0x30CE, 0x2C75, 0x09B8, 0x1503, 0x4222, 0x5E99, 0x7B54, 0x67EF,
+		0x99E4, 0x855F, 0xA092, 0xBC29, 0xEB08, 0xF7B3, 0xD27E, 0xCEC5,
+		0x7C3C, 0x6087, 0x454A, 0x59F1, 0x0ED0, 0x126B, 0x37A6, 0x2B1D,
+		0x5A45, 0x46FE, 0x6333, 0x7F88, 0x28A9, 0x3412, 0x11DF, 0x0D64,
+		0xBF9D, 0xA326, 0x86EB, 0x9A50, 0xCD71, 0xD1CA, 0xF407, 0xE8BC,
+		0x2D6E, 0x31D5, 0x1418, 0x08A3, 0x5F82, 0x4339, 0x66F4, 0x7A4F,
+		0xC8B6, 0xD40D, 0xF1C0, 0xED7B, 0xBA5A, 0xA6E1, 0x832C, 0x9F97,
+		0xEECF, 0xF274, 0xD7B9, 0xCB02, 0x9C23, 0x8098, 0xA555, 0xB9EE,
+		0x0B17, 0x17AC, 0x3261, 0x2EDA, 0x79FB, 0x6540, 0x408D, 0x5C36,
+		0xA23D, 0xBE86, 0x9B4B, 0x87F0, 0xD0D1, 0xCC6A, 0xE9A7, 0xF51C,
+		0x47E5, 0x5B5E, 0x7E93, 0x6228, 0x3509, 0x29B2, 0x0C7F, 0x10C4,
+		0x619C, 0x7D27, 0x58EA, 0x4451, 0x1370, 0x0FCB, 0x2A06, 0x36BD,
+		0x8444, 0x98FF, 0xBD32, 0xA189, 0xF6A8, 0xEA13, 0xCFDE, 0xD365,
+		0x3BD9, 0x2762, 0x02AF, 0x1E14, 0x4935, 0x558E, 0x7043, 0x6CF8,
+		0xDE01, 0xC2BA, 0xE777, 0xFBCC, 0xACED, 0xB056, 0x959B, 0x8920,
+		0xF878, 0xE4C3, 0xC10E, 0xDDB5, 0x8A94, 0x962F, 0xB3E2, 0xAF59,
+		0x1DA0, 0x011B, 0x24D6, 0x386D, 0x6F4C, 0x73F7, 0x563A, 0x4A81,
+		0xB48A, 0xA831, 0x8DFC, 0x9147, 0xC666, 0xDADD, 0xFF10, 0xE3AB,
+		0x5152, 0x4DE9, 0x6824, 0x749F, 0x23BE, 0x3F05, 0x1AC8, 0x0673,
+		0x772B, 0x6B90, 0x4E5D, 0x52E6, 0x05C7, 0x197C, 0x3CB1, 0x200A,
+		0x92F3, 0x8E48, 0xAB85, 0xB73E, 0xE01F, 0xFCA4, 0xD969, 0xC5D2
+	}
+};
+
+uint16_t TM_MFRC522_CrcA(const uint8_t* data, uint16_t len) {
+	uint16_t crc = 0x6363;
+
+	//Slicing-by-4: the two CRC bytes meet the first two data bytes, the other two start from zero
+	while (len >= 4) {
+		crc = CrcATable[3][(crc ^ data[0]) & 0xFF] ^ CrcATable[2][((crc >> 8) ^ data[1]) & 0xFF]
+			^ CrcATable[1][data[2]] ^ CrcATable[0][data[3]];
+		data += 4;
+		len -= 4;
+	}
+	while (len--) {
+		crc = (crc >> 8) ^ CrcATable[0][(crc ^ *data++) & 0xFF];
+	}
+
+	return crc;
+}
+
 void TM_MFRC522_CalculateCRC(uint8_t*  pIndata, uint8_t len, uint8_t* pOutData) {
+	TM_MFRC522_CalculateCRCEx(MFRC522_CRC_DEFAULT, pIndata, len, pOutData);
+}
+
+void TM_MFRC522_CalculateCRCEx(TM_MFRC522_CrcMode_t mode, uint8_t*  pIndata, uint8_t len, uint8_t* pOutData) {
 	uint8_t i, n;
+	uint16_t crc;
+
+	if (mode == MFRC522_CRC_SW) {
+		crc = TM_MFRC522_CrcA(pIndata, len);
+		pOutData[0] = crc & 0xFF;
+		pOutData[1] = crc >> 8;
+		return;
+	}
 
 	TM_MFRC522_ClearBitMask(MFRC522_REG_DIV_IRQ, 0x04);			//CRCIrq = 0
 	TM_MFRC522_SetBitMask(MFRC522_REG_FIFO_LEVEL, 0x80);			//Clear the FIFO pointer
 	//Write_MFRC522(CommandReg, PCD_IDLE);
 
 	//Writing data to the FIFO	
-	for (i = 0; i < len; i++) {   
-		TM_MFRC522_WriteRegister(MFRC522_REG_FIFO_DATA, *(pIndata+i));   
-	}
+	TM_MFRC522_WriteRegisterBurst(MFRC522_REG_FIFO_DATA, pIndata, len);
 	TM_MFRC522_WriteRegister(MFRC522_REG_COMMAND, PCD_CALCCRC);
 
 	//Wait CRC calculation is complete
@@ -271,7 +546,7 @@ uint8_t TM_MFRC522_SelectTag(uint8_t* serNum) {
 	uint8_t i;
 	TM_MFRC522_Status_t status;
 	uint8_t size;
-	uint16_t recvBits;
+	uint16_t recvBits = 0;
 	uint8_t buffer[9]; 
 
 	buffer[0] = PICC_SElECTTAG;
@@ -291,9 +566,264 @@ uint8_t TM_MFRC522_SelectTag(uint8_t* serNum) {
 	return size;
 }
 
+/* Steps of the enumeration, one reader command each */
+typedef enum {
+	ENUM_IDLE = 0,
+	ENUM_REQA,
+	ENUM_ANTICOLL,
+	ENUM_SELECT,
+	ENUM_HALT
+} TM_MFRC522_EnumStep_t;
+
+typedef struct {
+	TM_MFRC522_EnumStep_t Step;
+	TM_MFRC522_Uid_t* pUids;
+	uint8_t u8Max;
+	uint8_t u8Count;
+	uint8_t u8Single;					//TM_MFRC522_Select: one card, no REQA or HLTA
+	uint8_t u8Level;					//Cascade level 0..2
+	uint8_t u8KnownBits;				//UID bits of the level known so far
+	uint8_t buffer[9];					//SEL NVB UID0..3 BCC CRC_A
+	uint8_t resp[MFRC522_MAX_LEN];
+} TM_MFRC522_Enum_t;
+
+static TM_MFRC522_Enum_t Enum;
+
+static void TM_MFRC522_EnumRequest(void) {
+	TM_MFRC522_WriteRegister(MFRC522_REG_BIT_FRAMING, 0x07);		//TxLastBists = BitFramingReg[2..0]
+	Enum.buffer[0] = PICC_REQIDL;
+	TM_MFRC522_ToCardStart(PCD_TRANSCEIVE, Enum.buffer, 1);
+	Enum.Step = ENUM_REQA;
+}
+
+static void TM_MFRC522_EnumAnticoll(void) {
+	uint8_t index = 2 + Enum.u8KnownBits / 8;
+	uint8_t txLastBits = Enum.u8KnownBits % 8;
+
+	//ANTICOLLISION: send the known UID bits, the cards answer with the rest
+	Enum.buffer[1] = (index << 4) | txLastBits;				//NVB
+	TM_MFRC522_WriteRegister(MFRC522_REG_BIT_FRAMING, (txLastBits << 4) | txLastBits);	//RxAlign, TxLastBits
+	TM_MFRC522_ToCardStart(PCD_TRANSCEIVE, Enum.buffer, index + (txLastBits ? 1 : 0));
+	Enum.Step = ENUM_ANTICOLL;
+}
+
+static void TM_MFRC522_EnumLevel(uint8_t level) {
+	uint8_t i;
+
+	TM_MFRC522_ClearBitMask(MFRC522_REG_COLL, 0x80);		//ValuesAfterColl = 0, bits after a collision read 0
+
+	if (level == 0) {
+		Enum.pUids[Enum.u8Count].size = 0;
+	}
+	Enum.u8Level = level;
+	Enum.u8KnownBits = 0;
+	Enum.buffer[0] = PICC_SEL_CL1 + 2 * level;
+	for (i = 2; i < 7; i++) {
+		Enum.buffer[i] = 0;
+	}
+	TM_MFRC522_EnumAnticoll();
+}
+
+/* Anticollision answer, returns 0 if the level cannot be resolved */
+static uint8_t TM_MFRC522_EnumAnticollDone(TM_MFRC522_Status_t status) {
+	uint8_t* buffer = Enum.buffer;
+	uint8_t index = 2 + Enum.u8KnownBits / 8;
+	uint8_t txLastBits = Enum.u8KnownBits % 8;
+	uint8_t mask, coll, i;
+
+	if (status != MI_OK && status != MI_COLLISION) {
+		return 0;
+	}
+
+	//The first byte received completes the partly sent byte
+	mask = 0xFF << txLastBits;
+	buffer[index] = (buffer[index] & ~mask) | (Enum.resp[0] & mask);
+	for (i = 1; index + i < 7; i++) {
+		buffer[index + i] = Enum.resp[i];
+	}
+
+	if (status == MI_COLLISION) {
+		//CollReg[5] CollPosNotValid, CollReg[4..0] first collision bit 1..32 (0 = 32)
+		coll = TM_MFRC522_ReadRegister(MFRC522_REG_COLL);
+		if (coll & 0x20) {
+			return 0;
+		}
+		coll &= 0x1F;
+		if (coll == 0) {
+			coll = 32;
+		}
+		//CollPos counts from the first received byte, the bytes sent whole come before it
+		coll += Enum.u8KnownBits & ~0x07;
+		if (coll <= Enum.u8KnownBits || coll > 32) {
+			return 0;
+		}
+		//Follow the '1' branch, cards with a '0' there drop out of this round
+		buffer[2 + (coll - 1) / 8] |= 1 << ((coll - 1) % 8);
+		Enum.u8KnownBits = coll;
+		if (coll < 32) {
+			TM_MFRC522_EnumAnticoll();
+			return 1;
+		}
+		//The last UID bit collided, the BCC received after it is not valid
+		buffer[6] = buffer[2] ^ buffer[3] ^ buffer[4] ^ buffer[5];
+	}
+
+	//BCC
+	if ((buffer[2] ^ buffer[3] ^ buffer[4] ^ buffer[5]) != buffer[6]) {
+		return 0;
+	}
+
+	//SELECT
+	TM_MFRC522_WriteRegister(MFRC522_REG_BIT_FRAMING, 0x00);
+	buffer[1] = 0x70;
+	TM_MFRC522_CalculateCRC(buffer, 7, &buffer[7]);
+	TM_MFRC522_ToCardStart(PCD_TRANSCEIVE, buffer, 9);
+	Enum.Step = ENUM_SELECT;
+	return 1;
+}
+
+/* SAK of a cascade level, returns 0 on a bad answer */
+static uint8_t TM_MFRC522_EnumSelectDone(TM_MFRC522_Status_t status, uint16_t backBits) {
+	TM_MFRC522_Uid_t* uid = &Enum.pUids[Enum.u8Count];
+	uint8_t sak = Enum.resp[0];
+	uint8_t i;
+
+	if (status != MI_OK || backBits != 0x18) {
+		return 0;
+	}
+
+	//SAK bit 2: UID not complete, the level starts with the cascade tag
+	if (sak & 0x04) {
+		if (Enum.buffer[2] != PICC_CASCADE_TAG || Enum.u8Level == 2) {
+			return 0;
+		}
+		for (i = 3; i < 6; i++) {
+			uid->uidByte[uid->size++] = Enum.buffer[i];
+		}
+		TM_MFRC522_EnumLevel(Enum.u8Level + 1);
+		return 1;
+	}
+
+	for (i = 2; i < 6; i++) {
+		uid->uidByte[uid->size++] = Enum.buffer[i];
+	}
+	uid->sak = sak;
+	Enum.u8Count++;
+	if (Enum.u8Single) {
+		Enum.Step = ENUM_IDLE;
+		return 1;
+	}
+
+	//HLTA, a halted card no longer answers REQA
+	Enum.buffer[0] = PICC_HALT;
+	Enum.buffer[1] = 0;
+	TM_MFRC522_CalculateCRC(Enum.buffer, 2, &Enum.buffer[2]);
+	TM_MFRC522_ToCardStart(PCD_TRANSCEIVE, Enum.buffer, 4);
+	Enum.Step = ENUM_HALT;
+	return 1;
+}
+
+TM_MFRC522_Status_t TM_MFRC522_EnumerateStart(TM_MFRC522_Uid_t* uids, uint8_t max) {
+	//Enum has one owner, a running enumeration or command is finished first
+	if (Enum.Step != ENUM_IDLE || u8Busy) {
+		return MI_BUSY;
+	}
+	Enum.pUids = uids;
+	Enum.u8Max = max;
+	Enum.u8Count = 0;
+	Enum.u8Single = 0;
+	Enum.Step = ENUM_IDLE;
+	if (max) {
+		TM_MFRC522_EnumRequest();
+	}
+
+	return MI_OK;
+}
+
+TM_MFRC522_Status_t TM_MFRC522_EnumeratePoll(uint8_t* count) {
+	TM_MFRC522_Status_t status;
+	uint16_t backBits = 0;
+	uint8_t next = 0;
+
+	if (Enum.Step != ENUM_IDLE) {
+		status = TM_MFRC522_ToCardPoll(Enum.resp, &backBits);
+		if (status == MI_BUSY) {
+			return MI_BUSY;
+		}
+
+		switch (Enum.Step) {
+			case ENUM_REQA:
+				//Different ATQAs from several cards collide, there still are cards to select
+				if (status == MI_COLLISION || (status == MI_OK && backBits == 0x10)) {
+					TM_MFRC522_EnumLevel(0);
+					next = 1;
+				}
+				break;
+			case ENUM_ANTICOLL:
+				next = TM_MFRC522_EnumAnticollDone(status);
+				break;
+			case ENUM_SELECT:
+				next = TM_MFRC522_EnumSelectDone(status, backBits);
+				break;
+			case ENUM_HALT:
+				//No answer to HLTA, the reader timer ends the command
+				if (Enum.u8Count < Enum.u8Max) {
+					TM_MFRC522_EnumRequest();
+					next = 1;
+				}
+				break;
+			default:
+				break;
+		}
+		if (!next) {
+			Enum.Step = ENUM_IDLE;
+		}
+		if (Enum.Step != ENUM_IDLE) {
+			return MI_BUSY;
+		}
+	}
+
+	*count = Enum.u8Count;
+	return MI_OK;
+}
+
+/* Run the started enumeration to its end, sleeping between the commands */
+static uint8_t TM_MFRC522_EnumWait(void) {
+	uint8_t count;
+
+	while (TM_MFRC522_EnumeratePoll(&count) == MI_BUSY) {
+#if MFRC522_USE_IRQ
+		__WFI();			//Sleep until the reader IRQ (or the 1 ms tick)
+#endif
+	}
+
+	return count;
+}
+
+TM_MFRC522_Status_t TM_MFRC522_Select(TM_MFRC522_Uid_t* uid) {
+	if (Enum.Step != ENUM_IDLE || u8Busy) {
+		return MI_BUSY;
+	}
+	Enum.pUids = uid;
+	Enum.u8Max = 1;
+	Enum.u8Count = 0;
+	Enum.u8Single = 1;
+	TM_MFRC522_EnumLevel(0);
+
+	return TM_MFRC522_EnumWait() ? MI_OK : MI_ERR;
+}
+
+uint8_t TM_MFRC522_Enumerate(TM_MFRC522_Uid_t* uids, uint8_t max) {
+	if (TM_MFRC522_EnumerateStart(uids, max) != MI_OK) {
+		return 0;
+	}
+
+	return TM_MFRC522_EnumWait();
+}
+
 TM_MFRC522_Status_t TM_MFRC522_Auth(uint8_t authMode, uint8_t BlockAddr, uint8_t* Sectorkey, uint8_t* serNum) {
 	TM_MFRC522_Status_t status;
-	uint16_t recvBits;
+	uint16_t recvBits = 0;
 	uint8_t i;
 	uint8_t buff[12]; 
 
@@ -319,12 +849,19 @@ TM_MFRC522_Status_t TM_MFRC522_Read(uint8_t blockAddr, uint8_t* recvData) {
 	TM_MFRC522_Status_t status;
 	uint16_t unLen;
 
+	//The reader appends the request CRC and checks the one of the answer (CRCErr)
+	TM_MFRC522_SetBitMask(MFRC522_REG_TX_MODE, 0x80);			//TxCRCEn
+	TM_MFRC522_SetBitMask(MFRC522_REG_RX_MODE, 0x80);			//RxCRCEn
+
 	recvData[0] = PICC_READ;
 	recvData[1] = blockAddr;
-	TM_MFRC522_CalculateCRC(recvData,2, &recvData[2]);
-	status = TM_MFRC522_ToCard(PCD_TRANSCEIVE, recvData, 4, recvData, &unLen);
+	status = TM_MFRC522_ToCard(PCD_TRANSCEIVE, recvData, 2, recvData, &unLen);
 
-	if ((status != MI_OK) || (unLen != 0x90)) {
+	TM_MFRC522_ClearBitMask(MFRC522_REG_TX_MODE, 0x80);
+	TM_MFRC522_ClearBitMask(MFRC522_REG_RX_MODE, 0x80);
+
+	//16 data bytes, the checked CRC may still be counted
+	if ((status != MI_OK) || (unLen != 0x80 && unLen != 0x90)) {
 		status = MI_ERR;
 	}
 
@@ -333,14 +870,16 @@ TM_MFRC522_Status_t TM_MFRC522_Read(uint8_t blockAddr, uint8_t* recvData) {
 
 TM_MFRC522_Status_t TM_MFRC522_Write(uint8_t blockAddr, uint8_t* writeData) {
 	TM_MFRC522_Status_t status;
-	uint16_t recvBits;
+	uint16_t recvBits = 0;
 	uint8_t i;
 	uint8_t buff[18]; 
 
+	//The 4 bit ACK/NAK carries no CRC, only the sent frames get one
+	TM_MFRC522_SetBitMask(MFRC522_REG_TX_MODE, 0x80);			//TxCRCEn
+
 	buff[0] = PICC_WRITE;
 	buff[1] = blockAddr;
-	TM_MFRC522_CalculateCRC(buff, 2, &buff[2]);
-	status = TM_MFRC522_ToCard(PCD_TRANSCEIVE, buff, 4, buff, &recvBits);
+	status = TM_MFRC522_ToCard(PCD_TRANSCEIVE, buff, 2, buff, &recvBits);
 
 	if ((status != MI_OK) || (recvBits != 4) || ((buff[0] & 0x0F) != 0x0A)) {   
 		status = MI_ERR;   
@@ -351,14 +890,15 @@ TM_MFRC522_Status_t TM_MFRC522_Write(uint8_t blockAddr, uint8_t* writeData) {
 		for (i = 0; i < 16; i++) {    
 			buff[i] = *(writeData+i);   
 		}
-		TM_MFRC522_CalculateCRC(buff, 16, &buff[16]);
-		status = TM_MFRC522_ToCard(PCD_TRANSCEIVE, buff, 18, buff, &recvBits);
+		status = TM_MFRC522_ToCard(PCD_TRANSCEIVE, buff, 16, buff, &recvBits);
 
 		if ((status != MI_OK) || (recvBits != 4) || ((buff[0] & 0x0F) != 0x0A)) {   
 			status = MI_ERR;   
 		}
 	}
 
+	TM_MFRC522_ClearBitMask(MFRC522_REG_TX_MODE, 0x80);
+
 	return status;
 }
 
@@ -11,9 +11,56 @@
 typedef enum {
 	MI_OK = 0,
 	MI_NOTAGERR,
-	MI_ERR
+	MI_ERR,
+	MI_BUSY,
+	MI_COLLISION
 } TM_MFRC522_Status_t;
 
+/**
+ * Card UID
+ *
+ * Single (4 bytes), double (7 bytes) or triple (10 bytes) size UID
+ * as collected over the cascade levels by TM_MFRC522_Select
+ */
+#define MFRC522_UID_MAX_LEN				10
+
+typedef struct {
+	uint8_t size;						/* UID length in bytes */
+	uint8_t uidByte[MFRC522_UID_MAX_LEN];
+	uint8_t sak;						/* SAK of the last cascade level */
+} TM_MFRC522_Uid_t;
+
+/**
+ * Command completion
+ *
+ * With MFRC522_USE_IRQ the reader IRQ output (MFRC522_IRQ_PIN in spi.h) wakes
+ * the driver through EXTI and ToCard sleeps between events instead of polling
+ * the Comm IRQ register over SPI. Set it to 0 if the IRQ pin is not wired.
+ */
+#ifndef MFRC522_USE_IRQ
+#define MFRC522_USE_IRQ					1
+#endif
+
+/**
+ * CRC_A of the frames built by the driver
+ *
+ * MFRC522_CRC_SW computes it on the MCU from a table, MFRC522_CRC_HW uses the
+ * reader coprocessor, which costs a FIFO load and DivIrqReg polling over SPI.
+ * Block reads and writes let the reader append and check the CRC on the fly
+ * (TxCRCEn/RxCRCEn) and do not use either.
+ */
+typedef enum {
+	MFRC522_CRC_HW = 0,
+	MFRC522_CRC_SW
+} TM_MFRC522_CrcMode_t;
+
+#ifndef MFRC522_CRC_DEFAULT
+#define MFRC522_CRC_DEFAULT				MFRC522_CRC_SW
+#endif
+
+/* Upper bound for one command, the reader timer normally ends it first */
+#define MFRC522_TIMEOUT_MS				25
+
 /* MFRC522 Commands */
 #define PCD_IDLE						0x00   //NO action; Cancel the current command
 #define PCD_AUTHENT						0x0E   //Authentication Key
@@ -28,6 +75,10 @@ typedef enum {
 #define PICC_REQALL						0x52   // find all the cards antenna area
 #define PICC_ANTICOLL					0x93   // anti-collision
 #define PICC_SElECTTAG					0x93   // election card
+#define PICC_SEL_CL1					0x93   // cascade level 1
+#define PICC_SEL_CL2					0x95   // cascade level 2
+#define PICC_SEL_CL3					0x97   // cascade level 3
+#define PICC_CASCADE_TAG				0x88   // CT, UID continues on the next level
 #define PICC_AUTHENT1A					0x60   // authentication key A
 #define PICC_AUTHENT1B					0x61   // authentication key B
 #define PICC_READ						0x30   // Read Block
@@ -135,6 +186,69 @@ extern void TM_MFRC522_Init(void);
  */
 extern TM_MFRC522_Status_t TM_MFRC522_Check(uint8_t* id);
 
+/**
+ * Select one card in the field
+ *
+ * Runs the bit-oriented anticollision loop on every cascade level, so 4, 7
+ * and 10 byte UIDs are supported and cards with colliding UID bits are told
+ * apart: on a collision the '1' branch is taken. Call after a successful
+ * TM_MFRC522_Request, the card is left in the ACTIVE state.
+ *
+ * Returns MI_OK and fills uid if a card is selected, MI_BUSY while an
+ * enumeration or another command is running
+ */
+extern TM_MFRC522_Status_t TM_MFRC522_Select(TM_MFRC522_Uid_t* uid);
+
+/**
+ * Read the UIDs of all cards in the field
+ *
+ * Each card is selected and halted in turn, halted cards no longer answer
+ * REQA so the next round finds another one.
+ *
+ * Parameters:
+ * 	- TM_MFRC522_Uid_t* uids:
+ * 		Array of max entries for the UIDs found
+ *
+ * Returns the number of cards found, 0 while an enumeration is running
+ */
+extern uint8_t TM_MFRC522_Enumerate(TM_MFRC522_Uid_t* uids, uint8_t max);
+
+/**
+ * TM_MFRC522_Enumerate without waiting
+ *
+ * Start sends the first REQA, every Poll collects the running command with
+ * TM_MFRC522_ToCardPoll and starts the next one (anticollision, SELECT, HLTA).
+ * The enumeration state is a single static, shared with TM_MFRC522_Select:
+ * one enumeration at a time. Start, Select and any other reader command
+ * return MI_BUSY until Poll has returned MI_OK.
+ *
+ * Start returns MI_BUSY while an enumeration or a command runs, otherwise MI_OK.
+ * Poll returns MI_BUSY while a command runs, MI_OK with the number of cards in count when done
+ */
+extern TM_MFRC522_Status_t TM_MFRC522_EnumerateStart(TM_MFRC522_Uid_t* uids, uint8_t max);
+extern TM_MFRC522_Status_t TM_MFRC522_EnumeratePoll(uint8_t* count);
+
+/**
+ * Start a command without waiting for it
+ *
+ * Completion is collected with TM_MFRC522_ToCardPoll. Returns MI_BUSY
+ * without touching the reader while the previous command is not collected.
+ */
+extern TM_MFRC522_Status_t TM_MFRC522_ToCardStart(uint8_t command, uint8_t* sendData, uint8_t sendLen);
+
+/**
+ * Collect the result of the command started by TM_MFRC522_ToCardStart
+ *
+ * Returns MI_BUSY while the command runs, otherwise the same result as TM_MFRC522_ToCard.
+ * Costs no SPI traffic while waiting when MFRC522_USE_IRQ is set.
+ */
+extern TM_MFRC522_Status_t TM_MFRC522_ToCardPoll(uint8_t* backData, uint16_t* backLen);
+
+/**
+ * Reader IRQ line asserted, called from the EXTI interrupt
+ */
+extern void TM_MFRC522_IRQHandler(void);
+
 /**
  * Compare 2 RFID ID's
  * Useful if you have known ID (database with allowed IDs), to compare detected card with with your ID
@@ -154,6 +268,8 @@ extern TM_MFRC522_Status_t TM_MFRC522_Compare(uint8_t* CardID, uint8_t* CompareI
  */
 extern void TM_MFRC522_WriteRegister(uint8_t addr, uint8_t val);
 extern uint8_t TM_MFRC522_ReadRegister(uint8_t addr);
+extern void TM_MFRC522_WriteRegisterBurst(uint8_t addr, uint8_t* val, uint8_t len);
+extern void TM_MFRC522_ReadRegisterBurst(uint8_t addr, uint8_t* val, uint8_t len);
 extern void TM_MFRC522_SetBitMask(uint8_t reg, uint8_t mask);
 extern void TM_MFRC522_ClearBitMask(uint8_t reg, uint8_t mask);
 extern void TM_MFRC522_AntennaOn(void);
@@ -163,6 +279,8 @@ extern TM_MFRC522_Status_t TM_MFRC522_Request(uint8_t reqMode, uint8_t* TagType)
 extern TM_MFRC522_Status_t TM_MFRC522_ToCard(uint8_t command, uint8_t* sendData, uint8_t sendLen, uint8_t* backData, uint16_t* backLen);
 extern TM_MFRC522_Status_t TM_MFRC522_Anticoll(uint8_t* serNum);
 extern void TM_MFRC522_CalculateCRC(uint8_t* pIndata, uint8_t len, uint8_t* pOutData);
+extern void TM_MFRC522_CalculateCRCEx(TM_MFRC522_CrcMode_t mode, uint8_t* pIndata, uint8_t len, uint8_t* pOutData);
+extern uint16_t TM_MFRC522_CrcA(const uint8_t* data, uint16_t len);
 extern uint8_t TM_MFRC522_SelectTag(uint8_t* serNum);
 extern TM_MFRC522_Status_t TM_MFRC522_Auth(uint8_t authMode, uint8_t BlockAddr, uint8_t* Sectorkey, uint8_t* serNum);
 extern TM_MFRC522_Status_t TM_MFRC522_Read(uint8_t blockAddr, uint8_t* recvData);
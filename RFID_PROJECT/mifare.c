@@ -0,0 +1,178 @@
+#include "mifare.h"
+#include "delay.h"
+#include <string.h>
+
+#define MIFARE_NO_SECTOR				0xFF
+#define MIFARE_NO_KEY					0xFF
+#define STATUS2_CRYPTO1_ON				0x08	/* Status2Reg MFCrypto1On */
+
+static const Mifare_Key_t* Keys;
+static uint8_t u8KeyCount;
+static uint8_t u8KeyCache[MIFARE_MAX_SECTORS];	/* Index of the key that last worked */
+static TM_MFRC522_Uid_t CardUid;
+static uint8_t u8AuthSector = MIFARE_NO_SECTOR;	/* Sector of the open Crypto1 session */
+
+uint8_t Mifare_SectorBlocks(uint8_t sector)
+{
+	return (sector < 32) ? 4 : 16;
+}
+
+uint8_t Mifare_SectorFirstBlock(uint8_t sector)
+{
+	return (sector < 32) ? sector * 4 : 128 + (sector - 32) * 16;
+}
+
+void Mifare_SetKeys(const Mifare_Key_t* keys, uint8_t count)
+{
+	Keys = keys;
+	u8KeyCount = count;
+	memset(u8KeyCache, MIFARE_NO_KEY, sizeof(u8KeyCache));
+}
+
+/* Wake and select the card again, a failed authentication leaves it unselected */
+static TM_MFRC522_Status_t Mifare_Reselect(void)
+{
+	TM_MFRC522_Uid_t uid;
+	uint8_t atqa[MFRC522_MAX_LEN];
+
+	u8AuthSector = MIFARE_NO_SECTOR;
+	TM_MFRC522_ClearBitMask(MFRC522_REG_STATUS2, STATUS2_CRYPTO1_ON);
+
+	if (TM_MFRC522_Request(PICC_REQALL, atqa) != MI_OK || TM_MFRC522_Select(&uid) != MI_OK) {
+		return MI_ERR;
+	}
+	if (uid.size != CardUid.size || memcmp(uid.uidByte, CardUid.uidByte, uid.size)) {
+		return MI_ERR;
+	}
+	return MI_OK;
+}
+
+TM_MFRC522_Status_t Mifare_Begin(const TM_MFRC522_Uid_t* uid)
+{
+	CardUid = *uid;
+	return Mifare_Reselect();
+}
+
+void Mifare_End(void)
+{
+	//Sent encrypted while the session is open
+	TM_MFRC522_Halt();
+	TM_MFRC522_ClearBitMask(MFRC522_REG_STATUS2, STATUS2_CRYPTO1_ON);
+	u8AuthSector = MIFARE_NO_SECTOR;
+}
+
+static TM_MFRC522_Status_t Mifare_AuthSector(uint8_t sector, Mifare_SectorTiming_t* timing)
+{
+	uint8_t block = Mifare_SectorFirstBlock(sector) + Mifare_SectorBlocks(sector) - 1;
+	uint8_t cached = u8KeyCache[sector];
+	uint8_t n, k;
+
+	if (u8AuthSector == sector) {
+		return MI_OK;
+	}
+
+	//Cached key first, then the list in order
+	for (n = 0; n < u8KeyCount + 1; n++) {
+		if (n == 0) {
+			if (cached >= u8KeyCount) {
+				continue;
+			}
+			k = cached;
+		} else {
+			k = n - 1;
+			if (k == cached) {
+				continue;
+			}
+		}
+
+		++timing->u8AuthTries;
+		//The last 4 UID bytes go into the authentication
+		if (TM_MFRC522_Auth(Keys[k].u8Type, block, (uint8_t*)Keys[k].u8Key, &CardUid.uidByte[CardUid.size - 4]) == MI_OK) {
+			u8KeyCache[sector] = k;
+			u8AuthSector = sector;
+			return MI_OK;
+		}
+		if (Mifare_Reselect() != MI_OK) {
+			break;
+		}
+	}
+
+	u8KeyCache[sector] = MIFARE_NO_KEY;
+	return MI_ERR;
+}
+
+TM_MFRC522_Status_t Mifare_ReadSector(uint8_t sector, uint8_t* data, Mifare_SectorTiming_t* timing)
+{
+	TM_MFRC522_Status_t status;
+	Mifare_SectorTiming_t t;
+	uint32_t u32Start = Delay_GetMicros();
+	uint8_t first, i, blocks;
+
+	memset(&t, 0, sizeof(t));
+	if (sector >= MIFARE_MAX_SECTORS) {
+		return MI_ERR;
+	}
+
+	status = Mifare_AuthSector(sector, &t);
+	t.u32AuthUs = Delay_GetMicros() - u32Start;
+
+	if (status == MI_OK) {
+		u32Start = Delay_GetMicros();
+		first = Mifare_SectorFirstBlock(sector);
+		blocks = Mifare_SectorBlocks(sector) - 1;
+		for (i = 0; i < blocks && status == MI_OK; i++) {
+			status = TM_MFRC522_Read(first + i, &data[i * MIFARE_BLOCK_SIZE]);
+			if (status == MI_OK) {
+				++t.u8Blocks;
+			}
+		}
+		t.u32TransferUs = Delay_GetMicros() - u32Start;
+		//A NAK drops the card out of the ACTIVE state, get it back for the next sector
+		if (status != MI_OK) {
+			Mifare_Reselect();
+		}
+	}
+
+	if (timing) {
+		*timing = t;
+	}
+	return status;
+}
+
+TM_MFRC522_Status_t Mifare_WriteSector(uint8_t sector, const uint8_t* data, Mifare_SectorTiming_t* timing)
+{
+	TM_MFRC522_Status_t status;
+	Mifare_SectorTiming_t t;
+	uint32_t u32Start = Delay_GetMicros();
+	uint8_t first, i, blocks;
+
+	memset(&t, 0, sizeof(t));
+	if (sector >= MIFARE_MAX_SECTORS) {
+		return MI_ERR;
+	}
+
+	status = Mifare_AuthSector(sector, &t);
+	t.u32AuthUs = Delay_GetMicros() - u32Start;
+
+	if (status == MI_OK) {
+		u32Start = Delay_GetMicros();
+		first = Mifare_SectorFirstBlock(sector);
+		blocks = Mifare_SectorBlocks(sector) - 1;
+		//Block 0 holds the UID and is read only
+		for (i = (sector == 0) ? 1 : 0; i < blocks && status == MI_OK; i++) {
+			status = TM_MFRC522_Write(first + i, (uint8_t*)&data[i * MIFARE_BLOCK_SIZE]);
+			if (status == MI_OK) {
+				++t.u8Blocks;
+			}
+		}
+		t.u32TransferUs = Delay_GetMicros() - u32Start;
+		if (status != MI_OK) {
+			Mifare_Reselect();
+		}
+	}
+
+	if (timing) {
+		*timing = t;
+	}
+	return status;
+}
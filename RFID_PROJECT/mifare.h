@@ -0,0 +1,76 @@
+#ifndef MIFARE_H_
+#define MIFARE_H_
+
+#include "stm32f10x.h"
+#include "mfrc522.h"
+
+/**
+ * MIFARE Classic sector access
+ *
+ * A sector is authenticated once and all its data blocks are then read or
+ * written back to back in the same Crypto1 session. The key that last
+ * worked for a sector is tried first next time, a failed authentication
+ * costs a reselect of the card. 1K and 4K layouts are supported.
+ *
+ * The reader has to be awake with the field on.
+ */
+
+#define MIFARE_MAX_SECTORS				40
+#define MIFARE_KEY_LEN					6
+#define MIFARE_BLOCK_SIZE				16
+#define MIFARE_MAX_DATA_BLOCKS			15		/* Data blocks of a 16 block sector */
+
+typedef struct {
+	uint8_t u8Type;						/* PICC_AUTHENT1A or PICC_AUTHENT1B */
+	uint8_t u8Key[MIFARE_KEY_LEN];
+} Mifare_Key_t;
+
+/* Time spent on one sector */
+typedef struct {
+	uint32_t u32AuthUs;					/* Authentication, reselects included */
+	uint32_t u32TransferUs;				/* Block reads or writes */
+	uint8_t u8AuthTries;				/* Keys tried, 0 if the session was still open */
+	uint8_t u8Blocks;					/* Blocks transferred */
+} Mifare_SectorTiming_t;
+
+/**
+ * Keys to try, the array has to stay valid. Clears the key cache.
+ */
+extern void Mifare_SetKeys(const Mifare_Key_t* keys, uint8_t count);
+
+/**
+ * Start working with a card, it is woken with WUPA and selected
+ *
+ * Returns MI_OK if the card with this UID answered
+ */
+extern TM_MFRC522_Status_t Mifare_Begin(const TM_MFRC522_Uid_t* uid);
+
+/**
+ * Halt the card and leave the Crypto1 session
+ */
+extern void Mifare_End(void);
+
+extern uint8_t Mifare_SectorBlocks(uint8_t sector);
+extern uint8_t Mifare_SectorFirstBlock(uint8_t sector);
+
+/**
+ * Read the data blocks of a sector, the trailer is skipped
+ *
+ * Parameters:
+ * 	- uint8_t* data:
+ * 		16 bytes for each data block, (Mifare_SectorBlocks(sector) - 1) * 16 bytes
+ * 	- Mifare_SectorTiming_t* timing:
+ * 		Filled with the time spent, may be 0
+ *
+ * Returns MI_OK if all blocks were read
+ */
+extern TM_MFRC522_Status_t Mifare_ReadSector(uint8_t sector, uint8_t* data, Mifare_SectorTiming_t* timing);
+
+/**
+ * Write the data blocks of a sector, same layout as Mifare_ReadSector
+ *
+ * The manufacturer block of sector 0 is not written, its 16 bytes in data are ignored.
+ */
+extern TM_MFRC522_Status_t Mifare_WriteSector(uint8_t sector, const uint8_t* data, Mifare_SectorTiming_t* timing);
+
+#endif
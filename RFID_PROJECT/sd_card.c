@@ -3,8 +3,34 @@
 FATFS FatFs;		/* FatFs work area needed for each volume */
 FIL Fil;			/* File object needed for each open file */
 
+#if FF_MULTI_PARTITION
+FATFS FatFsLog;		/* Work area of the log volume */
+
+PARTITION VolToPart[FF_VOLUMES] = {
+	{0, 1},		/* "0:" ==> 1st partition on the card */
+	{0, 2}		/* "1:" ==> 2nd partition on the card */
+};
+#endif
+
 void My_GPIO_Init(void);
 
+/* Mount once, remounting would invalidate files other modules keep open */
+FRESULT sd_card_mount(void) {
+	static uint8_t mounted;
+	FRESULT fr = FR_OK;
+
+	if (!mounted) {
+		fr = f_mount(&FatFs, "", 1);	/* Mount the default drive now */
+#if FF_MULTI_PARTITION
+		if (fr == FR_OK) {
+			fr = f_mount(&FatFsLog, SD_CARD_LOG_VOLUME, 1);
+		}
+#endif
+		mounted = (fr == FR_OK);
+	}
+	return fr;
+}
+
 void sd_card(void) {
 	UINT bw;
 	FRESULT fr;
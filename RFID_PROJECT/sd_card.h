@@ -6,7 +6,16 @@
 #ifndef SD_CARD_H__
 #define SD_CARD_H__
 
+/* Volume of the access log. With FF_MULTI_PARTITION (FF_PROFILE 3) the log
+ * gets the second partition, so a full log never takes space from CARDS.TXT */
+#if FF_MULTI_PARTITION
+#define SD_CARD_LOG_VOLUME	"1:"
+#else
+#define SD_CARD_LOG_VOLUME	""
+#endif
+
 void My_GPIO_Init(void);
+FRESULT sd_card_mount(void);
 void sd_card(void);
 
 #endif
\ No newline at end of file
@@ -51,8 +51,8 @@
 #define	CK_L()		PORTB &= 0xFB	/* Set MMC SCLK "low" */
 
 #define CS_INIT()	DDRB  |= 0x08	/* Initialize port for MMC CS as output */
-#define	CS_H()		GPIO_SetBits(GPIOA, GPIO_Pin_4) //PORTB |= 0x08	/* Set MMC CS "high" */
-#define CS_L()		GPIO_ResetBits(GPIOA, GPIO_Pin_4) //PORTB &= 0xF7	/* Set MMC CS "low" */
+#define	CS_H()		SD_CS_HIGH		/* Set MMC CS "high" */
+#define CS_L()		SD_CS_LOW		/* Set MMC CS "low" */
 
 
 static
@@ -62,6 +62,15 @@ void dly_us (UINT n)	/* Delay n microseconds (avr-gcc -Os) */
 }
 
 
+static
+void mem_cpy (BYTE* dst, const BYTE* src, UINT cnt)	/* Copy memory block */
+{
+	do {
+		*dst++ = *src++;
+	} while (--cnt);
+}
+
+
 
 /*--------------------------------------------------------------------------
 
@@ -99,6 +108,42 @@ DSTATUS Stat = STA_NOINIT;	/* Disk status */
 static
 BYTE CardType;			/* b0:MMC, b1:SDv1, b2:SDv2, b3:Block addressing */
 
+static
+MMC_IOSTAT IoStat;		/* Sector I/O counters (MMC_GET_IOSTAT) */
+
+
+/* Write-back sector cache between FatFs and the card. Single sector accesses
+/  (FAT, directory and the FF_FS_TINY window) are served from here, adjacent
+/  dirty sectors are written back with one CMD25 and everything is flushed on
+/  CTRL_SYNC (f_sync/f_close). Set CACHE_SECTORS to 0 to disable the cache. */
+
+#ifndef CACHE_SECTORS
+#define CACHE_SECTORS	4			/* Number of cached sectors (0:disabled) */
+#endif
+
+#define CF_VALID	0x01			/* Cache line holds a sector */
+#define CF_DIRTY	0x02			/* Cache line is newer than the card */
+
+#if CACHE_SECTORS
+static
+BYTE CacheBuf[CACHE_SECTORS][512];	/* Cached sector data */
+
+static
+LBA_t CacheLba[CACHE_SECTORS];		/* Sector number of each line */
+
+static
+BYTE CacheFlag[CACHE_SECTORS];		/* CF_VALID | CF_DIRTY */
+
+static
+DWORD CacheAge[CACHE_SECTORS];		/* Last access stamp for LRU eviction */
+
+static
+DWORD CacheClock;					/* Access stamp counter */
+
+static
+int cache_flush (void);
+#endif
+
 
 
 /*-----------------------------------------------------------------------*/
@@ -340,6 +385,9 @@ DSTATUS disk_initialize (
 
 	if (drv) return RES_NOTRDY;
 
+#if CACHE_SECTORS
+	if (!(Stat & STA_NOINIT)) cache_flush();	/* Initialized again (f_mkfs after f_fdisk), keep the dirty lines */
+#endif
 	dly_us(10000);			/* 10ms */
 	
 	My_SPI_Init();
@@ -377,6 +425,9 @@ DSTATUS disk_initialize (
 	CardType = ty;
 	s = ty ? 0 : STA_NOINIT;
 	Stat = s;
+#if CACHE_SECTORS
+	for (n = 0; n < CACHE_SECTORS; n++) CacheFlag[n] = 0;	/* Drop the cache of a previous card */
+#endif
 
 	deselect();
 
@@ -386,11 +437,11 @@ DSTATUS disk_initialize (
 
 
 /*-----------------------------------------------------------------------*/
-/* Read Sector(s)                                                        */
+/* Read sector(s) from the card                                          */
 /*-----------------------------------------------------------------------*/
 
-DRESULT disk_read (
-	BYTE drv,			/* Physical drive nmuber (0) */
+static
+int mmc_read (			/* 1:OK, 0:Failed */
 	BYTE *buff,			/* Pointer to the data buffer to store read data */
 	LBA_t sector,		/* Start sector number (LBA) */
 	UINT count			/* Sector count (1..128) */
@@ -400,9 +451,10 @@ DRESULT disk_read (
 	DWORD sect = (DWORD)sector;
 
 
-	if (disk_status(drv) & STA_NOINIT) return RES_NOTRDY;
 	if (!(CardType & CT_BLOCK)) sect *= 512;	/* Convert LBA to byte address if needed */
 
+	IoStat.rd_cmd++;
+	IoStat.rd_sect += count;
 	cmd = count > 1 ? CMD18 : CMD17;			/*  READ_MULTIPLE_BLOCK : READ_SINGLE_BLOCK */
 	if (send_cmd(cmd, sect) == 0) {
 		do {
@@ -413,39 +465,43 @@ DRESULT disk_read (
 	}
 	deselect();
 
-	return count ? RES_ERROR : RES_OK;
+	return count ? 0 : 1;
 }
 
 
 
 /*-----------------------------------------------------------------------*/
-/* Write Sector(s)                                                       */
+/* Write sector(s) to the card                                           */
 /*-----------------------------------------------------------------------*/
 
-DRESULT disk_write (
-	BYTE drv,			/* Physical drive nmuber (0) */
+static
+int mmc_write (			/* 1:OK, 0:Failed */
 	const BYTE *buff,	/* Pointer to the data to be written */
+	const BYTE **bvec,	/* Pointers to each sector data (used when buff is null) */
 	LBA_t sector,		/* Start sector number (LBA) */
 	UINT count			/* Sector count (1..128) */
 )
 {
 	DWORD sect = (DWORD)sector;
+	UINT i;
 
 
-	if (disk_status(drv) & STA_NOINIT) return RES_NOTRDY;
 	if (!(CardType & CT_BLOCK)) sect *= 512;	/* Convert LBA to byte address if needed */
 
+	IoStat.wr_cmd++;
+	IoStat.wr_sect += count;
 	if (count == 1) {	/* Single block write */
 		if ((send_cmd(CMD24, sect) == 0)	/* WRITE_BLOCK */
-			&& xmit_datablock(buff, 0xFE))
+			&& xmit_datablock(buff ? buff : bvec[0], 0xFE))
 			count = 0;
 	}
 	else {				/* Multiple block write */
 		if (CardType & CT_SDC) send_cmd(ACMD23, count);
 		if (send_cmd(CMD25, sect) == 0) {	/* WRITE_MULTIPLE_BLOCK */
+			i = 0;
 			do {
-				if (!xmit_datablock(buff, 0xFC)) break;
-				buff += 512;
+				if (!xmit_datablock(buff ? buff + 512 * i : bvec[i], 0xFC)) break;
+				i++;
 			} while (--count);
 			if (!xmit_datablock(0, 0xFD))	/* STOP_TRAN token */
 				count = 1;
@@ -453,7 +509,216 @@ DRESULT disk_write (
 	}
 	deselect();
 
-	return count ? RES_ERROR : RES_OK;
+	return count ? 0 : 1;
+}
+
+
+
+#if CACHE_SECTORS
+/*-----------------------------------------------------------------------*/
+/* Find the cache line holding a sector                                  */
+/*-----------------------------------------------------------------------*/
+
+static
+int cache_find (		/* Line index, -1:Not cached */
+	LBA_t sector		/* Sector number (LBA) */
+)
+{
+	int i;
+
+
+	for (i = 0; i < CACHE_SECTORS; i++) {
+		if ((CacheFlag[i] & CF_VALID) && CacheLba[i] == sector) return i;
+	}
+	return -1;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Write back the run of adjacent dirty lines containing a line          */
+/*-----------------------------------------------------------------------*/
+
+static
+int cache_writeback (	/* 1:OK, 0:Failed */
+	int line			/* Dirty line to be written back */
+)
+{
+	const BYTE *bvec[CACHE_SECTORS];
+	BYTE run[CACHE_SECTORS];
+	LBA_t start;
+	UINT n, i;
+	int j;
+
+
+	/* Extend the run downward to its first adjacent dirty sector */
+	start = CacheLba[line];
+	while (start > 0 && (j = cache_find(start - 1)) >= 0 && (CacheFlag[j] & CF_DIRTY)) start--;
+
+	/* Collect the dirty lines in ascending sector order */
+	for (n = 0; n < CACHE_SECTORS; n++) {
+		j = cache_find(start + n);
+		if (j < 0 || !(CacheFlag[j] & CF_DIRTY)) break;
+		bvec[n] = CacheBuf[j];
+		run[n] = (BYTE)j;
+	}
+
+	if (!mmc_write(0, bvec, start, n)) return 0;
+	if (n > 1) IoStat.wr_merge++;
+
+	for (i = 0; i < n; i++) CacheFlag[run[i]] &= ~CF_DIRTY;
+	return 1;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Write back all dirty lines                                            */
+/*-----------------------------------------------------------------------*/
+
+static
+int cache_flush (void)	/* 1:OK, 0:Failed */
+{
+	int i;
+
+
+	for (i = 0; i < CACHE_SECTORS; i++) {
+		if ((CacheFlag[i] & CF_DIRTY) && !cache_writeback(i)) return 0;
+	}
+	return 1;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Get a line for a sector, evicting the least recently used one         */
+/*-----------------------------------------------------------------------*/
+
+static
+int cache_alloc (		/* Line index, -1:Write back failed */
+	LBA_t sector		/* Sector number (LBA) to be cached */
+)
+{
+	int i, v = 0;
+
+
+	for (i = 0; i < CACHE_SECTORS; i++) {
+		if (!(CacheFlag[i] & CF_VALID)) {	/* Free line */
+			v = i;
+			break;
+		}
+		if (CacheAge[i] < CacheAge[v]) v = i;
+	}
+	if ((CacheFlag[v] & CF_DIRTY) && !cache_writeback(v)) return -1;
+
+	CacheLba[v] = sector;
+	CacheFlag[v] = CF_VALID;
+	return v;
+}
+#endif
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Read Sector(s)                                                        */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_read (
+	BYTE drv,			/* Physical drive nmuber (0) */
+	BYTE *buff,			/* Pointer to the data buffer to store read data */
+	LBA_t sector,		/* Start sector number (LBA) */
+	UINT count			/* Sector count (1..128) */
+)
+{
+#if CACHE_SECTORS
+	int i;
+	UINT n;
+#endif
+
+
+	if (disk_status(drv) & STA_NOINIT) return RES_NOTRDY;
+
+#if CACHE_SECTORS
+	if (count == 1) {	/* Single sector: serve it through the cache */
+		i = cache_find(sector);
+		if (i >= 0) {
+			IoStat.hit++;
+		} else {
+			IoStat.miss++;
+			i = cache_alloc(sector);
+			if (i < 0) return RES_ERROR;
+			if (!mmc_read(CacheBuf[i], sector, 1)) {
+				CacheFlag[i] = 0;
+				return RES_ERROR;
+			}
+		}
+		CacheAge[i] = ++CacheClock;
+		mem_cpy(buff, CacheBuf[i], 512);
+		return RES_OK;
+	}
+
+	/* Bulk read bypasses the cache, then takes newer data from dirty lines */
+	if (!mmc_read(buff, sector, count)) return RES_ERROR;
+	for (n = 0; n < count; n++) {
+		i = cache_find(sector + n);
+		if (i >= 0 && (CacheFlag[i] & CF_DIRTY)) mem_cpy(buff + 512 * n, CacheBuf[i], 512);
+	}
+	return RES_OK;
+#else
+	return mmc_read(buff, sector, count) ? RES_OK : RES_ERROR;
+#endif
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Write Sector(s)                                                       */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_write (
+	BYTE drv,			/* Physical drive nmuber (0) */
+	const BYTE *buff,	/* Pointer to the data to be written */
+	LBA_t sector,		/* Start sector number (LBA) */
+	UINT count			/* Sector count (1..128) */
+)
+{
+#if CACHE_SECTORS
+	int i;
+	UINT n;
+#endif
+
+
+	if (disk_status(drv) & STA_NOINIT) return RES_NOTRDY;
+
+#if CACHE_SECTORS
+	if (count == 1) {	/* Single sector: keep it dirty in the cache */
+		i = cache_find(sector);
+		if (i >= 0) {
+			IoStat.hit++;
+		} else {
+			IoStat.miss++;
+			i = cache_alloc(sector);
+			if (i < 0) return RES_ERROR;
+		}
+		CacheAge[i] = ++CacheClock;
+		mem_cpy(CacheBuf[i], buff, 512);
+		CacheFlag[i] |= CF_DIRTY;
+		return RES_OK;
+	}
+
+	/* Bulk write goes to the card, cached copies are refreshed and clean */
+	if (!mmc_write(buff, 0, sector, count)) return RES_ERROR;
+	for (n = 0; n < count; n++) {
+		i = cache_find(sector + n);
+		if (i >= 0) {
+			mem_cpy(CacheBuf[i], buff + 512 * n, 512);
+			CacheFlag[i] &= ~CF_DIRTY;
+		}
+	}
+	return RES_OK;
+#else
+	return mmc_write(buff, 0, sector, count) ? RES_OK : RES_ERROR;
+#endif
 }
 
 
@@ -477,6 +742,9 @@ DRESULT disk_ioctl (
 	res = RES_ERROR;
 	switch (ctrl) {
 		case CTRL_SYNC :		/* Make sure that no pending write process */
+#if CACHE_SECTORS
+			if (!cache_flush()) break;
+#endif
 			if (select()) res = RES_OK;
 			break;
 
@@ -499,6 +767,11 @@ DRESULT disk_ioctl (
 			res = RES_OK;
 			break;
 
+		case MMC_GET_IOSTAT :	/* Get sector I/O counters (MMC_IOSTAT) */
+			*(MMC_IOSTAT*)buff = IoStat;
+			res = RES_OK;
+			break;
+
 		default:
 			res = RES_PARERR;
 	}
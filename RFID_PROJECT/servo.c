@@ -1,18 +1,119 @@
 #include "servo.h"
 
+#define SERVO_TICKS_PER_S		(1000000 / SERVO_TICK_US)
+
+/* Position and speed in CCR counts, Q16 */
+static volatile int32_t i32Pos;
+static int32_t i32Target;
+static int32_t i32Vel;				/* Per tick, signed */
+static uint32_t u32VMax;			/* Per tick */
+static uint32_t u32Accel;			/* Per tick^2 */
+static void (*pfMoveDone)(void);
+static volatile uint8_t u8Moving;
+
+void Servo_MoveTo(uint16_t u16Pulse, uint16_t u16Speed, void (*pfDone)(void))
+{
+	if (u16Pulse > SERVO_PULSE_OPEN) {
+		u16Pulse = SERVO_PULSE_OPEN;
+	}
+
+	TIM_ITConfig(TIM2, TIM_IT_Update, DISABLE);
+	i32Target = (int32_t)u16Pulse << 16;
+	u32VMax = ((uint64_t)u16Speed << 16) / SERVO_TICKS_PER_S;
+	u32Accel = ((uint64_t)SERVO_ACCEL << 16) / ((uint32_t)SERVO_TICKS_PER_S * SERVO_TICKS_PER_S);
+	if (u32VMax == 0) {
+		u32VMax = 1;
+	}
+	if (u32Accel == 0) {
+		u32Accel = 1;
+	}
+	pfMoveDone = pfDone;
+	u8Moving = 1;
+	TIM_ClearITPendingBit(TIM2, TIM_IT_Update);
+	TIM_ITConfig(TIM2, TIM_IT_Update, ENABLE);
+}
+
+void Servo_MoveToAngle(uint8_t u8Angle, uint16_t u16DegPerS, void (*pfDone)(void))
+{
+	if (u8Angle > SERVO_ANGLE_MAX) {
+		u8Angle = SERVO_ANGLE_MAX;
+	}
+	Servo_MoveTo(SERVO_PULSE_CLOSED + (uint32_t)u8Angle * (SERVO_PULSE_OPEN - SERVO_PULSE_CLOSED) / SERVO_ANGLE_MAX,
+		(uint32_t)u16DegPerS * (SERVO_PULSE_OPEN - SERVO_PULSE_CLOSED) / SERVO_ANGLE_MAX, pfDone);
+}
+
+uint8_t Servo_IsMoving(void)
+{
+	return u8Moving;
+}
+
 void ServoOn(void){
-	for (int i = 0; i <= 1999; i += 20){
-		TIM2->CCR1 = i; 
-		Delay_Ms(100);     
+	Servo_MoveTo(SERVO_PULSE_OPEN, SERVO_SPEED, 0);
+	while (Servo_IsMoving()) {
+		__WFI();
 	}
 }
 
 
 void ServoOff(void){
-	for (int i = 1999; i >= 0; i -= 20){
-		TIM2->CCR1 = i;  
-		Delay_Ms(100);    
+	Servo_MoveTo(SERVO_PULSE_CLOSED, SERVO_SPEED, 0);
+	while (Servo_IsMoving()) {
+		__WFI();
+	}
+}
+
+void TIM2_IRQHandler(void)
+{
+	void (*pfDone)(void);
+	int32_t i32Rem, i32Dir, i32Speed;
+	uint32_t u32Dist;
+
+	if (TIM_GetITStatus(TIM2, TIM_IT_Update) == RESET) {
+		return;
+	}
+	TIM_ClearITPendingBit(TIM2, TIM_IT_Update);
+
+	i32Rem = i32Target - i32Pos;
+	i32Dir = (i32Rem < 0) ? -1 : 1;
+	u32Dist = i32Rem * i32Dir;
+	i32Speed = i32Vel * i32Dir;			/* Positive towards the target */
+
+	/* Brake once the stopping distance v^2 / 2a reaches the distance left, never below one step of a */
+	if (i32Speed > 0 && (uint64_t)i32Speed * i32Speed >= (uint64_t)2 * u32Accel * u32Dist) {
+		i32Speed -= u32Accel;
+		if (i32Speed < (int32_t)u32Accel) {
+			i32Speed = u32Accel;
+		}
+	} else {
+		i32Speed += u32Accel;
+		if (i32Speed > (int32_t)u32VMax) {
+			i32Speed = u32VMax;
+		}
+	}
+
+	if (i32Speed > 0 && u32Dist <= (uint32_t)i32Speed) {
+		i32Pos = i32Target;
+		i32Vel = 0;
+		TIM2->CCR1 = i32Pos >> 16;
+		TIM_ITConfig(TIM2, TIM_IT_Update, DISABLE);
+		u8Moving = 0;
+		pfDone = pfMoveDone;
+		pfMoveDone = 0;
+		if (pfDone) {
+			pfDone();
+		}
+		return;
 	}
+
+	i32Vel = i32Speed * i32Dir;
+	i32Pos += i32Vel;
+	/* A reversal still carries speed away from the target, never past the ends of travel */
+	if (i32Pos < ((int32_t)SERVO_PULSE_CLOSED << 16)) {
+		i32Pos = (int32_t)SERVO_PULSE_CLOSED << 16;
+	} else if (i32Pos > ((int32_t)SERVO_PULSE_OPEN << 16)) {
+		i32Pos = (int32_t)SERVO_PULSE_OPEN << 16;
+	}
+	TIM2->CCR1 = (i32Pos + 0x8000) >> 16;
 }
 
 void PWM_Init(void)
@@ -21,6 +122,7 @@ void PWM_Init(void)
 	TIM_TimeBaseInitTypeDef TIM_TimeBaseInitStruct;
 	TIM_OCInitTypeDef TIM_OCInitStruct;
 	GPIO_InitTypeDef GPIO_InitStruct;
+	NVIC_InitTypeDef NVIC_InitStruct;
 	
 	// Step 1: Initialize TIM2
 	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2, ENABLE);
@@ -40,8 +142,15 @@ void PWM_Init(void)
 	TIM_OCInitStruct.TIM_Pulse = 0;
 	TIM_OC1Init(TIM2, &TIM_OCInitStruct);
 	TIM_OC1PreloadConfig(TIM2, TIM_OCPreload_Enable);
+
+	// Step 3: Update interrupt for the motion engine, enabled while moving
+	NVIC_InitStruct.NVIC_IRQChannel = TIM2_IRQn;
+	NVIC_InitStruct.NVIC_IRQChannelPreemptionPriority = 2;
+	NVIC_InitStruct.NVIC_IRQChannelSubPriority = 0;
+	NVIC_InitStruct.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVIC_InitStruct);
 	
-	// Step 3: Initialize GPIOA (PA0)
+	// Step 4: Initialize GPIOA (PA0)
 	RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOA, ENABLE);
 	GPIO_InitStruct.GPIO_Pin = servoPin;
 	GPIO_InitStruct.GPIO_Mode = GPIO_Mode_AF_PP;
@@ -5,8 +5,25 @@
 #ifndef SERVO_H__
 #define SERVO_H__
 
+#define SERVO_PULSE_CLOSED		0		/* TIM2 CCR1 at the closed position */
+#define SERVO_PULSE_OPEN		1999	/* TIM2 CCR1 at the open position, TIM2 period */
+#define SERVO_ANGLE_MAX			180		/* Angle of SERVO_PULSE_OPEN */
+#define SERVO_SPEED				200		/* Default speed limit, CCR counts per second */
+#define SERVO_ACCEL				400		/* CCR counts per second^2 */
+#define SERVO_TICK_US			2000	/* TIM2 update period, one motion step */
+
 void ServoOn(void);
 void ServoOff(void);
 void PWM_Init(void);
 
+/*
+ * Motion engine: CCR1 is updated from the TIM2 update interrupt along a
+ * trapezoidal speed profile. A new command takes over from the current
+ * position and speed. pfDone runs in interrupt context when the target is
+ * reached, a command replaced before that does not call it.
+ */
+void Servo_MoveTo(uint16_t u16Pulse, uint16_t u16Speed, void (*pfDone)(void));
+void Servo_MoveToAngle(uint8_t u8Angle, uint16_t u16DegPerS, void (*pfDone)(void));
+uint8_t Servo_IsMoving(void);
+
 #endif
\ No newline at end of file
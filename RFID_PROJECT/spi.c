@@ -1,4 +1,5 @@
 #include "spi.h"
+#include "mfrc522.h"
 
 uint8_t TM_SPI_Send(uint8_t data)
 {
@@ -53,6 +54,40 @@ void TM_MFRC522_InitPins(void)
 	MFRC522_CS_HIGH;
 }
 
+void TM_MFRC522_InitIrqPin(void)
+{
+	GPIO_InitTypeDef gpioInit;
+	EXTI_InitTypeDef extiInit;
+	NVIC_InitTypeDef nvicInit;
+	
+	RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOB | RCC_APB2Periph_AFIO, ENABLE);
+	gpioInit.GPIO_Mode=GPIO_Mode_IPU;
+	gpioInit.GPIO_Speed=GPIO_Speed_50MHz;
+	gpioInit.GPIO_Pin=MFRC522_IRQ_PIN;
+	GPIO_Init(MFRC522_IRQ_PORT, &gpioInit);
+	GPIO_EXTILineConfig(MFRC522_IRQ_PORT_SOURCE, MFRC522_IRQ_PIN_SOURCE);
+	
+	extiInit.EXTI_Line = MFRC522_IRQ_EXTI_LINE;
+	extiInit.EXTI_Mode = EXTI_Mode_Interrupt;
+	extiInit.EXTI_Trigger = EXTI_Trigger_Falling;
+	extiInit.EXTI_LineCmd = ENABLE;
+	EXTI_Init(&extiInit);
+	
+	nvicInit.NVIC_IRQChannel = MFRC522_IRQ_CHANNEL;
+	nvicInit.NVIC_IRQChannelPreemptionPriority = 1;
+	nvicInit.NVIC_IRQChannelSubPriority = 0;
+	nvicInit.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&nvicInit);
+}
+
+void EXTI1_IRQHandler(void)
+{
+	if (EXTI_GetITStatus(MFRC522_IRQ_EXTI_LINE) != RESET) {
+		EXTI_ClearITPendingBit(MFRC522_IRQ_EXTI_LINE);
+		TM_MFRC522_IRQHandler();
+	}
+}
+
 void My_SPI_Init(void)
 {
 	GPIO_InitTypeDef gpioInit;
@@ -70,7 +105,7 @@ void My_SPI_Init(void)
 	gpioInit.GPIO_Speed=GPIO_Speed_50MHz;
 	gpioInit.GPIO_Pin=GPIO_Pin_4;
 	GPIO_Init(GPIOA, &gpioInit);
-	GPIO_SetBits(GPIOA, GPIO_Pin_4);
+	SD_CS_HIGH;
 	
 	gpioInit.GPIO_Mode=GPIO_Mode_IN_FLOATING;
 	gpioInit.GPIO_Speed=GPIO_Speed_50MHz;
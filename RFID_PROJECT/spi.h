@@ -15,8 +15,25 @@ void TM_SPI_Init(void);
 uint8_t TM_SPI_Send(uint8_t data);
 
 extern void TM_MFRC522_InitPins(void);
+extern void TM_MFRC522_InitIrqPin(void);
 
 #define MFRC522_CS_LOW					GPIO_ResetBits(GPIOB, GPIO_Pin_12)
 #define MFRC522_CS_HIGH					GPIO_SetBits(GPIOB, GPIO_Pin_12)
 
+/* MFRC522 IRQ output (active low) on PB1 / EXTI1 */
+#define MFRC522_IRQ_PORT				GPIOB
+#define MFRC522_IRQ_PIN					GPIO_Pin_1
+#define MFRC522_IRQ_PORT_SOURCE			GPIO_PortSourceGPIOB
+#define MFRC522_IRQ_PIN_SOURCE			GPIO_PinSource1
+#define MFRC522_IRQ_EXTI_LINE			EXTI_Line1
+#define MFRC522_IRQ_CHANNEL				EXTI1_IRQn
+
+/* SD card port used by sdmm.c (SPI1, CS on PA4) */
+void My_SPI_Init(void);
+
+uint8_t My_SPI_Exchange(uint8_t u8Data);
+
+#define SD_CS_LOW						GPIO_ResetBits(GPIOA, GPIO_Pin_4)
+#define SD_CS_HIGH						GPIO_SetBits(GPIOA, GPIO_Pin_4)
+
 #endif
@@ -52,19 +52,18 @@ void SPISetup(void){
     //GPIO_WriteBit(SPI_GPIO, SPI_MOSI_Pin, Bit_RESET);
 }
 
+// IDR is polled directly, a library call per sample cannot follow a MHz clock.
+// MOSI comes from the same read that saw SCK high, a second read could already
+// be past the falling edge at 3 MHz
 uint8_t SPI_Slave_Receive(void){// b00101010
     uint8_t dataReceive =0x00;
-    uint8_t temp = 0x00, i=0;
-    while(GPIO_ReadInputDataBit(SPI_GPIO, SPI_CS_Pin));//master muon truyen nhan (cs=0) 
-    while(!GPIO_ReadInputDataBit(SPI_GPIO, SPI_SCK_Pin));//Cho xung clock dau tien (bat dau truyen nhan) (chi nhan khi co xung clock)
-    for(i=0; i<8;i++){ 
-        if(GPIO_ReadInputDataBit(SPI_GPIO, SPI_SCK_Pin)){
-            while(GPIO_ReadInputDataBit(SPI_GPIO, SPI_SCK_Pin)) // Den khi nao xong clock =0 tien hanh ghi bit vao data
-                temp = GPIO_ReadInputDataBit(SPI_GPIO, SPI_MOSI_Pin);// gan gia tri doc duoc tu MOSI vao temp
-            dataReceive=dataReceive<<1;
-            dataReceive=dataReceive|temp;
-    }
-    while(!GPIO_ReadInputDataBit(SPI_GPIO, SPI_SCK_Pin));//Cho het xung clock
+    uint8_t i;
+    uint32_t u32Idr;
+    while(SPI_GPIO->IDR & SPI_CS_Pin);//master muon truyen nhan (cs=0)
+    for(i=0; i<8;i++){
+        while(!((u32Idr = SPI_GPIO->IDR) & SPI_SCK_Pin));//Cho suon len, MOSI da on dinh
+        dataReceive=(dataReceive<<1) | ((u32Idr & SPI_MOSI_Pin) ? 1 : 0);
+        while(SPI_GPIO->IDR & SPI_SCK_Pin);//Cho suon xuong
     }
     return dataReceive;//Data 8 bit
 }
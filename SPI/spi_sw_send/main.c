@@ -3,6 +3,7 @@
 #include "stm32f10x_rcc.h"              // Keil::Device:StdPeriph Drivers:RCC
 #include "stm32f10x_spi.h"              // Keil::Device:StdPeriph Drivers:SPI
 #include "stm32f10x_tim.h"              // Keil::Device:StdPeriph Drivers:TIM
+#include "stm32f10x_dma.h"              // Keil::Device:StdPeriph Drivers:DMA
 
 #define SPI_SCK_Pin GPIO_Pin_0
 #define SPI_MISO_Pin GPIO_Pin_1
@@ -11,6 +12,30 @@
 #define SPI_GPIO GPIOA
 #define SPI_RCC RCC_APB2Periph_GPIOA
 
+// Mode 0 clock rate. Paced from the DWT cycle counter the master keeps even
+// phases down to about 10 cycles each, 3.6 MHz at 72 MHz; asked for more it runs
+// as fast as the loop goes, near 5 MHz with uneven phases. From TIM3 and the DMA
+// it is any rate TIM3 divides down to. The polling slave on the other board takes
+// about 20 cycles a bit, the pair runs at 3 MHz.
+#ifndef SPI_SCK_HZ
+#define SPI_SCK_HZ 3000000
+#endif
+
+// 1: the byte is written out as a BSRR waveform, one word per TIM3 update moved
+// by DMA1 channel 3. The edges keep their period through interrupts and the CPU
+// is free during the byte
+#ifndef SPI_USE_DMA
+#define SPI_USE_DMA 0
+#endif
+
+#define SPI_WAVE_LEN (1 + 2 * 8 + 2)   // CS low, two edges a bit, SCK low, CS high
+
+static uint32_t u32Half;    // Half SCK period in CPU cycles
+#if SPI_USE_DMA
+static uint32_t u32Wave[SPI_WAVE_LEN];
+#else
+static uint32_t u32Edge;    // DWT time of the last SCK edge
+#endif
 
 void RCC_config(void){
     RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2, ENABLE);
@@ -34,6 +59,61 @@ void delay_ms(uint16_t timedelay){
     while(TIM_GetCounter(TIM2)<timedelay){}
 }
 
+// DWT cycle counter, free running at the core clock
+void DWT_Config(void){
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    u32Half = SystemCoreClock / (2 * SPI_SCK_HZ);
+}
+
+#if SPI_USE_DMA
+// TIM3 clocks at 72 MHz behind the APB1 prescaler of 2, one update a half period.
+// TIM3_UP requests DMA1 channel 3, which writes the next word into BSRR
+void SPI_DMA_Config(void){
+    TIM_TimeBaseInitTypeDef TIM_InitStruct;
+    DMA_InitTypeDef DMA_InitStruct;
+
+    RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM3, ENABLE);
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+
+    TIM_InitStruct.TIM_ClockDivision = TIM_CKD_DIV1;
+    TIM_InitStruct.TIM_Prescaler = 0;
+    TIM_InitStruct.TIM_Period = u32Half - 1;
+    TIM_InitStruct.TIM_CounterMode = TIM_CounterMode_Up;
+    TIM_TimeBaseInit(TIM3, &TIM_InitStruct);
+    TIM_DMACmd(TIM3, TIM_DMA_Update, ENABLE);
+
+    DMA_DeInit(DMA1_Channel3);
+    DMA_InitStruct.DMA_PeripheralBaseAddr = (uint32_t)&SPI_GPIO->BSRR;
+    DMA_InitStruct.DMA_MemoryBaseAddr = (uint32_t)u32Wave;
+    DMA_InitStruct.DMA_DIR = DMA_DIR_PeripheralDST;
+    DMA_InitStruct.DMA_BufferSize = SPI_WAVE_LEN;
+    DMA_InitStruct.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    DMA_InitStruct.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStruct.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Word;
+    DMA_InitStruct.DMA_MemoryDataSize = DMA_MemoryDataSize_Word;
+    DMA_InitStruct.DMA_Mode = DMA_Mode_Normal;
+    DMA_InitStruct.DMA_Priority = DMA_Priority_VeryHigh;
+    DMA_InitStruct.DMA_M2M = DMA_M2M_Disable;
+    DMA_Init(DMA1_Channel3, &DMA_InitStruct);
+}
+#else
+// Wait half a period after the previous edge, the loop code does not add to it.
+// If an interrupt already held us past that point, the edge is now: catching up
+// would make the following half periods short
+static void SPI_Wait(void){
+    uint32_t u32Now = DWT->CYCCNT;
+
+    u32Edge += u32Half;
+    if((int32_t)(u32Now - u32Edge) > 0){
+        u32Edge = u32Now;
+        return;
+    }
+    while((int32_t)(DWT->CYCCNT - u32Edge) < 0){}
+}
+#endif
+
 void GPIO_Config(void){
     GPIO_InitTypeDef GPIO_InitStructure;
 	
@@ -47,13 +127,6 @@ void GPIO_Config(void){
     GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
     GPIO_Init(SPI_GPIO, &GPIO_InitStructure);
 }
-void Clock(){
-    GPIO_WriteBit(SPI_GPIO, SPI_SCK_Pin, Bit_SET);
-    delay_ms(4);
-    GPIO_WriteBit(SPI_GPIO, SPI_SCK_Pin, Bit_RESET);
-    delay_ms(4);
-}
-
 void SPISetup(void){
     GPIO_WriteBit(SPI_GPIO, SPI_SCK_Pin,  Bit_RESET);
     GPIO_WriteBit(SPI_GPIO, SPI_CS_Pin,   Bit_SET);
@@ -61,36 +134,59 @@ void SPISetup(void){
     GPIO_WriteBit(SPI_GPIO, SPI_MOSI_Pin, Bit_RESET);
 }
 
+#if SPI_USE_DMA
+// Same edges as the DWT version below, one BSRR word each half period
 void SPI_Master_Transmit(uint8_t u8Data){
-    uint8_t u8Mask = 0x80;// 0b10000000
-													// 0b11101010
-    uint8_t tempData; //Bien dem de xu ly bit
-    GPIO_WriteBit(SPI_GPIO, SPI_CS_Pin, Bit_RESET); //Keo chan Chip Select xuong 0 de chon chip
-    delay_ms(1);//CS da keo xuong 0 va truyen toi Chip nhan
+    uint32_t *pWave = u32Wave;
+
+    *pWave++ = SPI_CS_Pin << 16;
     for(int i=0; i<8; i++){
-        tempData = u8Data & u8Mask; //Phep & bit de nhan biet gia tri vua gui la 0 hay 1
-        //Gui bit 0 hoac 1 vao chan MOSI
-        if(tempData){
-            GPIO_WriteBit(SPI_GPIO, SPI_MOSI_Pin, Bit_SET);
-            delay_ms(1);
-        } else{
-            GPIO_WriteBit(SPI_GPIO, SPI_MOSI_Pin, Bit_RESET);
-            delay_ms(1);
-        }
-        u8Data=u8Data<<1; 
-        Clock();// tao clock de truyen bit di
+        *pWave++ = (SPI_SCK_Pin << 16) | ((u8Data & 0x80) ? SPI_MOSI_Pin : (SPI_MOSI_Pin << 16));
+        *pWave++ = SPI_SCK_Pin;
+        u8Data=u8Data<<1;
+    }
+    *pWave++ = SPI_SCK_Pin << 16;
+    *pWave = SPI_CS_Pin;
+
+    DMA1_Channel3->CNDTR = SPI_WAVE_LEN;
+    DMA_Cmd(DMA1_Channel3, ENABLE);
+    TIM_SetCounter(TIM3, 0);
+    TIM_Cmd(TIM3, ENABLE);
+    while(DMA_GetFlagStatus(DMA1_FLAG_TC3) == RESET){}
+    TIM_Cmd(TIM3, DISABLE);
+    DMA_Cmd(DMA1_Channel3, DISABLE);
+    DMA_ClearFlag(DMA1_FLAG_TC3);
+}
+#else
+void SPI_Master_Transmit(uint8_t u8Data){
+    SPI_GPIO->BRR = SPI_CS_Pin; //Keo chan Chip Select xuong 0 de chon chip
+    u32Edge = DWT->CYCCNT;
+    SPI_Wait();//CS da keo xuong 0 va truyen toi Chip nhan
+    for(int i=0; i<8; i++){
+        //SCK xuong 0 va bit tiep theo ra MOSI trong mot lan ghi BSRR
+        SPI_GPIO->BSRR = (SPI_SCK_Pin << 16) | ((u8Data & 0x80) ? SPI_MOSI_Pin : (SPI_MOSI_Pin << 16));
+        u8Data=u8Data<<1;
+        SPI_Wait();
+        SPI_GPIO->BSRR = SPI_SCK_Pin;// slave lay mau o suon len
+        SPI_Wait();
     }
-    GPIO_WriteBit(SPI_GPIO, SPI_CS_Pin, Bit_SET);// keo chan Cs de ket thuc truyen nhan 
-    delay_ms(1);
+    SPI_GPIO->BRR = SPI_SCK_Pin;
+    SPI_Wait();
+    SPI_GPIO->BSRR = SPI_CS_Pin;// keo chan Cs de ket thuc truyen nhan
 }
+#endif
 
 
 uint8_t DataTrans[] = {2,9,14,25,31,37,48,79};//Du lieu duoc truyen di
 int main(){
     RCC_config();
     TIMER_config();
+    DWT_Config();
     GPIO_Config();
     SPISetup();
+#if SPI_USE_DMA
+    SPI_DMA_Config();
+#endif
     while(1){   
             for(int i=0; i<8; i++){
                 SPI_Master_Transmit(DataTrans[i]);
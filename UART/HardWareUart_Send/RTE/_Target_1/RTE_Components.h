@@ -18,6 +18,8 @@
 
 /*  Keil::Device:StdPeriph Drivers:Framework:3.6.0 */
 #define RTE_DEVICE_STDPERIPH_FRAMEWORK
+/*  Keil::Device:StdPeriph Drivers:DMA:3.6.0 */
+#define RTE_DEVICE_STDPERIPH_DMA
 /*  Keil::Device:StdPeriph Drivers:GPIO:3.6.0 */
 #define RTE_DEVICE_STDPERIPH_GPIO
 /*  Keil::Device:StdPeriph Drivers:RCC:3.6.0 */
@@ -3,19 +3,31 @@
 #include "stm32f10x_rcc.h"              // Keil::Device:StdPeriph Drivers:RCC
 #include "stm32f10x_usart.h"            // Keil::Device:StdPeriph Drivers:USART
 #include "stm32f10x_tim.h"              // Keil::Device:StdPeriph Drivers:TIM
+#include "stm32f10x_dma.h"              // Keil::Device:StdPeriph Drivers:DMA
+
+#include "uart_tx.h"
+
+/*
+ * The TX ring and the framing are in uart_tx.c, DMA1 channel 4 empties the
+ * ring from its interrupt below.
+ */
+#define UART_BAUDRATE 9600
+
+volatile uint16_t txDmaLen = 0;         // Bytes in the running transfer, 0 when idle
 
 void RCC_Config(void){
 	RCC_APB2PeriphClockCmd(RCC_APB2Periph_USART1 | RCC_APB2Periph_GPIOA, ENABLE);
 	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2, ENABLE);
+	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
 }
 
 void GPIO_Config(void){
 	GPIO_InitTypeDef GPIOInitStruct;
-	
+
 	GPIOInitStruct.GPIO_Pin = GPIO_Pin_10; //Chan RX
 	GPIOInitStruct.GPIO_Mode = GPIO_Mode_IN_FLOATING;
 	GPIO_Init(GPIOA, &GPIOInitStruct);
-	
+
 	GPIOInitStruct.GPIO_Pin = GPIO_Pin_9; //Chan TX
 	GPIOInitStruct.GPIO_Speed = GPIO_Speed_50MHz;
 	GPIOInitStruct.GPIO_Mode = GPIO_Mode_AF_PP;
@@ -24,9 +36,9 @@ void GPIO_Config(void){
 
 void TIMER_config(void){
     TIM_TimeBaseInitTypeDef TIM_InitStruct;
-    
-    TIM_InitStruct.TIM_ClockDivision = TIM_CKD_DIV2; //Chia thanh clock nho hon de cap cho timer default: 72MHz 
-    TIM_InitStruct.TIM_Prescaler = 36000; 
+
+    TIM_InitStruct.TIM_ClockDivision = TIM_CKD_DIV2; //Chia thanh clock nho hon de cap cho timer default: 72MHz
+    TIM_InitStruct.TIM_Prescaler = 36000;
     TIM_InitStruct.TIM_Period  = 0xFFFF;//Dem bao nhieu lan thi reset
     TIM_InitStruct.TIM_CounterMode = TIM_CounterMode_Up; //Set mode dem len tu 0
     TIM_TimeBaseInit(TIM2, &TIM_InitStruct);
@@ -41,39 +53,97 @@ void delay_ms(uint16_t timedelay){
 void UART_Config(void){
 	USART_InitTypeDef UARTInitStruct;
 	UARTInitStruct.USART_Mode = USART_Mode_Tx | USART_Mode_Rx; //Cau hinh che do: ca truyen va nhan (song cong)
-	UARTInitStruct.USART_BaudRate = 9600; //Cau hinh toc do bit
+	UARTInitStruct.USART_BaudRate = UART_BAUDRATE; //Cau hinh toc do bit
 	UARTInitStruct.USART_HardwareFlowControl = USART_HardwareFlowControl_None; //Cau hinh kiem soat luong truyen du lieu tranh viec tran bo dem
 	UARTInitStruct.USART_WordLength = USART_WordLength_8b; //Truyen du lieu 8 hoac 9 bit
 	UARTInitStruct.USART_Parity = USART_Parity_No;
 	UARTInitStruct.USART_StopBits = USART_StopBits_1;
-	
+
 	USART_Init(USART1, &UARTInitStruct);
+	USART_DMACmd(USART1, USART_DMAReq_Tx, ENABLE);
 	USART_Cmd(USART1, ENABLE);
-	
+
 }
 
+void DMA_Config(void){
+	DMA_InitTypeDef DMAInitStruct;
+	NVIC_InitTypeDef NVICInitStruct;
 
-void UART_SendChar(USART_TypeDef *USARTx, uint8_t data){
-	while(USART_GetFlagStatus(USARTx, USART_FLAG_TXE)==RESET);//Cho den khi gui thanh cong
-	USARTx->DR = 0x00; //Xoa du lieu trong thanh ghi DR
-	USART_SendData(USARTx, data);
+	//USART1_TX is DMA1 channel 4, address and length are set for every transfer
+	DMA_DeInit(DMA1_Channel4);
+	DMAInitStruct.DMA_PeripheralBaseAddr = (uint32_t)&USART1->DR;
+	DMAInitStruct.DMA_MemoryBaseAddr = (uint32_t)txBuf;
+	DMAInitStruct.DMA_DIR = DMA_DIR_PeripheralDST;
+	DMAInitStruct.DMA_BufferSize = 0;
+	DMAInitStruct.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	DMAInitStruct.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	DMAInitStruct.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+	DMAInitStruct.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+	DMAInitStruct.DMA_Mode = DMA_Mode_Normal;
+	DMAInitStruct.DMA_Priority = DMA_Priority_Medium;
+	DMAInitStruct.DMA_M2M = DMA_M2M_Disable;
+	DMA_Init(DMA1_Channel4, &DMAInitStruct);
+	DMA_ITConfig(DMA1_Channel4, DMA_IT_TC, ENABLE);
+
+	//Writers at any priority only pend it
+	NVICInitStruct.NVIC_IRQChannel = DMA1_Channel4_IRQn;
+	NVICInitStruct.NVIC_IRQChannelPreemptionPriority = 0x01;
+	NVICInitStruct.NVIC_IRQChannelSubPriority = 0x00;
+	NVICInitStruct.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVICInitStruct);
+}
+
+//Transfer complete, or pended by uart_write
+void DMA1_Channel4_IRQHandler(void){
+	uint16_t tail, count, len;
+
+	if (DMA_GetITStatus(DMA1_IT_TC4)) {
+		DMA_ClearITPendingBit(DMA1_IT_TC4);
+		DMA_Cmd(DMA1_Channel4, DISABLE);
+		txTail += txDmaLen;
+		txDmaLen = 0;
+	}
+	if (txDmaLen) {
+		return;
+	}
+
+	//Longest contiguous piece of committed bytes, the rest goes next time
+	tail = txTail;
+	count = (uint16_t)txCommit - tail;
+	if (count == 0) {
+		return;
+	}
+	len = TX_BUF_SIZE - tail % TX_BUF_SIZE;
+	if (len > count) {
+		len = count;
+	}
+	txDmaLen = len;
+	DMA1_Channel4->CMAR = (uint32_t)&txBuf[tail % TX_BUF_SIZE];
+	DMA_SetCurrDataCounter(DMA1_Channel4, len);
+	DMA_Cmd(DMA1_Channel4, ENABLE);
 }
 
 
 uint8_t DataTrans[] = {1,7,12,17,89};//Du lieu duoc truyen di
 int main() {
+	uint32_t stats[3];
+
 	RCC_Config();
 	GPIO_Config();
 	UART_Config();
-	TIMER_config();	
+	DMA_Config();
+	TIMER_config();
 	while(1){
 		for(int i = 0; i<5; ++i){
 			delay_ms(2998);
-			UART_SendChar(USART1, DataTrans[i]);
+			frame_send(FRAME_TYPE_DATA, &DataTrans[i], 1);
 			delay_ms(2);
 		}
 
+		stats[0] = txDropped;
+		stats[1] = frameSent;
+		stats[2] = frameDropped;
+		frame_send(FRAME_TYPE_STATS, stats, sizeof(stats));
 	}
 }
 
-
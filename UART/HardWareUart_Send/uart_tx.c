@@ -0,0 +1,147 @@
+#include "uart_tx.h"
+
+uint8_t txBuf[TX_BUF_SIZE];
+volatile uint32_t txState = 0;          // Head | writers << 16 | frame seq << 24
+volatile uint32_t txCommit = 0;
+volatile uint16_t txTail = 0;
+volatile uint32_t txDropped = 0;
+volatile uint32_t frameSent = 0;
+volatile uint32_t frameDropped = 0;
+
+//Counters are bumped from main and from interrupts, a plain += can lose the update of the preempting one
+static void TX_Count(volatile uint32_t *counter, uint32_t n){
+	uint32_t value;
+
+	do {
+		value = __LDREXW(counter) + n;
+	} while (__STREXW(value, counter));
+}
+
+//Move txCommit up to head, never back: a writer that finished earlier may have committed further already
+static void TX_Commit(uint16_t head){
+	uint32_t commit;
+
+	do {
+		commit = __LDREXW(&txCommit);
+		if ((int16_t)(head - (uint16_t)commit) <= 0) {
+			__CLREX();
+			return;
+		}
+	} while (__STREXW(head, &txCommit));
+}
+
+//Reserve up to len bytes, none if fewer than min are free. Returns the bytes reserved, *state the txState before
+static uint16_t TX_Reserve(uint16_t len, uint16_t min, uint32_t frames, uint32_t *state){
+	uint16_t head, space;
+
+	do {
+		*state = __LDREXW(&txState);
+		head = (uint16_t)*state;
+		space = TX_BUF_SIZE - (uint16_t)(head - txTail);
+		if (len > space) {
+			len = space;
+		}
+		if (len < min || len == 0) {
+			__CLREX();
+			return 0;
+		}
+	} while (__STREXW(((*state & 0xFFFF0000UL) + (1UL << 16) + (frames << 24)) | (uint16_t)(head + len), &txState));
+	return len;
+}
+
+//This writer is done, the last one out commits everything reserved so far
+static void TX_Release(void){
+	uint32_t state;
+
+	do {
+		state = __LDREXW(&txState) - (1UL << 16);
+	} while (__STREXW(state, &txState));
+	if (((state >> 16) & 0xFF) == 0) {
+		TX_Commit((uint16_t)state);
+		NVIC_SetPendingIRQ(DMA1_Channel4_IRQn);
+	}
+}
+
+uint16_t uart_write(const uint8_t *data, uint16_t len){
+	uint32_t state;
+	uint16_t head, taken, i;
+
+	taken = TX_Reserve(len, 1, 0, &state);
+	if (taken < len) {
+		TX_Count(&txDropped, len - taken);
+	}
+	if (taken == 0) {
+		return 0;
+	}
+	head = (uint16_t)state;
+	for (i = 0; i < taken; i++) {
+		txBuf[(uint16_t)(head + i) % TX_BUF_SIZE] = data[i];
+	}
+	TX_Release();
+	return taken;
+}
+
+//COBS encoder writing into the ring, code is the slot of the open block's length byte
+typedef struct {
+	uint16_t pos;
+	uint16_t code;
+	uint8_t run;
+	uint16_t crc;
+} FrameEnc_t;
+
+static void Frame_Put(FrameEnc_t *enc, uint8_t b){
+	if (b == 0) {
+		txBuf[enc->code % TX_BUF_SIZE] = enc->run;
+		enc->code = enc->pos++;
+		enc->run = 1;
+	} else {
+		txBuf[enc->pos++ % TX_BUF_SIZE] = b;
+		enc->run++;
+	}
+}
+
+static void Frame_PutCrc(FrameEnc_t *enc, uint8_t b){
+	uint16_t crc = enc->crc;
+
+	//CRC-16/CCITT a byte at a time, same result as the bitwise loop
+	crc = (crc >> 8) | (crc << 8);
+	crc ^= b;
+	crc ^= (crc & 0xFF) >> 4;
+	crc ^= crc << 12;
+	crc ^= (crc & 0xFF) << 5;
+	enc->crc = crc;
+	Frame_Put(enc, b);
+}
+
+uint8_t frame_send(uint8_t type, const void *data, uint8_t len){
+	const uint8_t *p = data;
+	FrameEnc_t enc;
+	uint32_t state;
+	uint16_t size = len + 6;        // COBS code, seq, type, crc16, delimiter
+
+	if (len > FRAME_DATA_MAX) {
+		return 0;
+	}
+	if (!TX_Reserve(size, size, 1, &state)) {
+		TX_Count(&frameDropped, 1);
+		return 0;
+	}
+
+	enc.code = (uint16_t)state;
+	enc.pos = enc.code + 1;
+	enc.run = 1;
+	enc.crc = 0xFFFF;
+	Frame_PutCrc(&enc, state >> 24);
+	Frame_PutCrc(&enc, type);
+	while (len--) {
+		Frame_PutCrc(&enc, *p++);
+	}
+	Frame_Put(&enc, (uint8_t)enc.crc);
+	Frame_Put(&enc, enc.crc >> 8);
+	txBuf[enc.code % TX_BUF_SIZE] = enc.run;
+	txBuf[enc.pos % TX_BUF_SIZE] = 0;
+
+	TX_Release();
+	TX_Count(&frameSent, 1);
+	return 1;
+}
@@ -0,0 +1,50 @@
+#ifndef UART_TX_H
+#define UART_TX_H
+
+#include "stm32f10x.h"                  // Device header
+
+/*
+ * TX goes through a ring that DMA1 channel 4 (USART1_TX) empties. uart_write
+ * copies into the ring and returns at once, so it can be called from main
+ * and from any interrupt, also when one preempts the other.
+ *
+ * A writer reserves its bytes by moving txState (head in the low half, the
+ * number of writers still copying and the frame sequence number in the high
+ * half) with LDREX/STREX. An interrupt between LDREX and STREX makes the
+ * STREX fail, so the reservation is simply retried. The last writer to
+ * finish moves txCommit up to the head, the DMA only sends committed bytes.
+ * The DMA interrupt sends the longest contiguous piece from the tail, and on
+ * transfer complete starts the next one. Writers just pend that interrupt.
+ *
+ * frame_send puts structured data on the same ring:
+ *
+ *   COBS( seq | type | data[len] | crc16 ) 0x00
+ *
+ * seq counts frames so the receiver sees lost ones, crc16 is CRC-16/CCITT
+ * (0x1021, start 0xFFFF) of seq, type and data, low byte first. COBS
+ * replaces every 0x00 so a frame never contains one and 0x00 only ends a
+ * frame, the receiver resyncs at the next 0x00 after garbage. A frame is
+ * shorter than 254 bytes, its COBS form is then exactly one byte longer,
+ * so the exact space is reserved and the frame is encoded straight into
+ * the ring without a copy.
+ */
+#define TX_BUF_SIZE   256   // Power of two, the indexes run freely over 16 bits
+#define FRAME_DATA_MAX  64  // Frame data bytes, seq, type and crc16 come on top
+
+#define FRAME_TYPE_DATA   0x01  // Raw bytes
+#define FRAME_TYPE_STATS  0x02  // txDropped, frameSent, frameDropped, 3 x uint32_t
+
+extern uint8_t txBuf[TX_BUF_SIZE];
+extern volatile uint32_t txCommit;      // Bytes up to here can be sent
+extern volatile uint16_t txTail;        // Next byte for the DMA, moved by the DMA interrupt only
+extern volatile uint32_t txDropped;     // Bytes uart_write could not take
+extern volatile uint32_t frameSent;
+extern volatile uint32_t frameDropped;  // Frames that did not fit into the ring
+
+//Queue up to len bytes, returns how many were taken. Safe from main and from interrupts
+uint16_t uart_write(const uint8_t *data, uint16_t len);
+
+//Queue one frame, all or nothing. Returns 1 if it was queued. Safe from main and from interrupts
+uint8_t frame_send(uint8_t type, const void *data, uint8_t len);
+
+#endif
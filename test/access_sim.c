@@ -0,0 +1,388 @@
+/*
+ * The access pipeline of main.c on the simulated board
+ *
+ * main.c runs unchanged (its main renamed App_Main) with the real drivers
+ * behind it: the MFRC522 with the cards of the trace, card_db.c on the
+ * simulated flash and CARDS.TXT, access_log.c on the emulated SD card,
+ * KV settings on the simulated AT24C32, the LCD on the PCF8574/HD44780
+ * model and the servo on TIM2, its update interrupt preempting the loop.
+ * The test takes control at each __WFI of the main loop.
+ *
+ * ACCESS_SIM_TAPS badges, 3 in 4 of them authorised, of 4, 7 and 10 byte
+ * UIDs, are presented ACCESS_SIM_TAP_MS each, one every 1 to 2 s in
+ * bursts of ACCESS_SIM_BURST. The pause after a burst lets the door start
+ * closing, so badges arrive while it opens, stands open and closes.
+ *
+ * - Throughput: every tap is logged once with the right decision, badges
+ *   per minute against the ones presented.
+ * - Latency from the card entering the field to its log record, worst
+ *   overall and worst while the servo moves, within CARD_POLL_MAX_MS
+ *   plus ACCESS_SIM_PIPE_MS.
+ * - Display: both lines show the last badge 100 ms after it is logged, a
+ *   UID wider than 16 columns has scrolled one column 500 ms later, the
+ *   screen is never cleared after boot.
+ * - Door: reopened by a badge while it closes, closed again at the end.
+ */
+
+#include "rc522_sim.h"
+#include "lcd_sim.h"
+#include "eeprom_sim.h"
+#include "flash_sim.h"
+#include "sd_emu.h"
+#include "sim_i2c.h"
+#include "sim_tim.h"
+#include "sim_clock.h"
+#include "servo.h"
+#include "card_db.h"
+#include "card_poll.h"
+#include "access_log.h"
+#include "sd_card.h"
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ACCESS_SIM_TAPS			40
+#define ACCESS_SIM_TAP_MS		600
+#define ACCESS_SIM_BURST		10			/* Badges in a row, then the door starts closing */
+#define ACCESS_SIM_START_MS		3000		/* Boot done */
+#define ACCESS_SIM_TAIL_MS		40000		/* Quiet after the last tap, the door closes */
+#define ACCESS_SIM_PIPE_MS		100			/* One poll, the access task and a display refresh */
+
+typedef struct {
+	uint32_t u32ArriveMs;
+	uint32_t u32LoggedMs;
+	uint8_t u8Moving;					/* Servo moving when the card arrived */
+	uint8_t u8Seen;
+} AccessSim_Tap_t;
+
+/* main.c */
+int App_Main(void);
+extern uint32_t u32MaxLateMs;
+extern uint32_t u32Badges;
+extern uint32_t u32LogLost;
+
+static AccessSim_Tap_t Taps[ACCESS_SIM_TAPS];
+static BYTE u8Work[FF_MAX_SS];
+static jmp_buf End;
+static uint32_t u32EndMs;
+static uint32_t u32Lcg = 777;
+static uint8_t u8Next;
+static uint32_t u32Shown;				/* Badges whose screen was checked */
+static uint32_t u32ShownAt;				/* Tick of the next display check */
+static uint32_t u32ScrollAt;
+static char szWantLine[40];
+static uint32_t u32Moves;				/* Door movements started */
+static uint32_t u32Reopens;
+static uint8_t u8WasMoving;
+static uint8_t u8Closing;
+static uint16_t u16LastPulse;
+static uint16_t u16MaxPulse;
+static int iFailed;
+
+static void Access_Fail(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	fprintf(stderr, "FAIL: ");
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	++iFailed;
+}
+
+static uint32_t Access_Rand(uint32_t u32Min, uint32_t u32Max)
+{
+	u32Lcg = u32Lcg * 1103515245 + 12345;
+	return u32Min + (u32Lcg >> 8) % (u32Max - u32Min + 1);
+}
+
+static uint8_t Access_Uid(uint8_t *pUid, uint8_t n)
+{
+	static const uint8_t u8Lens[3] = {4, 7, 10};
+	uint8_t len = u8Lens[n % 3], i;
+
+	for (i = 0; i < len && i < CARD_DB_UID_LEN; i++) {
+		pUid[i] = (uint8_t)(0x11 * (i + 1) ^ n);
+	}
+	pUid[0] = 0x3C;
+	pUid[1] = n;
+	return len;
+}
+
+static uint8_t Access_Granted(uint8_t n)
+{
+	return n % 4 != 3;
+}
+
+static FRESULT Access_WriteCards(void)
+{
+	FIL fil;
+	FRESULT fr;
+	char line[2 * CARD_DB_UID_LEN + 3];
+	uint8_t uid[CARD_DB_UID_LEN];
+	uint8_t n, len, i;
+	UINT bw;
+
+	fr = f_open(&fil, CARD_DB_FILE, FA_WRITE | FA_CREATE_ALWAYS);
+	for (n = 0; n < ACCESS_SIM_TAPS && fr == FR_OK; n++) {
+		if (!Access_Granted(n)) {
+			continue;
+		}
+		len = Access_Uid(uid, n);
+		for (i = 0; i < len; i++) {
+			sprintf(&line[2 * i], "%02X", uid[i]);
+		}
+		strcpy(&line[2 * len], "\r\n");
+		fr = f_write(&fil, line, 2 * len + 2, &bw);
+	}
+	if (fr == FR_OK) {
+		fr = f_close(&fil);
+	}
+	return fr;
+}
+
+/* The text main.c shows on line 2 for tap n */
+static uint8_t Access_IdLine(uint8_t n, char *psz)
+{
+	uint8_t uid[CARD_DB_UID_LEN], len, i;
+
+	len = Access_Uid(uid, n);
+	strcpy(psz, "ID:");
+	for (i = 0; i < len; i++) {
+		sprintf(&psz[3 + 2 * i], "%02X", uid[i]);
+	}
+	return 3 + 2 * len;
+}
+
+static void Access_Expect(uint8_t u8Row, const char *sz)
+{
+	char szLine[SIM_LCD_COLS + 1];
+
+	SimLcd_GetLine(u8Row, szLine);
+	if (strncmp(szLine, sz, SIM_LCD_COLS)) {
+		Access_Fail("display at %lu ms: row %u \"%s\", expected \"%.16s\"", (unsigned long)Delay_GetTick(), u8Row,
+			szLine, sz);
+	}
+}
+
+/* Between two passes of the main loop */
+static void Access_Wfi(void)
+{
+	SimRc522_Card_t Card;
+	uint8_t u8Uid[CARD_DB_UID_LEN], len;
+	uint32_t u32Now = Delay_GetTick();
+	char szWant[SIM_LCD_COLS + 1];
+	uint16_t u16Pulse;
+	uint8_t n;
+
+	if (u32Now >= u32EndMs) {
+		longjmp(End, 1);
+	}
+	while (u8Next < ACCESS_SIM_TAPS && Taps[u8Next].u32ArriveMs <= u32Now + 1) {
+		len = Access_Uid(u8Uid, u8Next);
+		SimRc522_MakeCard(&Card, u8Uid, len);
+		Card.u64InNs = (uint64_t)Taps[u8Next].u32ArriveMs * 1000000;
+		Card.u64OutNs = Card.u64InNs + (uint64_t)ACCESS_SIM_TAP_MS * 1000000;
+		if (SimRc522_AddCard(&Card) < 0) {
+			Access_Fail("no free card slot at %lu ms", (unsigned long)u32Now);
+		}
+		Taps[u8Next].u8Moving = Servo_IsMoving();
+		++u8Next;
+	}
+
+	//A closing door turned round without stopping was reopened by a badge
+	u16Pulse = SimTim_Compare();
+	if (Servo_IsMoving() && !u8WasMoving) {
+		++u32Moves;
+	} else if (u8WasMoving && u8Closing && u16Pulse > u16LastPulse) {
+		++u32Reopens;
+	}
+	if (u16Pulse != u16LastPulse) {
+		u8Closing = u16Pulse < u16LastPulse;
+	}
+	u8WasMoving = Servo_IsMoving();
+	u16LastPulse = u16Pulse;
+	if (u16Pulse > u16MaxPulse) {
+		u16MaxPulse = u16Pulse;
+	}
+
+	//The badges are taken in the order they arrived, the display follows them
+	if (u32Shown < u32Badges && !u32ShownAt) {
+		u32ShownAt = u32Now + ACCESS_SIM_PIPE_MS;
+	}
+	if (u32ShownAt && u32Now >= u32ShownAt) {
+		n = (uint8_t)u32Shown++;
+		u32ShownAt = 0;
+		if (u32Shown == u32Badges) {
+			Access_Expect(0, Access_Granted(n) ? "Access granted  " : "Access denied   ");
+			len = Access_IdLine(n, szWantLine);
+			snprintf(szWant, sizeof(szWant), "%-16s", szWantLine);
+			Access_Expect(1, szWant);
+			u32ScrollAt = (len > SIM_LCD_COLS) ? u32Now + 500 : 0;
+		}
+	}
+	if (u32ScrollAt && u32Now >= u32ScrollAt) {
+		u32ScrollAt = 0;
+		if (u32Shown == u32Badges) {
+			Access_Expect(1, szWantLine + 1);
+		}
+	}
+}
+
+
+static void Access_Setup(void)
+{
+	SimRc522_Config_t Rc522;
+	SimEeprom_Config_t Eeprom;
+	SimFlash_Config_t Flash;
+	SdEmu_Config_t Sd;
+	MKFS_PARM Opt = {FM_ANY, 0, 0, 0, 0};
+	uint32_t u32Ms;
+	FRESULT fr;
+	uint8_t i;
+
+	SimClock_Reset();
+	SimTim_Reset();
+	SimI2c_Reset();
+	SimFlash_DefaultConfig(&Flash, CARD_DB_FLASH_BASE, (uint32_t)CARD_DB_FLASH_PAGES * CARD_DB_PAGE_SIZE);
+	Flash.u32PageSize = CARD_DB_PAGE_SIZE;
+	SdEmu_DefaultConfig(&Sd);
+	if (!SimFlash_Open(&Flash) || !SdEmu_Open(&Sd)) {
+		fprintf(stderr, "cannot map the flash area or open the card image\n");
+		exit(1);
+	}
+	fr = f_mkfs("", &Opt, u8Work, sizeof(u8Work));
+	if (fr == FR_OK) {
+		fr = sd_card_mount();
+	}
+	if (fr == FR_OK) {
+		fr = Access_WriteCards();
+	}
+	if (fr != FR_OK) {
+		fprintf(stderr, "format/write of %s failed: %d\n", CARD_DB_FILE, fr);
+		exit(1);
+	}
+
+	//The board powers up once the card is prepared
+	SimLcd_Open();
+	SimEeprom_DefaultConfig(&Eeprom);
+	SimEeprom_Open(&Eeprom);
+	SimRc522_DefaultConfig(&Rc522);
+	SimRc522_Open(&Rc522);
+	SimRc522_SetWfiHook(Access_Wfi);
+
+	u32Ms = Delay_GetTick() + ACCESS_SIM_START_MS;
+	for (i = 0; i < ACCESS_SIM_TAPS; i++) {
+		Taps[i].u32ArriveMs = u32Ms;
+		u32Ms += (i % ACCESS_SIM_BURST == ACCESS_SIM_BURST - 1) ? Access_Rand(12000, 16000) : Access_Rand(1000, 2000);
+	}
+	u32EndMs = u32Ms + ACCESS_SIM_TAIL_MS;
+}
+
+/* Match the log against the trace */
+static void Access_Log(void)
+{
+	AccessLog_Reader_t rd;
+	AccessLog_Record_t rec;
+	uint8_t uid[ACCESS_LOG_UID_LEN];
+	uint32_t u32Seq, u32End = AccessLog_GetNextSeq();
+	uint8_t n, len;
+
+	AccessLog_OpenReader(&rd);
+	for (u32Seq = 0; u32Seq < u32End; u32Seq++) {
+		if (AccessLog_ReadRecordAt(&rd, u32Seq, &rec) != FR_OK) {
+			Access_Fail("record %lu not found", (unsigned long)u32Seq);
+			break;
+		}
+		n = rec.u8Uid[1];
+		memset(uid, 0, sizeof(uid));
+		len = (n < ACCESS_SIM_TAPS) ? Access_Uid(uid, n) : 0;
+		if (!len || Taps[n].u8Seen || ACCESS_LOG_UID_LENGTH(&rec) != len || memcmp(rec.u8Uid, uid, sizeof(uid))
+			|| ACCESS_LOG_DECISION(&rec) != (Access_Granted(n) ? ACCESS_LOG_GRANTED : ACCESS_LOG_DENIED)) {
+			Access_Fail("record %lu: unexpected card or decision", (unsigned long)u32Seq);
+			continue;
+		}
+		Taps[n].u8Seen = 1;
+		Taps[n].u32LoggedMs = rec.u32Time;
+	}
+	AccessLog_CloseReader(&rd);
+}
+
+int main(void)
+{
+	SimLcd_Stats_t ls;
+	SimTim_Stats_t ts;
+	uint32_t u32Lat, u32MaxLat = 0, u32MaxMoving = 0, u32Moving = 0, u32Logged = 0;
+	uint64_t u64LatSum = 0;
+	double dMinutes;
+	uint8_t n;
+
+	Access_Setup();
+	if (!setjmp(End)) {
+		App_Main();
+	}
+	AccessLog_Flush();
+	Access_Log();
+
+	for (n = 0; n < ACCESS_SIM_TAPS; n++) {
+		if (!Taps[n].u8Seen) {
+			Access_Fail("tap %u at %lu ms not logged", n, (unsigned long)Taps[n].u32ArriveMs);
+			continue;
+		}
+		++u32Logged;
+		u32Lat = Taps[n].u32LoggedMs - Taps[n].u32ArriveMs;
+		u64LatSum += u32Lat;
+		if (u32Lat > u32MaxLat) {
+			u32MaxLat = u32Lat;
+		}
+		if (Taps[n].u8Moving) {
+			++u32Moving;
+			if (u32Lat > u32MaxMoving) {
+				u32MaxMoving = u32Lat;
+			}
+		}
+	}
+	dMinutes = (Taps[ACCESS_SIM_TAPS - 1].u32ArriveMs + ACCESS_SIM_TAP_MS - Taps[0].u32ArriveMs) / 60000.0;
+	SimLcd_GetStats(&ls);
+	SimTim_GetStats(&ts);
+
+	printf("trace: %u badges in %.2f min, %lu logged, %.1f badges/min (%.1f presented)\n", ACCESS_SIM_TAPS,
+		dMinutes, (unsigned long)u32Logged, u32Logged / dMinutes, ACCESS_SIM_TAPS / dMinutes);
+	if (u32Logged) {
+		printf("latency: %.1f ms average, %lu ms worst; %lu badges while the door moved, %lu ms worst\n",
+			(double)u64LatSum / u32Logged, (unsigned long)u32MaxLat, (unsigned long)u32Moving,
+			(unsigned long)u32MaxMoving);
+	}
+	printf("loop: a task %lu ms late at worst; door: %lu movements, %lu reopened while closing, %lu servo"
+		" interrupts, %lu missed\n", (unsigned long)u32MaxLateMs, (unsigned long)u32Moves, (unsigned long)u32Reopens,
+		(unsigned long)ts.u32Irqs, (unsigned long)ts.u32Missed);
+	printf("display: %lu screens checked, %lu clears, %lu I2C transactions, %lu characters, %lu violations\n",
+		(unsigned long)u32Shown, (unsigned long)ls.u32Clears, (unsigned long)ls.u32Transactions,
+		(unsigned long)ls.u32Chars, (unsigned long)ls.u32Violations);
+
+	if (u32Badges != ACCESS_SIM_TAPS || u32LogLost) {
+		Access_Fail("%lu badges processed, %lu not logged", (unsigned long)u32Badges, (unsigned long)u32LogLost);
+	}
+	if (u32MaxLat > CARD_POLL_MAX_MS + ACCESS_SIM_PIPE_MS) {
+		Access_Fail("worst latency %lu ms", (unsigned long)u32MaxLat);
+	}
+	if (!u32Moving) {
+		Access_Fail("no badge arrived while the door moved");
+	}
+	//Boot: the clear of I2C_LCD_Init and the one in main
+	if (ls.u32Clears != 2 || ls.u32Violations) {
+		Access_Fail("display: %lu clears, %lu violations", (unsigned long)ls.u32Clears,
+			(unsigned long)ls.u32Violations);
+	}
+	if (!u32Reopens || u16MaxPulse != SERVO_PULSE_OPEN || SimTim_Compare() != SERVO_PULSE_CLOSED || Servo_IsMoving()) {
+		Access_Fail("door: %lu reopens, opened to %u, at %u at the end", (unsigned long)u32Reopens, u16MaxPulse,
+			SimTim_Compare());
+	}
+	if (iFailed) {
+		fprintf(stderr, "%d failures\n", iFailed);
+	}
+	return iFailed != 0;
+}
@@ -0,0 +1,285 @@
+/*
+ * Sector cache of sdmm.c on the emulated card
+ *
+ * Built with the default CACHE_SECTORS and once more with the cache off,
+ * the second build only runs the workload so both can be compared.
+ *
+ * - Hit: a written sector stays in the cache, reading it back does not
+ *   reach the card.
+ * - Flush: CTRL_SYNC writes dirty lines, adjacent ones with one CMD25.
+ * - LRU: the least recently used line is evicted, a dirty one written.
+ * - Coherence: a bulk read takes dirty lines from the cache.
+ * - Reinit: disk_initialize of the same card writes dirty lines first.
+ * - Logging: 32 byte records appended with an f_sync per sector, card
+ *   commands, sectors and time on the virtual clock, read back at the end.
+ */
+
+#include "sd_emu.h"
+#include "sim_clock.h"
+#include "ff.h"
+#include "diskio.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#ifndef CACHE_SECTORS
+#define CACHE_SECTORS			4		/* Default of sdmm.c */
+#endif
+#define CACHE_TEST_RECORD		32
+#define CACHE_TEST_RECORDS		4096
+#define CACHE_TEST_SYNC			(512 / CACHE_TEST_RECORD)	/* Records per f_sync */
+
+static FATFS Fs;
+static FIL Fil;
+static BYTE u8Work[FF_MAX_SS];
+static int iFailed;
+
+static void Cache_Fail(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	fprintf(stderr, "FAIL: ");
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	++iFailed;
+}
+
+#if CACHE_SECTORS
+static BYTE u8Sect[3 * 512];
+static BYTE u8Check[512];
+static SdEmu_Stats_t S0;
+static MMC_IOSTAT Io0;
+
+static void Cache_Fill(BYTE *p, LBA_t sector)
+{
+	UINT i;
+
+	for (i = 0; i < 512; i++) {
+		p[i] = (BYTE)(sector * 3 + i);
+	}
+}
+
+static void Cache_Mark(void)
+{
+	SdEmu_GetStats(&S0);
+	disk_ioctl(0, MMC_GET_IOSTAT, &Io0);
+}
+
+/* Card sectors read and written, cache hits since Cache_Mark */
+static void Cache_Delta(uint32_t *pu32Rd, uint32_t *pu32Wr, uint32_t *pu32Hit)
+{
+	SdEmu_Stats_t s;
+	MMC_IOSTAT io;
+
+	SdEmu_GetStats(&s);
+	disk_ioctl(0, MMC_GET_IOSTAT, &io);
+	*pu32Rd = s.u32SectorsRead - S0.u32SectorsRead;
+	*pu32Wr = s.u32SectorsWritten - S0.u32SectorsWritten;
+	*pu32Hit = io.hit - Io0.hit;
+}
+
+static void Cache_Write(LBA_t sector)
+{
+	Cache_Fill(u8Check, sector);
+	if (disk_write(0, u8Check, sector, 1) != RES_OK) {
+		Cache_Fail("write of sector %lu failed", (unsigned long)sector);
+	}
+}
+
+static void Cache_Read(LBA_t sector)
+{
+	if (disk_read(0, u8Sect, sector, 1) != RES_OK) {
+		Cache_Fail("read of sector %lu failed", (unsigned long)sector);
+	}
+}
+
+static void Cache_Lines(void)
+{
+	SdEmu_Stats_t s;
+	MMC_IOSTAT io;
+	uint32_t rd, wr, hit;
+
+	//Hit: written and read back without the card
+	Cache_Mark();
+	Cache_Write(1000);
+	Cache_Read(1000);
+	Cache_Delta(&rd, &wr, &hit);
+	if (rd || wr || hit != 1 || memcmp(u8Sect, u8Check, 512)) {
+		Cache_Fail("hit: %lu sectors read, %lu written, %lu hits", (unsigned long)rd, (unsigned long)wr,
+			(unsigned long)hit);
+	}
+
+	//Flush: one dirty line, then a run of three written in any order
+	Cache_Mark();
+	disk_ioctl(0, CTRL_SYNC, 0);
+	Cache_Delta(&rd, &wr, &hit);
+	if (wr != 1) {
+		Cache_Fail("flush: %lu sectors written for one dirty line", (unsigned long)wr);
+	}
+	Cache_Write(2001);
+	Cache_Write(2000);
+	Cache_Write(2002);
+	Cache_Mark();
+	disk_ioctl(0, CTRL_SYNC, 0);
+	Cache_Delta(&rd, &wr, &hit);
+	SdEmu_GetStats(&s);
+	disk_ioctl(0, MMC_GET_IOSTAT, &io);
+	if (wr != 3 || s.u32Cmd[25] - S0.u32Cmd[25] != 1 || s.u32Cmd[24] != S0.u32Cmd[24] || io.wr_merge != Io0.wr_merge + 1) {
+		Cache_Fail("flush: adjacent lines took %lu CMD24 and %lu CMD25", (unsigned long)(s.u32Cmd[24] - S0.u32Cmd[24]),
+			(unsigned long)(s.u32Cmd[25] - S0.u32Cmd[25]));
+	}
+
+	//LRU: 3000 is used again before 3004 comes in, so 3001 goes
+	Cache_Read(3000);
+	Cache_Read(3001);
+	Cache_Read(3002);
+	Cache_Read(3003);
+	Cache_Read(3000);
+	Cache_Read(3004);
+	Cache_Mark();
+	Cache_Read(3000);
+	Cache_Read(3001);
+	Cache_Delta(&rd, &wr, &hit);
+	if (hit != 1 || rd != 1) {
+		Cache_Fail("LRU: %lu hits, %lu sectors read instead of 1 and 1", (unsigned long)hit, (unsigned long)rd);
+	}
+
+	//A dirty line is written back when it is evicted
+	Cache_Write(4000);
+	Cache_Write(4010);
+	Cache_Write(4020);
+	Cache_Write(4030);
+	Cache_Mark();
+	Cache_Write(4040);
+	Cache_Delta(&rd, &wr, &hit);
+	if (wr != 1) {
+		Cache_Fail("evict: %lu sectors written for one dirty victim", (unsigned long)wr);
+	}
+
+	//Bulk read sees the dirty line, and the card has it after the flush
+	Cache_Write(5001);
+	if (disk_read(0, u8Sect, 5000, 3) != RES_OK || memcmp(u8Sect + 512, u8Check, 512)) {
+		Cache_Fail("coherence: bulk read missed a dirty line");
+	}
+	disk_ioctl(0, CTRL_SYNC, 0);
+	memset(u8Sect, 0, sizeof(u8Sect));
+	if (disk_read(0, u8Sect, 5000, 2) != RES_OK || memcmp(u8Sect + 512, u8Check, 512)) {
+		Cache_Fail("coherence: flushed sector not on the card");
+	}
+	Cache_Fill(u8Check, 4030);
+	if (disk_read(0, u8Sect, 4029, 2) != RES_OK || memcmp(u8Sect + 512, u8Check, 512)) {
+		Cache_Fail("coherence: sector written on eviction not on the card");
+	}
+	//f_mkfs initialises the card again, f_fdisk left its MBR in a dirty line
+	Cache_Write(6000);
+	disk_initialize(0);
+	if (disk_read(0, u8Sect, 5999, 2) != RES_OK || memcmp(u8Sect + 512, u8Check, 512)) {
+		Cache_Fail("reinit: dirty line dropped");
+	}
+	printf("lines: %d sectors, hit, flush, merge, LRU, coherence and reinit checked\n", CACHE_SECTORS);
+}
+#endif
+
+static void Cache_Record(BYTE *p, uint32_t n)
+{
+	UINT i;
+
+	for (i = 0; i < CACHE_TEST_RECORD; i++) {
+		p[i] = (BYTE)(n * 5 + i);
+	}
+}
+
+static void Cache_Logging(void)
+{
+	SdEmu_Stats_t s0, s1;
+	MMC_IOSTAT io0, io1;
+	BYTE rec[CACHE_TEST_RECORD], chk[CACHE_TEST_RECORD];
+	uint64_t u64T0, u64Ns;
+	uint32_t n;
+	FRESULT fr;
+	UINT bw;
+
+	SdEmu_GetStats(&s0);
+	disk_ioctl(0, MMC_GET_IOSTAT, &io0);
+	u64T0 = SimClock_Now();
+	fr = f_open(&Fil, "LOG.BIN", FA_WRITE | FA_CREATE_ALWAYS);
+	for (n = 0; fr == FR_OK && n < CACHE_TEST_RECORDS; n++) {
+		Cache_Record(rec, n);
+		fr = f_write(&Fil, rec, sizeof(rec), &bw);
+		if (fr == FR_OK && (n + 1) % CACHE_TEST_SYNC == 0) {
+			fr = f_sync(&Fil);
+		}
+	}
+	if (fr == FR_OK) {
+		fr = f_close(&Fil);
+	}
+	u64Ns = SimClock_Now() - u64T0;
+	SdEmu_GetStats(&s1);
+	disk_ioctl(0, MMC_GET_IOSTAT, &io1);
+	if (fr != FR_OK) {
+		Cache_Fail("logging: FatFs error %d", fr);
+		return;
+	}
+
+	printf("logging: %d records, f_sync every %d: %lu CMD24, %lu CMD25, %lu sectors written, %lu read,"
+		" %lu hits, %lu misses, %.1f ms, %.0f records/s\n", CACHE_TEST_RECORDS, CACHE_TEST_SYNC,
+		(unsigned long)(s1.u32Cmd[24] - s0.u32Cmd[24]), (unsigned long)(s1.u32Cmd[25] - s0.u32Cmd[25]),
+		(unsigned long)(s1.u32SectorsWritten - s0.u32SectorsWritten),
+		(unsigned long)(s1.u32SectorsRead - s0.u32SectorsRead), (unsigned long)(io1.hit - io0.hit),
+		(unsigned long)(io1.miss - io0.miss), u64Ns / 1e6, CACHE_TEST_RECORDS / (u64Ns / 1e9));
+
+	fr = f_open(&Fil, "LOG.BIN", FA_READ);
+	for (n = 0; fr == FR_OK && n < CACHE_TEST_RECORDS; n++) {
+		Cache_Record(chk, n);
+		fr = f_read(&Fil, rec, sizeof(rec), &bw);
+		if (fr == FR_OK && (bw != sizeof(rec) || memcmp(rec, chk, sizeof(rec)))) {
+			Cache_Fail("logging: record %lu read back wrong", (unsigned long)n);
+			break;
+		}
+	}
+	f_close(&Fil);
+}
+
+int main(void)
+{
+	SdEmu_Config_t Config;
+	SdEmu_Stats_t s;
+	MKFS_PARM Opt = {FM_ANY, 0, 0, 0, 0};
+	FRESULT fr;
+
+	SdEmu_DefaultConfig(&Config);
+	SimClock_Reset();
+	if (!SdEmu_Open(&Config) || (disk_initialize(0) & STA_NOINIT)) {
+		fprintf(stderr, "cannot open or initialise the card\n");
+		return 1;
+	}
+#if CACHE_SECTORS
+	Cache_Lines();
+#else
+	printf("lines: cache disabled\n");
+#endif
+
+	fr = f_mkfs("", &Opt, u8Work, sizeof(u8Work));
+	if (fr == FR_OK) {
+		fr = f_mount(&Fs, "", 1);
+	}
+	if (fr != FR_OK) {
+		fprintf(stderr, "format/mount failed: %d\n", fr);
+		return 1;
+	}
+	Cache_Logging();
+
+	SdEmu_GetStats(&s);
+	if (s.u32Errors || s.u32Illegal) {
+		Cache_Fail("card saw %lu protocol errors, %lu illegal commands", (unsigned long)s.u32Errors,
+			(unsigned long)s.u32Illegal);
+	}
+	f_mount(0, "", 0);
+	SdEmu_Close();
+	if (iFailed) {
+		fprintf(stderr, "%d failures\n", iFailed);
+	}
+	return iFailed != 0;
+}
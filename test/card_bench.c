@@ -0,0 +1,254 @@
+/*
+ * card_db.c on the simulated flash and the emulated SD card
+ *
+ * Built once per table size (CARD_BENCH_ENTRIES, the flash area and the
+ * bloom filter set from test/CMakeLists.txt), the size of the F103C8
+ * build included.
+ *
+ * - Boot: CARDS.TXT with CARD_BENCH_ENTRIES UIDs of 4, 7 and 10 bytes, a
+ *   comment and a malformed line. The first CardDB_Init rebuilds the
+ *   table, the second finds it current and must not erase anything.
+ * - Lookup: every authorised card is found, CARD_BENCH_MISSES unknown
+ *   cards are not. Host time, flash slots compared and the share of
+ *   unknown cards the bloom filter turns away are reported.
+ * - Add/revoke at run time, and UIDs longer than 10 bytes refused.
+ */
+
+#include "card_db.h"
+#include "flash_sim.h"
+#include "sd_card.h"
+#include "sd_emu.h"
+#include "sim_clock.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef CARD_BENCH_ENTRIES
+#define CARD_BENCH_ENTRIES		CARD_DB_MAX_ENTRIES
+#endif
+#define CARD_BENCH_MISSES		100000
+#define CARD_BENCH_REVOKE_EVERY	50
+
+static BYTE u8Work[FF_MAX_SS];
+static int iFailed;
+
+static void Card_Fail(const char* fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	fprintf(stderr, "FAIL: ");
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	++iFailed;
+}
+
+static double Card_Now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Card n of the file, n >= CARD_BENCH_ENTRIES are never authorised */
+static uint8_t Card_Uid(uint32_t n, uint8_t* uid)
+{
+	static const uint8_t u8Lens[] = {4, 7, 10};
+	uint8_t len = u8Lens[n % 3];
+	uint32_t x = n * 2654435761UL + 0x9E37;
+	uint8_t i;
+
+	for (i = 0; i < len; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		uid[i] = (uint8_t)x;
+	}
+	//The card number itself, UIDs never repeat
+	uid[0] = (uint8_t)n;
+	uid[1] = (uint8_t)(n >> 8);
+	uid[2] = (uint8_t)(n >> 16);
+	return len;
+}
+
+static FRESULT Card_WriteFile(void)
+{
+	FIL fil;
+	FRESULT fr;
+	char line[2 * CARD_DB_UID_LEN + 3];
+	uint8_t uid[CARD_DB_UID_LEN];
+	uint8_t len, i;
+	uint32_t n;
+	UINT bw;
+
+	fr = f_open(&fil, CARD_DB_FILE, FA_WRITE | FA_CREATE_ALWAYS);
+	if (fr != FR_OK) {
+		return fr;
+	}
+	f_write(&fil, "# badges\r\n", 10, &bw);
+	f_write(&fil, "12 34 XY\r\n", 10, &bw);
+	for (n = 0; n < CARD_BENCH_ENTRIES && fr == FR_OK; n++) {
+		len = Card_Uid(n, uid);
+		for (i = 0; i < len; i++) {
+			sprintf(&line[2 * i], "%02X", uid[i]);
+		}
+		strcpy(&line[2 * len], "\r\n");
+		fr = f_write(&fil, line, 2 * len + 2, &bw);
+	}
+	if (fr == FR_OK) {
+		fr = f_close(&fil);
+	}
+	return fr;
+}
+
+static void Card_Boot(void)
+{
+	CardDB_Stats_t s;
+	SimFlash_Stats_t f0, f1;
+	uint64_t u64T0, u64Rebuild, u64Check;
+	FRESULT fr;
+
+	SimFlash_GetStats(&f0);
+	u64T0 = SimClock_Now();
+	fr = CardDB_Init();
+	u64Rebuild = SimClock_Now() - u64T0;
+	SimFlash_GetStats(&f1);
+	CardDB_GetStats(&s);
+	if (fr != FR_OK || s.u32Entries != CARD_BENCH_ENTRIES) {
+		Card_Fail("boot: init %d, %lu of %lu cards in the table", fr, (unsigned long)s.u32Entries,
+			(unsigned long)CARD_BENCH_ENTRIES);
+	}
+	printf("boot: rebuild of %lu cards %.2f s, %lu page erases, %lu halfwords programmed\n",
+		(unsigned long)s.u32Entries, u64Rebuild / 1e9, (unsigned long)(f1.u32Erases - f0.u32Erases),
+		(unsigned long)(f1.u32Programs - f0.u32Programs));
+
+	u64T0 = SimClock_Now();
+	fr = CardDB_Init();
+	u64Check = SimClock_Now() - u64T0;
+	SimFlash_GetStats(&f0);
+	if (fr != FR_OK || f0.u32Erases != f1.u32Erases) {
+		Card_Fail("boot: unchanged file rebuilt the table");
+	}
+	printf("boot: unchanged file %.2f s, table kept\n", u64Check / 1e9);
+}
+
+static void Card_Lookup(void)
+{
+	CardDB_Stats_t s0, s1;
+	uint8_t uid[CARD_DB_UID_LEN];
+	uint8_t len;
+	uint32_t n, u32Missed = 0, u32False = 0;
+	double dHit, dMiss;
+
+	CardDB_GetStats(&s0);
+	dHit = Card_Now();
+	for (n = 0; n < CARD_BENCH_ENTRIES; n++) {
+		len = Card_Uid(n, uid);
+		u32Missed += !CardDB_Lookup(uid, len);
+	}
+	dHit = Card_Now() - dHit;
+	CardDB_GetStats(&s1);
+	printf("lookup: %lu authorised, %.0f ns and %.2f slots each\n", (unsigned long)CARD_BENCH_ENTRIES,
+		dHit * 1e9 / CARD_BENCH_ENTRIES, (double)(s1.u32Probes - s0.u32Probes) / CARD_BENCH_ENTRIES);
+
+	s0 = s1;
+	dMiss = Card_Now();
+	for (n = 0; n < CARD_BENCH_MISSES; n++) {
+		len = Card_Uid(CARD_BENCH_ENTRIES + n, uid);
+		u32False += CardDB_Lookup(uid, len);
+	}
+	dMiss = Card_Now() - dMiss;
+	CardDB_GetStats(&s1);
+	printf("lookup: %lu unknown, %.0f ns and %.2f slots each, %.1f%% rejected by the bloom filter\n",
+		(unsigned long)CARD_BENCH_MISSES, dMiss * 1e9 / CARD_BENCH_MISSES,
+		(double)(s1.u32Probes - s0.u32Probes) / CARD_BENCH_MISSES,
+		100.0 * (s1.u32BloomRejects - s0.u32BloomRejects) / CARD_BENCH_MISSES);
+
+	if (u32Missed || u32False) {
+		Card_Fail("lookup: %lu authorised cards not found, %lu unknown cards accepted", (unsigned long)u32Missed,
+			(unsigned long)u32False);
+	}
+}
+
+static void Card_Update(void)
+{
+	uint8_t uid[CARD_DB_UID_LEN + 1];
+	uint8_t len;
+	uint32_t n, u32Wrong = 0;
+
+	for (n = 0; n < CARD_BENCH_ENTRIES; n += CARD_BENCH_REVOKE_EVERY) {
+		len = Card_Uid(n, uid);
+		if (CardDB_Revoke(uid, len) != CARD_DB_OK) {
+			++u32Wrong;
+		}
+	}
+	for (n = 0; n < CARD_BENCH_ENTRIES; n++) {
+		len = Card_Uid(n, uid);
+		u32Wrong += CardDB_Lookup(uid, len) != (n % CARD_BENCH_REVOKE_EVERY != 0);
+	}
+	if (u32Wrong) {
+		Card_Fail("revoke: %lu cards with the wrong answer", (unsigned long)u32Wrong);
+	}
+
+	//A revoked card leaves a tombstone, adding it again takes a fresh slot if the load allows
+	len = Card_Uid(0, uid);
+	if (CardDB_Add(uid, len) == CARD_DB_OK && !CardDB_Lookup(uid, len)) {
+		Card_Fail("add: card added again not found");
+	}
+
+	memset(uid, 0x5A, sizeof(uid));
+	if (CardDB_Add(uid, CARD_DB_UID_LEN + 1) != CARD_DB_INVALID || CardDB_Lookup(uid, CARD_DB_UID_LEN + 1)) {
+		Card_Fail("add: UID of %d bytes not refused", CARD_DB_UID_LEN + 1);
+	}
+}
+
+int main(void)
+{
+	SdEmu_Config_t SdConfig;
+	SimFlash_Config_t FlashConfig;
+	MKFS_PARM Opt = {FM_ANY, 0, 0, 0, 0};
+	uint32_t u32Area = (uint32_t)CARD_DB_FLASH_PAGES * CARD_DB_PAGE_SIZE;
+	FRESULT fr;
+
+	printf("table: %lu slots in %lu KB of flash (%u byte pages), bloom filter %lu bytes of RAM, load limit %lu\n",
+		(unsigned long)CARD_DB_SLOTS, (unsigned long)(u32Area / 1024), CARD_DB_PAGE_SIZE,
+		(unsigned long)(CARD_DB_BLOOM_BITS / 8), (unsigned long)CARD_DB_MAX_ENTRIES);
+	if (CARD_BENCH_ENTRIES > CARD_DB_MAX_ENTRIES) {
+		fprintf(stderr, "%lu cards do not fit\n", (unsigned long)CARD_BENCH_ENTRIES);
+		return 2;
+	}
+
+	SimFlash_DefaultConfig(&FlashConfig, CARD_DB_FLASH_BASE, u32Area);
+	FlashConfig.u32PageSize = CARD_DB_PAGE_SIZE;
+	SdEmu_DefaultConfig(&SdConfig);
+	SimClock_Reset();
+	if (!SimFlash_Open(&FlashConfig) || !SdEmu_Open(&SdConfig)) {
+		fprintf(stderr, "cannot map the flash area or open the card image\n");
+		return 1;
+	}
+	fr = f_mkfs("", &Opt, u8Work, sizeof(u8Work));
+	if (fr == FR_OK) {
+		fr = sd_card_mount();
+	}
+	if (fr == FR_OK) {
+		fr = Card_WriteFile();
+	}
+	if (fr != FR_OK) {
+		fprintf(stderr, "format/write of %s failed: %d\n", CARD_DB_FILE, fr);
+		return 1;
+	}
+
+	Card_Boot();
+	Card_Lookup();
+	Card_Update();
+
+	SdEmu_Close();
+	SimFlash_Close();
+	if (iFailed) {
+		fprintf(stderr, "%d failures\n", iFailed);
+	}
+	return iFailed != 0;
+}
@@ -0,0 +1,242 @@
+/*
+ * CRC_A of mfrc522.c against the bit by bit algorithm of the reader
+ *
+ * Built with MFRC522_CRC_DEFAULT on the MCU (crc_test) and on the reader
+ * coprocessor (crc_test_hw), the transaction times of both can be compared.
+ *
+ * - Vectors: the CRC_A examples of ISO 14443-3 annex B.
+ * - Exhaustive: every message of 1, 2 and 3 bytes, and for every length up
+ *   to MFRC522_MAX_LEN every value of every byte with random bytes around
+ *   it, so each slicing-by-4 table entry is used at each position.
+ * - Coprocessor: CalculateCRCEx on the reader gives the same CRC, its SPI
+ *   bytes and time against the table.
+ * - Transactions: SELECT, READ, WRITE and HLTA on one card, SPI bytes and
+ *   virtual time.
+ */
+
+#include "rc522_sim.h"
+#include "sim_clock.h"
+#include "mfrc522.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define CRC_TEST_RANDOM			4		/* Random contexts per byte value and position */
+
+static const uint8_t u8CardUid[4] = {0x71, 0x0E, 0xB3, 0x4D};
+static uint8_t u8KeyA[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+static uint32_t u32Lcg = 1;
+static int iFailed;
+
+static void Crc_Fail(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	fprintf(stderr, "FAIL: ");
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	++iFailed;
+}
+
+static uint8_t Crc_Rand(void)
+{
+	u32Lcg = u32Lcg * 1103515245 + 12345;
+	return (uint8_t)(u32Lcg >> 16);
+}
+
+/* Returns 0 and reports the first message the driver gets wrong */
+static uint8_t Crc_Check(const uint8_t *pData, uint16_t u16Len)
+{
+	uint16_t u16Ref = SimRc522_CrcA(pData, u16Len, 0x6363);
+	uint16_t u16Crc = TM_MFRC522_CrcA(pData, u16Len);
+
+	if (u16Crc != u16Ref) {
+		Crc_Fail("%u bytes starting %02X: %04X, reference %04X", u16Len, u16Len ? pData[0] : 0, u16Crc, u16Ref);
+		return 0;
+	}
+	return 1;
+}
+
+static void Crc_Vectors(void)
+{
+	uint8_t u8A[2] = {0x00, 0x00}, u8B[2] = {0x12, 0x34};
+
+	if (TM_MFRC522_CrcA(u8A, 2) != 0x1EA0 || TM_MFRC522_CrcA(u8B, 2) != 0xCF26) {
+		Crc_Fail("vectors: %04X and %04X instead of 1EA0 and CF26", TM_MFRC522_CrcA(u8A, 2), TM_MFRC522_CrcA(u8B, 2));
+	}
+	printf("vectors: 00 00 -> A0 1E, 12 34 -> 26 CF\n");
+}
+
+static void Crc_Exhaustive(void)
+{
+	uint8_t u8Buf[MFRC522_MAX_LEN];
+	uint32_t u32Msg, u32Count = 0;
+	uint16_t u16Len, u16Pos, v;
+	uint8_t r;
+
+	if (!Crc_Check(u8Buf, 0)) {
+		return;
+	}
+	for (u16Len = 1; u16Len <= 3; u16Len++) {
+		for (u32Msg = 0; u32Msg < (1UL << (8 * u16Len)); u32Msg++) {
+			u8Buf[0] = (uint8_t)u32Msg;
+			u8Buf[1] = (uint8_t)(u32Msg >> 8);
+			u8Buf[2] = (uint8_t)(u32Msg >> 16);
+			++u32Count;
+			if (!Crc_Check(u8Buf, u16Len)) {
+				return;
+			}
+		}
+	}
+	for (u16Len = 4; u16Len <= MFRC522_MAX_LEN; u16Len++) {
+		for (u16Pos = 0; u16Pos < u16Len; u16Pos++) {
+			for (v = 0; v < 256; v++) {
+				for (r = 0; r < CRC_TEST_RANDOM; r++) {
+					for (u32Msg = 0; u32Msg < u16Len; u32Msg++) {
+						u8Buf[u32Msg] = Crc_Rand();
+					}
+					u8Buf[u16Pos] = (uint8_t)v;
+					++u32Count;
+					if (!Crc_Check(u8Buf, u16Len)) {
+						return;
+					}
+				}
+			}
+		}
+	}
+	printf("exhaustive: %lu messages of 0 to %u bytes match the reference\n", (unsigned long)u32Count,
+		MFRC522_MAX_LEN);
+}
+
+static void Crc_Coprocessor(void)
+{
+	SimRc522_Stats_t s0, s1;
+	uint8_t u8Frame[MFRC522_MAX_LEN + 2], u8Hw[2], u8Sw[2];
+	uint64_t u64T0, u64Hw = 0, u64Sw = 0;
+	uint32_t u32Hw = 0, u32Sw = 0;
+	uint8_t u8Len, i;
+
+	for (u8Len = 1; u8Len <= sizeof(u8Frame); u8Len++) {
+		for (i = 0; i < u8Len; i++) {
+			u8Frame[i] = Crc_Rand();
+		}
+		SimRc522_GetStats(&s0);
+		u64T0 = SimClock_Now();
+		TM_MFRC522_CalculateCRCEx(MFRC522_CRC_HW, u8Frame, u8Len, u8Hw);
+		SimRc522_GetStats(&s1);
+		if (u8Len == 7) {
+			u64Hw = SimClock_Now() - u64T0;
+			u32Hw = (uint32_t)(s1.u64SpiBytes - s0.u64SpiBytes);
+		}
+
+		u64T0 = SimClock_Now();
+		TM_MFRC522_CalculateCRCEx(MFRC522_CRC_SW, u8Frame, u8Len, u8Sw);
+		SimRc522_GetStats(&s0);
+		if (u8Len == 7) {
+			u64Sw = SimClock_Now() - u64T0;
+			u32Sw = (uint32_t)(s0.u64SpiBytes - s1.u64SpiBytes);
+		}
+		if (memcmp(u8Hw, u8Sw, 2)) {
+			Crc_Fail("coprocessor: %u bytes, %02X%02X from the reader, %02X%02X from the table", u8Len, u8Hw[1],
+				u8Hw[0], u8Sw[1], u8Sw[0]);
+		}
+	}
+	printf("coprocessor: same CRC for 1 to 18 bytes; SELECT frame %lu SPI bytes, %.1f us on the reader,"
+		" %lu and %.1f us from the table\n", (unsigned long)u32Hw, u64Hw / 1e3, (unsigned long)u32Sw, u64Sw / 1e3);
+	if (u32Sw != 0) {
+		Crc_Fail("coprocessor: the table touches the reader");
+	}
+}
+
+static SimRc522_Stats_t S0;
+static uint64_t u64T0;
+
+static void Crc_Mark(void)
+{
+	SimRc522_GetStats(&S0);
+	u64T0 = SimClock_Now();
+}
+
+static void Crc_Report(const char *pszName)
+{
+	SimRc522_Stats_t s;
+
+	SimRc522_GetStats(&s);
+	printf("%-10s | %9lu | %9.1f\n", pszName, (unsigned long)(s.u64SpiBytes - S0.u64SpiBytes),
+		(SimClock_Now() - u64T0) / 1e3);
+}
+
+static void Crc_Transactions(void)
+{
+	TM_MFRC522_Uid_t uid;
+	uint8_t u8Buf[MFRC522_MAX_LEN + 2], u8Data[16];
+	uint8_t i;
+
+	printf("CRC default %s\n", (MFRC522_CRC_DEFAULT == MFRC522_CRC_SW) ? "MCU table" : "reader coprocessor");
+	printf("%-10s | %9s | %9s\n", "command", "SPI bytes", "us");
+	if (TM_MFRC522_Request(PICC_REQIDL, u8Buf) != MI_OK) {
+		Crc_Fail("REQA not answered");
+		return;
+	}
+	Crc_Mark();
+	if (TM_MFRC522_Select(&uid) != MI_OK || memcmp(uid.uidByte, u8CardUid, 4)) {
+		Crc_Fail("SELECT failed");
+	}
+	Crc_Report("SELECT");
+	if (TM_MFRC522_Auth(PICC_AUTHENT1A, 7, u8KeyA, uid.uidByte) != MI_OK) {
+		Crc_Fail("authentication failed");
+	}
+
+	Crc_Mark();
+	if (TM_MFRC522_Read(4, u8Buf) != MI_OK || memcmp(u8Buf, SimRc522_GetCard(0)->u8Block[4], 16)) {
+		Crc_Fail("block read failed");
+	}
+	Crc_Report("READ");
+
+	for (i = 0; i < sizeof(u8Data); i++) {
+		u8Data[i] = (uint8_t)(0x81 ^ i);
+	}
+	Crc_Mark();
+	if (TM_MFRC522_Write(6, u8Data) != MI_OK || memcmp(SimRc522_GetCard(0)->u8Block[6], u8Data, 16)) {
+		Crc_Fail("block write failed");
+	}
+	Crc_Report("WRITE");
+
+	Crc_Mark();
+	TM_MFRC522_Halt();
+	Crc_Report("HLTA");
+	TM_MFRC522_ClearBitMask(MFRC522_REG_STATUS2, 0x08);
+}
+
+int main(void)
+{
+	SimRc522_Config_t Config;
+	SimRc522_Card_t Card;
+	SimRc522_Stats_t s;
+
+	SimClock_Reset();
+	SimRc522_DefaultConfig(&Config);
+	SimRc522_Open(&Config);
+	SimRc522_MakeCard(&Card, u8CardUid, sizeof(u8CardUid));
+	SimRc522_AddCard(&Card);
+	TM_MFRC522_Init();
+	//The card powers up in the field before it answers
+	SimClock_Advance(5000000);
+
+	Crc_Vectors();
+	Crc_Exhaustive();
+	Crc_Coprocessor();
+	Crc_Transactions();
+
+	SimRc522_GetStats(&s);
+	if (s.u32Errors) {
+		Crc_Fail("%lu bytes sent with CS high or FIFO overflows", (unsigned long)s.u32Errors);
+	}
+	if (iFailed) {
+		fprintf(stderr, "%d failures\n", iFailed);
+	}
+	return iFailed != 0;
+}
@@ -0,0 +1,459 @@
+/*
+ * DMA/DMA/dma_mgr.c on the DMA1 model of sim_dma.c
+ *
+ * The test is the peripheral: it raises the request line of a channel
+ * with SimDma_Request, or fails the channel with SimDma_Error. Every
+ * buffer sits between guard bytes that must come out untouched.
+ *
+ * - Chains: three descriptors of a receive line and three of a transmit
+ *   line each fill or send their part in order after a single submit,
+ *   pfDone runs once per descriptor in chain order. A chain queued while
+ *   one runs starts from the interrupt. Requests past the end move
+ *   nothing.
+ * - Overrun: a descriptor whose u16Count elements do not fit u16BufSize,
+ *   first, middle or last in its chain, is DMAMGR_OVERRUN. Nothing of the
+ *   chain starts and requests write nothing.
+ * - Circular: a buffer received into lap after lap keeps the last bytes,
+ *   pfDone runs per lap and never writes past the end. While a circular
+ *   descriptor runs, or is still ahead in the chain or the queue, Submit
+ *   is DMAMGR_BUSY; after DMAMgr_Abort it is taken again.
+ * - Queue: three chains wait behind the running one, the fourth is BUSY.
+ * - Transfer error: the running chain ends with u8Error set on every
+ *   descriptor and the next queued chain starts.
+ * - Memory to memory: chains on a free channel, and DMAMgr_Copy of 1 to
+ *   70000 bytes at every alignment, by memcpy below DMAMGR_COPY_MIN.
+ * - A chain looping through pNext is DMAMGR_INVALID.
+ */
+
+#include "dma_mgr.h"
+#include "sim_dma.h"
+#include "sim_nvic.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define TEST_GUARD				16
+#define TEST_GUARD_BYTE			0xE5
+#define TEST_ARENA				256
+#define TEST_COPY_MAX			70000	/* More than one DMA transfer of 0xFFFF items */
+#define TEST_DONE_MAX			16
+
+void DMA1_Channel1_IRQHandler(void);
+void DMA1_Channel2_IRQHandler(void);
+void DMA1_Channel3_IRQHandler(void);
+void DMA1_Channel4_IRQHandler(void);
+void DMA1_Channel5_IRQHandler(void);
+void DMA1_Channel6_IRQHandler(void);
+void DMA1_Channel7_IRQHandler(void);
+
+/* dma_mgr.c only takes the address of their data registers */
+ADC_TypeDef SimAdc1;
+SPI_TypeDef SimSpi1;
+SPI_TypeDef SimSpi2;
+USART_TypeDef SimUsart1;
+USART_TypeDef SimUsart2;
+USART_TypeDef SimUsart3;
+I2C_TypeDef SimI2c1;
+
+static void (*const pfHandlers[DMAMGR_CHANNELS])(void) = {
+	DMA1_Channel1_IRQHandler, DMA1_Channel2_IRQHandler, DMA1_Channel3_IRQHandler, DMA1_Channel4_IRQHandler,
+	DMA1_Channel5_IRQHandler, DMA1_Channel6_IRQHandler, DMA1_Channel7_IRQHandler
+};
+
+static uint32_t u32Arena[(TEST_GUARD + TEST_ARENA + TEST_GUARD) / 4];	/* Aligned for 2 and 4 byte elements */
+static uint8_t *const u8Arena = (uint8_t *)u32Arena;
+static uint8_t u8CopySrc[TEST_COPY_MAX + 8];
+static uint8_t u8CopyDst[TEST_GUARD + TEST_COPY_MAX + 8 + TEST_GUARD];
+static DMAMgr_Desc_t Desc[8];
+static DMAMgr_Desc_t *pDone[TEST_DONE_MAX];
+static uint8_t u8Done;
+static uint8_t u8DoneErrors;
+static int iFailed;
+
+static void Test_Fail(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	fprintf(stderr, "FAIL: ");
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	++iFailed;
+}
+
+static void Test_OnDone(DMAMgr_Desc_t *pDesc)
+{
+	if (u8Done < TEST_DONE_MAX) {
+		pDone[u8Done] = pDesc;
+	}
+	++u8Done;
+	u8DoneErrors += pDesc->u8Error;
+}
+
+static void Test_Reset(void)
+{
+	uint8_t i;
+
+	SimNvic_Reset();
+	SimDma_Reset();
+	for (i = 0; i < DMAMGR_CHANNELS; i++) {
+		SimNvic_SetVector((IRQn_Type)(DMA1_Channel1_IRQn + i), pfHandlers[i]);
+	}
+	DMAMgr_Init();
+	memset(u8Arena, TEST_GUARD_BYTE, sizeof(u32Arena));
+	memset(Desc, 0, sizeof(Desc));
+	u8Done = 0;
+	u8DoneErrors = 0;
+}
+
+/* Descriptor over the arena, u16Off bytes past the front guard */
+static DMAMgr_Desc_t *Test_Desc(uint8_t n, uint16_t u16Off, uint16_t u16Size, uint16_t u16Count, uint8_t u8Dir)
+{
+	DMAMgr_Desc_t *p = &Desc[n];
+
+	p->pBuf = &u8Arena[TEST_GUARD + u16Off];
+	p->u16BufSize = u16Size;
+	p->u16Count = u16Count;
+	p->u8Width = 1;
+	p->u8Dir = u8Dir;
+	p->pfDone = Test_OnDone;
+	return p;
+}
+
+static void Test_Guards(const char *what, uint16_t u16Used)
+{
+	uint16_t i;
+
+	for (i = 0; i < TEST_GUARD; i++) {
+		if (u8Arena[i] != TEST_GUARD_BYTE) {
+			Test_Fail("%s: front guard byte %u written", what, i);
+			return;
+		}
+	}
+	for (i = TEST_GUARD + u16Used; i < sizeof(u32Arena); i++) {
+		if (u8Arena[i] != TEST_GUARD_BYTE) {
+			Test_Fail("%s: byte %u past the buffers written", what, i - TEST_GUARD);
+			return;
+		}
+	}
+}
+
+/* u16Len bytes from the peripheral, returns how many the channel took */
+static uint16_t Test_Receive(uint8_t u8Channel, uint8_t u8First, uint16_t u16Len)
+{
+	uint32_t u32Data;
+	uint16_t i, u16Taken = 0;
+
+	for (i = 0; i < u16Len; i++) {
+		u32Data = (uint8_t)(u8First + i);
+		u16Taken += SimDma_Request(u8Channel, &u32Data);
+	}
+	return u16Taken;
+}
+
+static void Test_Expect(const char *what, DMAMgr_Status_t eGot, DMAMgr_Status_t eWant)
+{
+	if (eGot != eWant) {
+		Test_Fail("%s: status %u, expected %u", what, eGot, eWant);
+	}
+}
+
+static void Test_Chains(void)
+{
+	DMAMgr_Chan_t *pRx, *pTx;
+	uint32_t u32Data;
+	uint16_t i, u16Taken;
+
+	Test_Reset();
+	pRx = DMAMgr_Alloc(DMAMGR_LINE_USART1_RX);
+	Test_Desc(0, 0, 10, 10, DMAMGR_TO_MEM)->pNext = Test_Desc(1, 10, 5, 5, DMAMGR_TO_MEM);
+	Desc[1].pNext = Test_Desc(2, 15, 20, 17, DMAMGR_TO_MEM);
+	Test_Desc(3, 40, 8, 8, DMAMGR_TO_MEM);
+	Test_Expect("rx chain", DMAMgr_Submit(pRx, &Desc[0]), DMAMGR_OK);
+	Test_Expect("rx queued", DMAMgr_Submit(pRx, &Desc[3]), DMAMGR_OK);
+	Test_Expect("rx resubmit", DMAMgr_Submit(pRx, &Desc[1]), DMAMGR_BUSY);
+
+	//32 of the chain, 8 of the queued one, the rest finds the channel idle
+	u16Taken = Test_Receive(5, 0, 48);
+	if (u16Taken != 40 || DMAMgr_Remaining(pRx)) {
+		Test_Fail("rx chain: %u of 48 bytes taken, %u remaining", u16Taken, DMAMgr_Remaining(pRx));
+	}
+	for (i = 0; i < 32; i++) {
+		if (u8Arena[TEST_GUARD + i] != i) {
+			Test_Fail("rx chain: byte %u is %u", i, u8Arena[TEST_GUARD + i]);
+			break;
+		}
+	}
+	for (i = 32; i < 40; i++) {
+		if (u8Arena[TEST_GUARD + i] != TEST_GUARD_BYTE || u8Arena[TEST_GUARD + i + 8] != i) {
+			Test_Fail("rx queued: byte %u wrong", i);
+			break;
+		}
+	}
+	if (u8Done != 4 || pDone[0] != &Desc[0] || pDone[1] != &Desc[1] || pDone[2] != &Desc[2] ||
+		pDone[3] != &Desc[3] || u8DoneErrors) {
+		Test_Fail("rx chain: pfDone %u times, out of order or with errors", u8Done);
+	}
+	for (i = 0; i < 4; i++) {
+		if (Desc[i].u8Busy) {
+			Test_Fail("rx chain: descriptor %u still busy", i);
+		}
+	}
+	//17 of 20 in the last descriptor, 8 of the queued one at 40
+	Test_Guards("rx chain", 48);
+
+	//Transmit: the arena in order, three descriptors
+	Test_Reset();
+	for (i = 0; i < 30; i++) {
+		u8Arena[TEST_GUARD + i] = (uint8_t)(100 + i);
+	}
+	pTx = DMAMgr_Alloc(DMAMGR_LINE_USART1_TX);
+	Test_Desc(0, 0, 12, 12, DMAMGR_FROM_MEM)->pNext = Test_Desc(1, 12, 3, 3, DMAMGR_FROM_MEM);
+	Desc[1].pNext = Test_Desc(2, 15, 15, 15, DMAMGR_FROM_MEM);
+	Test_Expect("tx chain", DMAMgr_Submit(pTx, &Desc[0]), DMAMGR_OK);
+	for (i = 0; i < 30; i++) {
+		if (!SimDma_Request(4, &u32Data) || u32Data != 100u + i) {
+			Test_Fail("tx chain: byte %u not sent as written", i);
+			break;
+		}
+	}
+	if (SimDma_Request(4, &u32Data) || u8Done != 3 || Desc[2].u8Busy) {
+		Test_Fail("tx chain: still running after 30 bytes, pfDone %u times", u8Done);
+	}
+	Test_Guards("tx chain", 30);
+}
+
+static void Test_Overrun(void)
+{
+	static const uint8_t u8Widths[] = {1, 2, 4};
+	DMAMgr_Chan_t *pChan;
+	char what[48];
+	uint8_t u8Bad, w;
+
+	for (u8Bad = 0; u8Bad < 3; u8Bad++) {
+		for (w = 0; w < sizeof(u8Widths); w++) {
+			Test_Reset();
+			pChan = DMAMgr_Alloc(DMAMGR_LINE_SPI1_RX);
+			Test_Desc(0, 0, 16, 16, DMAMGR_TO_MEM)->pNext = Test_Desc(1, 16, 16, 16, DMAMGR_TO_MEM);
+			Desc[1].pNext = Test_Desc(2, 32, 16, 16, DMAMGR_TO_MEM);
+			//One element more than the buffer holds
+			Desc[u8Bad].u8Width = u8Widths[w];
+			Desc[u8Bad].u16Count = 16 / u8Widths[w] + 1;
+
+			snprintf(what, sizeof(what), "overrun in descriptor %u, width %u", u8Bad, u8Widths[w]);
+			Test_Expect(what, DMAMgr_Submit(pChan, &Desc[0]), DMAMGR_OVERRUN);
+			if (Desc[0].u8Busy || Desc[1].u8Busy || Desc[2].u8Busy || DMAMgr_Remaining(pChan) ||
+				(DMA1_Channel2->CCR & DMA_CCR1_EN)) {
+				Test_Fail("%s: chain started", what);
+			}
+			if (Test_Receive(2, 0, 64)) {
+				Test_Fail("%s: the channel took bytes", what);
+			}
+			Test_Guards(what, 0);
+		}
+	}
+}
+
+static void Test_Circular(void)
+{
+	DMAMgr_Chan_t *pChan;
+	uint16_t i;
+
+	Test_Reset();
+	pChan = DMAMgr_Alloc(DMAMGR_LINE_SPI1_RX);
+	Test_Desc(0, 0, 16, 16, DMAMGR_TO_MEM)->u8Circular = 1;
+	Test_Expect("circular", DMAMgr_Submit(pChan, &Desc[0]), DMAMGR_OK);
+	if (Test_Receive(2, 0, 100) != 100) {
+		Test_Fail("circular: bytes refused");
+	}
+	//100 = 6 laps and 4 bytes into the 7th
+	for (i = 0; i < 16; i++) {
+		if (u8Arena[TEST_GUARD + i] != (i < 4 ? 96 + i : 80 + i)) {
+			Test_Fail("circular: byte %u is %u", i, u8Arena[TEST_GUARD + i]);
+			break;
+		}
+	}
+	if (u8Done != 6 || !Desc[0].u8Busy || DMAMgr_Remaining(pChan) != 12) {
+		Test_Fail("circular: %u laps, busy %u, %u remaining", u8Done, Desc[0].u8Busy, DMAMgr_Remaining(pChan));
+	}
+	Test_Guards("circular", 16);
+
+	Test_Desc(1, 16, 8, 8, DMAMGR_TO_MEM);
+	Test_Expect("behind circular", DMAMgr_Submit(pChan, &Desc[1]), DMAMGR_BUSY);
+	if (Desc[1].u8Busy) {
+		Test_Fail("behind circular: descriptor marked busy");
+	}
+	DMAMgr_Abort(pChan);
+	Test_Expect("after abort", DMAMgr_Submit(pChan, &Desc[1]), DMAMGR_OK);
+	if (Test_Receive(2, 0, 8) != 8 || Desc[1].u8Busy || u8Arena[TEST_GUARD + 16 + 7] != 7) {
+		Test_Fail("after abort: descriptor did not run");
+	}
+
+	//Circular at the end of the running chain, and queued behind a plain one
+	Test_Reset();
+	pChan = DMAMgr_Alloc(DMAMGR_LINE_SPI1_RX);
+	Test_Desc(0, 0, 8, 8, DMAMGR_TO_MEM)->pNext = Test_Desc(1, 8, 8, 8, DMAMGR_TO_MEM);
+	Desc[1].u8Circular = 1;
+	Test_Desc(2, 16, 8, 8, DMAMGR_TO_MEM);
+	Test_Expect("circular ahead in the chain", DMAMgr_Submit(pChan, &Desc[0]), DMAMGR_OK);
+	Test_Expect("behind a chain ending circular", DMAMgr_Submit(pChan, &Desc[2]), DMAMGR_BUSY);
+	DMAMgr_Abort(pChan);
+
+	Test_Desc(3, 24, 8, 8, DMAMGR_TO_MEM)->u8Circular = 1;
+	Test_Expect("plain", DMAMgr_Submit(pChan, &Desc[2]), DMAMGR_OK);
+	Test_Expect("circular queued", DMAMgr_Submit(pChan, &Desc[3]), DMAMGR_OK);
+	Test_Desc(4, 32, 8, 8, DMAMGR_TO_MEM);
+	Test_Expect("behind a queued circular", DMAMgr_Submit(pChan, &Desc[4]), DMAMGR_BUSY);
+	if (Test_Receive(2, 0, 40) != 40 || !Desc[3].u8Busy || Desc[4].u8Busy) {
+		Test_Fail("circular queued: did not take over from the plain descriptor");
+	}
+	Test_Guards("circular queued", 32);
+	DMAMgr_Abort(pChan);
+}
+
+static void Test_Queue(void)
+{
+	DMAMgr_Chan_t *pChan;
+	uint8_t i;
+
+	Test_Reset();
+	pChan = DMAMgr_Alloc(DMAMGR_LINE_I2C1_RX);
+	for (i = 0; i < 5; i++) {
+		Test_Desc(i, i * 4, 4, 4, DMAMGR_TO_MEM);
+	}
+	//The running one and DMAMGR_QUEUE_LEN - 1 waiting
+	for (i = 0; i < 4; i++) {
+		Test_Expect("queue", DMAMgr_Submit(pChan, &Desc[i]), DMAMGR_OK);
+	}
+	Test_Expect("queue full", DMAMgr_Submit(pChan, &Desc[4]), DMAMGR_BUSY);
+	if (Test_Receive(7, 0, 20) != 16 || u8Done != 4 || Desc[3].u8Busy || Desc[4].u8Busy) {
+		Test_Fail("queue: %u chains done", u8Done);
+	}
+	Test_Guards("queue", 16);
+}
+
+static void Test_Error(void)
+{
+	DMAMgr_Chan_t *pChan;
+	uint8_t i;
+
+	Test_Reset();
+	pChan = DMAMgr_Alloc(DMAMGR_LINE_USART2_RX);
+	Test_Desc(0, 0, 8, 8, DMAMGR_TO_MEM)->pNext = Test_Desc(1, 8, 8, 8, DMAMGR_TO_MEM);
+	Desc[1].pNext = Test_Desc(2, 16, 8, 8, DMAMGR_TO_MEM);
+	Test_Desc(3, 24, 8, 8, DMAMGR_TO_MEM);
+	Test_Expect("error chain", DMAMgr_Submit(pChan, &Desc[0]), DMAMGR_OK);
+	Test_Expect("error queued", DMAMgr_Submit(pChan, &Desc[3]), DMAMGR_OK);
+
+	//Into the second descriptor, then a bus error
+	Test_Receive(6, 0, 11);
+	SimDma_Error(6);
+	for (i = 0; i < 3; i++) {
+		if (Desc[i].u8Busy || (i && !Desc[i].u8Error)) {
+			Test_Fail("error: descriptor %u busy %u error %u", i, Desc[i].u8Busy, Desc[i].u8Error);
+		}
+	}
+	if (u8Done != 3 || u8DoneErrors != 2 || !Desc[3].u8Busy || DMAMgr_Remaining(pChan) != 8) {
+		Test_Fail("error: pfDone %u times, %u with errors, queued chain %s", u8Done, u8DoneErrors,
+			Desc[3].u8Busy ? "started" : "not started");
+	}
+	if (Test_Receive(6, 50, 8) != 8 || Desc[3].u8Busy || u8Arena[TEST_GUARD + 24] != 50) {
+		Test_Fail("error: queued chain did not run");
+	}
+	Test_Guards("error", 32);
+}
+
+static void Test_Memory(void)
+{
+	static const uint32_t u32Lens[] = {1, 63, 64, 65, 1000, 4099, TEST_COPY_MAX};
+	DMAMgr_Chan_t *pChan;
+	uint32_t u32Irqs, i, l, s, d;
+
+	Test_Reset();
+	pChan = DMAMgr_Alloc(DMAMGR_LINE_MEM);
+	for (i = 0; i < 64; i++) {
+		u8CopySrc[i] = (uint8_t)(i * 3 + 1);
+	}
+	//Four word copies chained, all run from the interrupt after the one submit
+	for (i = 0; i < 4; i++) {
+		Test_Desc(i, i * 16, 16, 4, DMAMGR_TO_MEM)->u8Width = 4;
+		Desc[i].pSrc = &u8CopySrc[i * 16];
+		Desc[i].pNext = i < 3 ? &Desc[i + 1] : 0;
+	}
+	Test_Expect("memory chain", DMAMgr_Submit(pChan, &Desc[0]), DMAMGR_OK);
+	if (u8Done != 4 || Desc[3].u8Busy || memcmp(&u8Arena[TEST_GUARD], u8CopySrc, 64)) {
+		Test_Fail("memory chain: %u of 4 done, data %s", u8Done,
+			memcmp(&u8Arena[TEST_GUARD], u8CopySrc, 64) ? "wrong" : "right");
+	}
+	Test_Guards("memory chain", 64);
+	Test_Desc(5, 64, 16, 4, DMAMGR_TO_MEM)->u8Circular = 1;
+	Desc[5].pSrc = u8CopySrc;
+	Test_Expect("memory circular", DMAMgr_Submit(pChan, &Desc[5]), DMAMGR_INVALID);
+	DMAMgr_Free(pChan);
+
+	for (i = 0; i < sizeof(u8CopySrc); i++) {
+		u8CopySrc[i] = (uint8_t)(i * 7 + (i >> 8));
+	}
+	for (l = 0; l < sizeof(u32Lens) / sizeof(u32Lens[0]); l++) {
+		for (s = 0; s < 4; s++) {
+			for (d = 0; d < 4; d++) {
+				memset(u8CopyDst, TEST_GUARD_BYTE, sizeof(u8CopyDst));
+				u32Irqs = SimNvic_Total();
+				DMAMgr_Copy(&u8CopyDst[TEST_GUARD + d], &u8CopySrc[s], u32Lens[l]);
+				if (memcmp(&u8CopyDst[TEST_GUARD + d], &u8CopySrc[s], u32Lens[l])) {
+					Test_Fail("copy of %lu from +%lu to +%lu: data wrong", (unsigned long)u32Lens[l],
+						(unsigned long)s, (unsigned long)d);
+				}
+				for (i = 0; i < TEST_GUARD + d; i++) {
+					if (u8CopyDst[i] != TEST_GUARD_BYTE) {
+						Test_Fail("copy of %lu: wrote before the destination", (unsigned long)u32Lens[l]);
+						break;
+					}
+				}
+				for (i = TEST_GUARD + d + u32Lens[l]; i < sizeof(u8CopyDst); i++) {
+					if (u8CopyDst[i] != TEST_GUARD_BYTE) {
+						Test_Fail("copy of %lu: wrote past the destination", (unsigned long)u32Lens[l]);
+						break;
+					}
+				}
+				if ((SimNvic_Total() != u32Irqs) != (u32Lens[l] >= DMAMGR_COPY_MIN)) {
+					Test_Fail("copy of %lu: %s the DMA", (unsigned long)u32Lens[l],
+						SimNvic_Total() != u32Irqs ? "by" : "without");
+				}
+			}
+		}
+	}
+}
+
+static void Test_Loop(void)
+{
+	DMAMgr_Chan_t *pChan;
+
+	Test_Reset();
+	pChan = DMAMgr_Alloc(DMAMGR_LINE_ADC1);
+	Test_Desc(0, 0, 8, 8, DMAMGR_TO_MEM)->pNext = Test_Desc(1, 8, 8, 8, DMAMGR_TO_MEM);
+	Desc[1].pNext = &Desc[0];
+	Test_Expect("pNext loop", DMAMgr_Submit(pChan, &Desc[0]), DMAMGR_INVALID);
+	if (Desc[0].u8Busy || Test_Receive(1, 0, 8)) {
+		Test_Fail("pNext loop: started");
+	}
+}
+
+int main(void)
+{
+	Test_Chains();
+	Test_Overrun();
+	Test_Circular();
+	Test_Queue();
+	Test_Error();
+	Test_Memory();
+	Test_Loop();
+
+	if (iFailed) {
+		fprintf(stderr, "%d failures\n", iFailed);
+		return 1;
+	}
+	printf("dma_mgr: chains, overrun, circular, queue, transfer error, memory to memory and copy passed\n");
+	return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * Write and read rates of the AT24C32 strategies on the simulated chip
+ *
+ * 4 KB written and read back at 400 kHz, for write cycles of 3 and 5 ms:
+ *
+ * - byte + 5 ms: one byte per transaction and a fixed delay, the old
+ *   hardware example.
+ * - page + 10 ms: page sized transactions and a fixed delay of the data
+ *   sheet maximum, the old software example once split at the pages.
+ * - page + ACK poll: AT24C32_Write, page sized transactions and ACK
+ *   polling through the write cycle.
+ *
+ * Reads: one byte per address write and read, against AT24C32_Read of the
+ * whole chip in one transaction. Every strategy has to read back what it
+ * wrote; the ACK polled writes have to be the fastest and follow the
+ * write cycle of the chip.
+ */
+
+#include "at24c32.h"
+#include "eeprom_sim.h"
+#include "sim_i2c.h"
+#include "sim_clock.h"
+#include "i2c.h"
+#include "delay.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define BENCH_BYTES				AT24C32_SIZE
+#define BENCH_FIXED_BYTE_MS		5
+#define BENCH_FIXED_PAGE_MS		AT24C32_TWR_MS
+
+static AT24C32_t Eeprom;
+static uint8_t u8Data[BENCH_BYTES];
+static uint8_t u8Back[BENCH_BYTES];
+static int iFailed;
+
+static void Bench_Fail(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	fprintf(stderr, "FAIL: ");
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	++iFailed;
+}
+
+static void Bench_Open(uint32_t u32WriteUs)
+{
+	SimEeprom_Config_t Config;
+
+	SimClock_Reset();
+	SimI2c_Reset();
+	SimEeprom_DefaultConfig(&Config);
+	Config.u32WriteUs = u32WriteUs;
+	SimEeprom_Open(&Config);
+	AT24C32_Init(&Eeprom, &AT24C32_I2C1Bus, AT24C32_ADDR);
+}
+
+static uint8_t Bench_WriteBytes(void)
+{
+	uint8_t u8Buf[3];
+	uint16_t i;
+
+	for (i = 0; i < BENCH_BYTES; i++) {
+		u8Buf[0] = i >> 8;
+		u8Buf[1] = i;
+		u8Buf[2] = u8Data[i];
+		if (I2C_Write(AT24C32_ADDR, u8Buf, 3) != Success) {
+			return 0;
+		}
+		Delay_Ms(BENCH_FIXED_BYTE_MS);
+	}
+	return 1;
+}
+
+static uint8_t Bench_WritePages(void)
+{
+	uint8_t u8Buf[2 + AT24C32_PAGE_SIZE];
+	uint16_t i;
+
+	for (i = 0; i < BENCH_BYTES; i += AT24C32_PAGE_SIZE) {
+		u8Buf[0] = i >> 8;
+		u8Buf[1] = i;
+		memcpy(&u8Buf[2], &u8Data[i], AT24C32_PAGE_SIZE);
+		if (I2C_Write(AT24C32_ADDR, u8Buf, sizeof(u8Buf)) != Success) {
+			return 0;
+		}
+		Delay_Ms(BENCH_FIXED_PAGE_MS);
+	}
+	return 1;
+}
+
+static uint8_t Bench_WritePolled(void)
+{
+	return AT24C32_Write(&Eeprom, 0, u8Data, BENCH_BYTES) == AT24C32_OK;
+}
+
+static uint8_t Bench_ReadBytes(void)
+{
+	uint8_t u8Buf[2];
+	uint16_t i;
+
+	for (i = 0; i < BENCH_BYTES; i++) {
+		u8Buf[0] = i >> 8;
+		u8Buf[1] = i;
+		if (I2C_Write(AT24C32_ADDR, u8Buf, 2) != Success || I2C_Read(AT24C32_ADDR, &u8Back[i], 1) != Success) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static uint8_t Bench_ReadSequential(void)
+{
+	return AT24C32_Read(&Eeprom, 0, u8Back, BENCH_BYTES) == AT24C32_OK;
+}
+
+typedef struct {
+	const char *pszName;
+	uint8_t (*pfWrite)(void);
+	uint8_t (*pfRead)(void);
+} Bench_Strategy_t;
+
+static const Bench_Strategy_t Strategies[] = {
+	{"byte + 5 ms", Bench_WriteBytes, Bench_ReadBytes},
+	{"page + 10 ms", Bench_WritePages, Bench_ReadBytes},
+	{"page + ACK poll", Bench_WritePolled, Bench_ReadSequential},
+};
+
+#define BENCH_STRATEGIES		(sizeof(Strategies) / sizeof(Strategies[0]))
+
+static void Bench_Run(uint32_t u32WriteUs)
+{
+	double fWrite[BENCH_STRATEGIES], fRead[BENCH_STRATEGIES], fPageMs;
+	uint64_t u64Start;
+	uint32_t i, j;
+
+	printf("write cycle %lu us\n", (unsigned long)u32WriteUs);
+	for (i = 0; i < BENCH_STRATEGIES; i++) {
+		for (j = 0; j < BENCH_BYTES; j++) {
+			u8Data[j] = (uint8_t)(j * 7 + i + u32WriteUs);
+		}
+		memset(u8Back, 0, sizeof(u8Back));
+		Bench_Open(u32WriteUs);
+
+		u64Start = SimClock_Now();
+		if (!Strategies[i].pfWrite()) {
+			Bench_Fail("%s: write failed", Strategies[i].pszName);
+		}
+		//Past the last write cycle, a fixed delay covers it already
+		if (AT24C32_WaitReady(&Eeprom) != AT24C32_OK) {
+			Bench_Fail("%s: still busy", Strategies[i].pszName);
+		}
+		fWrite[i] = BENCH_BYTES / ((SimClock_Now() - u64Start) / 1e9);
+
+		u64Start = SimClock_Now();
+		if (!Strategies[i].pfRead()) {
+			Bench_Fail("%s: read failed", Strategies[i].pszName);
+		}
+		fRead[i] = BENCH_BYTES / ((SimClock_Now() - u64Start) / 1e9);
+
+		printf("  %-16s write %7.0f bytes/s  read %7.0f bytes/s\n", Strategies[i].pszName, fWrite[i], fRead[i]);
+		if (memcmp(u8Back, u8Data, BENCH_BYTES) || memcmp(SimEeprom_Memory(), u8Data, BENCH_BYTES)) {
+			Bench_Fail("%s: read back differs", Strategies[i].pszName);
+		}
+	}
+	printf("  ACK polling writes %.1fx page + 10 ms, %.0fx byte + 5 ms; sequential reads %.1fx\n",
+		fWrite[2] / fWrite[1], fWrite[2] / fWrite[0], fRead[2] / fRead[0]);
+
+	if (fWrite[2] <= fWrite[1] || fWrite[1] <= fWrite[0] || fRead[2] <= fRead[0]) {
+		Bench_Fail("ACK polling not the fastest");
+	}
+	//A page costs its write cycle and the bus time of 34 bytes, the polls end within one of them
+	fPageMs = u32WriteUs / 1e3 + (1 + 9 * (3 + AT24C32_PAGE_SIZE) + 1) / 400.0 + 2 * 11 / 400.0;
+	if (fWrite[2] < AT24C32_PAGE_SIZE / fPageMs * 1e3 * 0.98) {
+		Bench_Fail("ACK polling: %.0f bytes/s, a page in %.2f ms gives %.0f", fWrite[2], fPageMs,
+			AT24C32_PAGE_SIZE / fPageMs * 1e3);
+	}
+}
+
+int main(void)
+{
+	Bench_Run(3000);
+	Bench_Run(5000);
+
+	if (iFailed) {
+		fprintf(stderr, "%d failures\n", iFailed);
+	}
+	return iFailed != 0;
+}
@@ -0,0 +1,120 @@
+#include "eeprom_sim.h"
+#include "sim_clock.h"
+#include "sim_i2c.h"
+#include <string.h>
+
+static SimEeprom_Config_t Config;
+static SimEeprom_Stats_t Stats;
+static uint8_t u8Cells[SIM_EEPROM_SIZE];
+static uint16_t u16Pointer;				/* Address of the next byte read or written */
+static uint64_t u64BusyUntil;
+static uint8_t u8Powered;
+static uint32_t u32CutIn;				/* Page writes left before the cut, 0 when not armed */
+static uint8_t u8CutBytes;
+
+/* Address byte of a transaction, NACKed while busy or powered off */
+static uint8_t SimEeprom_Ack(uint8_t u8Read)
+{
+	++Stats.u32Transactions;
+	if (!u8Powered || SimClock_Now() < u64BusyUntil) {
+		++Stats.u32Nacks;
+		return 0;
+	}
+	return 1;
+}
+
+static void SimEeprom_Program(const uint8_t *pData, uint16_t u16Len)
+{
+	uint16_t u16Page = u16Pointer & ~(SIM_EEPROM_PAGE - 1);
+	uint16_t i;
+
+	++Stats.u32PageWrites[u16Page / SIM_EEPROM_PAGE];
+	++Stats.u32Writes;
+
+	if (u32CutIn && !--u32CutIn) {
+		//Power lost in the write cycle, the rest of the page keeps its old bytes
+		if (u16Len > u8CutBytes) {
+			u16Len = u8CutBytes;
+			u8Cells[u16Page | ((u16Pointer + u16Len) & (SIM_EEPROM_PAGE - 1))] ^= 0x5A;
+		}
+		u8Powered = 0;
+	}
+
+	//Only the low bits count up, a write past the end of the page wraps to its start
+	for (i = 0; i < u16Len; i++) {
+		u8Cells[u16Page | ((u16Pointer + i) & (SIM_EEPROM_PAGE - 1))] = pData[i];
+	}
+	u16Pointer = u16Page | ((u16Pointer + u16Len) & (SIM_EEPROM_PAGE - 1));
+	u64BusyUntil = SimClock_Now() + Config.u32WriteUs * 1000ULL;
+}
+
+static void SimEeprom_Write(const uint8_t *pData, uint16_t u16Len)
+{
+	//Two address bytes, then data
+	if (u16Len >= 2) {
+		u16Pointer = ((pData[0] << 8) | pData[1]) % SIM_EEPROM_SIZE;
+	}
+	if (u16Len > 2) {
+		SimEeprom_Program(pData + 2, u16Len - 2);
+	}
+}
+
+static void SimEeprom_Read(uint8_t *pData, uint16_t u16Len)
+{
+	while (u16Len--) {
+		*pData++ = u8Cells[u16Pointer];
+		u16Pointer = (u16Pointer + 1) % SIM_EEPROM_SIZE;
+	}
+}
+
+void SimEeprom_DefaultConfig(SimEeprom_Config_t *pConfig)
+{
+	pConfig->u32BusHz = 400000;
+	pConfig->u32WriteUs = 5000;
+}
+
+void SimEeprom_Open(const SimEeprom_Config_t *pConfig)
+{
+	SimI2c_Device_t Dev = {SIM_EEPROM_ADDR, 0, SimEeprom_Ack, SimEeprom_Write, SimEeprom_Read};
+
+	Config = *pConfig;
+	Dev.u32Hz = Config.u32BusHz;
+	SimI2c_Attach(&Dev);
+	memset(u8Cells, 0xFF, sizeof(u8Cells));
+	memset(&Stats, 0, sizeof(Stats));
+	u32CutIn = 0;
+	SimEeprom_PowerOn();
+}
+
+uint8_t *SimEeprom_Memory(void)
+{
+	return u8Cells;
+}
+
+void SimEeprom_PowerCut(uint32_t u32Write, uint8_t u8Bytes)
+{
+	u32CutIn = u32Write;
+	u8CutBytes = u8Bytes;
+}
+
+uint8_t SimEeprom_IsPowered(void)
+{
+	return u8Powered;
+}
+
+void SimEeprom_PowerOn(void)
+{
+	u8Powered = 1;
+	u16Pointer = 0;
+	u64BusyUntil = 0;
+}
+
+void SimEeprom_GetStats(SimEeprom_Stats_t *pStats)
+{
+	*pStats = Stats;
+}
+
+void SimEeprom_ResetStats(void)
+{
+	memset(&Stats, 0, sizeof(Stats));
+}
@@ -0,0 +1,57 @@
+#ifndef EEPROM_SIM_H_
+#define EEPROM_SIM_H_
+
+#include <stdint.h>
+
+/*
+ * AT24C32 behind I2C_Write/I2C_Read
+ *
+ * at24c32.c and kv_store.c run unchanged on the host, the chip is attached
+ * to the bus of sim_i2c.c at SIM_EEPROM_ADDR. The chip keeps its address pointer across transactions, a
+ * page write wraps inside its page and starts the write cycle, during
+ * which every transaction is NACKed. Every byte advances the virtual clock
+ * by its time on the bus.
+ *
+ * A power cut can be armed for a later page write: only the first bytes of
+ * that write reach the cells, the next one is garbled and the chip answers
+ * nothing until SimEeprom_PowerOn.
+ */
+
+#define SIM_EEPROM_ADDR			0xA0
+#define SIM_EEPROM_SIZE			4096
+#define SIM_EEPROM_PAGE			32
+#define SIM_EEPROM_PAGES		(SIM_EEPROM_SIZE / SIM_EEPROM_PAGE)
+
+typedef struct {
+	uint32_t u32BusHz;					/* SCL rate unless the firmware sets one */
+	uint32_t u32WriteUs;				/* Write cycle time after a page write */
+} SimEeprom_Config_t;
+
+typedef struct {
+	uint32_t u32PageWrites[SIM_EEPROM_PAGES];	/* Write cycles per page */
+	uint32_t u32Writes;					/* Write cycles in total */
+	uint32_t u32Transactions;			/* Addressed to the chip */
+	uint32_t u32Nacks;					/* Transactions refused, busy or powered off */
+} SimEeprom_Stats_t;
+
+/* 400 kHz, 5 ms write cycle */
+void SimEeprom_DefaultConfig(SimEeprom_Config_t *pConfig);
+
+/* Power up with every byte erased to 0xFF */
+void SimEeprom_Open(const SimEeprom_Config_t *pConfig);
+
+/* The cells, for snapshots and checks */
+uint8_t *SimEeprom_Memory(void);
+
+/*
+ * Cut the power during the u32Write-th page write from now (1 is the next
+ * one). u8Bytes of it are programmed, the byte after them is garbled.
+ */
+void SimEeprom_PowerCut(uint32_t u32Write, uint8_t u8Bytes);
+uint8_t SimEeprom_IsPowered(void);
+void SimEeprom_PowerOn(void);
+
+void SimEeprom_GetStats(SimEeprom_Stats_t *pStats);
+void SimEeprom_ResetStats(void);
+
+#endif
@@ -0,0 +1,242 @@
+/*
+ * Card enumeration of mfrc522.c on the simulated MFRC522
+ *
+ * - UIDs: cards with 4, 7 and 10 byte UIDs in the field together, all
+ *   found with the right size and bytes.
+ * - Collisions: pairs of cards whose UIDs first differ at bit 1, 8, 9
+ *   (the first bit after UID0), 17, 31 and 32, and two 7 byte UIDs that
+ *   only collide on cascade level 2. Bit 32 leaves no valid BCC. Three
+ *   cards colliding at bit 10 and then at bit 20: CollPos of the second
+ *   answer counts from the first byte received, not from UID0.
+ * - Time: virtual time of TM_MFRC522_Enumerate for 1 to 4 cards.
+ * - Ownership: while an enumeration runs, Select, EnumerateStart and
+ *   Request are refused and the enumeration still finds every card.
+ */
+
+#include "rc522_sim.h"
+#include "sim_clock.h"
+#include "mfrc522.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define ENUM_TEST_MAX			SIM_RC522_MAX_CARDS
+#define ENUM_TEST_POWER_NS		5000000ULL		/* Cards powered up before the first REQA */
+
+static const uint8_t u8Uid4[4] = {0x3A, 0x51, 0xC7, 0x02};
+static const uint8_t u8Uid7[7] = {0x04, 0x6B, 0x12, 0x9A, 0x5E, 0x80, 0x31};
+static const uint8_t u8Uid10[10] = {0x04, 0xE2, 0x77, 0x18, 0x0C, 0x4D, 0x93, 0x26, 0xB5, 0x6F};
+
+static int iFailed;
+
+static void Enum_Fail(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	fprintf(stderr, "FAIL: ");
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	++iFailed;
+}
+
+/* Empty the field, then put fresh cards in it and let them power up */
+static void Enum_Field(const uint8_t **ppUids, const uint8_t *pu8Lens, uint8_t u8Cards)
+{
+	SimRc522_Card_t Card;
+	uint8_t i;
+
+	SimRc522_RemoveCards();
+	for (i = 0; i < u8Cards; i++) {
+		SimRc522_MakeCard(&Card, ppUids[i], pu8Lens[i]);
+		Card.u64InNs = SimClock_Now();
+		SimRc522_AddCard(&Card);
+	}
+	SimClock_Advance(ENUM_TEST_POWER_NS);
+}
+
+/* Every card of the field is in uids exactly once */
+static uint8_t Enum_Match(const uint8_t **ppUids, const uint8_t *pu8Lens, uint8_t u8Cards,
+	const TM_MFRC522_Uid_t *pFound, uint8_t u8Found)
+{
+	uint8_t i, j, n;
+
+	if (u8Found != u8Cards) {
+		return 0;
+	}
+	for (i = 0; i < u8Cards; i++) {
+		n = 0;
+		for (j = 0; j < u8Found; j++) {
+			if (pFound[j].size == pu8Lens[i] && !memcmp(pFound[j].uidByte, ppUids[i], pu8Lens[i])) {
+				++n;
+			}
+		}
+		if (n != 1) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Enumerate the field, returns the virtual time taken */
+static uint64_t Enum_Run(const char *pszName, const uint8_t **ppUids, const uint8_t *pu8Lens, uint8_t u8Cards)
+{
+	TM_MFRC522_Uid_t Found[ENUM_TEST_MAX];
+	uint64_t u64T0;
+	uint8_t u8Found;
+
+	Enum_Field(ppUids, pu8Lens, u8Cards);
+	u64T0 = SimClock_Now();
+	u8Found = TM_MFRC522_Enumerate(Found, ENUM_TEST_MAX);
+	u64T0 = SimClock_Now() - u64T0;
+	if (!Enum_Match(ppUids, pu8Lens, u8Cards, Found, u8Found)) {
+		Enum_Fail("%s: %u of %u cards found", pszName, u8Found, u8Cards);
+	}
+	return u64T0;
+}
+
+static void Enum_Sizes(void)
+{
+	const uint8_t *ppUids[3] = {u8Uid4, u8Uid7, u8Uid10};
+	uint8_t u8Lens[3] = {4, 7, 10};
+	uint8_t i;
+
+	for (i = 0; i < 3; i++) {
+		Enum_Run("single UID", &ppUids[i], &u8Lens[i], 1);
+	}
+	Enum_Run("4, 7 and 10 byte UIDs", ppUids, u8Lens, 3);
+	printf("sizes: 4, 7 and 10 byte UIDs alone and together\n");
+}
+
+static void Enum_Collisions(void)
+{
+	static const uint8_t u8Bits[] = {1, 8, 9, 17, 31, 32};
+	uint8_t u8A[7], u8B[7], u8C[4];
+	const uint8_t *ppUids[2] = {u8A, u8B};
+	const uint8_t *ppThree[3] = {u8A, u8B, u8C};
+	uint8_t u8Lens[2] = {4, 4};
+	uint8_t u8Fours[3] = {4, 4, 4};
+	SimRc522_Stats_t s0, s1;
+	char szName[32];
+	uint8_t i, j, bit;
+
+	for (i = 0; i < sizeof(u8Bits); i++) {
+		//Same bits below the collision, the rest of B inverted
+		bit = u8Bits[i] - 1;
+		memcpy(u8A, u8Uid4, 4);
+		memcpy(u8B, u8Uid4, 4);
+		u8B[bit / 8] ^= (uint8_t)(0xFF << (bit % 8));
+		for (j = bit / 8 + 1; j < 4; j++) {
+			u8B[j] ^= 0xFF;
+		}
+		sprintf(szName, "collision at bit %u", u8Bits[i]);
+		SimRc522_GetStats(&s0);
+		Enum_Run(szName, ppUids, u8Lens, 2);
+		SimRc522_GetStats(&s1);
+		if (s1.u32Collisions == s0.u32Collisions) {
+			Enum_Fail("%s: the cards did not collide", szName);
+		}
+	}
+
+	//A and C take the '1' branch at bit 10 and collide again at bit 20
+	memcpy(u8A, u8Uid4, 4);
+	u8A[1] |= 0x02;
+	memcpy(u8B, u8A, 4);
+	u8B[1] &= ~0x02;
+	memcpy(u8C, u8A, 4);
+	u8C[2] ^= 0x08;
+	Enum_Run("collisions at bits 10 and 20", ppThree, u8Fours, 3);
+
+	//Cascade level 1 is the same for both, level 2 collides
+	memcpy(u8A, u8Uid7, 7);
+	memcpy(u8B, u8Uid7, 7);
+	u8B[4] ^= 0x10;
+	u8Lens[0] = 7;
+	u8Lens[1] = 7;
+	Enum_Run("collision on level 2", ppUids, u8Lens, 2);
+	printf("collisions: bits 1, 8, 9, 17, 31, 32, 10 then 20 and on cascade level 2 resolved\n");
+}
+
+static void Enum_Time(void)
+{
+	uint8_t u8Uids[4][4];
+	const uint8_t *ppUids[4];
+	uint8_t u8Lens[4] = {4, 4, 4, 4};
+	uint8_t n, i;
+
+	for (i = 0; i < 4; i++) {
+		memcpy(u8Uids[i], u8Uid4, 4);
+		u8Uids[i][0] = (uint8_t)(0x10 * i + 0x21 * (i & 1));
+		ppUids[i] = u8Uids[i];
+	}
+	printf("%-6s | %9s\n", "cards", "ms");
+	for (n = 1; n <= 4; n++) {
+		printf("%-6u | %9.2f\n", n, Enum_Run("time", ppUids, u8Lens, n) / 1e6);
+	}
+}
+
+static void Enum_Ownership(void)
+{
+	const uint8_t *ppUids[2] = {u8Uid4, u8Uid7};
+	uint8_t u8Lens[2] = {4, 7};
+	TM_MFRC522_Uid_t Found[ENUM_TEST_MAX], Other[ENUM_TEST_MAX];
+	uint8_t u8Buf[MFRC522_MAX_LEN], u8Count;
+
+	Enum_Field(ppUids, u8Lens, 2);
+	if (TM_MFRC522_EnumerateStart(Found, ENUM_TEST_MAX) != MI_OK) {
+		Enum_Fail("ownership: enumeration not started");
+		return;
+	}
+	if (TM_MFRC522_Select(Other) != MI_BUSY) {
+		Enum_Fail("ownership: Select ran during an enumeration");
+	}
+	if (TM_MFRC522_EnumerateStart(Other, ENUM_TEST_MAX) != MI_BUSY) {
+		Enum_Fail("ownership: second enumeration started");
+	}
+	if (TM_MFRC522_Request(PICC_REQIDL, u8Buf) == MI_OK) {
+		Enum_Fail("ownership: REQA sent during an enumeration");
+	}
+	while (TM_MFRC522_EnumeratePoll(&u8Count) == MI_BUSY) {
+		__WFI();
+	}
+	if (!Enum_Match(ppUids, u8Lens, 2, Found, u8Count)) {
+		Enum_Fail("ownership: %u of 2 cards found", u8Count);
+	}
+	if (TM_MFRC522_EnumerateStart(Other, ENUM_TEST_MAX) != MI_OK) {
+		Enum_Fail("ownership: reader still busy after the enumeration");
+	}
+	while (TM_MFRC522_EnumeratePoll(&u8Count) == MI_BUSY) {
+		__WFI();
+	}
+	printf("ownership: Select, EnumerateStart and Request refused while enumerating\n");
+}
+
+int main(void)
+{
+	SimRc522_Config_t Config;
+	SimRc522_Stats_t s;
+
+	SimClock_Reset();
+	SimRc522_DefaultConfig(&Config);
+	SimRc522_Open(&Config);
+	TM_MFRC522_Init();
+	if (TM_MFRC522_ReadRegister(MFRC522_REG_VERSION) != 0x92) {
+		fprintf(stderr, "reader not found\n");
+		return 1;
+	}
+
+	Enum_Sizes();
+	Enum_Collisions();
+	Enum_Time();
+	Enum_Ownership();
+
+	SimRc522_GetStats(&s);
+	if (s.u32Errors) {
+		Enum_Fail("%lu bytes sent with CS high or FIFO overflows", (unsigned long)s.u32Errors);
+	}
+	if (iFailed) {
+		fprintf(stderr, "%d failures\n", iFailed);
+	}
+	return iFailed != 0;
+}
@@ -0,0 +1,177 @@
+/*
+ * FatFs build profiles (FF_PROFILE in ffconf.h) on the emulated card
+ *
+ * Built once per profile. Prints the object sizes of the profile on the
+ * host, then a directory lookup benchmark: PROFILE_FILES files are made in
+ * one directory and f_stat is timed for names spread over it and for a
+ * missing name, which scans the whole directory. With LFN the names are
+ * long ones taking several directory entries each.
+ *
+ * Profile 3 partitions the card, and the access log has to land on the
+ * second volume while "0:" keeps only CARDS.TXT.
+ *
+ * The flash each profile takes is printed by the fatfs_size test from the
+ * host objects, a proxy for the Thumb code.
+ */
+
+#include "sd_card.h"
+#include "access_log.h"
+#include "sd_emu.h"
+#include "sim_clock.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define PROFILE_LOOKUPS			32
+
+static const uint16_t u16Counts[] = {16, 128, 512};
+
+static BYTE u8Work[FF_MAX_SS];
+static int iFailed;
+
+static void Profile_Fail(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	fprintf(stderr, "FAIL: ");
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	++iFailed;
+}
+
+static void Profile_Name(char *name, const char *dir, uint16_t n)
+{
+#if FF_USE_LFN
+	sprintf(name, "%s/badge-reader-event-log-%04u.dat", dir, n);
+#else
+	sprintf(name, "%s/F%04u.DAT", dir, n);
+#endif
+}
+
+static FRESULT Profile_Format(void)
+{
+	MKFS_PARM Opt = {FM_ANY, 0, 0, 0, 0};
+	FRESULT fr;
+#if FF_MULTI_PARTITION
+	LBA_t plist[] = {50, 50, 0};		/* Two halves of the card, in percent */
+
+	fr = f_fdisk(0, plist, u8Work);
+	if (fr == FR_OK) {
+		fr = f_mkfs("0:", &Opt, u8Work, sizeof(u8Work));
+	}
+	if (fr == FR_OK) {
+		fr = f_mkfs("1:", &Opt, u8Work, sizeof(u8Work));
+	}
+#else
+	fr = f_mkfs("", &Opt, u8Work, sizeof(u8Work));
+#endif
+	if (fr == FR_OK) {
+		fr = sd_card_mount();
+	}
+	return fr;
+}
+
+static void Profile_Lookup(uint16_t u16Files)
+{
+	SdEmu_Stats_t s0, s1;
+	FILINFO fno;
+	FIL fil;
+	char dir[8], name[48];
+	uint64_t u64T0, u64Hit, u64Miss;
+	uint32_t u32HitSect;
+	uint16_t i;
+	FRESULT fr;
+
+	sprintf(dir, "D%u", u16Files);
+	fr = f_mkdir(dir);
+	for (i = 0; fr == FR_OK && i < u16Files; i++) {
+		Profile_Name(name, dir, i);
+		fr = f_open(&fil, name, FA_WRITE | FA_CREATE_NEW);
+		if (fr == FR_OK) {
+			fr = f_close(&fil);
+		}
+	}
+	if (fr != FR_OK) {
+		Profile_Fail("%u files: create failed: %d", u16Files, fr);
+		return;
+	}
+
+	SdEmu_GetStats(&s0);
+	u64T0 = SimClock_Now();
+	for (i = 0; i < PROFILE_LOOKUPS; i++) {
+		Profile_Name(name, dir, (uint16_t)((uint32_t)i * u16Files / PROFILE_LOOKUPS));
+		if (f_stat(name, &fno) != FR_OK) {
+			Profile_Fail("%u files: %s not found", u16Files, name);
+			return;
+		}
+	}
+	u64Hit = SimClock_Now() - u64T0;
+	SdEmu_GetStats(&s1);
+	u32HitSect = s1.u32SectorsRead - s0.u32SectorsRead;
+
+	Profile_Name(name, dir, u16Files);
+	u64T0 = SimClock_Now();
+	if (f_stat(name, &fno) != FR_NO_FILE) {
+		Profile_Fail("%u files: missing name found", u16Files);
+	}
+	u64Miss = SimClock_Now() - u64T0;
+
+	printf("lookup: %4u files, %7.1f us and %.1f sectors per name found, %8.1f us for a missing name\n",
+		u16Files, u64Hit / 1e3 / PROFILE_LOOKUPS, (double)u32HitSect / PROFILE_LOOKUPS, u64Miss / 1e3);
+}
+
+#if FF_MULTI_PARTITION
+static void Profile_Volumes(void)
+{
+	FILINFO fno;
+	uint8_t uid[4] = {1, 2, 3, 4};
+
+	if (AccessLog_Init() != FR_OK || AccessLog_Append(uid, sizeof(uid), ACCESS_LOG_GRANTED) != FR_OK
+		|| AccessLog_Flush() != FR_OK) {
+		Profile_Fail("volumes: log on %s failed", SD_CARD_LOG_VOLUME);
+		return;
+	}
+	if (f_stat("1:LOG0.BIN", &fno) != FR_OK || f_stat("0:LOG0.BIN", &fno) != FR_NO_FILE) {
+		Profile_Fail("volumes: log not on the second partition");
+		return;
+	}
+	printf("volumes: \"0:\" and \"1:\" mounted, log on \"1:\"\n");
+}
+#endif
+
+int main(void)
+{
+	SdEmu_Config_t Config;
+	FRESULT fr;
+	int i;
+
+	printf("profile %d: LFN %d, %d volume(s), FATFS %u, FIL %u, FILINFO %u bytes on the host\n", FF_PROFILE,
+		FF_USE_LFN, FF_VOLUMES, (unsigned)sizeof(FATFS), (unsigned)sizeof(FIL), (unsigned)sizeof(FILINFO));
+
+	SdEmu_DefaultConfig(&Config);
+	SimClock_Reset();
+	if (!SdEmu_Open(&Config)) {
+		fprintf(stderr, "cannot open the card image\n");
+		return 1;
+	}
+	fr = Profile_Format();
+	if (fr != FR_OK) {
+		fprintf(stderr, "format/mount failed: %d\n", fr);
+		return 1;
+	}
+
+	for (i = 0; i < (int)(sizeof(u16Counts) / sizeof(u16Counts[0])); i++) {
+		Profile_Lookup(u16Counts[i]);
+	}
+#if FF_MULTI_PARTITION
+	Profile_Volumes();
+#endif
+
+	SdEmu_Close();
+	if (iFailed) {
+		fprintf(stderr, "%d failures\n", iFailed);
+	}
+	return iFailed != 0;
+}
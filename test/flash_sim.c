@@ -0,0 +1,102 @@
+#define _DEFAULT_SOURCE
+
+#include "flash_sim.h"
+#include "sim_clock.h"
+#include "stm32f10x_flash.h"
+#include <string.h>
+#include <sys/mman.h>
+
+static SimFlash_Config_t Config;
+static SimFlash_Stats_t Stats;
+static uint8_t *pu8Area;
+static uint8_t u8Locked = 1;
+
+void SimFlash_DefaultConfig(SimFlash_Config_t *pConfig, uint32_t u32Base, uint32_t u32Size)
+{
+	pConfig->u32Base = u32Base;
+	pConfig->u32Size = u32Size;
+	pConfig->u32PageSize = 1024;
+	pConfig->u32EraseUs = 20000;
+	pConfig->u32ProgramUs = 52;
+}
+
+int SimFlash_Open(const SimFlash_Config_t *pConfig)
+{
+	void *p;
+
+	Config = *pConfig;
+	memset(&Stats, 0, sizeof(Stats));
+	//The fixed address has to be free, MAP_FIXED would silently replace a mapping
+	p = mmap((void *)(uintptr_t)Config.u32Base, Config.u32Size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+	if (p == MAP_FAILED || p != (void *)(uintptr_t)Config.u32Base) {
+		return 0;
+	}
+	pu8Area = p;
+	memset(pu8Area, 0xFF, Config.u32Size);
+	u8Locked = 1;
+	return 1;
+}
+
+void SimFlash_Close(void)
+{
+	if (pu8Area) {
+		munmap(pu8Area, Config.u32Size);
+		pu8Area = 0;
+	}
+}
+
+void SimFlash_GetStats(SimFlash_Stats_t *pStats)
+{
+	*pStats = Stats;
+}
+
+void FLASH_Unlock(void)
+{
+	u8Locked = 0;
+}
+
+void FLASH_Lock(void)
+{
+	u8Locked = 1;
+}
+
+void FLASH_ClearFlag(uint32_t FLASH_FLAG)
+{
+	(void)FLASH_FLAG;
+}
+
+FLASH_Status FLASH_ErasePage(uint32_t Page_Address)
+{
+	uint32_t u32Off = Page_Address - Config.u32Base;
+
+	if (u8Locked || Page_Address < Config.u32Base || u32Off >= Config.u32Size) {
+		++Stats.u32Errors;
+		return FLASH_ERROR_WRP;
+	}
+	u32Off -= u32Off % Config.u32PageSize;
+	memset(pu8Area + u32Off, 0xFF, Config.u32PageSize);
+	++Stats.u32Erases;
+	SimClock_Advance(Config.u32EraseUs * 1000ULL);
+	return FLASH_COMPLETE;
+}
+
+FLASH_Status FLASH_ProgramHalfWord(uint32_t Address, uint16_t Data)
+{
+	uint32_t u32Off = Address - Config.u32Base;
+	uint16_t u16Old;
+
+	if (u8Locked || Address < Config.u32Base || u32Off + 2 > Config.u32Size || (Address & 1)) {
+		++Stats.u32Errors;
+		return FLASH_ERROR_WRP;
+	}
+	memcpy(&u16Old, pu8Area + u32Off, 2);
+	if (u16Old != 0xFFFF && Data != 0) {
+		++Stats.u32Errors;
+		return FLASH_ERROR_PG;
+	}
+	memcpy(pu8Area + u32Off, &Data, 2);
+	++Stats.u32Programs;
+	SimClock_Advance(Config.u32ProgramUs * 1000ULL);
+	return FLASH_COMPLETE;
+}
@@ -0,0 +1,40 @@
+#ifndef FLASH_SIM_H_
+#define FLASH_SIM_H_
+
+#include <stdint.h>
+
+/*
+ * Internal flash behind the StdPeriph FLASH_* calls
+ *
+ * The simulated area is mapped at its STM32 address, so code that reads
+ * flash through pointers built from 0x08xxxxxx runs unchanged. Erased
+ * cells read 0xFF. A halfword can be programmed once after an erase, only
+ * 0x0000 may be written over a programmed one, anything else is refused
+ * with FLASH_ERROR_PG like on the F1. Erase and program take their
+ * datasheet time on the virtual clock.
+ */
+
+typedef struct {
+	uint32_t u32Base;					/* Page aligned */
+	uint32_t u32Size;
+	uint32_t u32PageSize;
+	uint32_t u32EraseUs;				/* Page erase time */
+	uint32_t u32ProgramUs;				/* Halfword program time */
+} SimFlash_Config_t;
+
+typedef struct {
+	uint32_t u32Erases;
+	uint32_t u32Programs;				/* Halfwords programmed */
+	uint32_t u32Errors;					/* Refused: locked, not erased or outside the area */
+} SimFlash_Stats_t;
+
+/* 1 KB pages, 20 ms erase, 52 us halfword program (STM32F103 medium density) */
+void SimFlash_DefaultConfig(SimFlash_Config_t *pConfig, uint32_t u32Base, uint32_t u32Size);
+
+/* Map the area erased, returns 0 when the address range is not free */
+int SimFlash_Open(const SimFlash_Config_t *pConfig);
+void SimFlash_Close(void);
+
+void SimFlash_GetStats(SimFlash_Stats_t *pStats);
+
+#endif
@@ -0,0 +1,268 @@
+/*
+ * uart_tx.c of UART/HardWareUart_Send on the host, its frames sent through
+ * a pty into the decoder of tools/frame_rx
+ *
+ * - Encode cost: frame_send of 1..64 data bytes in a loop, with the ring
+ *   emptied right away, timed on the host.
+ * - Throughput: frames of every length through the pty, each one decoded
+ *   and compared with what was sent.
+ * - Loss: frames dropped or corrupted on the way have to come out as
+ *   lost, and the corrupted ones as bad, with no good frame missed.
+ *
+ * NVIC_SetPendingIRQ stands in for the DMA interrupt and moves the
+ * committed bytes from the ring to the pty. Nothing preempts a writer
+ * here, uart_tx_race.c does.
+ */
+
+#define _XOPEN_SOURCE 700
+#define _DEFAULT_SOURCE
+
+#include "uart_tx.h"
+#include "frame_decode.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOOP_COST_FRAMES		200000
+#define LOOP_FRAMES				100000
+#define LOOP_LOSS_FRAMES		20000
+#define LOOP_DROP_EVERY			97		/* Frame on the wire left out */
+#define LOOP_CORRUPT_EVERY		89		/* Frame on the wire with a byte changed */
+#define LOOP_BAUD_LOW			115200
+#define LOOP_BAUD_HIGH			921600
+
+typedef struct {
+	uint32_t u32Frame;					/* Frame number of the last good frame */
+	uint8_t u8Seq;
+	uint8_t u8Started;
+	uint32_t u32Mismatch;
+} Loop_Check_t;
+
+static int iMaster = -1;
+static int iSlave = -1;
+static uint8_t u8ToPty;					/* 0: the ring is emptied without sending */
+static FrameRx_t Rx;
+static Loop_Check_t Check;
+
+static uint8_t u8Wire[FRAME_RX_MAX];	/* Frame on its way, the wire filter sees it whole */
+static uint16_t u16WireLen;
+static uint32_t u32WireFrames;
+static uint32_t u32Dropped;
+static uint32_t u32Corrupted;
+static uint8_t u8Faults;
+
+static int iFailed;
+
+extern volatile uint32_t txState;		/* Frame seq in the top byte, private to uart_tx.c */
+
+static double Loop_Now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Data of frame number u32Frame, the length goes round 0..FRAME_DATA_MAX */
+static uint8_t Loop_Data(uint32_t u32Frame, uint8_t *p)
+{
+	uint8_t len = u32Frame % (FRAME_DATA_MAX + 1);
+	uint8_t i;
+
+	for (i = 0; i < len; i++) {
+		//Zeros in plenty, COBS has to replace them
+		p[i] = (i % 5 == 0) ? 0 : (uint8_t)(u32Frame * 31 + i * 7);
+	}
+	return len;
+}
+
+static void Loop_Frame(void *pCtx, uint8_t u8Seq, uint8_t u8Type, const uint8_t *pData, uint16_t u16Len)
+{
+	Loop_Check_t *c = pCtx;
+	uint8_t expect[FRAME_DATA_MAX];
+	uint8_t len;
+
+	//seq is the frame number modulo 256, gaps are short
+	c->u32Frame = c->u8Started ? c->u32Frame + (uint8_t)(u8Seq - c->u8Seq) : u8Seq;
+	c->u8Seq = u8Seq;
+	c->u8Started = 1;
+
+	len = Loop_Data(c->u32Frame, expect);
+	if (u8Type != FRAME_TYPE_DATA || u16Len != len || memcmp(pData, expect, len)) {
+		++c->u32Mismatch;
+	}
+}
+
+static void Loop_Pump(void)
+{
+	uint8_t buf[4096];
+	ssize_t n;
+
+	while ((n = read(iSlave, buf, sizeof(buf))) > 0) {
+		FrameRx_Feed(&Rx, buf, n);
+	}
+}
+
+static void Loop_Write(const uint8_t *p, uint16_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		n = write(iMaster, p, len);
+		if (n > 0) {
+			p += n;
+			len -= n;
+		} else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+			perror("pty write");
+			exit(1);
+		}
+		Loop_Pump();
+	}
+}
+
+/* The wire, sees a frame when its delimiter goes out */
+static void Loop_Wire(uint8_t b)
+{
+	u8Wire[u16WireLen++] = b;
+	if (b != 0 && u16WireLen < sizeof(u8Wire)) {
+		return;
+	}
+
+	++u32WireFrames;
+	if (u8Faults && u32WireFrames % LOOP_DROP_EVERY == 0) {
+		++u32Dropped;
+	} else {
+		if (u8Faults && u32WireFrames % LOOP_CORRUPT_EVERY == 0) {
+			//Never a 0x00, that would be a second frame
+			u8Wire[u16WireLen / 2] ^= (u8Wire[u16WireLen / 2] == 0x80) ? 0x40 : 0x80;
+			++u32Corrupted;
+		}
+		Loop_Write(u8Wire, u16WireLen);
+	}
+	u16WireLen = 0;
+}
+
+/* A single writer, no STREX fails */
+uint8_t SimStrex_Preempt(uint32_t value, volatile uint32_t *addr)
+{
+	(void)value;
+	(void)addr;
+	return 0;
+}
+
+/* DMA1 channel 4 and its interrupt */
+void NVIC_SetPendingIRQ(IRQn_Type IRQn)
+{
+	uint16_t tail;
+
+	(void)IRQn;
+	while ((tail = txTail) != (uint16_t)txCommit) {
+		if (u8ToPty) {
+			Loop_Wire(txBuf[tail % TX_BUF_SIZE]);
+		}
+		txTail = tail + 1;
+	}
+}
+
+static void Loop_Open(void)
+{
+	struct termios tio;
+
+	iMaster = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (iMaster < 0 || grantpt(iMaster) || unlockpt(iMaster)) {
+		perror("pty");
+		exit(1);
+	}
+	iSlave = open(ptsname(iMaster), O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (iSlave < 0) {
+		perror("pty slave");
+		exit(1);
+	}
+	//No echo, no line editing, binary bytes pass as they are
+	tcgetattr(iSlave, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(iSlave, TCSANOW, &tio);
+}
+
+static void Loop_Cost(void)
+{
+	static const uint8_t u8Lens[] = {1, 8, 32, 64};
+	uint8_t data[FRAME_DATA_MAX];
+	double dStart, dNs;
+	uint32_t i;
+	uint8_t j;
+
+	u8ToPty = 0;
+	for (i = 0; i < sizeof(data); i++) {
+		data[i] = (i % 5 == 0) ? 0 : i;
+	}
+	printf("encode cost on this host, a frame of n bytes is n + 6 on the wire:\n");
+	for (j = 0; j < sizeof(u8Lens); j++) {
+		dStart = Loop_Now();
+		for (i = 0; i < LOOP_COST_FRAMES; i++) {
+			frame_send(FRAME_TYPE_DATA, data, u8Lens[j]);
+		}
+		dNs = (Loop_Now() - dStart) * 1e9 / LOOP_COST_FRAMES;
+		printf("  %2u bytes: %6.1f ns/frame, %5.2f ns/byte, %6.1f/%5.1f us on the line at %u/%u baud\n",
+			u8Lens[j], dNs, dNs / u8Lens[j], (u8Lens[j] + 6) * 10 * 1e6 / LOOP_BAUD_LOW,
+			(u8Lens[j] + 6) * 10 * 1e6 / LOOP_BAUD_HIGH, LOOP_BAUD_LOW, LOOP_BAUD_HIGH);
+	}
+}
+
+static void Loop_Run(const char *what, uint32_t u32Frames, uint8_t u8WithFaults)
+{
+	uint8_t data[FRAME_DATA_MAX];
+	uint32_t u32Sent = frameSent, u32Lost = frameDropped;
+	uint32_t u32First = (uint8_t)(txState >> 24);
+	uint32_t u32Good, i;
+	double dSecs;
+
+	u8ToPty = 1;
+	u8Faults = u8WithFaults;
+	u32WireFrames = u32Dropped = u32Corrupted = 0;
+	memset(&Check, 0, sizeof(Check));
+	FrameRx_Init(&Rx, 1, Loop_Frame, &Check);
+
+	//Frames are numbered from the seq of the first one, as Loop_Frame counts them
+	dSecs = Loop_Now();
+	for (i = 0; i < u32Frames; i++) {
+		frame_send(FRAME_TYPE_DATA, data, Loop_Data(u32First + i, data));
+	}
+	Loop_Pump();
+	dSecs = Loop_Now() - dSecs;
+
+	u32Good = u32Frames - u32Dropped - u32Corrupted;
+	printf("%s: %lu frames, %lu good, %lu bad, %lu lost (%lu dropped, %lu corrupted), %.1f MB/s payload, %.0f frames/s\n",
+		what, (unsigned long)u32Frames, (unsigned long)Rx.Stats.u32Frames,
+		(unsigned long)(Rx.Stats.u32BadCrc + Rx.Stats.u32BadCobs), (unsigned long)Rx.Stats.u32Lost,
+		(unsigned long)u32Dropped, (unsigned long)u32Corrupted, Rx.Stats.u64Payload / dSecs / 1e6, u32Frames / dSecs);
+
+	if (frameSent - u32Sent != u32Frames || frameDropped != u32Lost) {
+		fprintf(stderr, "FAIL: %s: frame_send refused frames\n", what);
+		++iFailed;
+	}
+	if (Rx.Stats.u32Frames != u32Good || Check.u32Mismatch) {
+		fprintf(stderr, "FAIL: %s: %lu of %lu good frames decoded, %lu with wrong data\n", what,
+			(unsigned long)Rx.Stats.u32Frames, (unsigned long)u32Good, (unsigned long)Check.u32Mismatch);
+		++iFailed;
+	}
+	if (Rx.Stats.u32BadCrc + Rx.Stats.u32BadCobs != u32Corrupted || Rx.Stats.u32Lost != u32Dropped + u32Corrupted) {
+		fprintf(stderr, "FAIL: %s: decoder counted %lu bad and %lu lost\n", what,
+			(unsigned long)(Rx.Stats.u32BadCrc + Rx.Stats.u32BadCobs), (unsigned long)Rx.Stats.u32Lost);
+		++iFailed;
+	}
+}
+
+int main(void)
+{
+	Loop_Open();
+	Loop_Cost();
+	Loop_Run("loopback", LOOP_FRAMES, 0);
+	Loop_Run("faults", LOOP_LOSS_FRAMES, 1);
+	return iFailed != 0;
+}
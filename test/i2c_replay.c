@@ -0,0 +1,379 @@
+/*
+ * i2c.c on the register model of I2C1
+ *
+ * The event, error and DMA handlers of the driver run on SR1/SR2 as the
+ * peripheral sets them, see sim_i2c_reg.h.
+ *
+ * - Replay: the trace of every transfer mode against the AN2824 sequence,
+ *   EV5/EV6/EV8_2 for writes, EV6_1 for a 1 byte read, LAST for a DMA
+ *   read, AF for an address nobody ACKs.
+ * - Back to back: transactions queued from the callbacks and the blocking
+ *   calls never set START while the STOP before is pending, and none waits
+ *   in the interrupt for it. Queued ones start from the Task_Bus tick.
+ * - EEPROM workload: page write, ACK polling, read back at 400 kHz,
+ *   interrupts per transaction and CPU idle against bus time, no bus
+ *   recovery.
+ * - Wedged bus: SDA held low in the middle of a read, the watchdog ends the
+ *   transaction within its byte time + I2C_TIMEOUT_MS, recovers the bus
+ *   and the next read succeeds. SDA that never comes back is counted in
+ *   u32StuckSda and no handler storms.
+ */
+
+#include "sim_i2c_reg.h"
+#include "sim_i2c.h"
+#include "sim_nvic.h"
+#include "sim_dma.h"
+#include "sim_clock.h"
+#include "sim_gpio.h"
+#include "eeprom_sim.h"
+#include "i2c.h"
+#include "delay.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define REPLAY_DEV_ADDR		0x40		/* Register device of the replay */
+#define REPLAY_NOBODY		0x50
+#define REPLAY_QUEUED		4
+#define REPLAY_BUS_TICK_MS	10			/* Task_Bus period of main.c */
+
+static uint8_t u8DevWritten[64];
+static uint16_t u16DevWrittenLen;
+static uint8_t u8DevNext;
+static uint64_t u64IdleNs;
+static uint32_t u32Done;
+static int iFailed;
+
+/* The DMA takes 32 bit addresses, static buffers only */
+static uint8_t u8Buf[64];
+static uint8_t u8Page[2 + SIM_EEPROM_PAGE];
+static I2C_Xfer_t Queued[REPLAY_QUEUED];
+static uint8_t u8QueuedData[REPLAY_QUEUED][4];
+
+static void Replay_Fail(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	fprintf(stderr, "FAIL: ");
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	++iFailed;
+}
+
+static uint8_t Replay_DevAck(uint8_t u8Read)
+{
+	return 1;
+}
+
+static void Replay_DevWrite(const uint8_t *pData, uint16_t u16Len)
+{
+	memcpy(u8DevWritten, pData, u16Len);
+	u16DevWrittenLen = u16Len;
+}
+
+static void Replay_DevRead(uint8_t *pData, uint16_t u16Len)
+{
+	while (u16Len--) {
+		*pData++ = u8DevNext++;
+	}
+}
+
+/* Sleeps until an interrupt or the next SysTick, idle time counted */
+void __WFI(void)
+{
+	uint32_t u32Irqs = SimNvic_Total();
+	uint64_t u64Start = SimClock_Now();
+	uint64_t u64Tick = (u64Start / 1000000 + 1) * 1000000;
+	uint64_t u64Next;
+
+	while (SimNvic_Total() == u32Irqs && SimClock_Now() < u64Tick) {
+		u64Next = SimClock_NextEvent();
+		if (u64Next > u64Tick) {
+			u64Next = u64Tick;
+		}
+		SimClock_Advance(u64Next > SimClock_Now() ? u64Next - SimClock_Now() : 0);
+	}
+	u64IdleNs += SimClock_Now() - u64Start;
+}
+
+static void Replay_Open(void)
+{
+	SimEeprom_Config_t Config;
+	SimI2c_Device_t Dev = {REPLAY_DEV_ADDR, 400000, Replay_DevAck, Replay_DevWrite, Replay_DevRead};
+
+	SimClock_Reset();
+	SimNvic_Reset();
+	SimDma_Reset();
+	SimI2c_Reset();
+	SimI2cReg_Open();
+	SimI2c_Attach(&Dev);
+	SimEeprom_DefaultConfig(&Config);
+	SimEeprom_Open(&Config);
+	My_I2C_Init();
+}
+
+/* One blocking transfer, its trace against the expected one */
+static void Replay_Mode(const char *pszName, uint8_t Address, uint8_t u8Dir, uint16_t u16Len, Status eWant,
+	const char *pszWant)
+{
+	SimI2cReg_Stats_t s;
+	uint32_t u32Irqs = SimNvic_Total();
+	Status eResult;
+	uint16_t i;
+
+	for (i = 0; i < u16Len; i++) {
+		u8Buf[i] = 0xC0 + i;
+	}
+	u8DevNext = 0x10;
+	u16DevWrittenLen = 0;
+	SimI2cReg_ClearTrace();
+	SimI2cReg_ResetStats();
+	if (u8Dir == I2C_XFER_READ) {
+		eResult = I2C_Read(Address, u8Buf, u16Len);
+	} else {
+		eResult = I2C_Write(Address, u8Buf, u16Len);
+	}
+	//Let the STOP go out
+	Delay_Us(100);
+	SimI2cReg_GetStats(&s);
+
+	printf("%-14s %2lu irqs  %s\n", pszName, (unsigned long)(SimNvic_Total() - u32Irqs), SimI2cReg_Trace());
+	if (eResult != eWant) {
+		Replay_Fail("%s: returned %d", pszName, eResult);
+	}
+	if (strcmp(SimI2cReg_Trace(), pszWant)) {
+		Replay_Fail("%s: trace differs, expected\n      %s", pszName, pszWant);
+	}
+	if (s.u32Transactions != 1 || s.u32StartInStop || s.u32Overruns || s.u32Storms) {
+		Replay_Fail("%s: %lu STOPs, %lu STARTs in a STOP, %lu overruns, %lu storms", pszName,
+			(unsigned long)s.u32Transactions, (unsigned long)s.u32StartInStop, (unsigned long)s.u32Overruns,
+			(unsigned long)s.u32Storms);
+	}
+	if (eWant != Success) {
+		return;
+	}
+	for (i = 0; i < u16Len; i++) {
+		if (u8Dir == I2C_XFER_READ ? u8Buf[i] != 0x10 + i : u8DevWritten[i] != 0xC0 + i) {
+			Replay_Fail("%s: byte %u wrong", pszName, i);
+			return;
+		}
+	}
+	if (u8Dir == I2C_XFER_WRITE && u16DevWrittenLen != u16Len) {
+		Replay_Fail("%s: device got %u bytes", pszName, u16DevWrittenLen);
+	}
+}
+
+static void Replay_Modes(void)
+{
+	Replay_Open();
+	Replay_Mode("write 1", REPLAY_DEV_ADDR, I2C_XFER_WRITE, 1, Success,
+		"S [SB] a [ADDR] [TXE] w [BTF TXE] P p");
+	Replay_Mode("write 4 dma", REPLAY_DEV_ADDR, I2C_XFER_WRITE, 4, Success,
+		"S [SB] a [ADDR] [BTF TXE] P p");
+	Replay_Mode("write 0 poll", REPLAY_DEV_ADDR, I2C_XFER_WRITE, 0, Success,
+		"S [SB] a [ADDR] P p");
+	Replay_Mode("read 1", REPLAY_DEV_ADDR, I2C_XFER_READ, 1, Success,
+		"S [SB] a [ADDR] A- P [RXNE] r p");
+	Replay_Mode("read 4 dma", REPLAY_DEV_ADDR, I2C_XFER_READ, 4, Success,
+		"S [SB] a [ADDR] {TC7} P p");
+	Replay_Mode("nack", REPLAY_NOBODY, I2C_XFER_WRITE, 1, Error,
+		"S [SB] a nack {AF} P p");
+}
+
+static void Replay_QueuedDone(I2C_Xfer_t *pXfer)
+{
+	++u32Done;
+}
+
+/* Transactions queued at once, run from the callbacks and the bus tick of main.c */
+static void Replay_BackToBack(void)
+{
+	SimI2cReg_Stats_t s;
+	uint64_t u64Start;
+	uint32_t u32Irqs, u32NextTick;
+	uint8_t i;
+
+	Replay_Open();
+	SimI2cReg_ClearTrace();
+	SimI2cReg_ResetStats();
+	u32Done = 0;
+	u32Irqs = SimNvic_Total();
+	u64Start = SimClock_Now();
+	for (i = 0; i < REPLAY_QUEUED; i++) {
+		u8QueuedData[i][0] = i;
+		Queued[i].u8Addr = REPLAY_DEV_ADDR;
+		Queued[i].u8Dir = (i & 1) ? I2C_XFER_READ : I2C_XFER_WRITE;
+		Queued[i].pData = u8QueuedData[i];
+		Queued[i].u16Len = 1 + i;
+		Queued[i].pfDone = Replay_QueuedDone;
+		if (I2C_Submit(&Queued[i]) != Success) {
+			Replay_Fail("queue: submit %u refused", i);
+		}
+	}
+	u32NextTick = Delay_GetTick() + REPLAY_BUS_TICK_MS;
+	while (u32Done < REPLAY_QUEUED && SimClock_Now() - u64Start < 1000000000ULL) {
+		__WFI();
+		if (Delay_GetTick() >= u32NextTick) {
+			u32NextTick += REPLAY_BUS_TICK_MS;
+			I2C_Watchdog();
+		}
+	}
+	Delay_Us(100);
+	SimI2cReg_GetStats(&s);
+	printf("queue: %u transactions from the bus tick in %.1f ms, %lu irqs, %.1f us on the bus, %lu STARTs in a STOP\n",
+		REPLAY_QUEUED, (SimClock_Now() - u64Start) / 1e6, (unsigned long)(SimNvic_Total() - u32Irqs),
+		s.u64BusNs / 1e3, (unsigned long)s.u32StartInStop);
+	if (u32Done != REPLAY_QUEUED || s.u32Transactions != REPLAY_QUEUED) {
+		Replay_Fail("queue: %lu of %u done, %lu STOPs", (unsigned long)u32Done, REPLAY_QUEUED,
+			(unsigned long)s.u32Transactions);
+	}
+	if (s.u32StartInStop || strstr(SimI2cReg_Trace(), "S!")) {
+		Replay_Fail("queue: START set while a STOP was pending\n      %s", SimI2cReg_Trace());
+	}
+	//One tick per transaction held back at most
+	if (SimClock_Now() - u64Start > (uint64_t)(REPLAY_QUEUED + 1) * REPLAY_BUS_TICK_MS * 1000000) {
+		Replay_Fail("queue: took %.1f ms", (SimClock_Now() - u64Start) / 1e6);
+	}
+}
+
+/* Page write, ACK polling through the write cycle, read back */
+static void Replay_Eeprom(void)
+{
+	SimI2cReg_Stats_t s;
+	SimEeprom_Stats_t e;
+	I2C_Stats_t Before, After;
+	uint64_t u64Start;
+	uint32_t u32Irqs, u32Polls = 0;
+	uint16_t i;
+
+	Replay_Open();
+	I2C_SetSpeed(SIM_EEPROM_ADDR, I2C_SPEED_FAST);
+	SimI2cReg_ResetStats();
+	I2C_GetStats(&Before);
+	u64IdleNs = 0;
+	u32Irqs = SimNvic_Total();
+	u64Start = SimClock_Now();
+
+	u8Page[0] = 0x01;
+	u8Page[1] = 0x00;
+	for (i = 0; i < SIM_EEPROM_PAGE; i++) {
+		u8Page[2 + i] = i * 7;
+	}
+	if (I2C_Write(SIM_EEPROM_ADDR, u8Page, sizeof(u8Page)) != Success) {
+		Replay_Fail("eeprom: page write failed");
+	}
+	while (I2C_Write(SIM_EEPROM_ADDR, u8Page, 0) != Success && u32Polls < 1000) {
+		++u32Polls;
+	}
+	if (I2C_Write(SIM_EEPROM_ADDR, u8Page, 2) != Success || I2C_Read(SIM_EEPROM_ADDR, u8Buf, SIM_EEPROM_PAGE) != Success) {
+		Replay_Fail("eeprom: read back failed");
+	}
+	Delay_Us(100);
+	SimI2cReg_GetStats(&s);
+	SimEeprom_GetStats(&e);
+	I2C_GetStats(&After);
+
+	printf("eeprom: %lu transactions at %lu Hz (%lu polls) in %.2f ms, %.1f irqs each, bus %.2f ms, CPU idle %.2f ms\n",
+		(unsigned long)s.u32Transactions, (unsigned long)SimI2cReg_SclHz(), (unsigned long)u32Polls,
+		(SimClock_Now() - u64Start) / 1e6, (double)(SimNvic_Total() - u32Irqs) / s.u32Transactions,
+		s.u64BusNs / 1e6, u64IdleNs / 1e6);
+	if (memcmp(u8Buf, u8Page + 2, SIM_EEPROM_PAGE) || e.u32Writes != 1) {
+		Replay_Fail("eeprom: read back differs, %lu write cycles", (unsigned long)e.u32Writes);
+	}
+	if (SimI2cReg_SclHz() < 390000 || SimI2cReg_SclHz() > I2C_SPEED_FAST) {
+		Replay_Fail("eeprom: SCL at %lu Hz", (unsigned long)SimI2cReg_SclHz());
+	}
+	if (s.u32StartInStop || s.u32Storms || s.u32Overruns) {
+		Replay_Fail("eeprom: %lu STARTs in a STOP, %lu storms, %lu overruns", (unsigned long)s.u32StartInStop,
+			(unsigned long)s.u32Storms, (unsigned long)s.u32Overruns);
+	}
+	//A STOP pending at one watchdog call is not an idle BUSY at the next
+	if (After.u32Recoveries != Before.u32Recoveries) {
+		Replay_Fail("eeprom: %lu recoveries of a healthy bus", (unsigned long)(After.u32Recoveries - Before.u32Recoveries));
+	}
+	//The polls end with the 5 ms write cycle
+	if (!u32Polls || SimClock_Now() - u64Start > 7000000) {
+		Replay_Fail("eeprom: %lu polls, %.2f ms", (unsigned long)u32Polls, (SimClock_Now() - u64Start) / 1e6);
+	}
+}
+
+static void Replay_Wedge(void)
+{
+	I2C_Stats_t Before, After;
+	SimI2cReg_Stats_t s;
+	I2C_Xfer_t *pXfer = &Queued[0];
+	uint64_t u64Start, u64Limit;
+	uint32_t i;
+
+	Replay_Open();
+	I2C_GetStats(&Before);
+
+	//A slave holds SDA low in the middle of a 16 byte read, 3 clocks free it
+	pXfer->u8Addr = REPLAY_DEV_ADDR;
+	pXfer->u8Dir = I2C_XFER_READ;
+	pXfer->pData = u8Buf;
+	pXfer->u16Len = 16;
+	pXfer->pfDone = 0;
+	u64Start = SimClock_Now();
+	I2C_Submit(pXfer);
+	Delay_Us(500);
+	SimI2cReg_Wedge(3);
+	while (pXfer->u8Busy && SimClock_Now() - u64Start < 1000000000ULL) {
+		__WFI();
+		I2C_Watchdog();
+	}
+	u64Limit = (I2C_TIMEOUT_MS + 16 * 9 / 100 + 2) * 1000000ULL;
+	I2C_GetStats(&After);
+	printf("wedge: read ended after %.2f ms (limit %.2f), %s, %lu recoveries, SDA %s\n",
+		(SimClock_Now() - u64Start) / 1e6, u64Limit / 1e6, pXfer->eResult == Success ? "success" : "error",
+		(unsigned long)(After.u32Recoveries - Before.u32Recoveries), SimI2cReg_IsWedged() ? "stuck" : "free");
+	if (pXfer->u8Busy || pXfer->eResult != Error || SimClock_Now() - u64Start > u64Limit) {
+		Replay_Fail("wedge: transaction not ended by the watchdog in time");
+	}
+	if (After.u32Recoveries - Before.u32Recoveries != 1 || After.u32StuckSda != Before.u32StuckSda ||
+		SimI2cReg_IsWedged()) {
+		Replay_Fail("wedge: %lu recoveries, %lu stuck", (unsigned long)(After.u32Recoveries - Before.u32Recoveries),
+			(unsigned long)(After.u32StuckSda - Before.u32StuckSda));
+	}
+	u8DevNext = 0x20;
+	if (I2C_Read(REPLAY_DEV_ADDR, u8Buf, 4) != Success || u8Buf[0] != 0x20 || u8Buf[3] != 0x23) {
+		Replay_Fail("wedge: read after the recovery failed");
+	}
+
+	//SDA never released: every recovery reports it, transfers fail in bounded time
+	I2C_GetStats(&Before);
+	SimI2cReg_Wedge(SIM_I2C_REG_FOREVER);
+	u64Start = SimClock_Now();
+	if (I2C_Read(REPLAY_DEV_ADDR, u8Buf, 4) != Error) {
+		Replay_Fail("wedge forever: read succeeded");
+	}
+	for (i = 0; i < 10; i++) {
+		Delay_Ms(REPLAY_BUS_TICK_MS);
+		I2C_Watchdog();
+	}
+	I2C_GetStats(&After);
+	SimI2cReg_GetStats(&s);
+	printf("wedge forever: read failed after %.2f ms, %lu recoveries, %lu with SDA stuck, %lu storms\n",
+		(SimClock_Now() - u64Start - 10 * REPLAY_BUS_TICK_MS * 1000000ULL) / 1e6,
+		(unsigned long)(After.u32Recoveries - Before.u32Recoveries),
+		(unsigned long)(After.u32StuckSda - Before.u32StuckSda), (unsigned long)s.u32Storms);
+	if (After.u32StuckSda == Before.u32StuckSda || After.u32StuckSda - Before.u32StuckSda !=
+		After.u32Recoveries - Before.u32Recoveries || s.u32Storms) {
+		Replay_Fail("wedge forever: stuck SDA not counted on every recovery");
+	}
+}
+
+int main(void)
+{
+	Replay_Modes();
+	Replay_BackToBack();
+	Replay_Eeprom();
+	Replay_Wedge();
+
+	if (iFailed) {
+		fprintf(stderr, "%d failures\n", iFailed);
+	}
+	return iFailed != 0;
+}
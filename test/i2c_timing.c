@@ -0,0 +1,262 @@
+/*
+ * Bus timing of i2c.c on the register model of I2C1
+ *
+ * - CCR/TRISE: for every APB1 clock from 2 to 36 MHz in 0.5 MHz steps and
+ *   rates of 100 kHz, 200 kHz, 400 kHz and 1 MHz, the registers written
+ *   give the fastest SCL of RM0008 that is not above the rate, with the
+ *   duty cycle that comes closer in fast mode, 400 kHz at most and
+ *   standard mode below 4 MHz. TRISE is 1000 ns / 300 ns of rise time.
+ * - Probe: the PCF8574 of the LCD is found at 100 kHz, the AT24C32 at
+ *   400 kHz.
+ * - Workloads, timed through the driver: the LCD reset and two lines, an
+ *   EEPROM page write with ACK polling and read back at each rate.
+ */
+
+#include "sim_i2c_reg.h"
+#include "sim_i2c.h"
+#include "sim_nvic.h"
+#include "sim_dma.h"
+#include "sim_clock.h"
+#include "sim_gpio.h"
+#include "eeprom_sim.h"
+#include "lcd_sim.h"
+#include "i2c.h"
+#include "i2c_lcd.h"
+#include "at24c32.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define TIMING_PCLK1_MIN	2000000
+#define TIMING_PCLK1_MAX	36000000
+#define TIMING_PCLK1_STEP	500000
+#define TIMING_DEV_ADDR		0x40		/* Answers at any rate */
+#define TIMING_EEPROM_BYTES	(4 * AT24C32_PAGE_SIZE)
+
+static const uint32_t u32Rates[] = {I2C_SPEED_STANDARD, 200000, I2C_SPEED_FAST, 1000000};
+
+/* The DMA takes 32 bit addresses, static buffers only */
+static uint8_t u8Buf[TIMING_EEPROM_BYTES];
+static uint8_t u8Data[TIMING_EEPROM_BYTES];
+static int iFailed;
+
+static void Timing_Fail(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	fprintf(stderr, "FAIL: ");
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	++iFailed;
+}
+
+static uint8_t Timing_DevAck(uint8_t u8Read)
+{
+	return 1;
+}
+
+/* Sleeps until an interrupt or the next SysTick */
+void __WFI(void)
+{
+	uint32_t u32Irqs = SimNvic_Total();
+	uint64_t u64Tick = (SimClock_Now() / 1000000 + 1) * 1000000;
+	uint64_t u64Next;
+
+	while (SimNvic_Total() == u32Irqs && SimClock_Now() < u64Tick) {
+		u64Next = SimClock_NextEvent();
+		if (u64Next > u64Tick) {
+			u64Next = u64Tick;
+		}
+		SimClock_Advance(u64Next > SimClock_Now() ? u64Next - SimClock_Now() : 0);
+	}
+}
+
+static void Timing_Open(uint32_t u32Pclk1)
+{
+	SimI2c_Device_t Dev = {TIMING_DEV_ADDR, 0, Timing_DevAck, 0, 0};
+	SimEeprom_Config_t Config;
+
+	SimClock_Reset();
+	SimNvic_Reset();
+	SimDma_Reset();
+	SimI2c_Reset();
+	SimRcc_SetPclk1(u32Pclk1);
+	SimI2cReg_Open();
+	SimI2c_Attach(&Dev);
+	SimEeprom_DefaultConfig(&Config);
+	SimEeprom_Open(&Config);
+	SimLcd_Open();
+	My_I2C_Init();
+}
+
+/* Fastest SCL of the CCR encodings that is not above u32Hz, RM0008 */
+static uint32_t Timing_Best(uint32_t u32Pclk1, uint32_t u32Hz, uint8_t *pu8Fast)
+{
+	uint32_t u32Ccr, u32Best = 0;
+
+	if (u32Hz > I2C_SPEED_FAST) {
+		u32Hz = I2C_SPEED_FAST;
+	}
+	*pu8Fast = u32Hz > I2C_SPEED_STANDARD && u32Pclk1 >= 4000000;
+	if (!*pu8Fast) {
+		u32Hz = u32Hz > I2C_SPEED_STANDARD ? I2C_SPEED_STANDARD : u32Hz;
+		for (u32Ccr = 4; u32Ccr <= 0xFFF && !u32Best; u32Ccr++) {
+			if (u32Pclk1 / (2 * u32Ccr) <= u32Hz) {
+				u32Best = u32Pclk1 / (2 * u32Ccr);
+			}
+		}
+		return u32Best;
+	}
+	for (u32Ccr = 1; u32Ccr <= 0xFFF; u32Ccr++) {
+		if (u32Pclk1 / (3 * u32Ccr) <= u32Hz) {
+			u32Best = u32Pclk1 / (3 * u32Ccr);
+			break;
+		}
+	}
+	for (u32Ccr = 1; u32Ccr <= 0xFFF; u32Ccr++) {
+		if (u32Pclk1 / (25 * u32Ccr) <= u32Hz) {
+			if (u32Pclk1 / (25 * u32Ccr) > u32Best) {
+				u32Best = u32Pclk1 / (25 * u32Ccr);
+			}
+			break;
+		}
+	}
+	return u32Best;
+}
+
+static void Timing_Table(void)
+{
+	uint32_t u32Pclk1, u32Best, u32Hz, u32Checked = 0;
+	uint16_t u16Trise;
+	uint8_t u8Fast, i;
+
+	printf("PCLK1 MHz  rate kHz   CCR    TRISE  SCL kHz\n");
+	for (u32Pclk1 = TIMING_PCLK1_MIN; u32Pclk1 <= TIMING_PCLK1_MAX; u32Pclk1 += TIMING_PCLK1_STEP) {
+		Timing_Open(u32Pclk1);
+		for (i = 0; i < sizeof(u32Rates) / sizeof(u32Rates[0]); i++) {
+			I2C_SetSpeed(TIMING_DEV_ADDR, u32Rates[i]);
+			if (I2C_Write(TIMING_DEV_ADDR, u8Buf, 1) != Success) {
+				Timing_Fail("%.1f MHz, %lu Hz: write failed", u32Pclk1 / 1e6, (unsigned long)u32Rates[i]);
+				continue;
+			}
+			u32Best = Timing_Best(u32Pclk1, u32Rates[i], &u8Fast);
+			u32Hz = SimI2cReg_SclHz();
+			u16Trise = u8Fast ? (u32Pclk1 / 1000000) * 300 / 1000 + 1 : u32Pclk1 / 1000000 + 1;
+			if (u32Pclk1 % 4000000 == 0) {
+				printf("%9.1f %9lu  %04X %8u %8.1f\n", u32Pclk1 / 1e6, (unsigned long)u32Rates[i] / 1000,
+					I2C1->CCR, I2C1->TRISE, u32Hz / 1e3);
+			}
+			//The model counts whole ns per SCL period
+			if (u32Hz > u32Best + u32Best / 1000 || u32Hz + u32Best / 1000 < u32Best) {
+				Timing_Fail("%.1f MHz, %lu Hz: SCL %lu Hz, best below the rate %lu Hz", u32Pclk1 / 1e6,
+					(unsigned long)u32Rates[i], (unsigned long)u32Hz, (unsigned long)u32Best);
+			}
+			if (I2C1->TRISE != u16Trise || !(I2C1->CCR & I2C_CCR_FS) != !u8Fast) {
+				Timing_Fail("%.1f MHz, %lu Hz: TRISE %u (want %u), CCR %04X", u32Pclk1 / 1e6,
+					(unsigned long)u32Rates[i], I2C1->TRISE, u16Trise, I2C1->CCR);
+			}
+			++u32Checked;
+		}
+	}
+	printf("ccr: %lu clock/rate pairs checked\n", (unsigned long)u32Checked);
+}
+
+static void Timing_Probe(void)
+{
+	uint32_t u32Lcd, u32Eeprom;
+
+	Timing_Open(TIMING_PCLK1_MAX);
+	u32Lcd = I2C_Probe(SIM_LCD_ADDR, I2C_SPEED_FAST);
+	u32Eeprom = I2C_Probe(SIM_EEPROM_ADDR, I2C_SPEED_FAST);
+	printf("probe: LCD %lu Hz, EEPROM %lu Hz\n", (unsigned long)u32Lcd, (unsigned long)u32Eeprom);
+	if (u32Lcd != SIM_LCD_HZ || u32Eeprom != I2C_SPEED_FAST) {
+		Timing_Fail("probe: LCD %lu Hz, EEPROM %lu Hz", (unsigned long)u32Lcd, (unsigned long)u32Eeprom);
+	}
+}
+
+static void Timing_Lcd(void)
+{
+	SimLcd_Stats_t s;
+	SimI2cReg_Stats_t r;
+	uint64_t u64Start;
+	uint32_t u32Transfers, u32Bytes, u32T0, u32B0;
+	char szLine[SIM_LCD_COLS + 1];
+
+	Timing_Open(TIMING_PCLK1_MAX);
+	I2C_SetSpeed(SIM_LCD_ADDR, SIM_LCD_HZ);
+	u64Start = SimClock_Now();
+	I2C_LCD_Init();
+	printf("lcd: init in %.2f ms\n", (SimClock_Now() - u64Start) / 1e6);
+
+	u64Start = SimClock_Now();
+	SimI2cReg_ResetStats();
+	I2C_LCD_GetStats(&u32T0, &u32B0);
+	I2C_LCD_Puts("Access granted  ");
+	I2C_LCD_NewLine();
+	I2C_LCD_Puts("UID 04A1B2C3D4E5");
+	//The PCF8574 outputs the last byte with the STOP
+	Delay_Us(100);
+	I2C_LCD_GetStats(&u32Transfers, &u32Bytes);
+	SimLcd_GetStats(&s);
+	SimLcd_GetLine(1, szLine);
+	SimI2cReg_GetStats(&r);
+	printf("lcd: two lines in %.2f ms at %lu Hz, %lu transactions of %lu PCF8574 bytes, %.1f us each on the bus\n",
+		(SimClock_Now() - u64Start) / 1e6, (unsigned long)SimI2cReg_SclHz(), (unsigned long)r.u32Transactions,
+		(unsigned long)(u32Bytes - u32B0), r.u64BusNs / 1e3 / r.u32Transactions);
+	if (strcmp(szLine, "UID 04A1B2C3D4E5") || s.u32Violations) {
+		Timing_Fail("lcd: line 1 \"%s\", %lu violations", szLine, (unsigned long)s.u32Violations);
+	}
+}
+
+static void Timing_Eeprom(void)
+{
+	AT24C32_t Dev;
+	SimI2cReg_Stats_t r;
+	uint64_t u64Start, u64Write, u64Read[3];
+	uint8_t i;
+	uint16_t j;
+
+	for (j = 0; j < TIMING_EEPROM_BYTES; j++) {
+		u8Data[j] = j * 13;
+	}
+	for (i = 0; i < 3; i++) {
+		Timing_Open(TIMING_PCLK1_MAX);
+		I2C_SetSpeed(SIM_EEPROM_ADDR, u32Rates[i]);
+		AT24C32_Init(&Dev, &AT24C32_I2C1Bus, SIM_EEPROM_ADDR);
+		SimI2cReg_ResetStats();
+		u64Start = SimClock_Now();
+		if (AT24C32_Write(&Dev, 0x100, u8Data, TIMING_EEPROM_BYTES) != AT24C32_OK) {
+			Timing_Fail("eeprom %lu Hz: write failed", (unsigned long)u32Rates[i]);
+		}
+		u64Write = SimClock_Now() - u64Start;
+		u64Start = SimClock_Now();
+		if (AT24C32_Read(&Dev, 0x100, u8Buf, TIMING_EEPROM_BYTES) != AT24C32_OK ||
+			memcmp(u8Buf, u8Data, TIMING_EEPROM_BYTES)) {
+			Timing_Fail("eeprom %lu Hz: read back differs", (unsigned long)u32Rates[i]);
+		}
+		u64Read[i] = SimClock_Now() - u64Start;
+		SimI2cReg_GetStats(&r);
+		printf("eeprom %3lu kHz: %u bytes written in %.2f ms (%lu polls), read in %.2f ms, %lu transactions, %.1f us on the bus each\n",
+			(unsigned long)u32Rates[i] / 1000, TIMING_EEPROM_BYTES, u64Write / 1e6, (unsigned long)Dev.u32Polls,
+			u64Read[i] / 1e6, (unsigned long)r.u32Transactions, r.u64BusNs / 1e3 / r.u32Transactions);
+	}
+	//9 clocks a byte, the read scales with the rate
+	if (u64Read[2] * 3 > u64Read[0]) {
+		Timing_Fail("eeprom: read in %.2f ms at 400 kHz, %.2f ms at 100 kHz", u64Read[2] / 1e6, u64Read[0] / 1e6);
+	}
+}
+
+int main(void)
+{
+	Timing_Table();
+	Timing_Probe();
+	Timing_Lcd();
+	Timing_Eeprom();
+
+	if (iFailed) {
+		fprintf(stderr, "%d failures\n", iFailed);
+	}
+	return iFailed != 0;
+}
@@ -0,0 +1,389 @@
+/*
+ * kv_store.c and at24c32.c on the simulated AT24C32
+ *
+ * - Wear: a long run of updates, mostly to a few hot keys, has to spread
+ *   the write cycles evenly over every page of the chip.
+ * - Boot: the index rebuild of a full chip is timed on the virtual clock
+ *   and has to stay within one pass over the chip at the bus rate.
+ * - Torn writes: the power is cut inside the write of a new record after
+ *   0..16 of its bytes, the key has to come back with its old or new value.
+ * - Reboot during garbage collection: the power is cut at every page write
+ *   of a run in which live records are relocated. After KV_Init every key
+ *   must still read back and the store has to keep working from the head
+ *   and tail it rebuilt, without overwriting a live record.
+ */
+
+#include "kv_store.h"
+#include "eeprom_sim.h"
+#include "sim_clock.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define TEST_KEYS				KV_MAX_KEYS	/* Keys 1..TEST_KEYS */
+#define TEST_HOT_KEYS			8			/* Keys 1..TEST_HOT_KEYS get most of the updates */
+#define TEST_WEAR_OPS			20000
+#define TEST_REBOOT_EVERY		2000
+#define TEST_GC_OPS				KV_SLOTS	/* Run cut at every page write, one lap */
+#define TEST_AFTER_OPS			(2 * KV_SLOTS)	/* Run after a recovery, laps the ring twice */
+
+typedef struct {
+	uint8_t u8Live;
+	uint8_t u8Len;
+	uint8_t u8Data[KV_VALUE_MAX];
+} Test_Value_t;
+
+typedef struct {
+	Test_Value_t Value[TEST_KEYS + 1];
+} Test_Model_t;
+
+typedef struct {
+	uint8_t u8Key;
+	uint8_t u8Delete;
+	uint8_t u8Len;
+	uint8_t u8Data[KV_VALUE_MAX];
+} Test_Op_t;
+
+static SimEeprom_Config_t Config;
+static AT24C32_t Eeprom;
+static Test_Model_t Model;
+static Test_Model_t SnapModel;
+static uint8_t u8Snap[SIM_EEPROM_SIZE];
+static uint32_t u32Rand = 1;
+static int iFailed;
+
+static void Test_Fail(const char* fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	fprintf(stderr, "FAIL: ");
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	++iFailed;
+}
+
+static uint32_t Test_Rand(void)
+{
+	u32Rand = u32Rand * 1103515245 + 12345;
+	return u32Rand >> 8;
+}
+
+/* Mostly updates of the hot keys, some deletes and now and then a cold key */
+static void Test_NextOp(Test_Op_t* op)
+{
+	uint32_t r = Test_Rand() % 100;
+	uint8_t i;
+
+	if (r < 95) {
+		op->u8Key = 1 + Test_Rand() % TEST_HOT_KEYS;
+	} else {
+		op->u8Key = 1 + TEST_HOT_KEYS + Test_Rand() % (TEST_KEYS - TEST_HOT_KEYS);
+	}
+	op->u8Delete = (r >= 90 && r < 95);
+	op->u8Len = Test_Rand() % (KV_VALUE_MAX + 1);
+	for (i = 0; i < KV_VALUE_MAX; i++) {
+		op->u8Data[i] = (uint8_t)Test_Rand();
+	}
+}
+
+static KV_Status_t Test_Apply(const Test_Op_t* op)
+{
+	KV_Status_t status;
+
+	if (!op->u8Delete) {
+		return KV_Set(op->u8Key, op->u8Data, op->u8Len);
+	}
+	status = KV_Delete(op->u8Key);
+	return (status == KV_NOT_FOUND) ? KV_OK : status;
+}
+
+static void Test_ModelApply(Test_Model_t* m, const Test_Op_t* op)
+{
+	Test_Value_t* v = &m->Value[op->u8Key];
+
+	v->u8Live = !op->u8Delete;
+	v->u8Len = op->u8Delete ? 0 : op->u8Len;
+	memcpy(v->u8Data, op->u8Data, v->u8Len);
+}
+
+static uint8_t Test_Matches(uint8_t key, const Test_Value_t* v)
+{
+	uint8_t data[KV_VALUE_MAX];
+	uint8_t len;
+	KV_Status_t status = KV_Get(key, data, sizeof(data), &len);
+
+	if (!v->u8Live) {
+		return status == KV_NOT_FOUND;
+	}
+	return status == KV_OK && len == v->u8Len && !memcmp(data, v->u8Data, len);
+}
+
+/* Every key reads back as in pA or pB, m is set to the one that matched */
+static void Test_Check(const char* what, Test_Model_t* m, const Test_Model_t* pA, const Test_Model_t* pB)
+{
+	uint8_t key;
+
+	for (key = 1; key <= TEST_KEYS; key++) {
+		if (Test_Matches(key, &pA->Value[key])) {
+			m->Value[key] = pA->Value[key];
+		} else if (Test_Matches(key, &pB->Value[key])) {
+			m->Value[key] = pB->Value[key];
+		} else {
+			Test_Fail("%s: key %u lost its value", what, key);
+		}
+	}
+}
+
+static void Test_Boot(const char* what)
+{
+	if (KV_Init(&Eeprom) != KV_OK) {
+		Test_Fail("%s: KV_Init failed", what);
+	}
+}
+
+static void Test_Run(const char* what, uint32_t u32Ops)
+{
+	Test_Op_t op;
+
+	while (u32Ops--) {
+		Test_NextOp(&op);
+		if (Test_Apply(&op) != KV_OK) {
+			Test_Fail("%s: key %u not stored", what, op.u8Key);
+			return;
+		}
+		Test_ModelApply(&Model, &op);
+	}
+}
+
+/* Blank chip with every key set once */
+static void Test_Fresh(void)
+{
+	Test_Op_t op;
+	uint8_t key;
+
+	SimClock_Reset();
+	SimEeprom_Open(&Config);
+	memset(&Model, 0, sizeof(Model));
+	Test_Boot("blank chip");
+	for (key = 1; key <= TEST_KEYS; key++) {
+		Test_NextOp(&op);
+		op.u8Key = key;
+		op.u8Delete = 0;
+		if (Test_Apply(&op) != KV_OK) {
+			Test_Fail("fill: key %u not stored", key);
+		}
+		Test_ModelApply(&Model, &op);
+	}
+}
+
+static void Test_Snapshot(void)
+{
+	memcpy(u8Snap, SimEeprom_Memory(), sizeof(u8Snap));
+	SnapModel = Model;
+}
+
+/*
+ * From the snapshot, run the ops with the power cut at the u32Cut-th page
+ * write, reboot, check and carry on. Returns the index of the op the cut
+ * hit, u32Ops when the run ended before it.
+ */
+static uint32_t Test_CutRun(const char* what, const Test_Op_t* pOps, uint32_t u32Ops, uint32_t u32Cut, uint8_t u8Bytes)
+{
+	Test_Model_t after;
+	uint32_t i;
+
+	memcpy(SimEeprom_Memory(), u8Snap, sizeof(u8Snap));
+	Model = SnapModel;
+	SimEeprom_PowerOn();
+	Test_Boot(what);
+
+	SimEeprom_PowerCut(u32Cut, u8Bytes);
+	for (i = 0; i < u32Ops; i++) {
+		after = Model;
+		Test_ModelApply(&after, &pOps[i]);
+		if (Test_Apply(&pOps[i]) != KV_OK) {
+			break;
+		}
+		Model = after;
+	}
+	SimEeprom_PowerCut(0, 0);
+	if (i == u32Ops) {
+		return i;
+	}
+	if (SimEeprom_IsPowered()) {
+		Test_Fail("%s: op %lu failed with the power on", what, (unsigned long)i);
+		return i;
+	}
+
+	SimEeprom_PowerOn();
+	Test_Boot(what);
+	Test_Check(what, &Model, &Model, &after);
+
+	//The rebuilt head and tail have to keep every live record through two laps
+	Test_Run(what, TEST_AFTER_OPS);
+	Test_Boot(what);
+	Test_Check(what, &Model, &Model, &Model);
+	return i;
+}
+
+static void Test_Wear(void)
+{
+	SimEeprom_Stats_t ee;
+	KV_Stats_t kv;
+	uint32_t u32KeyWrites[TEST_KEYS + 1] = {0};
+	uint32_t u32Min = ~0u, u32Max = 0, u32Hot = 0;
+	uint32_t u32ScanMs;
+	Test_Op_t op;
+	uint32_t i;
+
+	Test_Fresh();
+	SimEeprom_ResetStats();
+	for (i = 1; i <= TEST_WEAR_OPS; i++) {
+		Test_NextOp(&op);
+		if (Test_Apply(&op) != KV_OK) {
+			Test_Fail("wear: op %lu, key %u not stored", (unsigned long)i, op.u8Key);
+			return;
+		}
+		Test_ModelApply(&Model, &op);
+		++u32KeyWrites[op.u8Key];
+		if (i % TEST_REBOOT_EVERY == 0) {
+			Test_Boot("wear");
+			Test_Check("wear", &Model, &Model, &Model);
+		}
+	}
+
+	SimEeprom_GetStats(&ee);
+	for (i = 0; i < SIM_EEPROM_PAGES; i++) {
+		u32Min = (ee.u32PageWrites[i] < u32Min) ? ee.u32PageWrites[i] : u32Min;
+		u32Max = (ee.u32PageWrites[i] > u32Max) ? ee.u32PageWrites[i] : u32Max;
+	}
+	for (i = 1; i <= TEST_KEYS; i++) {
+		u32Hot = (u32KeyWrites[i] > u32Hot) ? u32KeyWrites[i] : u32Hot;
+	}
+	printf("wear: %u ops, %lu page writes, %.1f laps, per page min %lu max %lu, hottest key %lu updates\n",
+		TEST_WEAR_OPS, (unsigned long)ee.u32Writes, ee.u32Writes / (double)KV_SLOTS,
+		(unsigned long)u32Min, (unsigned long)u32Max, (unsigned long)u32Hot);
+
+	//Every slot is written once a lap, two slots a page
+	if (u32Max - u32Min > 2) {
+		Test_Fail("wear: page writes range from %lu to %lu", (unsigned long)u32Min, (unsigned long)u32Max);
+	}
+
+	SimEeprom_ResetStats();
+	Test_Boot("boot");
+	KV_GetStats(&kv);
+	SimEeprom_GetStats(&ee);
+	Test_Check("boot", &Model, &Model, &Model);
+	u32ScanMs = (uint32_t)(SIM_EEPROM_SIZE * 9ULL * 1000 / Config.u32BusHz);
+	printf("boot: index of %u keys rebuilt in %lu ms, %lu transactions, one pass over the chip is %lu ms\n",
+		kv.u16Keys, (unsigned long)kv.u32BootMs, (unsigned long)ee.u32Transactions, (unsigned long)u32ScanMs);
+	if (kv.u32BootMs > u32ScanMs + u32ScanMs / 10) {
+		Test_Fail("boot: %lu ms", (unsigned long)kv.u32BootMs);
+	}
+}
+
+static void Test_Torn(void)
+{
+	static const uint8_t u8Bytes[] = {0, 1, 2, 4, 8, 13, 14, 15, 16};
+	Test_Op_t ops[3];
+	uint32_t u32Cuts = 0;
+	uint8_t i, j;
+
+	Test_Fresh();
+	Test_Run("torn", 3 * KV_SLOTS);
+	Test_Snapshot();
+
+	//Update a hot key, delete one and give a cold key a new value
+	Test_NextOp(&ops[0]);
+	ops[0].u8Key = 1;
+	ops[0].u8Delete = 0;
+	ops[0].u8Len = KV_VALUE_MAX;
+	ops[0].u8Data[0] = ~Model.Value[1].u8Data[0];
+	ops[1] = ops[0];
+	ops[1].u8Key = 2;
+	ops[1].u8Delete = 1;
+	ops[2] = ops[0];
+	ops[2].u8Key = TEST_KEYS;
+	ops[2].u8Data[0] = ~Model.Value[TEST_KEYS].u8Data[0];
+
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < sizeof(u8Bytes); j++) {
+			if (Test_CutRun("torn", &ops[i], 1, 1, u8Bytes[j]) != 0) {
+				Test_Fail("torn: op %u with %u bytes was not cut", i, u8Bytes[j]);
+			}
+			++u32Cuts;
+		}
+	}
+	printf("torn: %lu cuts inside a record write recovered\n", (unsigned long)u32Cuts);
+}
+
+static void Test_Collect(void)
+{
+	Test_Op_t ops[TEST_GC_OPS];
+	uint8_t u8Reloc[TEST_GC_OPS * (TEST_KEYS + 1)];
+	SimEeprom_Stats_t ee;
+	KV_Stats_t kv;
+	uint32_t u32Writes = 0, u32Relocs = 0, u32RelocCuts = 0;
+	uint32_t u32Appends, u32Moved;
+	uint32_t i, w;
+
+	//Cold keys sit in the ring while the hot ones lap it, the tail hits them every lap
+	Test_Fresh();
+	Test_Run("gc", 2 * KV_SLOTS);
+	Test_Snapshot();
+	for (i = 0; i < TEST_GC_OPS; i++) {
+		Test_NextOp(&ops[i]);
+	}
+
+	//Reference run, which page writes are relocations
+	Test_Boot("gc");
+	SimEeprom_ResetStats();
+	for (i = 0; i < TEST_GC_OPS; i++) {
+		KV_GetStats(&kv);
+		u32Appends = kv.u32Appends;
+		u32Moved = kv.u32Relocations;
+		if (Test_Apply(&ops[i]) != KV_OK) {
+			Test_Fail("gc: reference op %lu failed", (unsigned long)i);
+			return;
+		}
+		KV_GetStats(&kv);
+		//The garbage collection runs before the new record is written
+		for (w = 0; w < kv.u32Appends - u32Appends; w++) {
+			u8Reloc[u32Writes++] = w < kv.u32Relocations - u32Moved;
+		}
+		u32Relocs += kv.u32Relocations - u32Moved;
+	}
+	SimEeprom_GetStats(&ee);
+	if (ee.u32Writes != u32Writes) {
+		Test_Fail("gc: %lu page writes for %lu records", (unsigned long)ee.u32Writes, (unsigned long)u32Writes);
+	}
+	if (!u32Relocs) {
+		Test_Fail("gc: the run relocated nothing");
+	}
+
+	for (w = 1; w <= u32Writes; w++) {
+		if (Test_CutRun("gc", ops, TEST_GC_OPS, w, w % (KV_SLOT_SIZE + 1)) == TEST_GC_OPS) {
+			Test_Fail("gc: cut at write %lu not reached", (unsigned long)w);
+		}
+		u32RelocCuts += u8Reloc[w - 1];
+	}
+	printf("gc: %lu ops, %lu page writes, %lu relocations, power cut at each write, %lu inside a relocation\n",
+		(unsigned long)TEST_GC_OPS, (unsigned long)u32Writes, (unsigned long)u32Relocs, (unsigned long)u32RelocCuts);
+}
+
+int main(void)
+{
+	SimEeprom_DefaultConfig(&Config);
+	AT24C32_Init(&Eeprom, &AT24C32_I2C1Bus, AT24C32_ADDR);
+
+	Test_Wear();
+	Test_Torn();
+	Test_Collect();
+
+	if (iFailed) {
+		fprintf(stderr, "%d failures\n", iFailed);
+	}
+	return iFailed != 0;
+}
@@ -0,0 +1,241 @@
+/*
+ * i2c_lcd.c on the simulated PCF8574 and HD44780
+ *
+ * - Init: the reset sequence leaves the controller in 4 bit mode with a
+ *   blank display, without a nibble dropped.
+ * - Puts: I2C transactions, PCF8574 bytes and bus time per I2C_LCD_Puts
+ *   for the strings main.c shows; a line of LCD_COLS characters is one
+ *   transaction. I2C_LCD_PutLine only sends what changed, an unchanged
+ *   line nothing.
+ * - Contents: random screens written with Clear, Puts and NewLine read
+ *   back from DDRAM, no write while the controller is busy.
+ * - The simulator catches a write during the 1.52 ms of a clear.
+ */
+
+#include "lcd_sim.h"
+#include "sim_i2c.h"
+#include "sim_clock.h"
+#include "i2c_lcd.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define LCD_BENCH_SCREENS		500
+
+static uint32_t u32Lcg = 4242;
+static int iFailed;
+
+static void Lcd_Fail(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	fprintf(stderr, "FAIL: ");
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	++iFailed;
+}
+
+static uint32_t Lcd_Rand(uint32_t u32Range)
+{
+	u32Lcg = u32Lcg * 1103515245 + 12345;
+	return (u32Lcg >> 8) % u32Range;
+}
+
+/* Compares a row with sz padded with spaces */
+static void Lcd_Expect(const char *pszWhat, uint8_t u8Row, const char *sz)
+{
+	char szLine[SIM_LCD_COLS + 1], szWant[SIM_LCD_COLS + 1];
+
+	snprintf(szWant, sizeof(szWant), "%-16s", sz);
+	SimLcd_GetLine(u8Row, szLine);
+	if (strcmp(szLine, szWant)) {
+		Lcd_Fail("%s: row %u shows \"%s\", expected \"%s\"", pszWhat, u8Row, szLine, szWant);
+	}
+}
+
+static void Lcd_Init(void)
+{
+	uint32_t u32Transfers, u32Bytes;
+	SimLcd_Stats_t s;
+	uint64_t u64T0 = SimClock_Now();
+
+	I2C_LCD_Init();
+	I2C_LCD_BackLight(1);
+	I2C_LCD_GetStats(&u32Transfers, &u32Bytes);
+	SimLcd_GetStats(&s);
+	printf("init: %lu transactions, %lu bytes, %.1f ms\n", (unsigned long)u32Transfers, (unsigned long)u32Bytes,
+		(SimClock_Now() - u64T0) / 1e6);
+	if (!SimLcd_IsFourBit() || SimLcd_Address() != 0 || !SimLcd_Backlight()) {
+		Lcd_Fail("init: 4 bit mode %u, address %02X, backlight %u", SimLcd_IsFourBit(), SimLcd_Address(),
+			SimLcd_Backlight());
+	}
+	if (s.u32Clears != 1 || s.u32Violations) {
+		Lcd_Fail("init: %lu clears, %lu violations", (unsigned long)s.u32Clears, (unsigned long)s.u32Violations);
+	}
+	Lcd_Expect("init", 0, "");
+	Lcd_Expect("init", 1, "");
+}
+
+static uint32_t u32T0, u32B0;
+static uint64_t u64T0;
+
+static void Lcd_Mark(void)
+{
+	I2C_LCD_GetStats(&u32T0, &u32B0);
+	u64T0 = SimClock_Now();
+}
+
+/* Prints the cost of the writes since Lcd_Mark, returns their transactions */
+static uint32_t Lcd_Report(const char *pszWhat, size_t len)
+{
+	uint32_t u32Transfers, u32Bytes;
+	uint64_t u64Ns = SimClock_Now() - u64T0;
+
+	I2C_LCD_GetStats(&u32Transfers, &u32Bytes);
+	u32Transfers -= u32T0;
+	u32Bytes -= u32B0;
+	printf("%-28s | %2u | %5lu | %5lu | %8.1f | %6.1f\n", pszWhat, (unsigned)len, (unsigned long)u32Transfers,
+		(unsigned long)u32Bytes, u64Ns / 1e3, len ? u64Ns / 1e3 / len : 0.0);
+	return u32Transfers;
+}
+
+/* One Puts, prints its cost and returns its transactions */
+static uint32_t Lcd_Puts(const char *pszWhat, char *sz)
+{
+	Lcd_Mark();
+	I2C_LCD_Puts(sz);
+	return Lcd_Report(pszWhat, strlen(sz));
+}
+
+static uint32_t Lcd_PutLine(const char *pszWhat, uint8_t u8Line, char *sz)
+{
+	Lcd_Mark();
+	I2C_LCD_PutLine(u8Line, sz);
+	return Lcd_Report(pszWhat, LCD_COLS);
+}
+
+static void Lcd_PutsCost(void)
+{
+	printf("%-28s | %2s | %5s | %5s | %8s | %6s\n", "Puts", "ch", "xfers", "bytes", "bus us", "us/ch");
+
+	I2C_LCD_Clear();
+	if (Lcd_Puts("banner after Clear", "STM32 - MFRC522") != 1) {
+		Lcd_Fail("banner: more than one transaction");
+	}
+	I2C_LCD_NewLine();
+	if (Lcd_Puts("full line after NewLine", "0123456789ABCDEF") != 1) {
+		Lcd_Fail("full line: more than one transaction");
+	}
+	Lcd_Expect("banner", 0, "STM32 - MFRC522");
+	Lcd_Expect("full line", 1, "0123456789ABCDEF");
+
+	I2C_LCD_Clear();
+	Lcd_Puts("granted after Clear", "Access granted");
+	I2C_LCD_NewLine();
+	Lcd_Puts("UID with spaces skipped", "ID: 04 A1 B2 C3");
+	Lcd_Expect("granted", 0, "Access granted");
+	Lcd_Expect("UID", 1, "ID: 04 A1 B2 C3");
+	//Past the last column the characters go to the hidden part of DDRAM
+	I2C_LCD_NewLine();
+	Lcd_Puts("23 characters, 7 hidden", "ID:04A1B2C3D4E5F6 more");
+	Lcd_Expect("long line", 1, "ID:04A1B2C3D4E5F");
+
+	//In place, as Task_Display of main.c: only the changed characters are sent
+	Lcd_PutLine("PutLine, granted -> denied", 0, "Access denied");
+	if (Lcd_PutLine("PutLine, UID scrolled", 1, "D:04A1B2C3D4E5F6") != 1) {
+		Lcd_Fail("PutLine: more than one transaction");
+	}
+	Lcd_Expect("PutLine", 0, "Access denied");
+	Lcd_Expect("PutLine", 1, "D:04A1B2C3D4E5F6");
+	Lcd_Mark();
+	I2C_LCD_PutLine(0, "Access denied");
+	if (Lcd_Report("PutLine, nothing changed", 0) != 0) {
+		Lcd_Fail("PutLine: an unchanged line goes on the bus");
+	}
+}
+
+/* Random screens, each row checked against DDRAM */
+static void Lcd_Screens(void)
+{
+	char sz[2][SIM_LCD_COLS + 1];
+	SimLcd_Stats_t s0, s;
+	uint32_t n, i, r, u32Len;
+
+	SimLcd_GetStats(&s0);
+	for (n = 0; n < LCD_BENCH_SCREENS; n++) {
+		for (r = 0; r < 2; r++) {
+			u32Len = Lcd_Rand(SIM_LCD_COLS + 1);
+			for (i = 0; i < u32Len; i++) {
+				//Spaces are frequent, they are the characters the frame copy skips
+				sz[r][i] = Lcd_Rand(4) ? (char)(' ' + Lcd_Rand(95)) : ' ';
+			}
+			sz[r][u32Len] = 0;
+		}
+		I2C_LCD_Clear();
+		I2C_LCD_Puts(sz[0]);
+		I2C_LCD_NewLine();
+		I2C_LCD_Puts(sz[1]);
+		Lcd_Expect("screen", 0, sz[0]);
+		Lcd_Expect("screen", 1, sz[1]);
+		if (iFailed) {
+			return;
+		}
+	}
+	SimLcd_GetStats(&s);
+	printf("screens: %u random screens read back, %lu characters, %lu violations\n", LCD_BENCH_SCREENS,
+		(unsigned long)(s.u32Chars - s0.u32Chars), (unsigned long)(s.u32Violations - s0.u32Violations));
+	if (s.u32Violations != s0.u32Violations) {
+		Lcd_Fail("screens: %lu nibbles written while busy", (unsigned long)(s.u32Violations - s0.u32Violations));
+	}
+}
+
+/* Clear and a character in one transaction, without the 2 ms wait */
+static void Lcd_Violation(void)
+{
+	uint8_t u8Bl = 1 << LCD_BL;
+	uint8_t u8Seq[8] = {
+		u8Bl | (1 << LCD_EN), u8Bl, u8Bl | (1 << LCD_EN) | (1 << LCD_D4), u8Bl | (1 << LCD_D4),
+		u8Bl | (1 << LCD_EN) | (1 << LCD_RS) | (4 << LCD_D4), u8Bl | (1 << LCD_RS) | (4 << LCD_D4),
+		u8Bl | (1 << LCD_EN) | (1 << LCD_RS) | (1 << LCD_D4), u8Bl | (1 << LCD_RS) | (1 << LCD_D4)
+	};
+	SimLcd_Stats_t s0, s;
+
+	SimLcd_GetStats(&s0);
+	I2C_Write(I2C_LCD_ADDR, u8Seq, sizeof(u8Seq));
+	SimLcd_GetStats(&s);
+	printf("violation: 'A' %.0f us after a clear, %lu nibbles dropped\n",
+		2 * 9 * 1e6 / SIM_LCD_HZ, (unsigned long)(s.u32Violations - s0.u32Violations));
+	if (s.u32Violations - s0.u32Violations != 2 || s.u32Chars != s0.u32Chars) {
+		Lcd_Fail("violation: write during a clear not caught");
+	}
+	Delay_Ms(2);
+}
+
+int main(void)
+{
+	SimLcd_Stats_t s;
+	uint32_t u32Transfers, u32Bytes;
+
+	SimClock_Reset();
+	SimI2c_Reset();
+	SimLcd_Open();
+
+	Lcd_Init();
+	Lcd_PutsCost();
+	Lcd_Screens();
+	Lcd_Violation();
+
+	//The driver's counters agree with the bus
+	I2C_LCD_GetStats(&u32Transfers, &u32Bytes);
+	SimLcd_GetStats(&s);
+	if (s.u32Transactions != u32Transfers + 1 || s.u32Bytes != u32Bytes + 8) {
+		Lcd_Fail("stats: driver %lu/%lu, bus %lu/%lu", (unsigned long)u32Transfers, (unsigned long)u32Bytes,
+			(unsigned long)s.u32Transactions, (unsigned long)s.u32Bytes);
+	}
+	if (iFailed) {
+		fprintf(stderr, "%d failures\n", iFailed);
+	}
+	return iFailed != 0;
+}
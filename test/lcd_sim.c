@@ -0,0 +1,179 @@
+#include "lcd_sim.h"
+#include "sim_clock.h"
+#include "sim_i2c.h"
+#include "i2c_lcd.h"
+#include <string.h>
+
+#define SIM_LCD_POWER_NS		40000000ULL		/* Before the first instruction */
+#define SIM_LCD_CLEAR_NS		1520000ULL
+#define SIM_LCD_CMD_NS			37000ULL
+#define SIM_LCD_DATA_NS			41000ULL
+
+static SimLcd_Stats_t Stats;
+static uint8_t u8Ddram[0x80];
+static uint8_t u8Ac;					/* DDRAM address counter */
+static uint8_t u8Increment;
+static uint8_t u8Cgram;					/* Data goes to CGRAM after a CGRAM address */
+static uint8_t u8FourBit;
+static uint8_t u8HaveHigh;				/* 4 bit mode: high nibble latched, low one expected */
+static uint8_t u8High;
+static uint8_t u8Out;					/* PCF8574 outputs */
+static uint64_t u64BusyUntil;
+
+/* Next DDRAM address, the two lines are 40 bytes each */
+static uint8_t SimLcd_Step(uint8_t u8Addr)
+{
+	if (u8Increment) {
+		if (u8Addr == 0x27) {
+			return 0x40;
+		}
+		return (u8Addr == 0x67) ? 0x00 : u8Addr + 1;
+	}
+	if (u8Addr == 0x00) {
+		return 0x67;
+	}
+	return (u8Addr == 0x40) ? 0x27 : u8Addr - 1;
+}
+
+static void SimLcd_Execute(uint8_t u8Rs, uint8_t u8Val, uint64_t u64Now)
+{
+	if (u8Rs) {
+		if (!u8Cgram) {
+			u8Ddram[u8Ac] = u8Val;
+			u8Ac = SimLcd_Step(u8Ac);
+		}
+		++Stats.u32Chars;
+		u64BusyUntil = u64Now + SIM_LCD_DATA_NS;
+		return;
+	}
+
+	++Stats.u32Instructions;
+	u64BusyUntil = u64Now + SIM_LCD_CMD_NS;
+	if (u8Val & 0x80) {
+		u8Ac = u8Val & 0x7F;
+		if ((u8Ac & 0x3F) > 0x27) {
+			u8Ac &= 0x40;
+		}
+		u8Cgram = 0;
+	} else if (u8Val & 0x40) {
+		u8Cgram = 1;
+	} else if (u8Val & 0x20) {
+		u8FourBit = !(u8Val & 0x10);
+	} else if (u8Val & 0x10) {
+		//Cursor move, a display shift is not modelled
+		if (!(u8Val & 0x08)) {
+			uint8_t u8Entry = u8Increment;
+
+			u8Increment = (u8Val & 0x04) != 0;
+			u8Ac = SimLcd_Step(u8Ac);
+			u8Increment = u8Entry;
+		}
+	} else if (u8Val & 0x04) {
+		u8Increment = (u8Val & 0x02) != 0;
+	} else if (u8Val & 0x02) {
+		u8Ac = 0;
+		u8Cgram = 0;
+		u64BusyUntil = u64Now + SIM_LCD_CLEAR_NS;
+	} else if (u8Val & 0x01) {
+		memset(u8Ddram, ' ', sizeof(u8Ddram));
+		u8Ac = 0;
+		u8Increment = 1;
+		u8Cgram = 0;
+		++Stats.u32Clears;
+		u64BusyUntil = u64Now + SIM_LCD_CLEAR_NS;
+	}
+}
+
+/* Falling edge of EN */
+static void SimLcd_Latch(uint8_t u8Pins, uint64_t u64Now)
+{
+	uint8_t u8Nibble = u8Pins >> LCD_D4;
+	uint8_t u8Rs = (u8Pins >> LCD_RS) & 1;
+
+	if ((u8Pins & (1 << LCD_RW)) || u64Now < u64BusyUntil) {
+		++Stats.u32Violations;
+		return;
+	}
+	if (!u8FourBit) {
+		SimLcd_Execute(u8Rs, u8Nibble << 4, u64Now);
+		u8HaveHigh = 0;
+	} else if (!u8HaveHigh) {
+		u8High = u8Nibble;
+		u8HaveHigh = 1;
+	} else {
+		u8HaveHigh = 0;
+		SimLcd_Execute(u8Rs, (u8High << 4) | u8Nibble, u64Now);
+	}
+}
+
+static uint8_t SimLcd_Ack(uint8_t u8Read)
+{
+	++Stats.u32Transactions;
+	return 1;
+}
+
+static void SimLcd_Write(const uint8_t *pData, uint16_t u16Len)
+{
+	uint16_t i;
+
+	for (i = 0; i < u16Len; i++) {
+		if ((u8Out & (1 << LCD_EN)) && !(pData[i] & (1 << LCD_EN))) {
+			SimLcd_Latch(pData[i], SimI2c_ByteTime(i));
+		}
+		u8Out = pData[i];
+	}
+	Stats.u32Bytes += u16Len;
+}
+
+/* The controller is never read, the pins read back as driven */
+static void SimLcd_Read(uint8_t *pData, uint16_t u16Len)
+{
+	memset(pData, u8Out, u16Len);
+}
+
+void SimLcd_Open(void)
+{
+	SimI2c_Device_t Dev = {SIM_LCD_ADDR, SIM_LCD_HZ, SimLcd_Ack, SimLcd_Write, SimLcd_Read};
+
+	memset(u8Ddram, ' ', sizeof(u8Ddram));
+	memset(&Stats, 0, sizeof(Stats));
+	u8Ac = 0;
+	u8Increment = 1;
+	u8Cgram = 0;
+	u8FourBit = 0;
+	u8HaveHigh = 0;
+	u8Out = 0xFF;
+	u64BusyUntil = SimClock_Now() + SIM_LCD_POWER_NS;
+	SimI2c_Attach(&Dev);
+}
+
+void SimLcd_GetLine(uint8_t u8Row, char *psz)
+{
+	memcpy(psz, &u8Ddram[u8Row ? 0x40 : 0x00], SIM_LCD_COLS);
+	psz[SIM_LCD_COLS] = 0;
+}
+
+uint8_t SimLcd_Address(void)
+{
+	return u8Ac;
+}
+
+uint8_t SimLcd_IsFourBit(void)
+{
+	return u8FourBit;
+}
+
+uint8_t SimLcd_Backlight(void)
+{
+	return (u8Out >> LCD_BL) & 1;
+}
+
+void SimLcd_GetStats(SimLcd_Stats_t *pStats)
+{
+	*pStats = Stats;
+}
+
+void SimLcd_ResetStats(void)
+{
+	memset(&Stats, 0, sizeof(Stats));
+}
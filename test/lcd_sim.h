@@ -0,0 +1,49 @@
+#ifndef LCD_SIM_H_
+#define LCD_SIM_H_
+
+#include <stdint.h>
+
+/*
+ * HD44780 16x2 behind a PCF8574 on the bus of sim_i2c.c
+ *
+ * i2c_lcd.c runs unchanged on the host. Every byte written to the PCF8574
+ * sets its outputs when its ACK clock ends; a falling edge on EN latches
+ * RS and D4..D7 into the controller. It powers up in 8 bit mode, where the
+ * low data lines read as 0, and executes the instruction set on DDRAM
+ * 0x00..0x27 and 0x40..0x67 of a two line display.
+ *
+ * Execution times are those of the datasheet at 270 kHz: 1.52 ms for clear
+ * and home, 37 us for the other instructions, 41 us for data. A nibble
+ * latched while the controller is busy, or less than 40 ms after power up,
+ * is dropped and counted as a violation.
+ */
+
+#define SIM_LCD_ADDR			0x4E
+#define SIM_LCD_HZ				100000		/* PCF8574 maximum SCL rate */
+#define SIM_LCD_COLS			16
+#define SIM_LCD_ROWS			2
+
+typedef struct {
+	uint32_t u32Transactions;
+	uint32_t u32Bytes;					/* PCF8574 output bytes */
+	uint32_t u32Instructions;			/* Executed, clears included */
+	uint32_t u32Chars;					/* Data writes executed */
+	uint32_t u32Clears;
+	uint32_t u32Violations;				/* Nibbles dropped while busy, writes with RW high */
+} SimLcd_Stats_t;
+
+/* Power up: outputs high, 8 bit mode, DDRAM filled with spaces */
+void SimLcd_Open(void);
+
+/* Visible characters of a row, SIM_LCD_COLS and a terminating 0 */
+void SimLcd_GetLine(uint8_t u8Row, char *psz);
+
+/* DDRAM address counter, 4 bit mode and backlight output */
+uint8_t SimLcd_Address(void);
+uint8_t SimLcd_IsFourBit(void);
+uint8_t SimLcd_Backlight(void);
+
+void SimLcd_GetStats(SimLcd_Stats_t *pStats);
+void SimLcd_ResetStats(void);
+
+#endif
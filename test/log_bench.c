@@ -0,0 +1,226 @@
+/*
+ * access_log.c on the emulated card
+ *
+ * - Rotation: LOG1.BIN is made a directory before LOG0.BIN fills up, so
+ *   opening the next ring file fails. The records appended meanwhile have
+ *   to stay in RAM, the ones that no longer fit are counted as dropped,
+ *   and all kept records land in LOG1.BIN once it can be created.
+ * - Rate: records appended back to back through two more rotations, the
+ *   sustained records/s and the worst single append on the virtual clock.
+ * - Flush: one record and a flush, repeated, the partial sector rewrite
+ *   and f_sync an idle log pays every ACCESS_LOG_FLUSH_MS.
+ *
+ * Every record is read back with AccessLog_ReadRecordAt at the end.
+ */
+
+#include "access_log.h"
+#include "sd_emu.h"
+#include "sim_clock.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define LOG_BENCH_SECTOR		(512 / ACCESS_LOG_RECORD_SIZE)
+#define LOG_BENCH_EXTRA			(LOG_BENCH_SECTOR + 3)	/* Appended while the rotation fails */
+#define LOG_BENCH_RATE			(2 * ACCESS_LOG_RECORDS_PER_FILE)
+#define LOG_BENCH_FLUSHES		200
+
+static BYTE u8Work[FF_MAX_SS];
+static uint32_t u32Dropped;				/* Appends refused, expected to get no sequence number */
+static int iFailed;
+
+static void Log_Fail(const char* fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	fprintf(stderr, "FAIL: ");
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	++iFailed;
+}
+
+/* UID and decision follow from the sequence number the record gets */
+static void Log_Uid(uint32_t u32Seq, uint8_t* uid)
+{
+	uint8_t i;
+
+	for (i = 0; i < ACCESS_LOG_UID_LEN; i++) {
+		uid[i] = (uint8_t)(u32Seq * 13 + i * 41);
+	}
+}
+
+static uint8_t Log_UidLen(uint32_t u32Seq)
+{
+	return (u32Seq % 3 == 0) ? 4 : ACCESS_LOG_UID_LEN;
+}
+
+/* Append the next record, returns its latency in ns */
+static uint64_t Log_Append(FRESULT* pfr)
+{
+	uint8_t uid[ACCESS_LOG_UID_LEN];
+	uint32_t u32Seq = AccessLog_GetNextSeq();
+	uint64_t u64T0 = SimClock_Now();
+
+	Log_Uid(u32Seq, uid);
+	*pfr = AccessLog_Append(uid, Log_UidLen(u32Seq), (u32Seq & 1) ? ACCESS_LOG_GRANTED : ACCESS_LOG_DENIED);
+	if (*pfr != FR_OK) {
+		++u32Dropped;
+	}
+	return SimClock_Now() - u64T0;
+}
+
+static void Log_Rotation(void)
+{
+	AccessLog_Stats_t s;
+	FRESULT fr;
+	uint32_t i;
+
+	if (f_mkdir("LOG1.BIN") != FR_OK) {
+		Log_Fail("rotation: cannot block LOG1.BIN");
+		return;
+	}
+	for (i = 0; i < ACCESS_LOG_RECORDS_PER_FILE + LOG_BENCH_EXTRA; i++) {
+		Log_Append(&fr);
+	}
+	AccessLog_GetStats(&s);
+	if (s.u32Rotations != 0) {
+		Log_Fail("rotation: switched to a file that cannot be opened");
+	}
+	if (s.u32Dropped != LOG_BENCH_EXTRA - LOG_BENCH_SECTOR || u32Dropped != s.u32Dropped) {
+		Log_Fail("rotation: %lu records dropped, %lu appends refused", (unsigned long)s.u32Dropped,
+			(unsigned long)u32Dropped);
+	}
+	if (AccessLog_Flush() == FR_OK) {
+		Log_Fail("rotation: flush without an open file succeeded");
+	}
+
+	//The next poll retries the rotation and writes the records kept in RAM
+	f_unlink("LOG1.BIN");
+	AccessLog_Poll();
+	AccessLog_GetStats(&s);
+	if (s.u32Rotations != 1) {
+		Log_Fail("rotation: not retried, %lu rotations", (unsigned long)s.u32Rotations);
+	}
+	printf("rotation: next file blocked, %lu records kept in RAM, %lu dropped, written after the retry\n",
+		(unsigned long)(AccessLog_GetNextSeq() - ACCESS_LOG_RECORDS_PER_FILE), (unsigned long)s.u32Dropped);
+}
+
+static void Log_Rate(void)
+{
+	AccessLog_Stats_t s0, s1;
+	uint64_t u64T0, u64Ns, u64Max = 0;
+	FRESULT fr;
+	uint32_t i;
+
+	AccessLog_GetStats(&s0);
+	u64T0 = SimClock_Now();
+	for (i = 0; i < LOG_BENCH_RATE; i++) {
+		u64Ns = Log_Append(&fr);
+		if (fr != FR_OK) {
+			Log_Fail("rate: append %lu failed: %d", (unsigned long)i, fr);
+			return;
+		}
+		if (u64Ns > u64Max) {
+			u64Max = u64Ns;
+		}
+	}
+	u64Ns = SimClock_Now() - u64T0;
+	AccessLog_GetStats(&s1);
+
+	printf("rate: %lu records, %lu sector writes, %lu rotations, %.0f records/s, %.1f us per record,"
+		" worst append %.2f ms\n", (unsigned long)LOG_BENCH_RATE, (unsigned long)(s1.u32Flushes - s0.u32Flushes),
+		(unsigned long)(s1.u32Rotations - s0.u32Rotations), LOG_BENCH_RATE / (u64Ns / 1e9),
+		u64Ns / 1e3 / LOG_BENCH_RATE, u64Max / 1e6);
+	if (s1.u32Rotations - s0.u32Rotations != 2) {
+		Log_Fail("rate: %lu rotations instead of 2", (unsigned long)(s1.u32Rotations - s0.u32Rotations));
+	}
+}
+
+static void Log_FlushLatency(void)
+{
+	uint64_t u64T0, u64Ns, u64Sum = 0, u64Max = 0;
+	FRESULT fr;
+	uint32_t i;
+
+	for (i = 0; i < LOG_BENCH_FLUSHES; i++) {
+		Log_Append(&fr);
+		u64T0 = SimClock_Now();
+		fr = AccessLog_Flush();
+		u64Ns = SimClock_Now() - u64T0;
+		if (fr != FR_OK) {
+			Log_Fail("flush %lu failed: %d", (unsigned long)i, fr);
+			return;
+		}
+		u64Sum += u64Ns;
+		if (u64Ns > u64Max) {
+			u64Max = u64Ns;
+		}
+	}
+	printf("flush: %lu partial sector flushes, %.2f ms mean, %.2f ms worst\n",
+		(unsigned long)LOG_BENCH_FLUSHES, u64Sum / 1e6 / LOG_BENCH_FLUSHES, u64Max / 1e6);
+}
+
+static void Log_Verify(void)
+{
+	AccessLog_Reader_t rd;
+	AccessLog_Record_t rec;
+	uint8_t uid[ACCESS_LOG_UID_LEN];
+	uint32_t u32Seq, u32End = AccessLog_GetNextSeq();
+	uint8_t len;
+
+	AccessLog_OpenReader(&rd);
+	for (u32Seq = 0; u32Seq < u32End; u32Seq++) {
+		if (AccessLog_ReadRecordAt(&rd, u32Seq, &rec) != FR_OK) {
+			Log_Fail("record %lu not found", (unsigned long)u32Seq);
+			break;
+		}
+		len = Log_UidLen(u32Seq);
+		Log_Uid(u32Seq, uid);
+		memset(uid + len, 0, ACCESS_LOG_UID_LEN - len);
+		if (ACCESS_LOG_UID_LENGTH(&rec) != len || memcmp(rec.u8Uid, uid, ACCESS_LOG_UID_LEN)
+			|| ACCESS_LOG_DECISION(&rec) != ((u32Seq & 1) ? ACCESS_LOG_GRANTED : ACCESS_LOG_DENIED)) {
+			Log_Fail("record %lu has wrong contents", (unsigned long)u32Seq);
+			break;
+		}
+	}
+	AccessLog_CloseReader(&rd);
+	printf("verify: %lu records read back\n", (unsigned long)u32End);
+}
+
+int main(void)
+{
+	SdEmu_Config_t Config;
+	MKFS_PARM Opt = {FM_ANY, 0, 0, 0, 0};
+	FRESULT fr;
+
+	SdEmu_DefaultConfig(&Config);
+	SimClock_Reset();
+	if (!SdEmu_Open(&Config)) {
+		fprintf(stderr, "cannot open the card image\n");
+		return 1;
+	}
+	fr = f_mkfs("", &Opt, u8Work, sizeof(u8Work));
+	if (fr == FR_OK) {
+		fr = AccessLog_Init();
+	}
+	if (fr != FR_OK) {
+		fprintf(stderr, "format/init failed: %d\n", fr);
+		return 1;
+	}
+
+	Log_Rotation();
+	Log_Rate();
+	Log_FlushLatency();
+	if (AccessLog_Flush() != FR_OK) {
+		Log_Fail("final flush failed");
+	}
+	Log_Verify();
+
+	SdEmu_Close();
+	if (iFailed) {
+		fprintf(stderr, "%d failures\n", iFailed);
+	}
+	return iFailed != 0;
+}
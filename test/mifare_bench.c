@@ -0,0 +1,166 @@
+/*
+ * mifare.c on the simulated MFRC522 with one MIFARE Classic 1K card
+ *
+ * Sectors 4 to 7 use the MAD key A0..A5, the rest the transport key. The
+ * key list starts with a wrong key, so the first dump pays for a failed
+ * authentication and a reselect on every sector.
+ *
+ * - Dump: all 16 sectors read, the data compared with the card, time and
+ *   keys tried per sector.
+ * - Key cache: a second dump tries one key per sector and is faster.
+ * - Write: sectors 1 to 15 written and read back, block 0 untouched.
+ */
+
+#include "rc522_sim.h"
+#include "sim_clock.h"
+#include "mifare.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define MIFARE_BENCH_SECTORS		16		/* 1K card */
+#define MIFARE_BENCH_DATA			(3 * MIFARE_BLOCK_SIZE)
+
+static const uint8_t u8CardUid[4] = {0x9C, 0x21, 0x5B, 0xE4};
+
+static const Mifare_Key_t Keys[3] = {
+	{PICC_AUTHENT1A, {0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC}},		/* Wrong for every sector */
+	{PICC_AUTHENT1A, {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}},		/* Transport key */
+	{PICC_AUTHENT1A, {0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5}}		/* MAD key */
+};
+
+static uint8_t u8Dump[MIFARE_BENCH_SECTORS][MIFARE_BENCH_DATA];
+static int iFailed;
+
+static void Mifare_Fail(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	fprintf(stderr, "FAIL: ");
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	++iFailed;
+}
+
+/* Read every sector, returns the virtual time of the dump */
+static uint64_t Mifare_Dump(const char *pszName, uint8_t u8Print, uint32_t *pu32Tries)
+{
+	Mifare_SectorTiming_t t;
+	uint64_t u64T0 = SimClock_Now();
+	uint8_t s;
+
+	*pu32Tries = 0;
+	if (u8Print) {
+		printf("%-6s | %9s %9s %5s\n", "sector", "auth us", "read us", "keys");
+	}
+	for (s = 0; s < MIFARE_BENCH_SECTORS; s++) {
+		if (Mifare_ReadSector(s, u8Dump[s], &t) != MI_OK) {
+			Mifare_Fail("%s: sector %u not read", pszName, s);
+			continue;
+		}
+		*pu32Tries += t.u8AuthTries;
+		if (memcmp(u8Dump[s], SimRc522_GetCard(0)->u8Block[s * 4], MIFARE_BENCH_DATA)) {
+			Mifare_Fail("%s: sector %u read wrong", pszName, s);
+		}
+		if (u8Print) {
+			printf("%-6u | %9lu %9lu %5u\n", s, (unsigned long)t.u32AuthUs, (unsigned long)t.u32TransferUs,
+				t.u8AuthTries);
+		}
+	}
+	return SimClock_Now() - u64T0;
+}
+
+static void Mifare_Dumps(void)
+{
+	uint64_t u64First, u64Second;
+	uint32_t u32First, u32Second;
+
+	u64First = Mifare_Dump("first dump", 1, &u32First);
+	u64Second = Mifare_Dump("second dump", 0, &u32Second);
+	printf("dump: %.1f ms with %lu keys tried, %.1f ms with %lu from the key cache\n", u64First / 1e6,
+		(unsigned long)u32First, u64Second / 1e6, (unsigned long)u32Second);
+	//Wrong key, then the transport key, and the MAD key after it for sectors 4 to 7
+	if (u32First != 2 * MIFARE_BENCH_SECTORS + 4 || u32Second != MIFARE_BENCH_SECTORS) {
+		Mifare_Fail("dump: %lu and %lu keys tried", (unsigned long)u32First, (unsigned long)u32Second);
+	}
+	if (u64Second >= u64First) {
+		Mifare_Fail("dump: key cache does not save time");
+	}
+}
+
+static void Mifare_WriteBack(void)
+{
+	Mifare_SectorTiming_t t;
+	uint8_t u8Data[MIFARE_BENCH_DATA], u8Block0[MIFARE_BLOCK_SIZE];
+	uint64_t u64T0 = SimClock_Now();
+	uint8_t s, i;
+
+	memcpy(u8Block0, SimRc522_GetCard(0)->u8Block[0], sizeof(u8Block0));
+	for (s = 0; s < MIFARE_BENCH_SECTORS; s++) {
+		for (i = 0; i < sizeof(u8Data); i++) {
+			u8Data[i] = (uint8_t)(0xC3 ^ (s * 11 + i));
+		}
+		if (Mifare_WriteSector(s, u8Data, &t) != MI_OK || t.u8Blocks != ((s == 0) ? 2 : 3)) {
+			Mifare_Fail("write: sector %u, %u blocks written", s, t.u8Blocks);
+		}
+	}
+	u64T0 = SimClock_Now() - u64T0;
+
+	for (s = 0; s < MIFARE_BENCH_SECTORS; s++) {
+		for (i = 0; i < sizeof(u8Data); i++) {
+			u8Data[i] = (uint8_t)(0xC3 ^ (s * 11 + i));
+		}
+		if (s == 0) {
+			memcpy(u8Data, u8Block0, sizeof(u8Block0));
+		}
+		if (Mifare_ReadSector(s, u8Dump[s], &t) != MI_OK || memcmp(u8Dump[s], u8Data, sizeof(u8Data))) {
+			Mifare_Fail("write: sector %u read back wrong", s);
+		}
+	}
+	printf("write: 47 blocks in %.1f ms, read back, block 0 untouched\n", u64T0 / 1e6);
+}
+
+int main(void)
+{
+	SimRc522_Config_t Config;
+	SimRc522_Card_t Card;
+	SimRc522_Stats_t s;
+	TM_MFRC522_Uid_t uid;
+	uint8_t i;
+
+	SimClock_Reset();
+	SimRc522_DefaultConfig(&Config);
+	SimRc522_Open(&Config);
+	SimRc522_MakeCard(&Card, u8CardUid, sizeof(u8CardUid));
+	for (i = 4; i < 8; i++) {
+		memcpy(Card.u8Block[i * 4 + 3], Keys[2].u8Key, MIFARE_KEY_LEN);
+	}
+	SimRc522_AddCard(&Card);
+
+	TM_MFRC522_Init();
+	//The card powers up in the field before it answers
+	SimClock_Advance(5000000);
+
+	memset(&uid, 0, sizeof(uid));
+	uid.size = sizeof(u8CardUid);
+	memcpy(uid.uidByte, u8CardUid, sizeof(u8CardUid));
+	Mifare_SetKeys(Keys, 3);
+	if (Mifare_Begin(&uid) != MI_OK) {
+		fprintf(stderr, "card not selected\n");
+		return 1;
+	}
+	Mifare_Dumps();
+	Mifare_WriteBack();
+	Mifare_End();
+
+	SimRc522_GetStats(&s);
+	if (s.u32Errors) {
+		Mifare_Fail("%lu bytes sent with CS high or FIFO overflows", (unsigned long)s.u32Errors);
+	}
+	if (iFailed) {
+		fprintf(stderr, "%d failures\n", iFailed);
+	}
+	return iFailed != 0;
+}
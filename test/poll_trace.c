@@ -0,0 +1,159 @@
+/*
+ * card_poll.c on the simulated MFRC522, driven by a card arrival trace
+ *
+ * The loop of main.c is reproduced: CardPoll_Task every millisecond, __WFI
+ * in between. POLL_TRACE_CARDS taps of distinct cards arrive in bursts
+ * (a queue at the door) separated by quiet periods, each card stays in the
+ * field POLL_TRACE_TAP_MS.
+ *
+ * - Every tap is reported once, within CARD_POLL_MAX_MS plus a poll.
+ * - Average wake time and field time per detection, worst and average
+ *   detection latency, awake fraction of the reader.
+ * - The awake time counted by card_poll.c matches the reader.
+ */
+
+#include "rc522_sim.h"
+#include "sim_clock.h"
+#include "card_poll.h"
+#include "delay.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define POLL_TRACE_CARDS		48
+#define POLL_TRACE_BURST		4			/* Cards per burst */
+#define POLL_TRACE_TAP_MS		600
+#define POLL_TRACE_POLL_MS		60			/* One poll: wake, field, SELECT, and HLTA and the last REQA on the reader timer */
+
+typedef struct {
+	uint32_t u32ArriveMs;
+	uint32_t u32DetectMs;
+	uint8_t u8Seen;
+} PollTrace_Tap_t;
+
+static PollTrace_Tap_t Taps[POLL_TRACE_CARDS];
+static uint32_t u32Lcg = 12345;
+static int iFailed;
+
+static void Trace_Fail(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	fprintf(stderr, "FAIL: ");
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	++iFailed;
+}
+
+static uint32_t Trace_Rand(uint32_t u32Min, uint32_t u32Max)
+{
+	u32Lcg = u32Lcg * 1103515245 + 12345;
+	return u32Min + (u32Lcg >> 8) % (u32Max - u32Min + 1);
+}
+
+/* Bursts 1.5 to 3 s apart inside, 8 to 30 s of quiet between them */
+static uint32_t Trace_Build(void)
+{
+	uint32_t u32Ms = 2000;
+	uint8_t i;
+
+	for (i = 0; i < POLL_TRACE_CARDS; i++) {
+		Taps[i].u32ArriveMs = u32Ms;
+		u32Ms += (i % POLL_TRACE_BURST == POLL_TRACE_BURST - 1) ? Trace_Rand(8000, 30000) : Trace_Rand(1500, 3000);
+	}
+	return u32Ms;
+}
+
+static void Trace_Uid(uint8_t *pUid, uint8_t n)
+{
+	pUid[0] = 0x5A;
+	pUid[1] = n;
+	pUid[2] = (uint8_t)(0xC0 ^ n);
+	pUid[3] = 0x17;
+}
+
+int main(void)
+{
+	SimRc522_Config_t Config;
+	SimRc522_Card_t Card;
+	SimRc522_Stats_t s;
+	CardPoll_Stats_t ps;
+	TM_MFRC522_Uid_t uid;
+	uint8_t u8Uid[4];
+	uint32_t u32EndMs, u32Now, u32Lat, u32MaxLat = 0, u32Detected = 0;
+	uint64_t u64LatSum = 0;
+	uint8_t u8Next = 0, n;
+
+	SimClock_Reset();
+	SimRc522_DefaultConfig(&Config);
+	SimRc522_Open(&Config);
+	TM_MFRC522_Init();
+	CardPoll_Init();
+	u32EndMs = Trace_Build();
+
+	while ((u32Now = Delay_GetTick()) < u32EndMs) {
+		//Cards due within the next tick enter the field at their own time
+		while (u8Next < POLL_TRACE_CARDS && Taps[u8Next].u32ArriveMs <= u32Now + 1) {
+			Trace_Uid(u8Uid, u8Next);
+			SimRc522_MakeCard(&Card, u8Uid, sizeof(u8Uid));
+			Card.u64InNs = (uint64_t)Taps[u8Next].u32ArriveMs * 1000000;
+			Card.u64OutNs = Card.u64InNs + (uint64_t)POLL_TRACE_TAP_MS * 1000000;
+			if (SimRc522_AddCard(&Card) < 0) {
+				Trace_Fail("no free card slot at %lu ms", (unsigned long)u32Now);
+			}
+			++u8Next;
+		}
+
+		while (CardPoll_Task(&uid) == MI_OK) {
+			n = uid.uidByte[1];
+			Trace_Uid(u8Uid, n);
+			if (uid.size != 4 || n >= u8Next || memcmp(uid.uidByte, u8Uid, 4) || Taps[n].u8Seen) {
+				Trace_Fail("unexpected card %02X%02X%02X%02X", uid.uidByte[0], uid.uidByte[1], uid.uidByte[2],
+					uid.uidByte[3]);
+				continue;
+			}
+			Taps[n].u8Seen = 1;
+			Taps[n].u32DetectMs = Delay_GetTick();
+			u32Lat = Taps[n].u32DetectMs - Taps[n].u32ArriveMs;
+			u64LatSum += u32Lat;
+			if (u32Lat > u32MaxLat) {
+				u32MaxLat = u32Lat;
+			}
+			++u32Detected;
+		}
+		__WFI();
+	}
+
+	CardPoll_GetStats(&ps);
+	SimRc522_GetStats(&s);
+	printf("trace: %u taps of %u ms over %.1f s, %lu detected, %lu polls\n", POLL_TRACE_CARDS, POLL_TRACE_TAP_MS,
+		u32EndMs / 1e3, (unsigned long)u32Detected, (unsigned long)ps.u32Polls);
+	if (u32Detected) {
+		printf("per detection: %.1f ms awake, %.1f ms field on; latency %.1f ms average, %lu ms worst\n",
+			(double)ps.u32AwakeMs / u32Detected, (double)ps.u32FieldOnMs / u32Detected,
+			(double)u64LatSum / u32Detected, (unsigned long)u32MaxLat);
+	}
+	printf("reader: awake %.2f%%, field on %.2f%% of the time, CPU idle %.1f%%\n",
+		s.u64AwakeNs / 1e4 / u32EndMs, s.u64FieldNs / 1e4 / u32EndMs, s.u64IdleNs / 1e4 / u32EndMs);
+
+	if (u32Detected != POLL_TRACE_CARDS) {
+		Trace_Fail("%lu of %u taps detected", (unsigned long)u32Detected, POLL_TRACE_CARDS);
+	}
+	if (u32MaxLat > CARD_POLL_MAX_MS + POLL_TRACE_POLL_MS) {
+		Trace_Fail("worst latency %lu ms over the %u ms interval", (unsigned long)u32MaxLat, CARD_POLL_MAX_MS);
+	}
+	//card_poll.c counts whole ticks, one per poll at most
+	if (s.u64AwakeNs / 1000000 + ps.u32Polls < ps.u32AwakeMs || ps.u32AwakeMs + ps.u32Polls < s.u64AwakeNs / 1000000) {
+		Trace_Fail("awake %lu ms counted, reader awake %lu ms", (unsigned long)ps.u32AwakeMs,
+			(unsigned long)(s.u64AwakeNs / 1000000));
+	}
+	if (s.u32Errors) {
+		Trace_Fail("%lu bytes sent with CS high or FIFO overflows", (unsigned long)s.u32Errors);
+	}
+	if (iFailed) {
+		fprintf(stderr, "%d failures\n", iFailed);
+	}
+	return iFailed != 0;
+}
@@ -0,0 +1,234 @@
+/*
+ * mfrc522.c on the simulated MFRC522 with one MIFARE Classic 1K card
+ *
+ * - Burst: a 16 byte FIFO write and read each take one CS cycle and 17
+ *   SPI bytes, the read gets back what was written.
+ * - Transactions: REQA, SELECT, authentication, block read, block write
+ *   and HLTA, the SPI bytes, CS cycles and virtual time of each.
+ * - Polling: TM_MFRC522_Check in a loop as main.c used to run it, one
+ *   second with an empty field and one with a card. The fraction of the
+ *   time the CPU sleeps in __WFI, the IRQs and the SPI traffic per second.
+ *
+ * Built again with MFRC522_USE_IRQ 0 as rc522_bench_poll: there the driver
+ * reads CommIrqReg until the command ends and never sleeps.
+ */
+
+#include "rc522_sim.h"
+#include "sim_clock.h"
+#include "mfrc522.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define RC522_POLL_NS			1000000000ULL	/* Length of each polling phase */
+
+static const uint8_t u8CardUid[4] = {0xDE, 0xAD, 0xBE, 0xEF};
+static uint8_t u8KeyA[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+static SimRc522_Stats_t S0;
+static uint64_t u64T0;
+static int iFailed;
+
+static void Rc522_Fail(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	fprintf(stderr, "FAIL: ");
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	++iFailed;
+}
+
+static void Rc522_Mark(void)
+{
+	SimRc522_GetStats(&S0);
+	u64T0 = SimClock_Now();
+}
+
+/* SPI bytes and CS cycles since Rc522_Mark, printed with the time */
+static void Rc522_Report(const char *pszName, uint32_t *pu32Bytes, uint32_t *pu32Cs)
+{
+	SimRc522_Stats_t s;
+
+	SimRc522_GetStats(&s);
+	*pu32Bytes = (uint32_t)(s.u64SpiBytes - S0.u64SpiBytes);
+	*pu32Cs = s.u32CsCycles - S0.u32CsCycles;
+	printf("%-10s | %9lu %9lu | %9.1f\n", pszName, (unsigned long)*pu32Bytes, (unsigned long)*pu32Cs,
+		(SimClock_Now() - u64T0) / 1e3);
+}
+
+static void Rc522_Burst(void)
+{
+	uint8_t u8Out[16], u8In[16];
+	uint32_t u32Bytes, u32Cs;
+	SimRc522_Stats_t s;
+	uint8_t i;
+
+	for (i = 0; i < sizeof(u8Out); i++) {
+		u8Out[i] = (uint8_t)(0xA5 ^ (i * 7));
+	}
+	TM_MFRC522_WriteRegister(MFRC522_REG_FIFO_LEVEL, 0x80);
+
+	Rc522_Mark();
+	TM_MFRC522_WriteRegisterBurst(MFRC522_REG_FIFO_DATA, u8Out, sizeof(u8Out));
+	SimRc522_GetStats(&s);
+	u32Bytes = (uint32_t)(s.u64SpiBytes - S0.u64SpiBytes);
+	u32Cs = s.u32CsCycles - S0.u32CsCycles;
+	if (u32Bytes != 17 || u32Cs != 1 || TM_MFRC522_ReadRegister(MFRC522_REG_FIFO_LEVEL) != 16) {
+		Rc522_Fail("burst write: %lu bytes, %lu CS cycles", (unsigned long)u32Bytes, (unsigned long)u32Cs);
+	}
+
+	Rc522_Mark();
+	TM_MFRC522_ReadRegisterBurst(MFRC522_REG_FIFO_DATA, u8In, sizeof(u8In));
+	SimRc522_GetStats(&s);
+	u32Bytes = (uint32_t)(s.u64SpiBytes - S0.u64SpiBytes);
+	u32Cs = s.u32CsCycles - S0.u32CsCycles;
+	if (u32Bytes != 17 || u32Cs != 1 || memcmp(u8In, u8Out, sizeof(u8In))) {
+		Rc522_Fail("burst read: %lu bytes, %lu CS cycles, data %s", (unsigned long)u32Bytes, (unsigned long)u32Cs,
+			memcmp(u8In, u8Out, sizeof(u8In)) ? "wrong" : "right");
+	}
+	printf("burst: 16 FIFO bytes written and read back, 17 SPI bytes and 1 CS cycle each way\n");
+}
+
+static void Rc522_Transactions(void)
+{
+	TM_MFRC522_Uid_t uid;
+	uint8_t u8Buf[MFRC522_MAX_LEN + 2], u8Data[16];
+	uint32_t u32Bytes, u32Cs;
+	uint8_t i;
+
+	printf("%-10s | %9s %9s | %9s\n", "command", "SPI bytes", "CS cycles", "us");
+
+	Rc522_Mark();
+	if (TM_MFRC522_Request(PICC_REQIDL, u8Buf) != MI_OK) {
+		Rc522_Fail("REQA not answered");
+	}
+	Rc522_Report("REQA", &u32Bytes, &u32Cs);
+
+	Rc522_Mark();
+	if (TM_MFRC522_Select(&uid) != MI_OK || uid.size != 4 || memcmp(uid.uidByte, u8CardUid, 4)) {
+		Rc522_Fail("SELECT failed");
+	}
+	Rc522_Report("SELECT", &u32Bytes, &u32Cs);
+
+	Rc522_Mark();
+	if (TM_MFRC522_Auth(PICC_AUTHENT1A, 7, u8KeyA, uid.uidByte) != MI_OK) {
+		Rc522_Fail("authentication failed");
+	}
+	Rc522_Report("AUTH", &u32Bytes, &u32Cs);
+
+	Rc522_Mark();
+	if (TM_MFRC522_Read(4, u8Buf) != MI_OK || memcmp(u8Buf, SimRc522_GetCard(0)->u8Block[4], 16)) {
+		Rc522_Fail("block read failed");
+	}
+	Rc522_Report("READ", &u32Bytes, &u32Cs);
+
+	for (i = 0; i < sizeof(u8Data); i++) {
+		u8Data[i] = (uint8_t)(0x3C + i);
+	}
+	Rc522_Mark();
+	if (TM_MFRC522_Write(5, u8Data) != MI_OK || memcmp(SimRc522_GetCard(0)->u8Block[5], u8Data, 16)) {
+		Rc522_Fail("block write failed");
+	}
+	Rc522_Report("WRITE", &u32Bytes, &u32Cs);
+
+	Rc522_Mark();
+	TM_MFRC522_Halt();
+	TM_MFRC522_ClearBitMask(MFRC522_REG_STATUS2, 0x08);
+	Rc522_Report("HLTA", &u32Bytes, &u32Cs);
+	if (TM_MFRC522_Request(PICC_REQIDL, u8Buf) == MI_OK) {
+		Rc522_Fail("halted card answers REQA");
+	}
+}
+
+/* Check in a loop for RC522_POLL_NS, returns the CPU idle fraction */
+static double Rc522_PollPhase(const char *pszName, uint32_t *pu32Checks, uint32_t *pu32Found)
+{
+	SimRc522_Stats_t s;
+	uint8_t u8Id[MFRC522_MAX_LEN];
+	uint64_t u64Ns;
+	double dIdle;
+
+	*pu32Checks = 0;
+	*pu32Found = 0;
+	Rc522_Mark();
+	do {
+		if (TM_MFRC522_Check(u8Id) == MI_OK) {
+			++*pu32Found;
+		}
+		++*pu32Checks;
+	} while (SimClock_Now() - u64T0 < RC522_POLL_NS);
+	u64Ns = SimClock_Now() - u64T0;
+	SimRc522_GetStats(&s);
+	dIdle = (double)(s.u64IdleNs - S0.u64IdleNs) / u64Ns;
+	printf("%-10s | %6lu %5lu | %5.1f%% %6lu %9.0f\n", pszName, (unsigned long)*pu32Checks, (unsigned long)*pu32Found,
+		dIdle * 100, (unsigned long)(s.u32Irqs - S0.u32Irqs), (s.u64SpiBytes - S0.u64SpiBytes) / (u64Ns / 1e9));
+	return dIdle;
+}
+
+static void Rc522_Polling(void)
+{
+	SimRc522_Card_t Card;
+	uint32_t u32Checks, u32Found;
+	double dIdle;
+
+	printf("%-10s | %6s %5s | %6s %6s %9s\n", "field", "checks", "found", "idle", "IRQs", "SPI B/s");
+	SimRc522_RemoveCards();
+	dIdle = Rc522_PollPhase("empty", &u32Checks, &u32Found);
+	if (u32Found) {
+		Rc522_Fail("polling: %lu cards found in an empty field", (unsigned long)u32Found);
+	}
+	//HLTA does not halt a card that was never selected, every check after power-up finds it
+	SimRc522_MakeCard(&Card, u8CardUid, sizeof(u8CardUid));
+	Card.u64InNs = SimClock_Now();
+	SimRc522_AddCard(&Card);
+	dIdle += Rc522_PollPhase("card", &u32Checks, &u32Found);
+	if (u32Found + 1 < u32Checks) {
+		Rc522_Fail("polling: card found by %lu of %lu checks", (unsigned long)u32Found, (unsigned long)u32Checks);
+	}
+#if MFRC522_USE_IRQ
+	if (dIdle / 2 < 0.9) {
+		Rc522_Fail("polling: CPU idle %.1f%% of the time, the IRQ should leave it asleep", dIdle * 50);
+	}
+#else
+	if (dIdle != 0) {
+		Rc522_Fail("polling: CPU idle without MFRC522_USE_IRQ");
+	}
+#endif
+}
+
+int main(void)
+{
+	SimRc522_Config_t Config;
+	SimRc522_Card_t Card;
+	SimRc522_Stats_t s;
+
+	SimClock_Reset();
+	SimRc522_DefaultConfig(&Config);
+	SimRc522_Open(&Config);
+	SimRc522_MakeCard(&Card, u8CardUid, sizeof(u8CardUid));
+	SimRc522_AddCard(&Card);
+
+	TM_MFRC522_Init();
+	if (TM_MFRC522_ReadRegister(MFRC522_REG_VERSION) != 0x92) {
+		fprintf(stderr, "reader not found\n");
+		return 1;
+	}
+	printf("SPI2 at %lu Hz, MFRC522_USE_IRQ %d\n", (unsigned long)Config.u32SpiHz, MFRC522_USE_IRQ);
+	Rc522_Burst();
+	//The card powers up in the field before it answers
+	SimClock_Advance(5000000);
+	Rc522_Transactions();
+	Rc522_Polling();
+
+	SimRc522_GetStats(&s);
+	if (s.u32Errors) {
+		Rc522_Fail("%lu bytes sent with CS high or FIFO overflows", (unsigned long)s.u32Errors);
+	}
+	if (iFailed) {
+		fprintf(stderr, "%d failures\n", iFailed);
+	}
+	return iFailed != 0;
+}
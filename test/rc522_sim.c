@@ -0,0 +1,1041 @@
+#include "rc522_sim.h"
+#include "sim_clock.h"
+#include "sim_gpio.h"
+#include "mfrc522.h"
+#include "spi.h"
+#include <string.h>
+
+#define RC522_FC_HZ				13560000ULL
+#define RC522_ETU_NS			9440		/* 128 / fc, one bit at 106 kbit/s */
+#define RC522_CRC_BYTE_NS		590			/* CRC coprocessor, 8 clocks per byte */
+#define RC522_FIFO_SIZE			64
+#define RC522_EVENTS			4
+#define RC522_FRAME_MAX			24			/* READ answer with its CRC_A, and some */
+
+/* CommIrqReg, DivIrqReg */
+#define IRQ_SET					0x80
+#define IRQ_TX					0x40
+#define IRQ_RX					0x20
+#define IRQ_IDLE				0x10
+#define IRQ_ERR					0x02
+#define IRQ_TIMER				0x01
+#define DIV_IRQ_CRC				0x04
+
+/* ErrorReg */
+#define ERR_BUFFER_OVFL			0x10
+#define ERR_COLL				0x08
+#define ERR_CRC					0x04
+
+#define CMD_POWER_DOWN			0x10
+#define CMD_RCV_OFF				0x20
+#define STATUS2_CRYPTO1_ON		0x08
+#define COLL_VALUES_AFTER		0x80
+#define COLL_POS_NOT_VALID		0x20
+
+#define PICC_NO_SECTOR			0xFF
+#define PICC_ACK				0x0A
+#define PICC_NAK				0x04
+
+typedef enum {
+	EV_TX_DONE = 0,
+	EV_COLL,							/* First collided bit received */
+	EV_RX_DONE,
+	EV_TIMER,
+	EV_AUTH_DONE,
+	EV_CRC_DONE
+} Rc522_Event_t;
+
+typedef struct {
+	uint64_t u64At;
+	Rc522_Event_t Type;
+} Rc522_Pending_t;
+
+typedef enum {
+	RC522_RUNNING = 0,
+	RC522_POWER_DOWN,
+	RC522_WAKING						/* Oscillator starting */
+} Rc522_Power_t;
+
+typedef enum {
+	CARD_OFF = 0,
+	CARD_IDLE,
+	CARD_READY,
+	CARD_ACTIVE,
+	CARD_HALT
+} Picc_State_t;
+
+typedef struct {
+	SimRc522_Card_t Card;
+	uint8_t u8Used;
+	Picc_State_t State;
+	uint8_t u8Halted;					/* Woken from HALT, an error sends it back there */
+	uint8_t u8Level;					/* Cascade level while READY */
+	uint8_t u8AuthSector;
+	int16_t i16WriteBlock;				/* WRITE acknowledged, the data frame comes next */
+} Picc_t;
+
+static SimRc522_Config_t Config;
+static SimRc522_Stats_t Stats;
+static uint64_t u64ByteNs;
+
+static uint8_t u8Reg[64];
+static uint8_t u8Fifo[RC522_FIFO_SIZE];
+static uint8_t u8FifoLen;
+
+static uint8_t u8Selected;
+static uint8_t u8First;					/* Next byte is an address */
+static uint8_t u8Addr;
+static uint8_t u8Read;
+
+static uint8_t u8IrqLine = 1;
+static uint8_t u8Exti;
+static Rc522_Power_t Power;
+static uint64_t u64OscAt;
+static uint64_t u64FieldSince = SIM_RC522_NEVER;	/* Antenna on, cards power up from here */
+static uint64_t u64FieldFrom;			/* Start of the field time not yet in Stats */
+static uint64_t u64AwakeFrom;
+
+static Rc522_Pending_t Events[RC522_EVENTS];
+static uint8_t u8Events;
+
+/* Reception waiting for EV_RX_DONE */
+static uint8_t u8Rx[RC522_FRAME_MAX];
+static uint16_t u16RxBits;
+static uint16_t u16RxColl;				/* Index of the first collided bit, u16RxBits if none */
+static uint16_t u16CrcResult;
+static int iAuthPicc;
+static uint8_t u8AuthSector;
+
+static Picc_t Piccs[SIM_RC522_MAX_CARDS];
+static void (*pfWfiHook)(void);
+
+static uint8_t Bit_Get(const uint8_t *p, uint16_t i)
+{
+	return (p[i >> 3] >> (i & 7)) & 1;
+}
+
+static void Bit_Put(uint8_t *p, uint16_t i, uint8_t u8Bit)
+{
+	if (u8Bit) {
+		p[i >> 3] |= 1 << (i & 7);
+	} else {
+		p[i >> 3] &= ~(1 << (i & 7));
+	}
+}
+
+uint16_t SimRc522_CrcA(const uint8_t *pData, uint32_t u32Len, uint16_t u16Preset)
+{
+	uint16_t crc = u16Preset;
+	uint8_t i;
+
+	while (u32Len--) {
+		crc ^= *pData++;
+		for (i = 0; i < 8; i++) {
+			crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+		}
+	}
+	return crc;
+}
+
+/* ModeReg CRCPreset */
+static uint16_t Rc522_CrcPreset(void)
+{
+	static const uint16_t u16Preset[4] = {0x0000, 0x6363, 0xA671, 0xFFFF};
+
+	return u16Preset[u8Reg[MFRC522_REG_MODE] & 0x03];
+}
+
+static uint8_t Crc_Ok(const uint8_t *p, uint16_t u16Len)
+{
+	uint16_t crc;
+
+	if (u16Len < 3) {
+		return 0;
+	}
+	crc = SimRc522_CrcA(p, u16Len - 2, 0x6363);
+	return p[u16Len - 2] == (uint8_t)crc && p[u16Len - 1] == (uint8_t)(crc >> 8);
+}
+
+/* SOF, the bits with a parity bit per byte, EOF */
+static uint64_t Frame_Ns(uint16_t u16Bits)
+{
+	return (uint64_t)(u16Bits + u16Bits / 8 + 2) * RC522_ETU_NS;
+}
+
+static void Events_Clear(void)
+{
+	u8Events = 0;
+}
+
+static void Events_Add(uint64_t u64At, Rc522_Event_t Type)
+{
+	uint8_t i;
+
+	if (u8Events == RC522_EVENTS) {
+		return;
+	}
+	for (i = u8Events; i > 0 && Events[i - 1].u64At > u64At; i--) {
+		Events[i] = Events[i - 1];
+	}
+	Events[i].u64At = u64At;
+	Events[i].Type = Type;
+	++u8Events;
+}
+
+static void Irq_Update(void)
+{
+	uint8_t u8Active = (u8Reg[MFRC522_REG_COMM_IRQ] & u8Reg[MFRC522_REG_COMM_IE_N] & 0x7F)
+		|| (u8Reg[MFRC522_REG_DIV_IRQ] & u8Reg[MFRC522_REG_DIV1_EN] & 0x14);
+	//IRqInv: active low. An open drain line is pulled up by the input
+	uint8_t u8Level = (u8Reg[MFRC522_REG_COMM_IE_N] & 0x80) ? !u8Active : u8Active;
+
+	SimGpio_SetInput(MFRC522_IRQ_PORT, MFRC522_IRQ_PIN, u8Level);
+	if (u8IrqLine && !u8Level) {
+		++Stats.u32Irqs;
+		u8IrqLine = 0;
+		if (u8Exti) {
+			TM_MFRC522_IRQHandler();
+		}
+	}
+	u8IrqLine = u8Level;
+}
+
+/* Cards */
+
+static uint8_t Picc_LastLevel(const Picc_t *p)
+{
+	return (p->Card.u8UidLen == 4) ? 0 : (p->Card.u8UidLen == 7) ? 1 : 2;
+}
+
+/* The 5 bytes of a cascade level: UID bytes or CT and three of them, BCC */
+static void Picc_Level(const Picc_t *p, uint8_t u8Level, uint8_t *pData)
+{
+	const uint8_t *pUid = p->Card.u8Uid;
+
+	if (u8Level == Picc_LastLevel(p)) {
+		memcpy(pData, &pUid[3 * u8Level], 4);
+	} else {
+		pData[0] = PICC_CASCADE_TAG;
+		memcpy(&pData[1], &pUid[3 * u8Level], 3);
+	}
+	pData[4] = pData[0] ^ pData[1] ^ pData[2] ^ pData[3];
+}
+
+/* Error or a command not valid in the state: back to IDLE, or HALT once woken from it */
+static void Picc_Drop(Picc_t *p)
+{
+	p->u8AuthSector = PICC_NO_SECTOR;
+	p->i16WriteBlock = -1;
+	if (p->State != CARD_OFF) {
+		p->State = p->u8Halted ? CARD_HALT : CARD_IDLE;
+	}
+}
+
+static void Picc_Off(Picc_t *p)
+{
+	p->State = CARD_OFF;
+	p->u8Halted = 0;
+	p->u8AuthSector = PICC_NO_SECTOR;
+	p->i16WriteBlock = -1;
+}
+
+/* In the field and powered long enough at u64T */
+static uint8_t Picc_Powered(Picc_t *p, uint64_t u64T)
+{
+	uint64_t u64From;
+
+	if (!p->u8Used) {
+		return 0;
+	}
+	u64From = (p->Card.u64InNs > u64FieldSince) ? p->Card.u64InNs : u64FieldSince;
+	if (u64FieldSince == SIM_RC522_NEVER || u64T < p->Card.u64InNs || u64T >= p->Card.u64OutNs
+		|| u64T < u64From + (uint64_t)Config.u32PowerUpUs * 1000) {
+		Picc_Off(p);
+		return 0;
+	}
+	if (p->State == CARD_OFF) {
+		p->State = CARD_IDLE;
+	}
+	return 1;
+}
+
+static uint8_t Picc_Select(Picc_t *p, const uint8_t *pTx, uint16_t u16Bits, uint8_t *pResp, uint16_t *pu16Bits)
+{
+	uint8_t u8Data[5];
+	uint8_t u8Nvb, u8Known, i;
+	uint16_t crc;
+
+	if (u16Bits < 16 || pTx[0] != PICC_SEL_CL1 + 2 * p->u8Level) {
+		Picc_Drop(p);
+		return 0;
+	}
+	Picc_Level(p, p->u8Level, u8Data);
+	u8Nvb = pTx[1];
+
+	if (u8Nvb == 0x70) {
+		if (u16Bits != 72 || !Crc_Ok(pTx, 9) || memcmp(&pTx[2], u8Data, 5)) {
+			Picc_Drop(p);
+			return 0;
+		}
+		if (p->u8Level < Picc_LastLevel(p)) {
+			++p->u8Level;
+			pResp[0] = 0x04;			/* UID not complete */
+		} else {
+			p->State = CARD_ACTIVE;
+			pResp[0] = p->Card.u8Sak;
+		}
+		crc = SimRc522_CrcA(pResp, 1, 0x6363);
+		pResp[1] = (uint8_t)crc;
+		pResp[2] = (uint8_t)(crc >> 8);
+		*pu16Bits = 24;
+		return 1;
+	}
+
+	//ANTICOLLISION: answer with the rest of the level if the known bits match
+	u8Known = ((u8Nvb >> 4) - 2) * 8 + (u8Nvb & 0x07);
+	if ((u8Nvb >> 4) < 2 || u8Known >= 40 || u16Bits != 16 + u8Known) {
+		Picc_Drop(p);
+		return 0;
+	}
+	for (i = 0; i < u8Known; i++) {
+		if (Bit_Get(&pTx[2], i) != Bit_Get(u8Data, i)) {
+			return 0;
+		}
+	}
+	memset(pResp, 0, 5);
+	for (i = u8Known; i < 40; i++) {
+		Bit_Put(pResp, i - u8Known, Bit_Get(u8Data, i));
+	}
+	*pu16Bits = 40 - u8Known;
+	return 1;
+}
+
+static uint8_t Picc_Nak(Picc_t *p, uint8_t *pResp, uint16_t *pu16Bits)
+{
+	Picc_Drop(p);
+	pResp[0] = PICC_NAK;
+	*pu16Bits = 4;
+	return 1;
+}
+
+static uint8_t Picc_Active(Picc_t *p, const uint8_t *pTx, uint16_t u16Bits, uint8_t *pResp, uint16_t *pu16Bits,
+	uint64_t *pu64DelayNs)
+{
+	uint8_t u8Block;
+	uint16_t crc;
+
+	if (p->i16WriteBlock >= 0) {
+		u8Block = (uint8_t)p->i16WriteBlock;
+		p->i16WriteBlock = -1;
+		if (u16Bits != 18 * 8 || !Crc_Ok(pTx, 18)) {
+			return Picc_Nak(p, pResp, pu16Bits);
+		}
+		memcpy(p->Card.u8Block[u8Block], pTx, 16);
+		pResp[0] = PICC_ACK;
+		*pu16Bits = 4;
+		*pu64DelayNs = (uint64_t)Config.u32WriteUs * 1000;
+		return 1;
+	}
+	if (u16Bits != 32 || !Crc_Ok(pTx, 4)) {
+		Picc_Drop(p);
+		return 0;
+	}
+
+	u8Block = pTx[1];
+	switch (pTx[0]) {
+		case PICC_HALT:
+			p->State = CARD_HALT;
+			p->u8Halted = 1;
+			p->u8AuthSector = PICC_NO_SECTOR;
+			return 0;
+		case PICC_READ:
+			if (u8Block >= SIM_RC522_BLOCKS || p->u8AuthSector != u8Block / 4) {
+				return Picc_Nak(p, pResp, pu16Bits);
+			}
+			memcpy(pResp, p->Card.u8Block[u8Block], 16);
+			crc = SimRc522_CrcA(pResp, 16, 0x6363);
+			pResp[16] = (uint8_t)crc;
+			pResp[17] = (uint8_t)(crc >> 8);
+			*pu16Bits = 18 * 8;
+			return 1;
+		case PICC_WRITE:
+			//Block 0 is read only
+			if (u8Block == 0 || u8Block >= SIM_RC522_BLOCKS || p->u8AuthSector != u8Block / 4) {
+				return Picc_Nak(p, pResp, pu16Bits);
+			}
+			p->i16WriteBlock = u8Block;
+			pResp[0] = PICC_ACK;
+			*pu16Bits = 4;
+			return 1;
+		default:
+			Picc_Drop(p);
+			return 0;
+	}
+}
+
+/* A reader frame, returns 1 with the answer of the card */
+static uint8_t Picc_Frame(Picc_t *p, const uint8_t *pTx, uint16_t u16Bits, uint8_t u8Crypto, uint8_t *pResp,
+	uint16_t *pu16Bits, uint64_t *pu64DelayNs)
+{
+	uint8_t u8Cmd = pTx[0] & 0x7F;
+
+	//Plain frames to a card in a Crypto1 session, or the other way round, are garbage to it
+	if ((p->u8AuthSector != PICC_NO_SECTOR) != u8Crypto) {
+		Picc_Drop(p);
+		return 0;
+	}
+
+	if (u16Bits == 7) {
+		if ((u8Cmd == PICC_REQIDL && p->State == CARD_IDLE)
+			|| (u8Cmd == PICC_REQALL && (p->State == CARD_IDLE || p->State == CARD_HALT))) {
+			p->u8Halted = (p->State == CARD_HALT);
+			p->State = CARD_READY;
+			p->u8Level = 0;
+			pResp[0] = (uint8_t)p->Card.u16Atqa;
+			pResp[1] = (uint8_t)(p->Card.u16Atqa >> 8);
+			*pu16Bits = 16;
+			return 1;
+		}
+		if (p->State == CARD_READY || p->State == CARD_ACTIVE) {
+			Picc_Drop(p);
+		}
+		return 0;
+	}
+
+	switch (p->State) {
+		case CARD_READY:
+			return Picc_Select(p, pTx, u16Bits, pResp, pu16Bits);
+		case CARD_ACTIVE:
+			return Picc_Active(p, pTx, u16Bits, pResp, pu16Bits, pu64DelayNs);
+		default:
+			return 0;
+	}
+}
+
+/* Reader */
+
+static uint64_t Timer_Ns(void)
+{
+	uint32_t u32Prescaler = ((uint32_t)(u8Reg[MFRC522_REG_T_MODE] & 0x0F) << 8) | u8Reg[MFRC522_REG_T_PRESCALER];
+	uint32_t u32Reload = ((uint32_t)u8Reg[MFRC522_REG_T_RELOAD_H] << 8) | u8Reg[MFRC522_REG_T_RELOAD_L];
+
+	return (uint64_t)(2 * u32Prescaler + 1) * (u32Reload + 1) * 1000000000ULL / RC522_FC_HZ;
+}
+
+/* TAuto: the timer starts at the end of the frame sent, only an answer stops it */
+static void Timer_Start(uint64_t u64At)
+{
+	if (u8Reg[MFRC522_REG_T_MODE] & 0x80) {
+		Events_Add(u64At + Timer_Ns(), EV_TIMER);
+	}
+}
+
+static void Field_Update(uint64_t u64T)
+{
+	uint8_t u8On = (u8Reg[MFRC522_REG_TX_CONTROL] & 0x03) && Power == RC522_RUNNING;
+	uint8_t i;
+
+	if (u8On && u64FieldSince == SIM_RC522_NEVER) {
+		u64FieldSince = u64T;
+		u64FieldFrom = u64T;
+	} else if (!u8On && u64FieldSince != SIM_RC522_NEVER) {
+		Stats.u64FieldNs += u64T - u64FieldFrom;
+		u64FieldSince = SIM_RC522_NEVER;
+		//No field, no power: the cards forget their state
+		for (i = 0; i < SIM_RC522_MAX_CARDS; i++) {
+			Picc_Off(&Piccs[i]);
+		}
+	}
+}
+
+static void Fifo_Push(uint8_t u8Data)
+{
+	if (u8FifoLen == RC522_FIFO_SIZE) {
+		u8Reg[MFRC522_REG_ERROR] |= ERR_BUFFER_OVFL;
+		++Stats.u32Errors;
+		return;
+	}
+	u8Fifo[u8FifoLen++] = u8Data;
+}
+
+static uint8_t Fifo_Pop(void)
+{
+	uint8_t u8Data;
+
+	if (!u8FifoLen) {
+		return 0;
+	}
+	u8Data = u8Fifo[0];
+	memmove(u8Fifo, &u8Fifo[1], --u8FifoLen);
+	return u8Data;
+}
+
+static void Reader_Reset(void)
+{
+	memset(u8Reg, 0, sizeof(u8Reg));
+	u8Reg[MFRC522_REG_COMMAND] = CMD_RCV_OFF;
+	u8Reg[MFRC522_REG_COMM_IE_N] = 0x80;
+	u8Reg[MFRC522_REG_COMM_IRQ] = 0x14;
+	u8Reg[MFRC522_REG_STATUS1] = 0x21;
+	u8Reg[MFRC522_REG_WATER_LEVEL] = 0x08;
+	u8Reg[MFRC522_REG_CONTROL] = 0x10;
+	u8Reg[MFRC522_REG_COLL] = COLL_VALUES_AFTER | COLL_POS_NOT_VALID;
+	u8Reg[MFRC522_REG_MODE] = 0x3F;
+	u8Reg[MFRC522_REG_TX_CONTROL] = 0x80;
+	u8Reg[MFRC522_REG_TX_SELL] = 0x10;
+	u8Reg[MFRC522_REG_RX_SELL] = 0x84;
+	u8Reg[MFRC522_REG_RX_THRESHOLD] = 0x84;
+	u8Reg[MFRC522_REG_DEMOD] = 0x4D;
+	u8Reg[MFRC522_REG_MIFARE] = 0x62;
+	u8Reg[MFRC522_REG_SERIALSPEED] = 0xEB;
+	u8Reg[MFRC522_REG_CRC_RESULT_M] = 0xFF;
+	u8Reg[MFRC522_REG_CRC_RESULT_L] = 0xFF;
+	u8Reg[MFRC522_REG_MOD_WIDTH] = 0x26;
+	u8Reg[MFRC522_REG_RF_CFG] = 0x48;
+	u8Reg[MFRC522_REG_GS_N] = 0x88;
+	u8Reg[MFRC522_REG_CWGS_PREG] = 0x20;
+	u8Reg[MFRC522_REG__MODGS_PREG] = 0x20;
+	u8Reg[MFRC522_REG_VERSION] = 0x92;
+	u8FifoLen = 0;
+	Events_Clear();
+	Field_Update(SimClock_Now());
+	Irq_Update();
+}
+
+/* StartSend with Transceive: the FIFO goes out, the cards answer */
+static void Rc522_Transceive(void)
+{
+	uint8_t u8Tx[RC522_FIFO_SIZE + 2];
+	uint8_t u8Resp[RC522_FRAME_MAX];
+	uint8_t u8TxLast = u8Reg[MFRC522_REG_BIT_FRAMING] & 0x07;
+	uint8_t u8Crypto = (u8Reg[MFRC522_REG_STATUS2] & STATUS2_CRYPTO1_ON) != 0;
+	uint8_t u8Len = u8FifoLen, u8Answers = 0, i;
+	uint16_t u16Bits, u16RespBits, j;
+	uint64_t u64TxEnd, u64RxStart, u64DelayNs = 0, u64Delay;
+	uint16_t crc;
+
+	memcpy(u8Tx, u8Fifo, u8Len);
+	u8FifoLen = 0;
+	if (!u8Len) {
+		return;
+	}
+	u16Bits = u8TxLast ? (u8Len - 1) * 8 + u8TxLast : u8Len * 8;
+	if ((u8Reg[MFRC522_REG_TX_MODE] & 0x80) && !u8TxLast) {
+		crc = SimRc522_CrcA(u8Tx, u8Len, Rc522_CrcPreset());
+		u8Tx[u8Len++] = (uint8_t)crc;
+		u8Tx[u8Len++] = (uint8_t)(crc >> 8);
+		u16Bits += 16;
+	}
+	u8Reg[MFRC522_REG_ERROR] = 0;
+	++Stats.u32Frames;
+	u64TxEnd = SimClock_Now() + Frame_Ns(u16Bits);
+	Events_Add(u64TxEnd, EV_TX_DONE);
+
+	//Answers merged bit by bit, the first bit that differs is the collision
+	u16RxBits = 0;
+	u16RxColl = 0xFFFF;
+	memset(u8Rx, 0, sizeof(u8Rx));
+	for (i = 0; i < SIM_RC522_MAX_CARDS; i++) {
+		u64Delay = 0;
+		if (!Picc_Powered(&Piccs[i], u64TxEnd)
+			|| !Picc_Frame(&Piccs[i], u8Tx, u16Bits, u8Crypto, u8Resp, &u16RespBits, &u64Delay)) {
+			continue;
+		}
+		if (!u8Answers++) {
+			memcpy(u8Rx, u8Resp, (u16RespBits + 7) / 8);
+			u16RxBits = u16RespBits;
+			u64DelayNs = u64Delay;
+			continue;
+		}
+		for (j = 0; j < u16RxBits || j < u16RespBits; j++) {
+			if (j >= u16RxBits || j >= u16RespBits || Bit_Get(u8Rx, j) != Bit_Get(u8Resp, j)) {
+				if (j < u16RxColl) {
+					u16RxColl = j;
+				}
+				break;
+			}
+		}
+		if (u16RespBits > u16RxBits) {
+			u16RxBits = u16RespBits;
+		}
+		//ValuesAfterColl = 1 keeps what the field looks like, both answers at once
+		for (j = 0; j < (u16RespBits + 7) / 8; j++) {
+			u8Rx[j] |= u8Resp[j];
+		}
+	}
+
+	if (!u8Answers) {
+		Timer_Start(u64TxEnd);
+		return;
+	}
+	if (u16RxColl > u16RxBits) {
+		u16RxColl = u16RxBits;
+	}
+	if (u16RxColl < u16RxBits && !(u8Reg[MFRC522_REG_COLL] & COLL_VALUES_AFTER)) {
+		for (j = u16RxColl; j < u16RxBits; j++) {
+			Bit_Put(u8Rx, j, 0);
+		}
+	}
+	u64RxStart = u64TxEnd + Config.u32FdtNs + u64DelayNs;
+	if (u16RxColl < u16RxBits) {
+		Events_Add(u64RxStart + (uint64_t)(u16RxColl + 1) * RC522_ETU_NS, EV_COLL);
+	}
+	Events_Add(u64RxStart + Frame_Ns(u16RxBits), EV_RX_DONE);
+}
+
+/* Received frame to the FIFO at RxAlign, the CRC_A checked and dropped with RxCRCEn */
+static void Rc522_Received(void)
+{
+	uint8_t u8Align = (u8Reg[MFRC522_REG_BIT_FRAMING] >> 4) & 0x07;
+	uint8_t u8Out[RC522_FRAME_MAX + 1];
+	uint16_t u16Bits = u16RxBits, u16Total, u16Pos, j;
+
+	if ((u8Reg[MFRC522_REG_RX_MODE] & 0x80) && u16Bits >= 24 && !(u16Bits & 7)) {
+		if (!Crc_Ok(u8Rx, u16Bits / 8)) {
+			u8Reg[MFRC522_REG_ERROR] |= ERR_CRC;
+		}
+		u16Bits -= 16;
+	}
+	memset(u8Out, 0, sizeof(u8Out));
+	for (j = 0; j < u16Bits; j++) {
+		Bit_Put(u8Out, u8Align + j, Bit_Get(u8Rx, j));
+	}
+	u16Total = u8Align + u16Bits;
+	for (j = 0; j < (u16Total + 7) / 8; j++) {
+		Fifo_Push(u8Out[j]);
+	}
+	u8Reg[MFRC522_REG_CONTROL] = (u8Reg[MFRC522_REG_CONTROL] & ~0x07) | (u16Total & 0x07);
+
+	u8Reg[MFRC522_REG_COLL] &= COLL_VALUES_AFTER;
+	if (u16RxColl < u16RxBits) {
+		u16Pos = u8Align + u16RxColl + 1;
+		u8Reg[MFRC522_REG_COLL] |= (u16Pos > 32) ? COLL_POS_NOT_VALID : (u16Pos & 0x1F);
+	} else {
+		u8Reg[MFRC522_REG_COLL] |= COLL_POS_NOT_VALID;
+	}
+	u8Reg[MFRC522_REG_COMM_IRQ] |= IRQ_RX;
+	if (u8Reg[MFRC522_REG_ERROR] & 0x1F) {
+		u8Reg[MFRC522_REG_COMM_IRQ] |= IRQ_ERR;
+	}
+}
+
+/* MFAuthent: the FIFO holds the command, block, key and the 4 UID bytes */
+static void Rc522_Authent(void)
+{
+	const uint8_t *pKey;
+	Picc_t *p;
+	uint8_t u8Cmd[RC522_FIFO_SIZE];
+	uint8_t u8Len = u8FifoLen, u8Sector;
+	uint64_t u64T, u64Exchange;
+	int i;
+
+	memcpy(u8Cmd, u8Fifo, u8Len);
+	u8FifoLen = 0;
+	u8Reg[MFRC522_REG_ERROR] = 0;
+	++Stats.u32Frames;
+	if (u8Len < 12) {
+		return;
+	}
+	u8Sector = u8Cmd[1] / 4;
+
+	//AUTH command, then the card nonce
+	u64T = SimClock_Now() + Frame_Ns(32);
+	u64Exchange = Config.u32FdtNs + Frame_Ns(32);
+	iAuthPicc = -1;
+	for (i = 0; i < SIM_RC522_MAX_CARDS; i++) {
+		p = &Piccs[i];
+		if (Picc_Powered(p, u64T) && p->State == CARD_ACTIVE && p->i16WriteBlock < 0
+			&& ((p->u8AuthSector != PICC_NO_SECTOR) == ((u8Reg[MFRC522_REG_STATUS2] & STATUS2_CRYPTO1_ON) != 0))) {
+			iAuthPicc = i;
+			break;
+		}
+	}
+	if (iAuthPicc < 0 || u8Cmd[1] >= SIM_RC522_BLOCKS || (u8Cmd[0] != PICC_AUTHENT1A && u8Cmd[0] != PICC_AUTHENT1B)) {
+		Timer_Start(u64T);
+		return;
+	}
+
+	//Reader token, the card checks it with its key and answers only if it matches
+	u64T += u64Exchange + Config.u32FdtNs + Frame_Ns(64);
+	pKey = &p->Card.u8Block[u8Sector * 4 + 3][(u8Cmd[0] == PICC_AUTHENT1A) ? 0 : 10];
+	if (memcmp(&u8Cmd[2], pKey, 6) || memcmp(&u8Cmd[8], &p->Card.u8Uid[p->Card.u8UidLen - 4], 4)) {
+		Picc_Drop(p);
+		Timer_Start(u64T);
+		return;
+	}
+	u8AuthSector = u8Sector;
+	Events_Add(u64T + u64Exchange, EV_AUTH_DONE);
+}
+
+static void Rc522_CalcCrc(void)
+{
+	u16CrcResult = SimRc522_CrcA(u8Fifo, u8FifoLen, Rc522_CrcPreset());
+	Events_Add(SimClock_Now() + (uint64_t)(u8FifoLen + 1) * RC522_CRC_BYTE_NS, EV_CRC_DONE);
+	u8FifoLen = 0;
+}
+
+static void Rc522_Command(uint8_t u8Val)
+{
+	uint8_t u8Cmd = u8Val & 0x0F;
+	uint64_t u64Now = SimClock_Now();
+
+	if (u8Val & CMD_POWER_DOWN) {
+		//Soft power-down ends the running command, the registers stay
+		if (Power != RC522_POWER_DOWN) {
+			Stats.u64AwakeNs += u64Now - u64AwakeFrom;
+			Power = RC522_POWER_DOWN;
+			Events_Clear();
+			Field_Update(u64Now);
+		}
+		u8Reg[MFRC522_REG_COMMAND] = u8Val & CMD_RCV_OFF;
+		return;
+	}
+	if (Power == RC522_POWER_DOWN) {
+		Power = RC522_WAKING;
+		u64OscAt = u64Now + (uint64_t)Config.u32OscUs * 1000;
+		u64AwakeFrom = u64Now;
+	}
+	if (Power != RC522_RUNNING) {
+		u8Reg[MFRC522_REG_COMMAND] = u8Val & CMD_RCV_OFF;
+		return;
+	}
+
+	++Stats.u32Commands[u8Cmd];
+	Events_Clear();
+	u8Reg[MFRC522_REG_COMMAND] = u8Val & (CMD_RCV_OFF | 0x0F);
+	switch (u8Cmd) {
+		case PCD_RESETPHASE:
+			Reader_Reset();
+			break;
+		case PCD_CALCCRC:
+			Rc522_CalcCrc();
+			break;
+		case PCD_TRANSCEIVE:
+			if (u8Reg[MFRC522_REG_BIT_FRAMING] & 0x80) {
+				Rc522_Transceive();
+			}
+			break;
+		case PCD_AUTHENT:
+			Rc522_Authent();
+			break;
+		default:
+			break;
+	}
+}
+
+static void Rc522_Event(Rc522_Event_t Type)
+{
+	switch (Type) {
+		case EV_TX_DONE:
+			u8Reg[MFRC522_REG_COMM_IRQ] |= IRQ_TX;
+			break;
+		case EV_COLL:
+			u8Reg[MFRC522_REG_ERROR] |= ERR_COLL;
+			u8Reg[MFRC522_REG_COMM_IRQ] |= IRQ_ERR;
+			++Stats.u32Collisions;
+			break;
+		case EV_RX_DONE:
+			Rc522_Received();
+			break;
+		case EV_TIMER:
+			u8Reg[MFRC522_REG_COMM_IRQ] |= IRQ_TIMER;
+			++Stats.u32Timeouts;
+			break;
+		case EV_AUTH_DONE:
+			Piccs[iAuthPicc].u8AuthSector = u8AuthSector;
+			u8Reg[MFRC522_REG_STATUS2] |= STATUS2_CRYPTO1_ON;
+			u8Reg[MFRC522_REG_COMM_IRQ] |= IRQ_IDLE;
+			u8Reg[MFRC522_REG_COMMAND] &= ~0x0F;
+			break;
+		case EV_CRC_DONE:
+			u8Reg[MFRC522_REG_CRC_RESULT_L] = (uint8_t)u16CrcResult;
+			u8Reg[MFRC522_REG_CRC_RESULT_M] = (uint8_t)(u16CrcResult >> 8);
+			u8Reg[MFRC522_REG_DIV_IRQ] |= DIV_IRQ_CRC;
+			break;
+	}
+	Irq_Update();
+}
+
+void SimRc522_Run(void)
+{
+	uint64_t u64Now = SimClock_Now();
+	Rc522_Event_t Type;
+	uint8_t i;
+
+	if (Power == RC522_WAKING && u64Now >= u64OscAt) {
+		Power = RC522_RUNNING;
+		Field_Update(u64OscAt);
+	}
+	while (u8Events && Events[0].u64At <= u64Now) {
+		Type = Events[0].Type;
+		for (i = 1; i < u8Events; i++) {
+			Events[i - 1] = Events[i];
+		}
+		--u8Events;
+		Rc522_Event(Type);
+	}
+}
+
+static void Rc522_Write(uint8_t u8Addr, uint8_t u8Val)
+{
+	uint8_t u8Old = u8Reg[u8Addr];
+
+	switch (u8Addr) {
+		case MFRC522_REG_COMMAND:
+			Rc522_Command(u8Val);
+			break;
+		case MFRC522_REG_COMM_IRQ:
+		case MFRC522_REG_DIV_IRQ:
+			//Set1/Set2: the marked bits are set with bit 7, cleared without it
+			if (u8Val & IRQ_SET) {
+				u8Reg[u8Addr] |= u8Val & 0x7F;
+			} else {
+				u8Reg[u8Addr] &= ~u8Val;
+			}
+			Irq_Update();
+			break;
+		case MFRC522_REG_COMM_IE_N:
+		case MFRC522_REG_DIV1_EN:
+			u8Reg[u8Addr] = u8Val;
+			Irq_Update();
+			break;
+		case MFRC522_REG_FIFO_DATA:
+			Fifo_Push(u8Val);
+			break;
+		case MFRC522_REG_FIFO_LEVEL:
+			if (u8Val & 0x80) {
+				u8FifoLen = 0;
+				u8Reg[MFRC522_REG_ERROR] &= ~ERR_BUFFER_OVFL;
+			}
+			break;
+		case MFRC522_REG_BIT_FRAMING:
+			u8Reg[u8Addr] = u8Val;
+			if ((u8Val & 0x80) && !(u8Old & 0x80) && Power == RC522_RUNNING
+				&& (u8Reg[MFRC522_REG_COMMAND] & 0x0F) == PCD_TRANSCEIVE) {
+				Rc522_Transceive();
+			}
+			break;
+		case MFRC522_REG_TX_CONTROL:
+			u8Reg[u8Addr] = u8Val;
+			Field_Update(SimClock_Now());
+			break;
+		case MFRC522_REG_STATUS2:
+			u8Reg[u8Addr] = (u8Old & ~0xC8) | (u8Val & 0xC8);
+			break;
+		case MFRC522_REG_COLL:
+			u8Reg[u8Addr] = (u8Old & ~COLL_VALUES_AFTER) | (u8Val & COLL_VALUES_AFTER);
+			break;
+		case MFRC522_REG_ERROR:
+		case MFRC522_REG_STATUS1:
+		case MFRC522_REG_VERSION:
+		case MFRC522_REG_CRC_RESULT_M:
+		case MFRC522_REG_CRC_RESULT_L:
+			break;
+		case MFRC522_REG_CONTROL:
+			u8Reg[u8Addr] = (u8Old & 0x07) | (u8Val & ~0x07);
+			break;
+		default:
+			u8Reg[u8Addr] = u8Val;
+			break;
+	}
+}
+
+static uint8_t Rc522_Read(uint8_t u8Addr)
+{
+	switch (u8Addr) {
+		case MFRC522_REG_COMMAND:
+			//PowerDown reads 1 until the oscillator runs
+			return (u8Reg[u8Addr] & (CMD_RCV_OFF | 0x0F)) | (Power != RC522_RUNNING ? CMD_POWER_DOWN : 0);
+		case MFRC522_REG_FIFO_DATA:
+			return Fifo_Pop();
+		case MFRC522_REG_FIFO_LEVEL:
+			return u8FifoLen;
+		default:
+			return u8Reg[u8Addr];
+	}
+}
+
+/* CS on PB12, attached by SimRc522_Open */
+static void SimRc522_Cs(uint16_t u16Pin, uint8_t u8Level)
+{
+	if (!u8Level) {
+		u8Selected = 1;
+		u8First = 1;
+	} else if (u8Selected) {
+		u8Selected = 0;
+		++Stats.u32CsCycles;
+	}
+}
+
+void SimRc522_DefaultConfig(SimRc522_Config_t *pConfig)
+{
+	pConfig->u32SpiHz = 36000000 / 16;
+	pConfig->u32FdtNs = 86400;			/* 1172 / fc */
+	pConfig->u32WriteUs = 2500;
+	pConfig->u32PowerUpUs = 1500;
+	pConfig->u32OscUs = 500;
+}
+
+void SimRc522_Open(const SimRc522_Config_t *pConfig)
+{
+	Config = *pConfig;
+	u64ByteNs = 8000000000ULL / Config.u32SpiHz;
+	memset(Piccs, 0, sizeof(Piccs));
+	memset(&Stats, 0, sizeof(Stats));
+	u8Selected = 0;
+	u8Exti = 0;
+	u8IrqLine = 1;
+	Power = RC522_RUNNING;
+	u64AwakeFrom = SimClock_Now();
+	u64FieldSince = SIM_RC522_NEVER;
+	pfWfiHook = 0;
+	SimGpio_Attach(GPIOB, GPIO_Pin_12, SimRc522_Cs);
+	Reader_Reset();
+}
+
+void SimRc522_MakeCard(SimRc522_Card_t *pCard, const uint8_t *pUid, uint8_t u8UidLen)
+{
+	static const uint8_t u8Access[4] = {0xFF, 0x07, 0x80, 0x69};
+	uint8_t b, i;
+
+	memset(pCard, 0, sizeof(*pCard));
+	memcpy(pCard->u8Uid, pUid, u8UidLen);
+	pCard->u8UidLen = u8UidLen;
+	pCard->u8Sak = 0x08;
+	//ATQA bits 7..6: single, double or triple size UID
+	pCard->u16Atqa = 0x0004 | ((u8UidLen == 4) ? 0x00 : (u8UidLen == 7) ? 0x40 : 0x80);
+	pCard->u64InNs = 0;
+	pCard->u64OutNs = SIM_RC522_NEVER;
+	for (b = 0; b < SIM_RC522_BLOCKS; b++) {
+		if (b % 4 == 3) {
+			memset(pCard->u8Block[b], 0xFF, 16);
+			memcpy(&pCard->u8Block[b][6], u8Access, 4);
+		} else {
+			for (i = 0; i < 16; i++) {
+				pCard->u8Block[b][i] = (uint8_t)(b * 16 + i);
+			}
+		}
+	}
+	memcpy(pCard->u8Block[0], pUid, u8UidLen);
+}
+
+int SimRc522_AddCard(const SimRc522_Card_t *pCard)
+{
+	uint64_t u64Now = SimClock_Now();
+	int i;
+
+	for (i = 0; i < SIM_RC522_MAX_CARDS; i++) {
+		if (!Piccs[i].u8Used || Piccs[i].Card.u64OutNs <= u64Now) {
+			memset(&Piccs[i], 0, sizeof(Piccs[i]));
+			Piccs[i].Card = *pCard;
+			Piccs[i].u8Used = 1;
+			Picc_Off(&Piccs[i]);
+			return i;
+		}
+	}
+	return -1;
+}
+
+SimRc522_Card_t *SimRc522_GetCard(int iSlot)
+{
+	return &Piccs[iSlot].Card;
+}
+
+void SimRc522_RemoveCards(void)
+{
+	memset(Piccs, 0, sizeof(Piccs));
+}
+
+void SimRc522_GetStats(SimRc522_Stats_t *pStats)
+{
+	uint64_t u64Now = SimClock_Now();
+
+	SimRc522_Run();
+	*pStats = Stats;
+	if (u64FieldSince != SIM_RC522_NEVER) {
+		pStats->u64FieldNs += u64Now - u64FieldFrom;
+	}
+	if (Power != RC522_POWER_DOWN) {
+		pStats->u64AwakeNs += u64Now - u64AwakeFrom;
+	}
+}
+
+void SimRc522_ResetStats(void)
+{
+	uint64_t u64Now = SimClock_Now();
+
+	memset(&Stats, 0, sizeof(Stats));
+	u64FieldFrom = u64Now;
+	u64AwakeFrom = u64Now;
+}
+
+/* spi.h, the MFRC522 port. The SD card port is sd_emu.c */
+
+void TM_SPI_Init(void)
+{
+}
+
+void TM_MFRC522_InitPins(void)
+{
+	MFRC522_CS_HIGH;
+}
+
+void TM_MFRC522_InitIrqPin(void)
+{
+	u8Exti = 1;
+}
+
+uint8_t TM_SPI_Send(uint8_t data)
+{
+	uint8_t u8Out = 0;
+
+	SimClock_Advance(u64ByteNs);
+	SimRc522_Run();
+	if (!u8Selected) {
+		++Stats.u32Errors;
+		return 0xFF;
+	}
+	++Stats.u64SpiBytes;
+
+	if (u8First) {
+		u8First = 0;
+		u8Read = data & 0x80;
+		u8Addr = (data >> 1) & 0x3F;
+	} else if (u8Read) {
+		//The byte clocked in is the address of the next read
+		u8Out = Rc522_Read(u8Addr);
+		u8Addr = (data >> 1) & 0x3F;
+	} else {
+		Rc522_Write(u8Addr, data);
+	}
+	return u8Out;
+}
+
+/* Core sleep: up to the next reader event that raises the IRQ line, at most to the next SysTick */
+void __WFI(void)
+{
+	uint64_t u64Now, u64Tick, u64Next;
+	uint32_t u32Irqs = Stats.u32Irqs;
+
+	SimRc522_Run();
+	u64Now = SimClock_Now();
+	u64Tick = (u64Now / 1000000 + 1) * 1000000;
+	do {
+		u64Next = (u8Events && Events[0].u64At < u64Tick) ? Events[0].u64At : u64Tick;
+		if (Power == RC522_WAKING && u64OscAt > u64Now && u64OscAt < u64Next) {
+			u64Next = u64OscAt;
+		}
+		Stats.u64IdleNs += u64Next - u64Now;
+		SimClock_Advance(u64Next - u64Now);
+		SimRc522_Run();
+		u64Now = u64Next;
+	} while (Stats.u32Irqs == u32Irqs && u64Now < u64Tick);
+	if (pfWfiHook) {
+		pfWfiHook();
+	}
+}
+
+void SimRc522_SetWfiHook(void (*pfHook)(void))
+{
+	pfWfiHook = pfHook;
+}
@@ -0,0 +1,99 @@
+#ifndef RC522_SIM_H_
+#define RC522_SIM_H_
+
+#include <stdint.h>
+
+/*
+ * MFRC522 on SPI2 and MIFARE Classic 1K cards in its field
+ *
+ * mfrc522.c, mifare.c and card_poll.c run unchanged on the host: the
+ * MFRC522 half of spi.c is replaced by this file. The reader answers the
+ * register protocol on CS PB12 (a FIFO burst keeps the address, a burst
+ * read takes the next address from every byte), runs Transceive,
+ * MFAuthent, CalcCRC, SoftReset and soft power-down, and drives its IRQ
+ * line on PB1. A falling edge calls TM_MFRC522_IRQHandler once
+ * TM_MFRC522_InitIrqPin has set up EXTI1.
+ *
+ * Every SPI byte advances the virtual clock by its time at the SPI2 rate.
+ * RF frames take their ISO 14443A bit times at 106 kbit/s, a card answers
+ * after the frame delay time, and a command nobody answers ends with the
+ * reader timer as TModeReg, TPrescalerReg and TReloadReg set it up.
+ *
+ * The cards answer REQA/WUPA, the bit oriented anticollision of up to three
+ * cascade levels, SELECT, HLTA, READ and WRITE. Answers of several cards
+ * are merged bit by bit: the first bit that differs is a collision, with
+ * ValuesAfterColl = 0 it and the bits after it read 0, and CollPos counts
+ * from bit 0 of the first FIFO byte, RxAlign included. Frames with a bad
+ * CRC_A are ignored. Authentication checks the key against the sector
+ * trailer and sets MFCrypto1On, there is no Crypto1: the frames stay
+ * plain, but a card and the reader out of step on MFCrypto1On do not
+ * understand each other.
+ *
+ * __WFI is implemented here: the clock jumps to the next reader event or
+ * the next 1 ms SysTick, the time is counted as idle. A test running the
+ * main loop of the firmware gets control back through the WFI hook.
+ */
+
+#define SIM_RC522_MAX_CARDS			8
+#define SIM_RC522_BLOCKS			64		/* MIFARE Classic 1K */
+#define SIM_RC522_NEVER				UINT64_MAX
+
+typedef struct {
+	uint8_t u8Uid[10];
+	uint8_t u8UidLen;					/* 4, 7 or 10 */
+	uint8_t u8Sak;						/* SAK of the last cascade level */
+	uint16_t u16Atqa;
+	uint64_t u64InNs;					/* Enters the field, virtual time */
+	uint64_t u64OutNs;					/* Leaves it, SIM_RC522_NEVER to stay */
+	uint8_t u8Block[SIM_RC522_BLOCKS][16];	/* Trailers: key A, access bits, key B */
+} SimRc522_Card_t;
+
+typedef struct {
+	uint32_t u32SpiHz;					/* SCK rate, sets the time of every byte */
+	uint32_t u32FdtNs;					/* Card answer after the end of a reader frame */
+	uint32_t u32WriteUs;				/* EEPROM programming before the ACK of the WRITE data */
+	uint32_t u32PowerUpUs;				/* Card in the field with the antenna on before it answers */
+	uint32_t u32OscUs;					/* Oscillator start after soft power-down */
+} SimRc522_Config_t;
+
+typedef struct {
+	uint64_t u64SpiBytes;				/* Bytes exchanged with CS low */
+	uint32_t u32CsCycles;				/* CS low-high cycles, one per register access or burst */
+	uint32_t u32Irqs;					/* Falling edges of the IRQ line */
+	uint32_t u32Commands[16];			/* Commands started, by CommandReg code */
+	uint32_t u32Frames;					/* Frames sent to the cards */
+	uint32_t u32Timeouts;				/* Commands ended by the reader timer */
+	uint32_t u32Collisions;
+	uint32_t u32Errors;					/* Bytes with CS high, FIFO overflows */
+	uint64_t u64IdleNs;					/* Time in __WFI */
+	uint64_t u64FieldNs;				/* Time with the antenna on */
+	uint64_t u64AwakeNs;				/* Time out of soft power-down */
+} SimRc522_Stats_t;
+
+/* SPI2 at 36 MHz / 16, typical card timing */
+void SimRc522_DefaultConfig(SimRc522_Config_t *pConfig);
+
+/* Power the reader up with its reset values and an empty field */
+void SimRc522_Open(const SimRc522_Config_t *pConfig);
+
+/* 1K card: block 0 from the UID, transport keys FF..FF, data blocks filled with their number */
+void SimRc522_MakeCard(SimRc522_Card_t *pCard, const uint8_t *pUid, uint8_t u8UidLen);
+
+/* Put a card in the field, a slot of a card gone is reused. Returns the slot or -1 */
+int SimRc522_AddCard(const SimRc522_Card_t *pCard);
+SimRc522_Card_t *SimRc522_GetCard(int iSlot);
+void SimRc522_RemoveCards(void);
+
+/* Run the reader up to the virtual time, for callers that move the clock themselves */
+void SimRc522_Run(void);
+
+/* Called at the end of every __WFI, between two passes of the main loop; SimRc522_Open removes it */
+void SimRc522_SetWfiHook(void (*pfHook)(void));
+
+/* CRC_A bit by bit, the reference for the tables of the driver */
+uint16_t SimRc522_CrcA(const uint8_t *pData, uint32_t u32Len, uint16_t u16Preset);
+
+void SimRc522_GetStats(SimRc522_Stats_t *pStats);
+void SimRc522_ResetStats(void);
+
+#endif
@@ -0,0 +1,192 @@
+/*
+ * FatFs on the emulated card: f_write/f_read throughput and card commands
+ * for a range of file sizes. Times are virtual, from the SPI byte time and
+ * the card timing in SdEmu_Config_t, and can be changed on the command
+ * line, e.g. sd_bench spi_hz=18000000 write_us=1500 chunk=512
+ *
+ * Every file is read back and compared, the run fails on a mismatch, a
+ * FatFs error or a protocol error seen by the card.
+ */
+
+#include "sd_emu.h"
+#include "sim_clock.h"
+#include "ff.h"
+#include "diskio.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_CHUNK_MAX			32768
+
+static const uint32_t u32Sizes[] = {512, 4096, 32768, 262144, 1048576};
+
+static FATFS Fs;
+static FIL Fil;
+static BYTE u8Work[FF_MAX_SS];
+static BYTE u8Buf[BENCH_CHUNK_MAX];
+static BYTE u8Check[BENCH_CHUNK_MAX];
+
+static int Bench_Arg(const char *pszArg, const char *pszKey, uint32_t *pu32Value)
+{
+	size_t len = strlen(pszKey);
+
+	if (strncmp(pszArg, pszKey, len) || pszArg[len] != '=') {
+		return 0;
+	}
+	*pu32Value = strtoul(pszArg + len + 1, 0, 0);
+	return 1;
+}
+
+static void Bench_Fill(BYTE *p, uint32_t u32Pos, UINT n)
+{
+	while (n--) {
+		*p++ = (BYTE)(u32Pos * 7 + (u32Pos >> 9));
+		u32Pos++;
+	}
+}
+
+/* Throughput column, a file served from the sector cache takes no bus time */
+static const char *Bench_KBps(char *psz, uint32_t u32Bytes, uint64_t u64Ns)
+{
+	if (!u64Ns) {
+		return "cached";
+	}
+	sprintf(psz, "%.1f", u32Bytes / 1024.0 / (u64Ns / 1e9));
+	return psz;
+}
+
+static void Bench_Diff(SdEmu_Stats_t *pDiff, const SdEmu_Stats_t *pA, const SdEmu_Stats_t *pB)
+{
+	int i;
+
+	for (i = 0; i < 64; i++) {
+		pDiff->u32Cmd[i] = pB->u32Cmd[i] - pA->u32Cmd[i];
+		pDiff->u32Acmd[i] = pB->u32Acmd[i] - pA->u32Acmd[i];
+	}
+	pDiff->u32SectorsRead = pB->u32SectorsRead - pA->u32SectorsRead;
+	pDiff->u32SectorsWritten = pB->u32SectorsWritten - pA->u32SectorsWritten;
+}
+
+int main(int argc, char **argv)
+{
+	SdEmu_Config_t Config;
+	SdEmu_Stats_t S0, S1, S2, W, R;
+	MKFS_PARM Opt = {FM_ANY, 0, 0, 0, 0};
+	uint32_t u32Chunk = 4096;
+	uint32_t u32Size, u32Pos;
+	uint64_t u64T0, u64T1, u64T2;
+	FRESULT res;
+	UINT n, bw;
+	int i, iFail = 0;
+	char szWr[16], szRd[16];
+
+	SdEmu_DefaultConfig(&Config);
+	for (i = 1; i < argc; i++) {
+		if (!Bench_Arg(argv[i], "spi_hz", &Config.u32SpiHz)
+			&& !Bench_Arg(argv[i], "init_us", &Config.u32InitUs)
+			&& !Bench_Arg(argv[i], "read_us", &Config.u32ReadUs)
+			&& !Bench_Arg(argv[i], "write_us", &Config.u32WriteUs)
+			&& !Bench_Arg(argv[i], "multi_write_us", &Config.u32MultiWriteUs)
+			&& !Bench_Arg(argv[i], "stop_us", &Config.u32StopUs)
+			&& !Bench_Arg(argv[i], "sectors", &Config.u32Sectors)
+			&& !Bench_Arg(argv[i], "chunk", &u32Chunk)) {
+			if (!strncmp(argv[i], "image=", 6)) {
+				Config.pszImage = argv[i] + 6;
+			} else {
+				fprintf(stderr, "unknown argument %s\n", argv[i]);
+				return 2;
+			}
+		}
+	}
+	if (!u32Chunk || u32Chunk > BENCH_CHUNK_MAX) {
+		fprintf(stderr, "chunk must be 1..%d\n", BENCH_CHUNK_MAX);
+		return 2;
+	}
+
+	SimClock_Reset();
+	if (!SdEmu_Open(&Config)) {
+		fprintf(stderr, "cannot open the card image\n");
+		return 1;
+	}
+	res = f_mkfs("", &Opt, u8Work, sizeof(u8Work));
+	if (res == FR_OK) {
+		res = f_mount(&Fs, "", 1);
+	}
+	if (res != FR_OK) {
+		fprintf(stderr, "format/mount failed: %d\n", res);
+		return 1;
+	}
+
+	printf("SPI %lu Hz, access %lu us, write busy %lu us single / %lu us multi, chunk %lu\n",
+		(unsigned long)Config.u32SpiHz, (unsigned long)Config.u32ReadUs, (unsigned long)Config.u32WriteUs,
+		(unsigned long)Config.u32MultiWriteUs, (unsigned long)u32Chunk);
+	printf("%8s %9s %9s | %5s %5s %6s %5s %6s %6s | %5s %5s %5s %6s\n",
+		"size", "wr KB/s", "rd KB/s", "CMD24", "CMD25", "ACMD23", "CMD55", "wrsect", "rdsect",
+		"CMD17", "CMD18", "CMD12", "rdsect");
+
+	for (i = 0; i < (int)(sizeof(u32Sizes) / sizeof(u32Sizes[0])); i++) {
+		u32Size = u32Sizes[i];
+
+		SdEmu_GetStats(&S0);
+		u64T0 = SimClock_Now();
+		res = f_open(&Fil, "BENCH.BIN", FA_CREATE_ALWAYS | FA_WRITE);
+		for (u32Pos = 0; res == FR_OK && u32Pos < u32Size; u32Pos += n) {
+			n = (u32Size - u32Pos < u32Chunk) ? u32Size - u32Pos : u32Chunk;
+			Bench_Fill(u8Buf, u32Pos, n);
+			res = f_write(&Fil, u8Buf, n, &bw);
+			if (res == FR_OK && bw != n) {
+				res = FR_DENIED;
+			}
+		}
+		if (res == FR_OK) {
+			res = f_close(&Fil);
+		}
+		SdEmu_GetStats(&S1);
+		u64T1 = SimClock_Now();
+
+		if (res == FR_OK) {
+			res = f_open(&Fil, "BENCH.BIN", FA_READ);
+		}
+		for (u32Pos = 0; res == FR_OK && u32Pos < u32Size; u32Pos += n) {
+			n = (u32Size - u32Pos < u32Chunk) ? u32Size - u32Pos : u32Chunk;
+			res = f_read(&Fil, u8Buf, n, &bw);
+			Bench_Fill(u8Check, u32Pos, n);
+			if (res == FR_OK && (bw != n || memcmp(u8Buf, u8Check, n))) {
+				fprintf(stderr, "%lu bytes: data mismatch at %lu\n", (unsigned long)u32Size, (unsigned long)u32Pos);
+				iFail = 1;
+				break;
+			}
+		}
+		if (res == FR_OK) {
+			res = f_close(&Fil);
+		}
+		SdEmu_GetStats(&S2);
+		u64T2 = SimClock_Now();
+
+		if (res != FR_OK) {
+			fprintf(stderr, "%lu bytes: FatFs error %d\n", (unsigned long)u32Size, res);
+			iFail = 1;
+			break;
+		}
+
+		Bench_Diff(&W, &S0, &S1);
+		Bench_Diff(&R, &S1, &S2);
+		printf("%8lu %9s %9s | %5lu %5lu %6lu %5lu %6lu %6lu | %5lu %5lu %5lu %6lu\n",
+			(unsigned long)u32Size, Bench_KBps(szWr, u32Size, u64T1 - u64T0), Bench_KBps(szRd, u32Size, u64T2 - u64T1),
+			(unsigned long)W.u32Cmd[24], (unsigned long)W.u32Cmd[25], (unsigned long)W.u32Acmd[23],
+			(unsigned long)W.u32Cmd[55], (unsigned long)W.u32SectorsWritten,
+			(unsigned long)W.u32SectorsRead,
+			(unsigned long)R.u32Cmd[17], (unsigned long)R.u32Cmd[18], (unsigned long)R.u32Cmd[12],
+			(unsigned long)R.u32SectorsRead);
+	}
+
+	SdEmu_GetStats(&S2);
+	if (S2.u32Errors || S2.u32Illegal) {
+		fprintf(stderr, "card saw %lu protocol errors, %lu illegal commands\n",
+			(unsigned long)S2.u32Errors, (unsigned long)S2.u32Illegal);
+		iFail = 1;
+	}
+	f_mount(0, "", 0);
+	SdEmu_Close();
+	return iFail;
+}
@@ -0,0 +1,414 @@
+#define _XOPEN_SOURCE 700
+
+#include "sd_emu.h"
+#include "sim_clock.h"
+#include "sim_gpio.h"
+#include "spi.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define SD_SECTOR				512
+#define SD_QUEUE_LEN			(SD_SECTOR + 32)
+
+#define SD_TOKEN_SINGLE			0xFE	/* Data token of CMD17/18/24 and CMD9 */
+#define SD_TOKEN_MULTI			0xFC	/* Data token of CMD25 */
+#define SD_TOKEN_STOP			0xFD	/* Stop token of CMD25 */
+#define SD_DATA_ACCEPTED		0x05
+#define SD_ERR_RANGE			0x08	/* Data error token: out of range */
+
+#define R1_IDLE					0x01
+#define R1_ILLEGAL				0x04
+#define R1_ADDRESS				0x40
+
+typedef enum {
+	SD_MODE_CMD = 0,
+	SD_MODE_READ,						/* CMD17/18, a block is sent when the access time is over */
+	SD_MODE_WRITE_TOKEN,				/* CMD24/25, waiting for a data or stop token */
+	SD_MODE_WRITE_DATA					/* Receiving 512 bytes and the CRC */
+} SdMode_t;
+
+static void SdEmu_Cs(uint16_t u16Pin, uint8_t u8Level);
+
+static SdEmu_Config_t Config;
+static SdEmu_Stats_t Stats;
+static int iImage = -1;
+static uint64_t u64ByteNs;
+
+static uint8_t u8Selected;
+static SdMode_t eMode;
+static uint8_t u8Multi;
+static uint8_t u8App;					/* CMD55 came before */
+static uint8_t u8Idle;
+static uint8_t u8InitStarted;
+static uint64_t u64InitDone;
+static uint64_t u64BusyUntil;
+static uint64_t u64ReadyAt;				/* Next read block can be sent */
+static uint32_t u32Lba;
+
+static uint8_t u8Cmd[6];
+static uint8_t u8CmdLen;
+
+static uint8_t u8Block[SD_SECTOR + 2];
+static uint16_t u16BlockLen;
+
+static uint8_t u8Queue[SD_QUEUE_LEN];	/* Bytes the card sends next */
+static uint16_t u16QHead;
+static uint16_t u16QLen;
+
+static void SdEmu_Push(uint8_t u8Byte)
+{
+	if (u16QLen < SD_QUEUE_LEN) {
+		u8Queue[(u16QHead + u16QLen++) % SD_QUEUE_LEN] = u8Byte;
+	}
+}
+
+static void SdEmu_Flush(void)
+{
+	u16QHead = 0;
+	u16QLen = 0;
+}
+
+static void SdEmu_PushBlock(const uint8_t *pData, uint16_t u16Len)
+{
+	SdEmu_Push(SD_TOKEN_SINGLE);
+	while (u16Len--) {
+		SdEmu_Push(*pData++);
+	}
+	SdEmu_Push(0xFF);					/* CRC, not checked in SPI mode */
+	SdEmu_Push(0xFF);
+}
+
+/* CSD version 2.0, C_SIZE in 512 KiB units */
+static void SdEmu_Csd(uint8_t *pCsd)
+{
+	uint32_t u32CSize = Config.u32Sectors / 1024 - 1;
+
+	memset(pCsd, 0, 16);
+	pCsd[0] = 0x40;
+	pCsd[1] = 0x0E;
+	pCsd[3] = 0x32;
+	pCsd[4] = 0x5B;
+	pCsd[5] = 0x59;
+	pCsd[7] = (u32CSize >> 16) & 0x3F;
+	pCsd[8] = u32CSize >> 8;
+	pCsd[9] = u32CSize;
+	pCsd[10] = 0x7F;
+	pCsd[11] = 0x80;
+	pCsd[12] = 0x0A;
+	pCsd[13] = 0x40;
+	pCsd[15] = 0x01;
+}
+
+static void SdEmu_Command(void)
+{
+	uint8_t u8Index = u8Cmd[0] & 0x3F;
+	uint32_t u32Arg = ((uint32_t)u8Cmd[1] << 24) | ((uint32_t)u8Cmd[2] << 16) | ((uint32_t)u8Cmd[3] << 8) | u8Cmd[4];
+	uint8_t u8App0 = u8App;
+	uint8_t u8R1;
+	uint8_t u8Csd[16];
+
+	u8App = 0;
+	SdEmu_Flush();
+	if (u8App0) {
+		++Stats.u32Acmd[u8Index];
+	} else {
+		++Stats.u32Cmd[u8Index];
+	}
+
+	//NCR, one byte before the response
+	SdEmu_Push(0xFF);
+
+	if (u8Index == 12) {
+		//Stuff byte, then R1. Ends CMD18
+		eMode = SD_MODE_CMD;
+		SdEmu_Push(0x00);
+		return;
+	}
+
+	if (u8Index == 0) {
+		u8Idle = 1;
+		u8InitStarted = 0;
+		eMode = SD_MODE_CMD;
+	}
+	u8R1 = u8Idle ? R1_IDLE : 0;
+
+	if (u8App0 && u8Index == 41) {
+		if (!u8InitStarted) {
+			u8InitStarted = 1;
+			u64InitDone = SimClock_Now() + (uint64_t)Config.u32InitUs * 1000;
+		}
+		if (SimClock_Now() >= u64InitDone) {
+			u8Idle = 0;
+		}
+		SdEmu_Push(u8Idle ? R1_IDLE : 0);
+		return;
+	}
+	if (u8App0 && u8Index == 23) {
+		SdEmu_Push(u8R1);
+		return;
+	}
+
+	switch (u8Index) {
+	case 0:
+	case 16:
+		SdEmu_Push(u8R1);
+		break;
+	case 55:
+		u8App = 1;
+		SdEmu_Push(u8R1);
+		break;
+	case 8:
+		//R7 echoes the voltage range and the check pattern
+		SdEmu_Push(u8R1);
+		SdEmu_Push(0x00);
+		SdEmu_Push(0x00);
+		SdEmu_Push((u32Arg >> 8) & 0x0F);
+		SdEmu_Push(u32Arg);
+		break;
+	case 58:
+		//OCR with power up done and CCS (block addressing)
+		SdEmu_Push(u8R1);
+		SdEmu_Push(u8Idle ? 0x00 : 0xC0);
+		SdEmu_Push(0xFF);
+		SdEmu_Push(0x80);
+		SdEmu_Push(0x00);
+		break;
+	case 9:
+		SdEmu_Push(u8R1);
+		SdEmu_Push(0xFF);
+		SdEmu_Csd(u8Csd);
+		SdEmu_PushBlock(u8Csd, 16);
+		break;
+	case 13:
+		SdEmu_Push(u8R1);
+		SdEmu_Push(0x00);
+		break;
+	case 17:
+	case 18:
+	case 24:
+	case 25:
+		if (u8Idle || u32Arg >= Config.u32Sectors) {
+			++Stats.u32Errors;
+			SdEmu_Push(u8R1 | (u8Idle ? R1_ILLEGAL : R1_ADDRESS));
+			break;
+		}
+		SdEmu_Push(0x00);
+		u32Lba = u32Arg;
+		u8Multi = (u8Index == 18 || u8Index == 25);
+		if (u8Index == 17 || u8Index == 18) {
+			eMode = SD_MODE_READ;
+			u64ReadyAt = SimClock_Now() + (uint64_t)Config.u32ReadUs * 1000;
+		} else {
+			eMode = SD_MODE_WRITE_TOKEN;
+		}
+		break;
+	default:
+		++Stats.u32Illegal;
+		SdEmu_Push(u8R1 | R1_ILLEGAL);
+		break;
+	}
+}
+
+static void SdEmu_LoadBlock(void)
+{
+	if (u32Lba >= Config.u32Sectors) {
+		++Stats.u32Errors;
+		SdEmu_Push(SD_ERR_RANGE);
+		eMode = SD_MODE_CMD;
+		return;
+	}
+	memset(u8Block, 0, SD_SECTOR);
+	if (pread(iImage, u8Block, SD_SECTOR, (off_t)u32Lba * SD_SECTOR) < 0) {
+		++Stats.u32Errors;
+	}
+	SdEmu_PushBlock(u8Block, SD_SECTOR);
+	++Stats.u32SectorsRead;
+	++u32Lba;
+
+	if (u8Multi) {
+		//The next block is looked up while this one is on the wire
+		u64ReadyAt = SimClock_Now() + (SD_SECTOR + 3) * u64ByteNs + (uint64_t)Config.u32ReadUs * 1000;
+	} else {
+		eMode = SD_MODE_CMD;
+	}
+}
+
+static void SdEmu_StoreBlock(void)
+{
+	uint32_t u32BusyUs = u8Multi ? Config.u32MultiWriteUs : Config.u32WriteUs;
+
+	if (pwrite(iImage, u8Block, SD_SECTOR, (off_t)u32Lba * SD_SECTOR) != SD_SECTOR) {
+		++Stats.u32Errors;
+	}
+	++Stats.u32SectorsWritten;
+	++u32Lba;
+
+	//The data response comes on the next byte, busy (DO low) after it
+	SdEmu_Push(SD_DATA_ACCEPTED);
+	u64BusyUntil = SimClock_Now() + u64ByteNs + (uint64_t)u32BusyUs * 1000;
+	eMode = u8Multi ? SD_MODE_WRITE_TOKEN : SD_MODE_CMD;
+}
+
+static uint8_t SdEmu_Exchange(uint8_t u8In)
+{
+	uint8_t u8Out;
+
+	SimClock_Advance(u64ByteNs);
+	if (!u8Selected) {
+		return 0xFF;
+	}
+	++Stats.u64Bytes;
+
+	//What the card drives while this byte is clocked
+	if (u16QLen) {
+		u8Out = u8Queue[u16QHead];
+		u16QHead = (u16QHead + 1) % SD_QUEUE_LEN;
+		--u16QLen;
+	} else if (SimClock_Now() < u64BusyUntil) {
+		u8Out = 0x00;
+	} else if (eMode == SD_MODE_READ && SimClock_Now() >= u64ReadyAt && u8In == 0xFF && !u8CmdLen) {
+		//Not while CMD12 comes in, the block would be counted as read
+		SdEmu_LoadBlock();
+		u8Out = u8Queue[u16QHead];
+		u16QHead = (u16QHead + 1) % SD_QUEUE_LEN;
+		--u16QLen;
+	} else {
+		u8Out = 0xFF;
+	}
+
+	//What the host sent
+	switch (eMode) {
+	case SD_MODE_WRITE_DATA:
+		u8Block[u16BlockLen++] = u8In;
+		if (u16BlockLen == SD_SECTOR + 2) {
+			SdEmu_StoreBlock();
+		}
+		break;
+	case SD_MODE_WRITE_TOKEN:
+		if (u8In == (u8Multi ? SD_TOKEN_MULTI : SD_TOKEN_SINGLE)) {
+			eMode = SD_MODE_WRITE_DATA;
+			u16BlockLen = 0;
+		} else if (u8Multi && u8In == SD_TOKEN_STOP) {
+			u64BusyUntil = SimClock_Now() + u64ByteNs + (uint64_t)Config.u32StopUs * 1000;
+			eMode = SD_MODE_CMD;
+		} else if (u8In != 0xFF) {
+			++Stats.u32Errors;
+		}
+		break;
+	default:
+		//Commands start with 01xxxxxx, the host clocks 0xFF while it reads
+		if (u8CmdLen || (u8In & 0xC0) == 0x40) {
+			u8Cmd[u8CmdLen++] = u8In;
+			if (u8CmdLen == sizeof(u8Cmd)) {
+				u8CmdLen = 0;
+				SdEmu_Command();
+			}
+		}
+		break;
+	}
+	return u8Out;
+}
+
+void SdEmu_DefaultConfig(SdEmu_Config_t *pConfig)
+{
+	pConfig->u32Sectors = 64UL * 2048;	/* 64 MiB */
+	pConfig->u32SpiHz = 72000000 / 16;
+	pConfig->u32InitUs = 50000;
+	pConfig->u32ReadUs = 300;
+	pConfig->u32WriteUs = 800;
+	pConfig->u32MultiWriteUs = 250;
+	pConfig->u32StopUs = 1000;
+	pConfig->pszImage = 0;
+}
+
+int SdEmu_Open(const SdEmu_Config_t *pConfig)
+{
+	FILE *pTmp;
+
+	SdEmu_Close();
+	Config = *pConfig;
+	if (Config.pszImage) {
+		iImage = open(Config.pszImage, O_RDWR | O_CREAT, 0644);
+	} else {
+		pTmp = tmpfile();
+		iImage = pTmp ? dup(fileno(pTmp)) : -1;
+		if (pTmp) {
+			fclose(pTmp);
+		}
+	}
+	if (iImage < 0) {
+		return 0;
+	}
+	//Holes read back as zeros and take no space
+	if (lseek(iImage, 0, SEEK_END) < (off_t)Config.u32Sectors * SD_SECTOR
+		&& ftruncate(iImage, (off_t)Config.u32Sectors * SD_SECTOR) != 0) {
+		SdEmu_Close();
+		return 0;
+	}
+
+	u64ByteNs = 8000000000ULL / Config.u32SpiHz;
+	u8Selected = 0;
+	eMode = SD_MODE_CMD;
+	u8App = 0;
+	u8Idle = 1;
+	u8InitStarted = 0;
+	u64BusyUntil = 0;
+	u8CmdLen = 0;
+	SdEmu_Flush();
+	SdEmu_ResetStats();
+	SimGpio_Attach(GPIOA, GPIO_Pin_4, SdEmu_Cs);
+	return 1;
+}
+
+void SdEmu_Close(void)
+{
+	if (iImage >= 0) {
+		close(iImage);
+		iImage = -1;
+	}
+}
+
+void SdEmu_GetStats(SdEmu_Stats_t *pStats)
+{
+	*pStats = Stats;
+}
+
+void SdEmu_ResetStats(void)
+{
+	memset(&Stats, 0, sizeof(Stats));
+}
+
+/* spi.h, the SD card port. The MFRC522 port is rc522_sim.c */
+
+void My_SPI_Init(void)
+{
+	u8Selected = 0;
+}
+
+uint8_t My_SPI_Exchange(uint8_t u8Data)
+{
+	return SdEmu_Exchange(u8Data);
+}
+
+/* LED pin of sd_card(), nothing to set up */
+void My_GPIO_Init(void)
+{
+}
+
+/* CS on PA4, attached by SdEmu_Open */
+static void SdEmu_Cs(uint16_t u16Pin, uint8_t u8Level)
+{
+	if (u8Level) {
+		//CS high ends a command and a read, DO goes hi-z
+		u8Selected = 0;
+		u8CmdLen = 0;
+		SdEmu_Flush();
+		if (eMode == SD_MODE_READ) {
+			eMode = SD_MODE_CMD;
+		}
+	} else {
+		u8Selected = 1;
+	}
+}
@@ -0,0 +1,51 @@
+#ifndef SD_EMU_H_
+#define SD_EMU_H_
+
+#include <stdint.h>
+
+/*
+ * SDHC card in SPI mode behind My_SPI_Exchange
+ *
+ * sdmm.c and ff.c run unchanged on the host: spi.c is replaced by this
+ * file, the card answers the bytes sdmm.c clocks out and keeps its sectors
+ * in a sparse image file. Every byte advances the virtual clock by one SPI
+ * byte time and the card is busy or slow to answer for the configured
+ * times, so the throughput seen by the firmware follows the bus and the
+ * card and not the host.
+ *
+ * Commands: CMD0, 8, 9, 12, 13, 16, 17, 18, 24, 25, 55, 58 and ACMD23, 41.
+ * Anything else is answered with "illegal command".
+ */
+
+typedef struct {
+	uint32_t u32Sectors;				/* Card size in 512 byte sectors */
+	uint32_t u32SpiHz;					/* SCK rate, sets the time of every byte */
+	uint32_t u32InitUs;					/* ACMD41 answers idle for this long after the first one */
+	uint32_t u32ReadUs;					/* CMD17/CMD18 access time before each data token */
+	uint32_t u32WriteUs;				/* Busy after a CMD24 block */
+	uint32_t u32MultiWriteUs;			/* Busy after each CMD25 block */
+	uint32_t u32StopUs;					/* Busy after the CMD25 stop token */
+	const char *pszImage;				/* Image file, created sparse if missing. 0 for a temporary one */
+} SdEmu_Config_t;
+
+typedef struct {
+	uint32_t u32Cmd[64];				/* Commands by index, CMD55 included */
+	uint32_t u32Acmd[64];				/* Application commands by index */
+	uint32_t u32SectorsRead;
+	uint32_t u32SectorsWritten;
+	uint32_t u32Illegal;				/* Commands the card does not know */
+	uint32_t u32Errors;					/* Protocol errors: bad token, address out of range */
+	uint64_t u64Bytes;					/* Bytes exchanged while selected */
+} SdEmu_Stats_t;
+
+/* Card with typical timing at the SPI1 rate of RFID_PROJECT (72 MHz / 16) */
+void SdEmu_DefaultConfig(SdEmu_Config_t *pConfig);
+
+/* Insert a card, returns 0 when the image cannot be opened */
+int SdEmu_Open(const SdEmu_Config_t *pConfig);
+void SdEmu_Close(void);
+
+void SdEmu_GetStats(SdEmu_Stats_t *pStats);
+void SdEmu_ResetStats(void);
+
+#endif
@@ -0,0 +1,173 @@
+/*
+ * f_lseek time against file size, following the FAT chain and with a
+ * cluster link map (fast seek), on the emulated card
+ *
+ * Files are preallocated with f_expand like the access log ring files,
+ * then read at SEEK_BENCH_SEEKS random record offsets: f_lseek and one
+ * 32 byte f_read each. Virtual time and card sectors read per seek are
+ * reported for both. With the link map a seek must cost at most the data
+ * sector and must not get slower as the file grows.
+ */
+
+#include "sd_emu.h"
+#include "sim_clock.h"
+#include "ff.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define SEEK_BENCH_SEEKS		256
+#define SEEK_BENCH_RECORD		32
+#define SEEK_BENCH_CHUNK		32768
+#define SEEK_BENCH_CLMT			16
+
+static const uint32_t u32Sizes[] = {0x10000, 0x40000, 0x100000, 0x400000, 0x1000000};
+
+static FATFS Fs;
+static FIL Fil;
+static BYTE u8Work[FF_MAX_SS];
+static BYTE u8Buf[SEEK_BENCH_CHUNK];
+static DWORD Clmt[SEEK_BENCH_CLMT];
+static int iFailed;
+
+static void Seek_Fail(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	fprintf(stderr, "FAIL: ");
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	++iFailed;
+}
+
+/* Every 32 bit word holds its own offset */
+static void Seek_Fill(BYTE *p, uint32_t u32Pos, UINT n)
+{
+	UINT i;
+
+	for (i = 0; i < n; i += 4, u32Pos += 4) {
+		memcpy(p + i, &u32Pos, 4);
+	}
+}
+
+static FRESULT Seek_Create(uint32_t u32Size)
+{
+	uint32_t u32Pos;
+	FRESULT fr;
+	UINT bw;
+
+	fr = f_open(&Fil, "SEEK.BIN", FA_WRITE | FA_CREATE_ALWAYS);
+	if (fr == FR_OK) {
+		fr = f_expand(&Fil, u32Size, 1);
+	}
+	for (u32Pos = 0; fr == FR_OK && u32Pos < u32Size; u32Pos += SEEK_BENCH_CHUNK) {
+		Seek_Fill(u8Buf, u32Pos, SEEK_BENCH_CHUNK);
+		fr = f_write(&Fil, u8Buf, SEEK_BENCH_CHUNK, &bw);
+	}
+	if (fr == FR_OK) {
+		fr = f_close(&Fil);
+	}
+	return fr;
+}
+
+/* Random seeks and reads, returns the mean time in ns and the card sectors read per seek */
+static double Seek_Run(uint32_t u32Size, uint8_t u8Fast, double *pdSectors)
+{
+	SdEmu_Stats_t s0, s1;
+	uint32_t u32Rand = 12345, u32Pos, u32Got, i;
+	uint64_t u64T0, u64Ns;
+	FRESULT fr;
+	UINT br;
+
+	fr = f_open(&Fil, "SEEK.BIN", FA_READ);
+	if (fr == FR_OK && u8Fast) {
+		Clmt[0] = SEEK_BENCH_CLMT;
+		Fil.cltbl = Clmt;
+		fr = f_lseek(&Fil, CREATE_LINKMAP);
+	}
+	if (fr != FR_OK) {
+		Seek_Fail("%lu bytes: open%s failed: %d", (unsigned long)u32Size, u8Fast ? " with link map" : "", fr);
+		return 0;
+	}
+
+	SdEmu_GetStats(&s0);
+	u64T0 = SimClock_Now();
+	for (i = 0; i < SEEK_BENCH_SEEKS; i++) {
+		u32Rand = u32Rand * 1103515245 + 12345;
+		u32Pos = (u32Rand >> 4) % (u32Size / SEEK_BENCH_RECORD) * SEEK_BENCH_RECORD;
+		fr = f_lseek(&Fil, u32Pos);
+		if (fr == FR_OK) {
+			fr = f_read(&Fil, u8Buf, SEEK_BENCH_RECORD, &br);
+		}
+		memcpy(&u32Got, u8Buf, 4);
+		if (fr != FR_OK || br != SEEK_BENCH_RECORD || u32Got != u32Pos) {
+			Seek_Fail("%lu bytes: read at %lu wrong", (unsigned long)u32Size, (unsigned long)u32Pos);
+			break;
+		}
+	}
+	u64Ns = SimClock_Now() - u64T0;
+	SdEmu_GetStats(&s1);
+	f_close(&Fil);
+
+	*pdSectors = (double)(s1.u32SectorsRead - s0.u32SectorsRead) / SEEK_BENCH_SEEKS;
+	return (double)u64Ns / SEEK_BENCH_SEEKS;
+}
+
+int main(void)
+{
+	SdEmu_Config_t Config;
+	MKFS_PARM Opt = {FM_ANY, 0, 0, 0, 0};
+	double dWalk, dFast, dWalkSect, dFastSect, dFastFirst = 0;
+	FRESULT fr;
+	int i;
+
+	SdEmu_DefaultConfig(&Config);
+	SimClock_Reset();
+	if (!SdEmu_Open(&Config)) {
+		fprintf(stderr, "cannot open the card image\n");
+		return 1;
+	}
+	fr = f_mkfs("", &Opt, u8Work, sizeof(u8Work));
+	if (fr == FR_OK) {
+		fr = f_mount(&Fs, "", 1);
+	}
+	if (fr != FR_OK) {
+		fprintf(stderr, "format/mount failed: %d\n", fr);
+		return 1;
+	}
+
+	printf("%d random %d byte reads, %s, %lu byte clusters\n", SEEK_BENCH_SEEKS, SEEK_BENCH_RECORD,
+		Fs.fs_type == FS_FAT32 ? "FAT32" : (Fs.fs_type == FS_FAT16 ? "FAT16" : "FAT12"),
+		(unsigned long)Fs.csize * FF_MAX_SS);
+	printf("%9s | %10s %8s | %10s %8s\n", "size", "FAT us", "sectors", "CLMT us", "sectors");
+	for (i = 0; i < (int)(sizeof(u32Sizes) / sizeof(u32Sizes[0])); i++) {
+		fr = Seek_Create(u32Sizes[i]);
+		if (fr != FR_OK) {
+			Seek_Fail("%lu bytes: create failed: %d", (unsigned long)u32Sizes[i], fr);
+			break;
+		}
+		dWalk = Seek_Run(u32Sizes[i], 0, &dWalkSect);
+		dFast = Seek_Run(u32Sizes[i], 1, &dFastSect);
+		printf("%9lu | %10.1f %8.2f | %10.1f %8.2f\n", (unsigned long)u32Sizes[i], dWalk / 1e3, dWalkSect,
+			dFast / 1e3, dFastSect);
+
+		if (dFastSect > 1.0) {
+			Seek_Fail("%lu bytes: %.2f sectors per seek with the link map", (unsigned long)u32Sizes[i], dFastSect);
+		}
+		if (!i) {
+			dFastFirst = dFast;
+		} else if (dFast > 1.5 * dFastFirst) {
+			Seek_Fail("%lu bytes: seek with the link map grows with the file", (unsigned long)u32Sizes[i]);
+		}
+		f_unlink("SEEK.BIN");
+	}
+
+	f_mount(0, "", 0);
+	SdEmu_Close();
+	if (iFailed) {
+		fprintf(stderr, "%d failures\n", iFailed);
+	}
+	return iFailed != 0;
+}
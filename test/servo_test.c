@@ -0,0 +1,245 @@
+/*
+ * Motion engine of servo.c on the simulated TIM2
+ *
+ * The compare value of every PWM period is recorded at the update event,
+ * the pulse the servo actually receives.
+ *
+ * - Full travel at SERVO_SPEED: CCR1 never steps back, no second of it
+ *   moves more than the speed limit, the first half second follows
+ *   a t^2 / 2 of SERVO_ACCEL, the move takes D / v + v / a and ends on
+ *   the target with pfDone called once.
+ * - Servo_MoveToAngle: 90 degrees is half the travel.
+ * - Retarget mid-move: the replaced pfDone is never called, the new one
+ *   once, on the new target.
+ * - Reversal near an end: a fast move towards CLOSED turned around just
+ *   before it still carries v^2 / 2a of travel, CCR1 stays within
+ *   SERVO_PULSE_CLOSED..SERVO_PULSE_OPEN.
+ * - CPU: update interrupts per second of motion and host time per
+ *   interrupt, an upper bound of the handler cost.
+ */
+
+#include "sim_tim.h"
+#include "sim_clock.h"
+#include "servo.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SERVO_TEST_MAX_TICKS	20000		/* 40 s of periods */
+#define SERVO_TEST_FAST			4000		/* CCR counts per second of the reversal */
+
+static uint16_t u16Ccr[SERVO_TEST_MAX_TICKS];
+static uint32_t u32Ticks;
+static uint32_t u32DoneA, u32DoneB;
+static int iFailed;
+
+static void Servo_Fail(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	fprintf(stderr, "FAIL: ");
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	++iFailed;
+}
+
+static void Servo_Observe(uint16_t u16Compare)
+{
+	if (u32Ticks < SERVO_TEST_MAX_TICKS) {
+		u16Ccr[u32Ticks++] = u16Compare;
+	}
+}
+
+static void Servo_DoneA(void)
+{
+	++u32DoneA;
+}
+
+static void Servo_DoneB(void)
+{
+	++u32DoneB;
+}
+
+/* servo.c sleeps in ServoOn/ServoOff, wake at the next update */
+void __WFI(void)
+{
+	SimClock_Advance(SERVO_TICK_US * 1000ULL);
+}
+
+static void Servo_Start(void)
+{
+	SimClock_Reset();
+	SimTim_Reset();
+	PWM_Init();
+	SimTim_SetObserver(Servo_Observe);
+	u32Ticks = 0;
+	u32DoneA = 0;
+	u32DoneB = 0;
+}
+
+/* Runs until the move ends, returns its periods */
+static uint32_t Servo_Run(void)
+{
+	while (Servo_IsMoving() && u32Ticks < SERVO_TEST_MAX_TICKS) {
+		SimClock_Advance(SERVO_TICK_US * 1000ULL);
+	}
+	//The period after the last interrupt carries the final compare value
+	SimClock_Advance(SERVO_TICK_US * 1000ULL);
+	return u32Ticks;
+}
+
+/* Every compare value within the travel */
+static void Servo_CheckRange(const char *pszWhat)
+{
+	uint32_t i;
+
+	for (i = 0; i < u32Ticks; i++) {
+		if (u16Ccr[i] > SERVO_PULSE_OPEN) {
+			Servo_Fail("%s: CCR1 %u at period %lu, past SERVO_PULSE_OPEN", pszWhat, u16Ccr[i], (unsigned long)i);
+			return;
+		}
+	}
+}
+
+static void Servo_FullTravel(void)
+{
+	SimTim_Stats_t s;
+	uint32_t i, u32Per, u32Win, u32MaxWin = 0, u32Irqs;
+	double fWant, fSecs, fHostUs;
+	clock_t t0;
+
+	Servo_Start();
+	t0 = clock();
+	Servo_MoveTo(SERVO_PULSE_OPEN, SERVO_SPEED, Servo_DoneA);
+	Servo_Run();
+	fHostUs = (double)(clock() - t0) * 1e6 / CLOCKS_PER_SEC;
+	SimTim_GetStats(&s);
+
+	//u16Ccr[n] is the pulse after n interrupts
+	u32Per = 1000000 / SERVO_TICK_US;
+	for (i = 1; i < u32Ticks; i++) {
+		if (u16Ccr[i] < u16Ccr[i - 1]) {
+			Servo_Fail("travel: CCR1 back from %u to %u at period %lu", u16Ccr[i - 1], u16Ccr[i], (unsigned long)i);
+			break;
+		}
+	}
+	for (i = 0; i + u32Per < u32Ticks; i++) {
+		u32Win = u16Ccr[i + u32Per] - u16Ccr[i];
+		if (u32Win > u32MaxWin) {
+			u32MaxWin = u32Win;
+		}
+	}
+	//Rounded CCR steps, one count of slack
+	if (u32MaxWin > SERVO_SPEED + 1) {
+		Servo_Fail("travel: %lu counts in one second, limit %u", (unsigned long)u32MaxWin, SERVO_SPEED);
+	}
+	fWant = SERVO_ACCEL * 0.5 * 0.5 / 2;		/* a t^2 / 2 at t = 0.5 s */
+	if (abs((int)u16Ccr[u32Per / 2] - (int)(fWant + 0.5)) > 2) {
+		Servo_Fail("travel: CCR1 %u after 0.5 s, a t^2 / 2 is %.1f", u16Ccr[u32Per / 2], fWant);
+	}
+
+	//The pulse rounds to the target half a count early, the last interrupt ends the move
+	fSecs = (double)s.u32Irqs / u32Per;
+	fWant = (double)(SERVO_PULSE_OPEN - SERVO_PULSE_CLOSED) / SERVO_SPEED + (double)SERVO_SPEED / SERVO_ACCEL;
+	printf("travel: %u counts in %.2f s (D/v + v/a %.2f s), max %lu counts/s, %lu interrupts, %lu missed\n",
+		SERVO_PULSE_OPEN - SERVO_PULSE_CLOSED, fSecs, fWant, (unsigned long)u32MaxWin, (unsigned long)s.u32Irqs,
+		(unsigned long)s.u32Missed);
+	printf("cpu: %.0f interrupts per second of motion, %.3f us host time each\n", s.u32Irqs / fSecs,
+		fHostUs / s.u32Irqs);
+	//Q16 steps and the final snap to the target, 1 %
+	if (fSecs < fWant * 0.99 || fSecs > fWant * 1.01) {
+		Servo_Fail("travel: %.2f s, trapezoid %.2f s", fSecs, fWant);
+	}
+	if (u16Ccr[u32Ticks - 1] != SERVO_PULSE_OPEN || u32DoneA != 1 || s.u32Missed) {
+		Servo_Fail("travel: ends on %u, pfDone called %lu times, %lu missed", u16Ccr[u32Ticks - 1],
+			(unsigned long)u32DoneA, (unsigned long)s.u32Missed);
+	}
+	//No interrupt once the target is reached
+	u32Irqs = s.u32Irqs;
+	SimClock_Advance(100 * SERVO_TICK_US * 1000ULL);
+	SimTim_GetStats(&s);
+	if (s.u32Irqs != u32Irqs) {
+		Servo_Fail("travel: %lu interrupts after the end", (unsigned long)(s.u32Irqs - u32Irqs));
+	}
+	Servo_CheckRange("travel");
+}
+
+static void Servo_Angle(void)
+{
+	uint16_t u16Want = SERVO_PULSE_CLOSED + (SERVO_PULSE_OPEN - SERVO_PULSE_CLOSED) * 90 / SERVO_ANGLE_MAX;
+
+	Servo_Start();
+	Servo_MoveToAngle(90, 90, Servo_DoneA);
+	Servo_Run();
+	printf("angle: 90 degrees -> CCR1 %u in %.2f s\n", u16Ccr[u32Ticks - 1], u32Ticks * SERVO_TICK_US / 1e6);
+	if (u16Ccr[u32Ticks - 1] != u16Want || u32DoneA != 1) {
+		Servo_Fail("angle: CCR1 %u, expected %u, pfDone %lu", u16Ccr[u32Ticks - 1], u16Want, (unsigned long)u32DoneA);
+	}
+	Servo_CheckRange("angle");
+}
+
+static void Servo_Retarget(void)
+{
+	uint16_t u16Turn;
+
+	Servo_Start();
+	Servo_MoveTo(SERVO_PULSE_OPEN, SERVO_TEST_FAST, Servo_DoneA);
+	while (SimTim_Compare() < SERVO_PULSE_OPEN / 2) {
+		SimClock_Advance(SERVO_TICK_US * 1000ULL);
+	}
+	u16Turn = SimTim_Compare();
+	Servo_MoveTo(SERVO_PULSE_OPEN / 4, SERVO_SPEED, Servo_DoneB);
+	Servo_Run();
+	printf("retarget: turned at %u, ends on %u after %lu periods\n", u16Turn, u16Ccr[u32Ticks - 1],
+		(unsigned long)u32Ticks);
+	if (u16Ccr[u32Ticks - 1] != SERVO_PULSE_OPEN / 4 || u32DoneA || u32DoneB != 1) {
+		Servo_Fail("retarget: ends on %u, replaced pfDone %lu, new pfDone %lu", u16Ccr[u32Ticks - 1],
+			(unsigned long)u32DoneA, (unsigned long)u32DoneB);
+	}
+	Servo_CheckRange("retarget");
+}
+
+static void Servo_Reversal(void)
+{
+	uint32_t i, u32Low = SERVO_PULSE_OPEN;
+
+	Servo_Start();
+	Servo_MoveTo(SERVO_PULSE_OPEN, SERVO_TEST_FAST, 0);
+	Servo_Run();
+	u32Ticks = 0;
+	Servo_MoveTo(SERVO_PULSE_CLOSED, SERVO_TEST_FAST, 0);
+	while (SimTim_Compare() > SERVO_PULSE_CLOSED + 100) {
+		SimClock_Advance(SERVO_TICK_US * 1000ULL);
+	}
+	//v^2 / 2a is far more than the 100 counts left
+	Servo_MoveTo(SERVO_PULSE_OPEN, SERVO_TEST_FAST, Servo_DoneA);
+	Servo_Run();
+	for (i = 0; i < u32Ticks; i++) {
+		if (u16Ccr[i] < u32Low) {
+			u32Low = u16Ccr[i];
+		}
+	}
+	printf("reversal: %u counts/s turned 100 counts before CLOSED, lowest CCR1 %lu, ends on %u\n",
+		SERVO_TEST_FAST, (unsigned long)u32Low, u16Ccr[u32Ticks - 1]);
+	Servo_CheckRange("reversal");
+	if (u16Ccr[u32Ticks - 1] != SERVO_PULSE_OPEN || u32DoneA != 1) {
+		Servo_Fail("reversal: ends on %u, pfDone %lu", u16Ccr[u32Ticks - 1], (unsigned long)u32DoneA);
+	}
+}
+
+int main(void)
+{
+	Servo_FullTravel();
+	Servo_Angle();
+	Servo_Retarget();
+	Servo_Reversal();
+
+	if (iFailed) {
+		fprintf(stderr, "%d failures\n", iFailed);
+	}
+	return iFailed != 0;
+}
@@ -0,0 +1,7 @@
+#ifndef HOST_MISC_H_
+#define HOST_MISC_H_
+
+/* NVIC functions of misc.c, the shim declares them with the device header */
+#include "stm32f10x.h"
+
+#endif
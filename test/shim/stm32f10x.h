@@ -0,0 +1,184 @@
+#ifndef HOST_STM32F10X_H_
+#define HOST_STM32F10X_H_
+
+/*
+ * Host stand-in for the device header. Only what the RFID_PROJECT modules
+ * under test touch is declared, the simulators in test/ implement it.
+ */
+
+#include <stdint.h>
+
+#define __IO				volatile
+
+typedef enum {RESET = 0, SET = !RESET} FlagStatus, ITStatus;
+typedef enum {Bit_RESET = 0, Bit_SET} BitAction;
+typedef enum {DISABLE = 0, ENABLE = !DISABLE} FunctionalState;
+
+typedef struct {
+	uint32_t u32Port;
+	volatile uint32_t BSRR;				/* Written directly by the bit-banged examples, sim_wave.c applies it */
+	volatile uint32_t BRR;
+} GPIO_TypeDef;
+
+extern GPIO_TypeDef SimGpioA;
+extern GPIO_TypeDef SimGpioB;
+extern GPIO_TypeDef SimGpioC;
+
+#define GPIOA				(&SimGpioA)
+#define GPIOB				(&SimGpioB)
+#define GPIOC				(&SimGpioC)
+
+#define GPIO_Pin_0			((uint16_t)0x0001)
+#define GPIO_Pin_1			((uint16_t)0x0002)
+#define GPIO_Pin_2			((uint16_t)0x0004)
+#define GPIO_Pin_3			((uint16_t)0x0008)
+#define GPIO_Pin_4			((uint16_t)0x0010)
+#define GPIO_Pin_6			((uint16_t)0x0040)
+#define GPIO_Pin_7			((uint16_t)0x0080)
+#define GPIO_Pin_9			((uint16_t)0x0200)
+#define GPIO_Pin_10			((uint16_t)0x0400)
+#define GPIO_Pin_11			((uint16_t)0x0800)
+#define GPIO_Pin_12			((uint16_t)0x1000)
+#define GPIO_Pin_13			((uint16_t)0x2000)
+
+typedef enum {
+	GPIO_Speed_10MHz = 1,
+	GPIO_Speed_2MHz,
+	GPIO_Speed_50MHz
+} GPIOSpeed_TypeDef;
+
+typedef enum {
+	GPIO_Mode_IN_FLOATING = 0x04,
+	GPIO_Mode_Out_OD = 0x14,
+	GPIO_Mode_Out_PP = 0x10,
+	GPIO_Mode_AF_OD = 0x1C,
+	GPIO_Mode_AF_PP = 0x18
+} GPIOMode_TypeDef;
+
+typedef struct {
+	uint16_t GPIO_Pin;
+	GPIOSpeed_TypeDef GPIO_Speed;
+	GPIOMode_TypeDef GPIO_Mode;
+} GPIO_InitTypeDef;
+
+#define RCC_AHBPeriph_DMA1		((uint32_t)0x00000001)
+#define RCC_APB1Periph_TIM2		((uint32_t)0x00000001)
+#define RCC_APB1Periph_TIM3		((uint32_t)0x00000002)
+#define RCC_APB1Periph_I2C1		((uint32_t)0x00200000)
+#define RCC_APB1Periph_I2C2		((uint32_t)0x00400000)
+#define RCC_APB2Periph_GPIOA	((uint32_t)0x00000004)
+#define RCC_APB2Periph_GPIOB	((uint32_t)0x00000008)
+#define RCC_APB2Periph_GPIOC	((uint32_t)0x00000010)
+#define RCC_APB2Periph_USART1	((uint32_t)0x00004000)
+
+typedef struct {
+	uint32_t SYSCLK_Frequency;
+	uint32_t HCLK_Frequency;
+	uint32_t PCLK1_Frequency;
+	uint32_t PCLK2_Frequency;
+	uint32_t ADCCLK_Frequency;
+} RCC_ClocksTypeDef;
+
+/* Core clock and the DWT cycle counter, sim_wave.c: every access to DWT stands for the code around it */
+typedef struct {
+	volatile uint32_t CTRL;
+	volatile uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct {
+	volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+#define DWT_CTRL_CYCCNTENA_Msk		((uint32_t)0x00000001)
+#define CoreDebug_DEMCR_TRCENA_Msk	((uint32_t)0x01000000)
+
+extern uint32_t SystemCoreClock;
+extern CoreDebug_Type SimCoreDebug;
+DWT_Type *SimWave_Dwt(void);
+
+#define CoreDebug			(&SimCoreDebug)
+#define DWT					(SimWave_Dwt())
+
+/*
+ * Cortex-M3 exclusives. Exception entry and return clear the monitor, so
+ * an interrupt between LDREX and STREX fails the STREX. Each test linking
+ * code that uses them defines SimStrex_Preempt: it runs there what such an
+ * interrupt would, and returns nonzero when it did.
+ */
+uint8_t SimStrex_Preempt(uint32_t value, volatile uint32_t *addr);
+
+static inline uint32_t __LDREXW(volatile uint32_t *addr)
+{
+	return *addr;
+}
+
+static inline uint32_t __STREXW(uint32_t value, volatile uint32_t *addr)
+{
+	if (SimStrex_Preempt(value, addr)) {
+		return 1;
+	}
+	*addr = value;
+	return 0;
+}
+
+static inline void __CLREX(void)
+{
+}
+
+typedef enum {
+	DMA1_Channel1_IRQn = 11,
+	DMA1_Channel4_IRQn = 14,
+	DMA1_Channel5_IRQn = 15,
+	DMA1_Channel6_IRQn = 16,
+	DMA1_Channel7_IRQn = 17,
+	TIM2_IRQn = 28,
+	I2C1_EV_IRQn = 31,
+	I2C1_ER_IRQn = 32,
+	USART1_IRQn = 37,
+	SIM_IRQ_COUNT = 68
+} IRQn_Type;
+
+typedef struct {
+	uint8_t NVIC_IRQChannel;
+	uint8_t NVIC_IRQChannelPreemptionPriority;
+	uint8_t NVIC_IRQChannelSubPriority;
+	FunctionalState NVIC_IRQChannelCmd;
+} NVIC_InitTypeDef;
+
+/* The simulator of the peripheral behind the interrupt runs it */
+void NVIC_SetPendingIRQ(IRQn_Type IRQn);
+
+/* sim_nvic.c */
+void NVIC_Init(NVIC_InitTypeDef *NVIC_InitStruct);
+void NVIC_DisableIRQ(IRQn_Type IRQn);
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t u32PriMask);
+void __disable_irq(void);
+void __enable_irq(void);
+
+/* Sleep until the next interrupt: the simulator raising it (rc522_sim.c) moves the clock */
+void __WFI(void);
+
+/* sim_gpio.c */
+void RCC_APB1PeriphClockCmd(uint32_t RCC_APB1Periph, FunctionalState NewState);
+void RCC_APB2PeriphClockCmd(uint32_t RCC_APB2Periph, FunctionalState NewState);
+void RCC_AHBPeriphClockCmd(uint32_t RCC_AHBPeriph, FunctionalState NewState);
+void RCC_APB1PeriphResetCmd(uint32_t RCC_APB1Periph, FunctionalState NewState);
+void RCC_GetClocksFreq(RCC_ClocksTypeDef *RCC_Clocks);
+void GPIO_StructInit(GPIO_InitTypeDef *GPIO_InitStruct);
+void GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_InitStruct);
+void GPIO_SetBits(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+void GPIO_ResetBits(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+void GPIO_WriteBit(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, BitAction BitVal);
+uint8_t GPIO_ReadInputDataBit(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+
+/*
+ * The device header declares every peripheral, code that only takes the
+ * address of a data register (dma_mgr.c) includes nothing else
+ */
+#include "stm32f10x_adc.h"
+#include "stm32f10x_i2c.h"
+#include "stm32f10x_spi.h"
+#include "stm32f10x_usart.h"
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef HOST_STM32F10X_ADC_H_
+#define HOST_STM32F10X_ADC_H_
+
+#include "stm32f10x.h"
+
+/* ADC1, registers of RM0008 for the address of DR, nothing simulates it */
+
+typedef struct {
+	volatile uint32_t SR;
+	volatile uint32_t CR1;
+	volatile uint32_t CR2;
+	volatile uint32_t SMPR1;
+	volatile uint32_t SMPR2;
+	volatile uint32_t JOFR[4];
+	volatile uint32_t HTR;
+	volatile uint32_t LTR;
+	volatile uint32_t SQR1;
+	volatile uint32_t SQR2;
+	volatile uint32_t SQR3;
+	volatile uint32_t JSQR;
+	volatile uint32_t JDR[4];
+	volatile uint32_t DR;
+} ADC_TypeDef;
+
+extern ADC_TypeDef SimAdc1;
+
+#define ADC1				(&SimAdc1)
+
+#endif
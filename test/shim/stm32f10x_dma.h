@@ -0,0 +1,107 @@
+#ifndef HOST_STM32F10X_DMA_H_
+#define HOST_STM32F10X_DMA_H_
+
+#include "stm32f10x.h"
+
+/*
+ * DMA1, registers and bits of RM0008. sim_dma.c moves the data when the
+ * simulated peripherals request it.
+ */
+
+typedef struct {
+	volatile uint32_t CCR;
+	volatile uint32_t CNDTR;
+	volatile uint32_t CPAR;
+	volatile uint32_t CMAR;
+} DMA_Channel_TypeDef;
+
+typedef struct {
+	volatile uint32_t ISR;
+	volatile uint32_t IFCR;
+} DMA_TypeDef;
+
+extern DMA_TypeDef SimDma1;
+extern DMA_Channel_TypeDef SimDma1Channel[7];
+
+#define DMA1				(&SimDma1)
+#define DMA1_Channel1		(&SimDma1Channel[0])
+#define DMA1_Channel2		(&SimDma1Channel[1])
+#define DMA1_Channel3		(&SimDma1Channel[2])
+#define DMA1_Channel4		(&SimDma1Channel[3])
+#define DMA1_Channel5		(&SimDma1Channel[4])
+#define DMA1_Channel6		(&SimDma1Channel[5])
+#define DMA1_Channel7		(&SimDma1Channel[6])
+
+/* The channels are evenly spaced as on the target, dma_mgr.c steps through them */
+#define DMA1_Channel1_BASE	((uintptr_t)&SimDma1Channel[0])
+#define DMA1_Channel2_BASE	((uintptr_t)&SimDma1Channel[1])
+
+#define DMA_CCR1_EN			((uint32_t)0x00000001)
+
+#define DMA_DIR_PeripheralDST			((uint32_t)0x00000010)
+#define DMA_DIR_PeripheralSRC			((uint32_t)0x00000000)
+#define DMA_PeripheralInc_Enable		((uint32_t)0x00000040)
+#define DMA_PeripheralInc_Disable		((uint32_t)0x00000000)
+#define DMA_MemoryInc_Enable			((uint32_t)0x00000080)
+#define DMA_MemoryInc_Disable			((uint32_t)0x00000000)
+#define DMA_PeripheralDataSize_Byte		((uint32_t)0x00000000)
+#define DMA_PeripheralDataSize_HalfWord	((uint32_t)0x00000100)
+#define DMA_PeripheralDataSize_Word		((uint32_t)0x00000200)
+#define DMA_MemoryDataSize_Byte			((uint32_t)0x00000000)
+#define DMA_MemoryDataSize_HalfWord		((uint32_t)0x00000400)
+#define DMA_MemoryDataSize_Word			((uint32_t)0x00000800)
+#define DMA_Mode_Circular				((uint32_t)0x00000020)
+#define DMA_Mode_Normal					((uint32_t)0x00000000)
+#define DMA_Priority_VeryHigh			((uint32_t)0x00003000)
+#define DMA_Priority_High				((uint32_t)0x00002000)
+#define DMA_Priority_Medium				((uint32_t)0x00001000)
+#define DMA_Priority_Low				((uint32_t)0x00000000)
+#define DMA_M2M_Enable					((uint32_t)0x00004000)
+#define DMA_M2M_Disable					((uint32_t)0x00000000)
+
+#define DMA_IT_TC			((uint32_t)0x00000002)
+#define DMA_IT_HT			((uint32_t)0x00000004)
+#define DMA_IT_TE			((uint32_t)0x00000008)
+
+/* Flags and interrupt bits of ISR/IFCR, 4 per channel */
+#define DMA1_FLAG_GL1		((uint32_t)0x00000001)
+#define DMA1_FLAG_TC1		((uint32_t)0x00000002)
+#define DMA1_FLAG_HT1		((uint32_t)0x00000004)
+#define DMA1_FLAG_TE1		((uint32_t)0x00000008)
+#define DMA1_FLAG_TC3		((uint32_t)0x00000200)
+#define DMA1_IT_GL4			((uint32_t)0x00001000)
+#define DMA1_IT_TC4			((uint32_t)0x00002000)
+#define DMA1_IT_TC5			((uint32_t)0x00020000)
+#define DMA1_IT_HT5			((uint32_t)0x00040000)
+#define DMA1_IT_GL6			((uint32_t)0x00100000)
+#define DMA1_IT_TC6			((uint32_t)0x00200000)
+#define DMA1_IT_GL7			((uint32_t)0x01000000)
+#define DMA1_IT_TC7			((uint32_t)0x02000000)
+
+typedef struct {
+	uint32_t DMA_PeripheralBaseAddr;
+	uint32_t DMA_MemoryBaseAddr;
+	uint32_t DMA_DIR;
+	uint32_t DMA_BufferSize;
+	uint32_t DMA_PeripheralInc;
+	uint32_t DMA_MemoryInc;
+	uint32_t DMA_PeripheralDataSize;
+	uint32_t DMA_MemoryDataSize;
+	uint32_t DMA_Mode;
+	uint32_t DMA_Priority;
+	uint32_t DMA_M2M;
+} DMA_InitTypeDef;
+
+/* sim_dma.c */
+void DMA_DeInit(DMA_Channel_TypeDef *DMAy_Channelx);
+void DMA_Init(DMA_Channel_TypeDef *DMAy_Channelx, DMA_InitTypeDef *DMA_InitStruct);
+void DMA_Cmd(DMA_Channel_TypeDef *DMAy_Channelx, FunctionalState NewState);
+void DMA_ITConfig(DMA_Channel_TypeDef *DMAy_Channelx, uint32_t DMA_IT, FunctionalState NewState);
+void DMA_SetCurrDataCounter(DMA_Channel_TypeDef *DMAy_Channelx, uint16_t DataNumber);
+uint16_t DMA_GetCurrDataCounter(DMA_Channel_TypeDef *DMAy_Channelx);
+FlagStatus DMA_GetFlagStatus(uint32_t DMAy_FLAG);
+void DMA_ClearFlag(uint32_t DMAy_FLAG);
+ITStatus DMA_GetITStatus(uint32_t DMAy_IT);
+void DMA_ClearITPendingBit(uint32_t DMAy_IT);
+
+#endif
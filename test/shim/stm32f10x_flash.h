@@ -0,0 +1,25 @@
+#ifndef HOST_STM32F10X_FLASH_H_
+#define HOST_STM32F10X_FLASH_H_
+
+#include "stm32f10x.h"
+
+typedef enum {
+	FLASH_BUSY = 1,
+	FLASH_ERROR_PG,
+	FLASH_ERROR_WRP,
+	FLASH_COMPLETE,
+	FLASH_TIMEOUT
+} FLASH_Status;
+
+#define FLASH_FLAG_EOP			((uint32_t)0x00000020)
+#define FLASH_FLAG_PGERR		((uint32_t)0x00000004)
+#define FLASH_FLAG_WRPRTERR		((uint32_t)0x00000010)
+
+/* flash_sim.c */
+void FLASH_Unlock(void);
+void FLASH_Lock(void);
+void FLASH_ClearFlag(uint32_t FLASH_FLAG);
+FLASH_Status FLASH_ErasePage(uint32_t Page_Address);
+FLASH_Status FLASH_ProgramHalfWord(uint32_t Address, uint16_t Data);
+
+#endif
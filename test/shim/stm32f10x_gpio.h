@@ -0,0 +1,7 @@
+#ifndef HOST_STM32F10X_GPIO_H_
+#define HOST_STM32F10X_GPIO_H_
+
+/* Declared with the device header, sim_gpio.c implements them */
+#include "stm32f10x.h"
+
+#endif
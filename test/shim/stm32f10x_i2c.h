@@ -0,0 +1,103 @@
+#ifndef HOST_STM32F10X_I2C_H_
+#define HOST_STM32F10X_I2C_H_
+
+#include "stm32f10x.h"
+
+/*
+ * I2C1 as i2c.c drives it, registers and bits of RM0008. sim_i2c_reg.c
+ * runs the peripheral on the virtual clock, I2C2 is declared only.
+ */
+
+typedef struct {
+	volatile uint16_t CR1;
+	volatile uint16_t CR2;
+	volatile uint16_t OAR1;
+	volatile uint16_t OAR2;
+	volatile uint16_t DR;
+	volatile uint16_t SR1;
+	volatile uint16_t SR2;
+	volatile uint16_t CCR;
+	volatile uint16_t TRISE;
+} I2C_TypeDef;
+
+extern I2C_TypeDef SimI2c1;
+extern I2C_TypeDef SimI2c2;
+
+#define I2C1				(&SimI2c1)
+#define I2C2				(&SimI2c2)
+
+#define I2C_CR1_PE			((uint16_t)0x0001)
+#define I2C_CR1_START		((uint16_t)0x0100)
+#define I2C_CR1_STOP		((uint16_t)0x0200)
+#define I2C_CR1_ACK			((uint16_t)0x0400)
+#define I2C_CR1_POS			((uint16_t)0x0800)
+#define I2C_CR1_SWRST		((uint16_t)0x8000)
+
+#define I2C_CR2_FREQ		((uint16_t)0x003F)
+#define I2C_CR2_ITERREN		((uint16_t)0x0100)
+#define I2C_CR2_ITEVTEN		((uint16_t)0x0200)
+#define I2C_CR2_ITBUFEN		((uint16_t)0x0400)
+#define I2C_CR2_DMAEN		((uint16_t)0x0800)
+#define I2C_CR2_LAST		((uint16_t)0x1000)
+
+#define I2C_SR1_SB			((uint16_t)0x0001)
+#define I2C_SR1_ADDR		((uint16_t)0x0002)
+#define I2C_SR1_BTF			((uint16_t)0x0004)
+#define I2C_SR1_STOPF		((uint16_t)0x0010)
+#define I2C_SR1_RXNE		((uint16_t)0x0040)
+#define I2C_SR1_TXE			((uint16_t)0x0080)
+#define I2C_SR1_BERR		((uint16_t)0x0100)
+#define I2C_SR1_ARLO		((uint16_t)0x0200)
+#define I2C_SR1_AF			((uint16_t)0x0400)
+#define I2C_SR1_OVR			((uint16_t)0x0800)
+#define I2C_SR1_TIMEOUT		((uint16_t)0x4000)
+
+#define I2C_SR2_MSL			((uint16_t)0x0001)
+#define I2C_SR2_BUSY		((uint16_t)0x0002)
+#define I2C_SR2_TRA			((uint16_t)0x0004)
+
+#define I2C_CCR_CCR			((uint16_t)0x0FFF)
+#define I2C_CCR_DUTY		((uint16_t)0x4000)
+#define I2C_CCR_FS			((uint16_t)0x8000)
+
+#define I2C_IT_ERR			((uint16_t)0x0100)
+#define I2C_IT_EVT			((uint16_t)0x0200)
+#define I2C_IT_BUF			((uint16_t)0x0400)
+
+#define I2C_Mode_I2C					((uint16_t)0x0000)
+#define I2C_DutyCycle_16_9				((uint16_t)0x4000)
+#define I2C_DutyCycle_2					((uint16_t)0xBFFF)
+#define I2C_Ack_Enable					((uint16_t)0x0400)
+#define I2C_Ack_Disable					((uint16_t)0x0000)
+#define I2C_AcknowledgedAddress_7bit	((uint16_t)0x4000)
+#define I2C_Direction_Transmitter		((uint8_t)0x00)
+#define I2C_Direction_Receiver			((uint8_t)0x01)
+#define I2C_NACKPosition_Next			((uint16_t)0x0800)
+#define I2C_NACKPosition_Current		((uint16_t)0xF7FF)
+
+typedef struct {
+	uint32_t I2C_ClockSpeed;
+	uint16_t I2C_Mode;
+	uint16_t I2C_DutyCycle;
+	uint16_t I2C_OwnAddress1;
+	uint16_t I2C_Ack;
+	uint16_t I2C_AcknowledgedAddress;
+} I2C_InitTypeDef;
+
+/* sim_i2c_reg.c */
+void I2C_Init(I2C_TypeDef *I2Cx, I2C_InitTypeDef *I2C_InitStruct);
+void I2C_StructInit(I2C_InitTypeDef *I2C_InitStruct);
+void I2C_Cmd(I2C_TypeDef *I2Cx, FunctionalState NewState);
+void I2C_ITConfig(I2C_TypeDef *I2Cx, uint16_t I2C_IT, FunctionalState NewState);
+void I2C_DMACmd(I2C_TypeDef *I2Cx, FunctionalState NewState);
+void I2C_DMALastTransferCmd(I2C_TypeDef *I2Cx, FunctionalState NewState);
+void I2C_NACKPositionConfig(I2C_TypeDef *I2Cx, uint16_t I2C_NACKPosition);
+void I2C_AcknowledgeConfig(I2C_TypeDef *I2Cx, FunctionalState NewState);
+void I2C_GenerateSTART(I2C_TypeDef *I2Cx, FunctionalState NewState);
+void I2C_GenerateSTOP(I2C_TypeDef *I2Cx, FunctionalState NewState);
+void I2C_Send7bitAddress(I2C_TypeDef *I2Cx, uint8_t Address, uint8_t I2C_Direction);
+void I2C_SendData(I2C_TypeDef *I2Cx, uint8_t Data);
+uint8_t I2C_ReceiveData(I2C_TypeDef *I2Cx);
+void I2C_SoftwareResetCmd(I2C_TypeDef *I2Cx, FunctionalState NewState);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef HOST_STM32F10X_SPI_H_
+#define HOST_STM32F10X_SPI_H_
+
+/*
+ * Included by the bit-banged SPI examples, which do not use the
+ * peripheral. The registers of RM0008 are there for the address of DR,
+ * nothing simulates them.
+ */
+#include "stm32f10x.h"
+
+typedef struct {
+	volatile uint16_t CR1;
+	uint16_t RESERVED0;
+	volatile uint16_t CR2;
+	uint16_t RESERVED1;
+	volatile uint16_t SR;
+	uint16_t RESERVED2;
+	volatile uint16_t DR;
+	uint16_t RESERVED3;
+} SPI_TypeDef;
+
+extern SPI_TypeDef SimSpi1;
+extern SPI_TypeDef SimSpi2;
+
+#define SPI1				(&SimSpi1)
+#define SPI2				(&SimSpi2)
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef HOST_STM32F10X_TIM_H_
+#define HOST_STM32F10X_TIM_H_
+
+#include "stm32f10x.h"
+
+/*
+ * TIM2 as servo.c uses it: up counting time base, PWM on channel 1 with
+ * CCR1 preload, update interrupt. sim_tim.c runs it on the virtual clock.
+ * TIM3 only holds its registers, its update DMA requests pace the waveform
+ * of sim_wave.c.
+ */
+
+typedef struct {
+	uint16_t PSC;
+	uint16_t ARR;
+	uint16_t CR1;
+	uint16_t DIER;
+	uint16_t SR;
+	uint16_t CNT;
+	uint16_t CCMR1;
+	uint16_t CCER;
+	volatile uint16_t CCR1;				/* Preload register, loaded into the compare at each update */
+} TIM_TypeDef;
+
+extern TIM_TypeDef SimTim2;
+extern TIM_TypeDef SimTim3;
+
+#define TIM2				(&SimTim2)
+#define TIM3				(&SimTim3)
+
+#define TIM_IT_Update		((uint16_t)0x0001)
+#define TIM_DMA_Update		((uint16_t)0x0100)
+#define TIM_CKD_DIV1		((uint16_t)0x0000)
+#define TIM_CKD_DIV2		((uint16_t)0x0100)
+#define TIM_CounterMode_Up	((uint16_t)0x0000)
+#define TIM_OCMode_PWM1		((uint16_t)0x0060)
+#define TIM_OutputState_Enable	((uint16_t)0x0001)
+#define TIM_OCPolarity_High	((uint16_t)0x0000)
+#define TIM_OCPreload_Enable	((uint16_t)0x0008)
+
+typedef struct {
+	uint16_t TIM_Prescaler;
+	uint16_t TIM_CounterMode;
+	uint16_t TIM_Period;
+	uint16_t TIM_ClockDivision;
+	uint8_t TIM_RepetitionCounter;
+} TIM_TimeBaseInitTypeDef;
+
+typedef struct {
+	uint16_t TIM_OCMode;
+	uint16_t TIM_OutputState;
+	uint16_t TIM_Pulse;
+	uint16_t TIM_OCPolarity;
+} TIM_OCInitTypeDef;
+
+void TIM_TimeBaseInit(TIM_TypeDef *TIMx, TIM_TimeBaseInitTypeDef *TIM_TimeBaseInitStruct);
+void TIM_OC1Init(TIM_TypeDef *TIMx, TIM_OCInitTypeDef *TIM_OCInitStruct);
+void TIM_OC1PreloadConfig(TIM_TypeDef *TIMx, uint16_t TIM_OCPreload);
+void TIM_Cmd(TIM_TypeDef *TIMx, FunctionalState NewState);
+void TIM_ITConfig(TIM_TypeDef *TIMx, uint16_t TIM_IT, FunctionalState NewState);
+ITStatus TIM_GetITStatus(TIM_TypeDef *TIMx, uint16_t TIM_IT);
+void TIM_ClearITPendingBit(TIM_TypeDef *TIMx, uint16_t TIM_IT);
+void TIM_DMACmd(TIM_TypeDef *TIMx, uint16_t TIM_DMASource, FunctionalState NewState);
+void TIM_SetCounter(TIM_TypeDef *TIMx, uint16_t Counter);
+uint16_t TIM_GetCounter(TIM_TypeDef *TIMx);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef HOST_STM32F10X_USART_H_
+#define HOST_STM32F10X_USART_H_
+
+#include "stm32f10x.h"
+
+/*
+ * USART1, registers and bits of RM0008. sim_usart.c runs it on the
+ * virtual clock, USART2 and USART3 are declared only.
+ */
+
+typedef struct {
+	volatile uint16_t SR;
+	volatile uint16_t DR;
+	volatile uint16_t BRR;
+	volatile uint16_t CR1;
+	volatile uint16_t CR2;
+	volatile uint16_t CR3;
+} USART_TypeDef;
+
+extern USART_TypeDef SimUsart1;
+extern USART_TypeDef SimUsart2;
+extern USART_TypeDef SimUsart3;
+
+#define USART1				(&SimUsart1)
+#define USART2				(&SimUsart2)
+#define USART3				(&SimUsart3)
+
+#define USART_FLAG_ORE		((uint16_t)0x0008)
+#define USART_FLAG_IDLE		((uint16_t)0x0010)
+#define USART_FLAG_RXNE		((uint16_t)0x0020)
+#define USART_FLAG_TC		((uint16_t)0x0040)
+#define USART_FLAG_TXE		((uint16_t)0x0080)
+
+/* Interrupt: CR1 enable bit in the low byte, SR flag in the high byte */
+#define USART_IT_IDLE		((uint16_t)0x1010)
+#define USART_IT_RXNE		((uint16_t)0x2020)
+
+#define USART_DMAReq_Tx		((uint16_t)0x0080)
+#define USART_DMAReq_Rx		((uint16_t)0x0040)
+
+#define USART_Mode_Rx		((uint16_t)0x0004)
+#define USART_Mode_Tx		((uint16_t)0x0008)
+#define USART_WordLength_8b	((uint16_t)0x0000)
+#define USART_StopBits_1	((uint16_t)0x0000)
+#define USART_Parity_No		((uint16_t)0x0000)
+#define USART_HardwareFlowControl_None	((uint16_t)0x0000)
+
+typedef struct {
+	uint32_t USART_BaudRate;
+	uint16_t USART_WordLength;
+	uint16_t USART_StopBits;
+	uint16_t USART_Parity;
+	uint16_t USART_Mode;
+	uint16_t USART_HardwareFlowControl;
+} USART_InitTypeDef;
+
+/* sim_usart.c */
+void USART_Init(USART_TypeDef *USARTx, USART_InitTypeDef *USART_InitStruct);
+void USART_Cmd(USART_TypeDef *USARTx, FunctionalState NewState);
+void USART_ITConfig(USART_TypeDef *USARTx, uint16_t USART_IT, FunctionalState NewState);
+void USART_DMACmd(USART_TypeDef *USARTx, uint16_t USART_DMAReq, FunctionalState NewState);
+ITStatus USART_GetITStatus(USART_TypeDef *USARTx, uint16_t USART_IT);
+FlagStatus USART_GetFlagStatus(USART_TypeDef *USARTx, uint16_t USART_FLAG);
+void USART_SendData(USART_TypeDef *USARTx, uint16_t Data);
+uint16_t USART_ReceiveData(USART_TypeDef *USARTx);
+
+#endif
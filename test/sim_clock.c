@@ -0,0 +1,101 @@
+#include "sim_clock.h"
+#include "delay.h"
+
+static uint64_t u64Now;
+static uint64_t u64TimerPeriod;
+static uint64_t u64TimerAt;				/* Next interrupt */
+static void (*pfTimerIsr)(void);
+static uint64_t u64EventAt;
+static void (*pfEvent)(void);
+static uint8_t u8InIsr;
+
+void SimClock_Reset(void)
+{
+	u64Now = 0;
+	u64TimerPeriod = 0;
+	pfEvent = 0;
+}
+
+void SimClock_Advance(uint64_t u64Ns)
+{
+	uint64_t u64End = u64Now + u64Ns;
+	void (*pfRun)(void);
+
+	//Time spent inside the interrupt or the event does not nest another one
+	while (!u8InIsr) {
+		if (pfEvent && u64EventAt <= u64End && (!u64TimerPeriod || u64EventAt <= u64TimerAt)) {
+			if (u64EventAt > u64Now) {
+				u64Now = u64EventAt;
+			}
+			pfRun = pfEvent;
+			pfEvent = 0;
+		} else if (u64TimerPeriod && u64TimerAt <= u64End) {
+			u64Now = u64TimerAt;
+			u64TimerAt += u64TimerPeriod;
+			pfRun = pfTimerIsr;
+		} else {
+			break;
+		}
+		u8InIsr = 1;
+		pfRun();
+		u8InIsr = 0;
+	}
+	if (u64End > u64Now) {
+		u64Now = u64End;
+	}
+}
+
+void SimClock_SetTimer(uint64_t u64PeriodNs, void (*pfIsr)(void))
+{
+	u64TimerPeriod = pfIsr ? u64PeriodNs : 0;
+	u64TimerAt = u64Now + u64PeriodNs;
+	pfTimerIsr = pfIsr;
+}
+
+void SimClock_SetEvent(uint64_t u64At, void (*pfRun)(void))
+{
+	u64EventAt = u64At;
+	pfEvent = pfRun;
+}
+
+uint64_t SimClock_NextEvent(void)
+{
+	uint64_t u64At = UINT64_MAX;
+
+	if (pfEvent) {
+		u64At = u64EventAt;
+	}
+	if (u64TimerPeriod && u64TimerAt < u64At) {
+		u64At = u64TimerAt;
+	}
+	return u64At;
+}
+
+uint64_t SimClock_Now(void)
+{
+	return u64Now;
+}
+
+void Delay_Init(void)
+{
+}
+
+void Delay_Us(uint32_t u32DelayInUs)
+{
+	SimClock_Advance((uint64_t)u32DelayInUs * 1000);
+}
+
+void Delay_Ms(uint32_t u32DelayInMs)
+{
+	SimClock_Advance((uint64_t)u32DelayInMs * 1000000);
+}
+
+uint32_t Delay_GetTick(void)
+{
+	return (uint32_t)(u64Now / 1000000);
+}
+
+uint32_t Delay_GetMicros(void)
+{
+	return (uint32_t)(u64Now / 1000);
+}
@@ -0,0 +1,35 @@
+#ifndef SIM_CLOCK_H_
+#define SIM_CLOCK_H_
+
+#include <stdint.h>
+
+/*
+ * Virtual time for the host builds. delay.h is implemented on top of it, so
+ * timeouts and timestamps in the firmware follow the simulated bus time and
+ * not the speed of the machine running the tests.
+ */
+
+void SimClock_Reset(void);
+void SimClock_Advance(uint64_t u64Ns);
+uint64_t SimClock_Now(void);			/* Nanoseconds since the last reset */
+
+/*
+ * Periodic interrupt of a simulated timer: pfIsr runs each time the clock
+ * passes a multiple of u64PeriodNs from now, with the clock at that
+ * instant, preempting the firmware like the real interrupt. A 0 period
+ * stops it, SimClock_Reset too.
+ */
+void SimClock_SetTimer(uint64_t u64PeriodNs, void (*pfIsr)(void));
+
+/*
+ * One shot event of a simulated peripheral: pfEvent runs when the clock
+ * reaches u64At, before a timer interrupt of the same instant. There is
+ * one slot, a new event replaces the one pending and pfEvent may set the
+ * next; a NULL pfEvent cancels. SimClock_Reset cancels it too.
+ */
+void SimClock_SetEvent(uint64_t u64At, void (*pfEvent)(void));
+
+/* Time of the next timer interrupt or event, UINT64_MAX when none */
+uint64_t SimClock_NextEvent(void);
+
+#endif
@@ -0,0 +1,237 @@
+#include "sim_dma.h"
+#include "sim_nvic.h"
+#include <string.h>
+
+#define SIM_DMA_CCR_MASK		((uint32_t)0x00007FFF)
+#define SIM_DMA_CCR_CLEAR		((uint32_t)0xFFFF800F)	/* DMA_Init keeps EN and the interrupt enables */
+#define SIM_DMA_TCIE			((uint32_t)0x00000002)
+#define SIM_DMA_HTIE			((uint32_t)0x00000004)
+#define SIM_DMA_TEIE			((uint32_t)0x00000008)
+#define SIM_DMA_DIR				((uint32_t)0x00000010)
+#define SIM_DMA_CIRC			((uint32_t)0x00000020)
+#define SIM_DMA_PINC			((uint32_t)0x00000040)
+#define SIM_DMA_MINC			((uint32_t)0x00000080)
+#define SIM_DMA_PSIZE_SHIFT		8
+#define SIM_DMA_MSIZE_SHIFT		10
+#define SIM_DMA_M2M				((uint32_t)0x00004000)
+
+DMA_TypeDef SimDma1;
+DMA_Channel_TypeDef SimDma1Channel[7];
+
+static uint16_t u16Reload[7];			/* CNDTR as programmed, for circular mode */
+static uint16_t u16Done[7];				/* Items moved since the channel was enabled or reloaded */
+static void (*pfPoll)(void);
+static void (*pfStart)(uint8_t u8Channel);
+
+static uint8_t SimDma_Index(DMA_Channel_TypeDef *DMAy_Channelx)
+{
+	return (uint8_t)(DMAy_Channelx - SimDma1Channel);
+}
+
+/* IFCR written by the firmware since the last access, CGIF clears all four flags of its channel */
+static void SimDma_Clear(void)
+{
+	uint32_t u32Clear = SimDma1.IFCR;
+	uint8_t i;
+
+	for (i = 0; i < 7; i++) {
+		if (u32Clear & (DMA1_FLAG_GL1 << (4 * i))) {
+			u32Clear |= (uint32_t)0x0F << (4 * i);
+		}
+	}
+	SimDma1.ISR &= ~u32Clear;
+	SimDma1.IFCR = 0;
+}
+
+static void SimDma_Flags(uint8_t i, uint32_t u32Flags)
+{
+	DMA_Channel_TypeDef *pCh = &SimDma1Channel[i];
+
+	SimDma_Clear();
+	SimDma1.ISR |= (u32Flags | DMA1_FLAG_GL1) << (4 * i);
+	if (((u32Flags & DMA1_FLAG_TC1) && (pCh->CCR & SIM_DMA_TCIE)) ||
+		((u32Flags & DMA1_FLAG_HT1) && (pCh->CCR & SIM_DMA_HTIE)) ||
+		((u32Flags & DMA1_FLAG_TE1) && (pCh->CCR & SIM_DMA_TEIE))) {
+		SimNvic_Raise((IRQn_Type)(DMA1_Channel1_IRQn + i));
+	}
+}
+
+void SimDma_Reset(void)
+{
+	memset(&SimDma1, 0, sizeof(SimDma1));
+	memset(SimDma1Channel, 0, sizeof(SimDma1Channel));
+	memset(u16Reload, 0, sizeof(u16Reload));
+	memset(u16Done, 0, sizeof(u16Done));
+	pfPoll = 0;
+	pfStart = 0;
+}
+
+void SimDma_SetPoll(void (*pfFlagPoll)(void))
+{
+	pfPoll = pfFlagPoll;
+}
+
+void SimDma_SetStart(void (*pfChannelStart)(uint8_t u8Channel))
+{
+	pfStart = pfChannelStart;
+}
+
+uint8_t SimDma_Request(uint8_t u8Channel, uint32_t *pu32Data)
+{
+	DMA_Channel_TypeDef *pCh = &SimDma1Channel[u8Channel - 1];
+	uint8_t i = u8Channel - 1;
+	uint8_t u8Size = 1 << ((pCh->CCR >> SIM_DMA_MSIZE_SHIFT) & 3);
+	uint8_t *pMem;
+	uint32_t u32Flags = 0;
+
+	SimDma_Clear();
+	if (!(pCh->CCR & DMA_CCR1_EN) || !pCh->CNDTR) {
+		return 0;
+	}
+	pMem = (uint8_t *)(uintptr_t)pCh->CMAR;
+	if (pCh->CCR & SIM_DMA_MINC) {
+		pMem += (uint32_t)u16Done[i] * u8Size;
+	}
+	if (pCh->CCR & SIM_DMA_DIR) {
+		*pu32Data = 0;
+		memcpy(pu32Data, pMem, u8Size);
+	} else {
+		memcpy(pMem, pu32Data, u8Size);
+	}
+	++u16Done[i];
+	--pCh->CNDTR;
+
+	if (u16Done[i] == u16Reload[i] / 2) {
+		u32Flags |= DMA1_FLAG_HT1;
+	}
+	if (!pCh->CNDTR) {
+		u32Flags |= DMA1_FLAG_TC1;
+		if (pCh->CCR & SIM_DMA_CIRC) {
+			pCh->CNDTR = u16Reload[i];
+			u16Done[i] = 0;
+		}
+	}
+	if (u32Flags) {
+		SimDma_Flags(i, u32Flags);
+	}
+	return 1;
+}
+
+void SimDma_Error(uint8_t u8Channel)
+{
+	SimDma1Channel[u8Channel - 1].CCR &= ~DMA_CCR1_EN;
+	SimDma_Flags(u8Channel - 1, DMA1_FLAG_TE1);
+}
+
+/* Memory to memory, the source on the peripheral side: the whole count at once */
+static void SimDma_Copy(uint8_t i)
+{
+	DMA_Channel_TypeDef *pCh = &SimDma1Channel[i];
+	uint8_t u8PSize = 1 << ((pCh->CCR >> SIM_DMA_PSIZE_SHIFT) & 3);
+	uint8_t u8MSize = 1 << ((pCh->CCR >> SIM_DMA_MSIZE_SHIFT) & 3);
+	const uint8_t *pSrc = (const uint8_t *)(uintptr_t)pCh->CPAR;
+	uint8_t *pDst = (uint8_t *)(uintptr_t)pCh->CMAR;
+	uint32_t u32Item;
+
+	while (pCh->CNDTR) {
+		u32Item = 0;
+		memcpy(&u32Item, pSrc, u8PSize);
+		memcpy(pDst, &u32Item, u8MSize);
+		if (pCh->CCR & SIM_DMA_PINC) {
+			pSrc += u8PSize;
+		}
+		if (pCh->CCR & SIM_DMA_MINC) {
+			pDst += u8MSize;
+		}
+		--pCh->CNDTR;
+	}
+	SimDma_Flags(i, DMA1_FLAG_HT1 | DMA1_FLAG_TC1);
+}
+
+void DMA_DeInit(DMA_Channel_TypeDef *DMAy_Channelx)
+{
+	uint8_t i = SimDma_Index(DMAy_Channelx);
+
+	memset(DMAy_Channelx, 0, sizeof(*DMAy_Channelx));
+	SimDma1.ISR &= ~((uint32_t)0x0F << (4 * i));
+}
+
+void DMA_Init(DMA_Channel_TypeDef *DMAy_Channelx, DMA_InitTypeDef *DMA_InitStruct)
+{
+	uint8_t i = SimDma_Index(DMAy_Channelx);
+
+	DMAy_Channelx->CCR = (DMAy_Channelx->CCR & SIM_DMA_CCR_CLEAR) | ((DMA_InitStruct->DMA_DIR |
+		DMA_InitStruct->DMA_Mode | DMA_InitStruct->DMA_PeripheralInc | DMA_InitStruct->DMA_MemoryInc |
+		DMA_InitStruct->DMA_PeripheralDataSize | DMA_InitStruct->DMA_MemoryDataSize |
+		DMA_InitStruct->DMA_Priority | DMA_InitStruct->DMA_M2M) & SIM_DMA_CCR_MASK);
+	DMAy_Channelx->CNDTR = DMA_InitStruct->DMA_BufferSize & 0xFFFF;
+	DMAy_Channelx->CPAR = DMA_InitStruct->DMA_PeripheralBaseAddr;
+	DMAy_Channelx->CMAR = DMA_InitStruct->DMA_MemoryBaseAddr;
+	u16Reload[i] = DMAy_Channelx->CNDTR;
+	u16Done[i] = 0;
+}
+
+void DMA_Cmd(DMA_Channel_TypeDef *DMAy_Channelx, FunctionalState NewState)
+{
+	uint8_t i = SimDma_Index(DMAy_Channelx);
+
+	if (NewState) {
+		//CNDTR may have been written directly while the channel was off
+		if (!(DMAy_Channelx->CCR & DMA_CCR1_EN)) {
+			u16Reload[i] = DMAy_Channelx->CNDTR;
+			u16Done[i] = 0;
+		}
+		DMAy_Channelx->CCR |= DMA_CCR1_EN;
+		if (DMAy_Channelx->CCR & SIM_DMA_M2M) {
+			SimDma_Copy(i);
+		} else if (pfStart) {
+			pfStart(i + 1);
+		}
+	} else {
+		DMAy_Channelx->CCR &= ~DMA_CCR1_EN;
+	}
+}
+
+void DMA_ITConfig(DMA_Channel_TypeDef *DMAy_Channelx, uint32_t DMA_IT, FunctionalState NewState)
+{
+	if (NewState) {
+		DMAy_Channelx->CCR |= DMA_IT;
+	} else {
+		DMAy_Channelx->CCR &= ~DMA_IT;
+	}
+}
+
+void DMA_SetCurrDataCounter(DMA_Channel_TypeDef *DMAy_Channelx, uint16_t DataNumber)
+{
+	DMAy_Channelx->CNDTR = DataNumber;
+}
+
+uint16_t DMA_GetCurrDataCounter(DMA_Channel_TypeDef *DMAy_Channelx)
+{
+	return (uint16_t)DMAy_Channelx->CNDTR;
+}
+
+FlagStatus DMA_GetFlagStatus(uint32_t DMAy_FLAG)
+{
+	if (pfPoll) {
+		pfPoll();
+	}
+	SimDma_Clear();
+	return (SimDma1.ISR & DMAy_FLAG) ? SET : RESET;
+}
+
+void DMA_ClearFlag(uint32_t DMAy_FLAG)
+{
+	SimDma1.ISR &= ~DMAy_FLAG;
+}
+
+ITStatus DMA_GetITStatus(uint32_t DMAy_IT)
+{
+	SimDma_Clear();
+	return (SimDma1.ISR & DMAy_IT) ? SET : RESET;
+}
+
+void DMA_ClearITPendingBit(uint32_t DMAy_IT)
+{
+	SimDma1.ISR &= ~DMAy_IT;
+}
@@ -0,0 +1,41 @@
+#ifndef SIM_DMA_H_
+#define SIM_DMA_H_
+
+#include "stm32f10x_dma.h"
+
+/*
+ * DMA1 driven by the simulated peripherals
+ *
+ * A peripheral calls SimDma_Request when it raises the request line of a
+ * channel, one item moves per call: from memory into *pu32Data towards
+ * the peripheral (DIR set), or from *pu32Data into memory. CNDTR counts
+ * down, HT and TC are set in ISR and raise the channel interrupt through
+ * sim_nvic.c when enabled, a circular channel reloads. A write to IFCR
+ * clears its flags before the next access of the model. A memory to
+ * memory channel needs no request, it moves everything when enabled.
+ * Addresses are 32 bit as on the target: binaries using it are linked
+ * without PIE and only hand static buffers to the DMA.
+ */
+
+/* Every channel disabled and cleared */
+void SimDma_Reset(void);
+
+/*
+ * Called at each DMA_GetFlagStatus, before the flags are read: time passes
+ * while the firmware polls, the peripheral behind the channel runs in it
+ */
+void SimDma_SetPoll(void (*pfFlagPoll)(void));
+
+/*
+ * Called when DMA_Cmd enables a channel: a peripheral that holds its
+ * request line up (USART TXE with DMAT) gets its first item at once
+ */
+void SimDma_SetStart(void (*pfChannelStart)(uint8_t u8Channel));
+
+/* Returns 0 when the channel is disabled or its count is spent, nothing moved */
+uint8_t SimDma_Request(uint8_t u8Channel, uint32_t *pu32Data);
+
+/* Bus error on the channel: TE set, the channel disables itself and interrupts */
+void SimDma_Error(uint8_t u8Channel);
+
+#endif
@@ -0,0 +1,123 @@
+#include "sim_gpio.h"
+
+#define SIM_GPIO_SLOTS			8
+
+typedef struct {
+	GPIO_TypeDef *pPort;
+	uint16_t u16Pins;
+	SimGpio_Write_t pfWrite;
+} SimGpio_Slot_t;
+
+GPIO_TypeDef SimGpioA;
+GPIO_TypeDef SimGpioB;
+GPIO_TypeDef SimGpioC;
+
+static SimGpio_Slot_t Slots[SIM_GPIO_SLOTS];
+static uint32_t u32Pclk1 = 36000000;
+
+void SimGpio_Attach(GPIO_TypeDef *GPIOx, uint16_t u16Pins, SimGpio_Write_t pfWrite)
+{
+	int i, iFree = -1;
+
+	for (i = 0; i < SIM_GPIO_SLOTS; i++) {
+		if (Slots[i].pPort == GPIOx && Slots[i].u16Pins == u16Pins) {
+			Slots[i].pfWrite = pfWrite;
+			return;
+		}
+		if (!Slots[i].pPort && iFree < 0) {
+			iFree = i;
+		}
+	}
+	if (iFree >= 0) {
+		Slots[iFree].pPort = GPIOx;
+		Slots[iFree].u16Pins = u16Pins;
+		Slots[iFree].pfWrite = pfWrite;
+	}
+}
+
+void SimGpio_SetInput(GPIO_TypeDef *GPIOx, uint16_t u16Pin, uint8_t u8Level)
+{
+	if (u8Level) {
+		GPIOx->u32Port |= u16Pin;
+	} else {
+		GPIOx->u32Port &= ~(uint32_t)u16Pin;
+	}
+}
+
+static void SimGpio_Write(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, uint8_t u8Level)
+{
+	int i;
+
+	SimGpio_SetInput(GPIOx, GPIO_Pin, u8Level);
+	for (i = 0; i < SIM_GPIO_SLOTS; i++) {
+		if (Slots[i].pPort == GPIOx && (Slots[i].u16Pins & GPIO_Pin) && Slots[i].pfWrite) {
+			Slots[i].pfWrite(Slots[i].u16Pins & GPIO_Pin, u8Level);
+		}
+	}
+}
+
+void GPIO_SetBits(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+	SimGpio_Write(GPIOx, GPIO_Pin, 1);
+}
+
+void GPIO_ResetBits(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+	SimGpio_Write(GPIOx, GPIO_Pin, 0);
+}
+
+void GPIO_WriteBit(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, BitAction BitVal)
+{
+	SimGpio_Write(GPIOx, GPIO_Pin, BitVal != Bit_RESET);
+}
+
+uint8_t GPIO_ReadInputDataBit(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+	return (GPIOx->u32Port & GPIO_Pin) ? Bit_SET : Bit_RESET;
+}
+
+void GPIO_StructInit(GPIO_InitTypeDef *GPIO_InitStruct)
+{
+	GPIO_InitStruct->GPIO_Pin = 0xFFFF;
+	GPIO_InitStruct->GPIO_Speed = GPIO_Speed_2MHz;
+	GPIO_InitStruct->GPIO_Mode = GPIO_Mode_IN_FLOATING;
+}
+
+/* Pin modes are not modelled */
+void GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_InitStruct)
+{
+	(void)GPIOx;
+	(void)GPIO_InitStruct;
+}
+
+/* Clock gates are not modelled either */
+void RCC_APB1PeriphClockCmd(uint32_t RCC_APB1Periph, FunctionalState NewState)
+{
+}
+
+void RCC_APB2PeriphClockCmd(uint32_t RCC_APB2Periph, FunctionalState NewState)
+{
+}
+
+void RCC_AHBPeriphClockCmd(uint32_t RCC_AHBPeriph, FunctionalState NewState)
+{
+}
+
+void RCC_APB1PeriphResetCmd(uint32_t RCC_APB1Periph, FunctionalState NewState)
+{
+}
+
+void SimRcc_SetPclk1(uint32_t u32Hz)
+{
+	u32Pclk1 = u32Hz;
+}
+
+/* 72 MHz core, APB1 as set, 36 MHz unless a test changed it */
+void RCC_GetClocksFreq(RCC_ClocksTypeDef *RCC_Clocks)
+{
+	RCC_Clocks->SYSCLK_Frequency = 72000000;
+	RCC_Clocks->HCLK_Frequency = 72000000;
+	RCC_Clocks->PCLK1_Frequency = u32Pclk1;
+	RCC_Clocks->PCLK2_Frequency = 72000000;
+	RCC_Clocks->ADCCLK_Frequency = 12000000;
+}
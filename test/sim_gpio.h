@@ -0,0 +1,24 @@
+#ifndef SIM_GPIO_H_
+#define SIM_GPIO_H_
+
+#include "stm32f10x.h"
+
+/*
+ * GPIO ports of the shim, shared by the simulators
+ *
+ * GPIO_SetBits/GPIO_ResetBits keep the pin levels in the port and hand
+ * every write to the simulator attached to the pin (a chip select), the
+ * simulators drive their outputs (an IRQ line) with SimGpio_SetInput for
+ * GPIO_ReadInputDataBit.
+ */
+
+typedef void (*SimGpio_Write_t)(uint16_t u16Pin, uint8_t u8Level);
+
+/* Attach pfWrite to the pins, replaces the simulator attached before */
+void SimGpio_Attach(GPIO_TypeDef *GPIOx, uint16_t u16Pins, SimGpio_Write_t pfWrite);
+void SimGpio_SetInput(GPIO_TypeDef *GPIOx, uint16_t u16Pin, uint8_t u8Level);
+
+/* APB1 clock RCC_GetClocksFreq reports, 36 MHz at start */
+void SimRcc_SetPclk1(uint32_t u32Hz);
+
+#endif
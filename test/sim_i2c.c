@@ -0,0 +1,176 @@
+#include "sim_i2c.h"
+#include "sim_clock.h"
+#include "i2c.h"
+#include <string.h>
+
+static SimI2c_Device_t Devices[SIM_I2C_DEVICES];
+static uint8_t u8SpeedAddr[I2C_MAX_DEVICES];
+static uint32_t u32SpeedHz[I2C_MAX_DEVICES];
+static I2C_Stats_t Stats;
+static uint64_t u64XferStart;			/* START of the running transaction */
+static uint32_t u32XferHz;
+
+static SimI2c_Device_t *SimI2c_Find(uint8_t Address)
+{
+	int i;
+
+	for (i = 0; i < SIM_I2C_DEVICES; i++) {
+		if (Devices[i].pfAck && Devices[i].u8Addr == (Address & 0xFE)) {
+			return &Devices[i];
+		}
+	}
+	return 0;
+}
+
+/* 9 clocks per byte, START and STOP one clock each */
+static uint64_t SimI2c_Ns(uint32_t u32Clocks, uint32_t u32Hz)
+{
+	return (uint64_t)u32Clocks * 1000000000ULL / u32Hz;
+}
+
+/* Address byte on the bus, returns the device if it ACKed */
+static SimI2c_Device_t *SimI2c_Start(uint8_t Address, uint8_t u8Read)
+{
+	SimI2c_Device_t *pDev = SimI2c_Find(Address);
+
+	u32XferHz = I2C_GetSpeed(Address);
+	if (!u32XferHz) {
+		u32XferHz = pDev ? pDev->u32Hz : I2C_SPEED_STANDARD;
+	}
+	u64XferStart = SimClock_Now();
+	++Stats.u32Transfers;
+	if (!pDev || !pDev->pfAck(u8Read)) {
+		SimClock_Advance(SimI2c_Ns(1 + 9 + 1, u32XferHz));
+		++Stats.u32Nacks;
+		return 0;
+	}
+	return pDev;
+}
+
+uint64_t SimI2c_ByteTime(uint16_t u16Index)
+{
+	return u64XferStart + SimI2c_Ns(1 + 9 * (2 + u16Index), u32XferHz);
+}
+
+uint8_t I2C_Write(uint8_t Address, uint8_t *pData, uint16_t length)
+{
+	SimI2c_Device_t *pDev = SimI2c_Start(Address, 0);
+
+	if (!pDev) {
+		return Error;
+	}
+	SimClock_Advance(SimI2c_Ns(1 + 9 * (1 + length) + 1, u32XferHz));
+	if (pDev->pfWrite) {
+		pDev->pfWrite(pData, length);
+	}
+	return Success;
+}
+
+uint8_t I2C_Read(uint8_t Address, uint8_t *pData, uint16_t length)
+{
+	SimI2c_Device_t *pDev = SimI2c_Start(Address, 1);
+
+	if (!pDev) {
+		return Error;
+	}
+	SimClock_Advance(SimI2c_Ns(1 + 9 * (1 + length) + 1, u32XferHz));
+	if (pDev->pfRead) {
+		pDev->pfRead(pData, length);
+	} else {
+		memset(pData, 0xFF, length);
+	}
+	return Success;
+}
+
+void SimI2c_Attach(const SimI2c_Device_t *pDevice)
+{
+	SimI2c_Device_t *pDev = SimI2c_Find(pDevice->u8Addr);
+	int i;
+
+	for (i = 0; !pDev && i < SIM_I2C_DEVICES; i++) {
+		if (!Devices[i].pfAck) {
+			pDev = &Devices[i];
+		}
+	}
+	if (pDev) {
+		*pDev = *pDevice;
+		pDev->u8Addr &= 0xFE;
+	}
+}
+
+void SimI2c_Reset(void)
+{
+	memset(Devices, 0, sizeof(Devices));
+	memset(u8SpeedAddr, 0, sizeof(u8SpeedAddr));
+	memset(u32SpeedHz, 0, sizeof(u32SpeedHz));
+	memset(&Stats, 0, sizeof(Stats));
+}
+
+void My_I2C_Init(void)
+{
+}
+
+Status I2C_SetSpeed(uint8_t Address, uint32_t u32Hz)
+{
+	int i;
+
+	if (u32Hz > I2C_SPEED_FAST) {
+		u32Hz = I2C_SPEED_FAST;
+	}
+	for (i = 0; i < I2C_MAX_DEVICES; i++) {
+		if (u32SpeedHz[i] && u8SpeedAddr[i] == (Address & 0xFE)) {
+			u32SpeedHz[i] = u32Hz;
+			return Success;
+		}
+	}
+	for (i = 0; i < I2C_MAX_DEVICES; i++) {
+		if (!u32SpeedHz[i]) {
+			u8SpeedAddr[i] = Address & 0xFE;
+			u32SpeedHz[i] = u32Hz;
+			return Success;
+		}
+	}
+	return Error;
+}
+
+uint32_t I2C_GetSpeed(uint8_t Address)
+{
+	int i;
+
+	for (i = 0; i < I2C_MAX_DEVICES; i++) {
+		if (u32SpeedHz[i] && u8SpeedAddr[i] == (Address & 0xFE)) {
+			return u32SpeedHz[i];
+		}
+	}
+	return 0;
+}
+
+/* A device answers at any rate up to its own */
+uint32_t I2C_Probe(uint8_t Address, uint32_t u32MaxHz)
+{
+	SimI2c_Device_t *pDev = SimI2c_Find(Address);
+	uint8_t u8Byte;
+
+	if (!pDev) {
+		I2C_Read(Address, &u8Byte, 1);
+		return 0;
+	}
+	if (u32MaxHz > pDev->u32Hz) {
+		u32MaxHz = pDev->u32Hz;
+	}
+	I2C_SetSpeed(Address, u32MaxHz);
+	return (I2C_Read(Address, &u8Byte, 1) == Success) ? u32MaxHz : 0;
+}
+
+void I2C_Watchdog(void)
+{
+}
+
+void I2C_Recover(void)
+{
+}
+
+void I2C_GetStats(I2C_Stats_t *pStats)
+{
+	*pStats = Stats;
+}
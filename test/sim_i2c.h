@@ -0,0 +1,37 @@
+#ifndef SIM_I2C_H_
+#define SIM_I2C_H_
+
+#include <stdint.h>
+
+/*
+ * I2C1 at transaction level, shared by the simulated I2C devices
+ *
+ * Replaces i2c.c: I2C_Write and I2C_Read hand the transaction to the
+ * device attached at the address. START, the address byte, every data byte
+ * with its ACK (9 clocks) and STOP advance the virtual clock at the rate
+ * set with I2C_SetSpeed or I2C_Probe, or the rate of the device when the
+ * firmware set none. A transaction nobody ACKs costs the address byte.
+ */
+
+#define SIM_I2C_DEVICES			4
+
+typedef struct {
+	uint8_t u8Addr;						/* 8 bit address, bit 0 is ignored */
+	uint32_t u32Hz;						/* Rate used when the firmware set none */
+	/* Address byte, returns 0 to NACK the transaction */
+	uint8_t (*pfAck)(uint8_t u8Read);
+	/* Data of an ACKed transaction, the clock is past its STOP */
+	void (*pfWrite)(const uint8_t *pData, uint16_t u16Len);
+	void (*pfRead)(uint8_t *pData, uint16_t u16Len);
+} SimI2c_Device_t;
+
+/* Attach a device, replaces the one at the same address */
+void SimI2c_Attach(const SimI2c_Device_t *pDevice);
+
+/* Detach every device and forget the rates the firmware set */
+void SimI2c_Reset(void);
+
+/* Time data byte u16Index of the running transaction was ACKed, for devices that act on every byte */
+uint64_t SimI2c_ByteTime(uint16_t u16Index);
+
+#endif
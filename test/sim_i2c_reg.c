@@ -0,0 +1,703 @@
+#include "sim_i2c_reg.h"
+#include "sim_i2c.h"
+#include "sim_clock.h"
+#include "sim_nvic.h"
+#include "sim_dma.h"
+#include "sim_gpio.h"
+#include <stdio.h>
+#include <string.h>
+
+#define SIM_I2C_REG_BYTES		512		/* Longest transaction recorded */
+#define SIM_I2C_REG_TRACE		16384
+#define SIM_I2C_REG_SCL			GPIO_Pin_6
+#define SIM_I2C_REG_SDA			GPIO_Pin_7
+#define SIM_I2C_REG_ERRORS		(I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_AF | I2C_SR1_OVR | I2C_SR1_TIMEOUT)
+
+enum {
+	SIM_BUS_IDLE = 0,
+	SIM_BUS_START,						/* START condition on the bus */
+	SIM_BUS_SB,							/* SB set, waiting for the address in DR */
+	SIM_BUS_ADDRESS,					/* Address byte on the bus */
+	SIM_BUS_ADDR,						/* ADDR set, waiting for it to be cleared */
+	SIM_BUS_TX,
+	SIM_BUS_RX,							/* A byte is always on the bus */
+	SIM_BUS_HOLD,						/* SCL held low after a NACK, waiting for STOP */
+	SIM_BUS_STOP,						/* STOP condition on the bus */
+	SIM_BUS_WAIT_FREE,					/* START asked for on a wedged bus */
+	SIM_BUS_STALLED						/* Wedged in the middle of a transfer */
+};
+
+void I2C1_EV_IRQHandler(void);
+void I2C1_ER_IRQHandler(void);
+void DMA1_Channel7_IRQHandler(void);
+
+I2C_TypeDef SimI2c1;
+I2C_TypeDef SimI2c2;
+
+static SimI2c_Device_t Devices[SIM_I2C_DEVICES];
+static SimI2c_Device_t *pDev;			/* Device that ACKed the address */
+static uint8_t u8State;
+static uint16_t u16Sr1;					/* SR1 as the hardware holds it */
+static uint8_t u8Addr;
+static uint8_t u8Data[SIM_I2C_REG_BYTES];
+static uint64_t u64AckAt[SIM_I2C_REG_BYTES];
+static uint16_t u16Count;
+static uint8_t u8Dr;
+static uint8_t u8DrFull;				/* Transmit: a byte waits in DR */
+static uint8_t u8Shift;
+static uint8_t u8Shifting;				/* Transmit: a byte is on the bus */
+static uint64_t u64BitNs = 10000;
+static uint64_t u64StartAt;
+static uint8_t u8Wedged;
+static uint8_t u8WedgeEdges;
+static uint8_t u8Scl = 1;
+static uint64_t u64StormAt;
+static uint32_t u32StormRuns;
+static SimI2cReg_Stats_t Stats;
+static char szTrace[SIM_I2C_REG_TRACE];
+static size_t TraceLen;
+
+static void SimI2cReg_Start(void);
+
+static void SimI2cReg_Log(const char *psz)
+{
+	size_t len = strlen(psz);
+
+	if (TraceLen + len + 2 < sizeof(szTrace)) {
+		if (TraceLen) {
+			szTrace[TraceLen++] = ' ';
+		}
+		memcpy(&szTrace[TraceLen], psz, len + 1);
+		TraceLen += len;
+	}
+}
+
+/* Event flags are read only, the error flags rc_w0: keep what the firmware cleared of them */
+static void SimI2cReg_Sr1(uint16_t u16Set, uint16_t u16Clear)
+{
+	u16Sr1 &= ~SIM_I2C_REG_ERRORS | SimI2c1.SR1;
+	u16Sr1 = (u16Sr1 & ~u16Clear) | u16Set;
+	SimI2c1.SR1 = u16Sr1;
+}
+
+static void SimI2cReg_At(uint64_t u64Ns, void (*pfStep)(void))
+{
+	SimClock_SetEvent(SimClock_Now() + u64Ns, pfStep);
+}
+
+/* Level triggered: raised as long as an enabled flag is set */
+static void SimI2cReg_Irqs(void)
+{
+	uint16_t u16Cr2 = SimI2c1.CR2;
+
+	SimI2cReg_Sr1(0, 0);
+	if ((u16Cr2 & I2C_CR2_ITEVTEN) && ((u16Sr1 & (I2C_SR1_SB | I2C_SR1_ADDR | I2C_SR1_BTF)) ||
+		((u16Cr2 & I2C_CR2_ITBUFEN) && (u16Sr1 & (I2C_SR1_TXE | I2C_SR1_RXNE))))) {
+		SimNvic_Raise(I2C1_EV_IRQn);
+	}
+	if ((u16Cr2 & I2C_CR2_ITERREN) && (u16Sr1 & SIM_I2C_REG_ERRORS)) {
+		SimNvic_Raise(I2C1_ER_IRQn);
+	}
+}
+
+static SimI2c_Device_t *SimI2cReg_Find(uint8_t Address)
+{
+	int i;
+
+	for (i = 0; i < SIM_I2C_DEVICES; i++) {
+		if (Devices[i].pfAck && Devices[i].u8Addr == (Address & 0xFE)) {
+			return &Devices[i];
+		}
+	}
+	return 0;
+}
+
+static void SimI2cReg_StopDone(void)
+{
+	SimI2c1.CR1 &= ~I2C_CR1_STOP;
+	SimI2cReg_Sr1(0, I2C_SR1_BTF | I2C_SR1_TXE);
+	SimI2c1.SR2 = 0;
+	u8State = SIM_BUS_IDLE;
+	u8DrFull = 0;
+	u8Shifting = 0;
+	++Stats.u32Transactions;
+	Stats.u64BusNs += SimClock_Now() - u64StartAt;
+	SimI2cReg_Log("p");
+	if (pDev && !(u8Addr & 1) && pDev->pfWrite) {
+		pDev->pfWrite(u8Data, u16Count);
+	}
+	pDev = 0;
+	if (SimI2c1.CR1 & I2C_CR1_START) {
+		SimI2cReg_Start();
+	}
+}
+
+/* STOP after the byte just ended */
+static void SimI2cReg_Stop(void)
+{
+	u8State = SIM_BUS_STOP;
+	SimI2cReg_At(u64BitNs, SimI2cReg_StopDone);
+}
+
+static void SimI2cReg_Record(uint8_t u8Byte)
+{
+	if (u16Count < SIM_I2C_REG_BYTES) {
+		u64AckAt[u16Count] = SimClock_Now();
+		u8Data[u16Count++] = u8Byte;
+	}
+	++Stats.u32Bytes;
+}
+
+static void SimI2cReg_TxByte(void);
+
+/* DR into the shift register when the bus is free for it */
+static void SimI2cReg_TxShift(void)
+{
+	if (!u8Shifting && u8DrFull) {
+		u8Shift = u8Dr;
+		u8DrFull = 0;
+		u8Shifting = 1;
+		SimI2cReg_Sr1(I2C_SR1_TXE, 0);
+		SimI2cReg_At(9 * u64BitNs, SimI2cReg_TxByte);
+	}
+}
+
+/* TXE is the DMA request of channel 6 */
+static void SimI2cReg_TxFill(void)
+{
+	uint32_t u32Data;
+
+	while ((SimI2c1.CR2 & I2C_CR2_DMAEN) && (u16Sr1 & I2C_SR1_TXE) && !u8DrFull && SimDma_Request(6, &u32Data)) {
+		u8Dr = (uint8_t)u32Data;
+		u8DrFull = 1;
+		SimI2cReg_Sr1(0, I2C_SR1_TXE | I2C_SR1_BTF);
+		SimI2cReg_TxShift();
+	}
+}
+
+static void SimI2cReg_TxByte(void)
+{
+	u8Shifting = 0;
+	SimI2cReg_Record(u8Shift);
+	if (SimI2c1.CR1 & I2C_CR1_STOP) {
+		SimI2cReg_Stop();
+	} else if (u8DrFull) {
+		SimI2cReg_TxShift();
+		SimI2cReg_TxFill();
+	} else {
+		SimI2cReg_TxFill();
+		if (!u8Shifting) {
+			SimI2cReg_Sr1(I2C_SR1_BTF, 0);
+		}
+	}
+	SimI2cReg_Irqs();
+}
+
+static void SimI2cReg_RxByte(void)
+{
+	uint8_t u8Byte = 0xFF;
+	uint8_t u8Nack;
+	uint32_t u32Data;
+
+	if (pDev && pDev->pfRead) {
+		pDev->pfRead(&u8Byte, 1);
+	}
+	SimI2cReg_Record(u8Byte);
+	u8Nack = !(SimI2c1.CR1 & I2C_CR1_ACK) || ((SimI2c1.CR2 & (I2C_CR2_DMAEN | I2C_CR2_LAST)) ==
+		(I2C_CR2_DMAEN | I2C_CR2_LAST) && DMA1_Channel7->CNDTR == 1);
+	if (u16Sr1 & I2C_SR1_RXNE) {
+		++Stats.u32Overruns;
+	}
+	u8Dr = u8Byte;
+	SimI2cReg_Sr1(I2C_SR1_RXNE, 0);
+	if (SimI2c1.CR2 & I2C_CR2_DMAEN) {
+		u32Data = u8Byte;
+		if (SimDma_Request(7, &u32Data)) {
+			SimI2cReg_Sr1(0, I2C_SR1_RXNE);
+		}
+	}
+
+	//A handler may have reset or disabled the peripheral
+	if (u8State != SIM_BUS_RX) {
+		return;
+	}
+	if (SimI2c1.CR1 & I2C_CR1_STOP) {
+		SimI2cReg_Stop();
+	} else if (u8Nack) {
+		u8State = SIM_BUS_HOLD;
+	} else {
+		SimI2cReg_At(9 * u64BitNs, SimI2cReg_RxByte);
+	}
+	SimI2cReg_Irqs();
+}
+
+/* ADDR cleared: the data phase starts */
+static void SimI2cReg_Addressed(void)
+{
+	if (u8Addr & 1) {
+		u8State = SIM_BUS_RX;
+		SimI2cReg_At(9 * u64BitNs, SimI2cReg_RxByte);
+		return;
+	}
+	u8State = SIM_BUS_TX;
+	SimI2cReg_Sr1(I2C_SR1_TXE, 0);
+	if (SimI2c1.CR1 & I2C_CR1_STOP) {
+		SimI2cReg_Stop();
+		return;
+	}
+	SimI2cReg_TxFill();
+}
+
+static void SimI2cReg_AddressDone(void)
+{
+	SimI2c_Device_t *p = SimI2cReg_Find(u8Addr);
+	uint32_t u32Hz = SimI2cReg_SclHz();
+
+	u16Count = 0;
+	//A device clocked above its rate misses its address
+	if (!p || (p->u32Hz && (uint64_t)u32Hz * 10 > (uint64_t)p->u32Hz * 11) || !p->pfAck(u8Addr & 1)) {
+		++Stats.u32Nacks;
+		SimI2cReg_Log("nack");
+		pDev = 0;
+		u8State = SIM_BUS_HOLD;
+		SimI2cReg_Sr1(I2C_SR1_AF, 0);
+		if (SimI2c1.CR1 & I2C_CR1_STOP) {
+			SimI2cReg_Stop();
+		}
+		SimI2cReg_Irqs();
+		return;
+	}
+	pDev = p;
+	u8State = SIM_BUS_ADDR;
+	SimI2c1.SR2 |= (u8Addr & 1) ? 0 : I2C_SR2_TRA;
+	SimI2cReg_Sr1(I2C_SR1_ADDR, 0);
+	SimI2cReg_Irqs();
+}
+
+static void SimI2cReg_StartDone(void)
+{
+	SimI2c1.CR1 &= ~I2C_CR1_START;
+	SimI2c1.SR2 |= I2C_SR2_MSL | I2C_SR2_BUSY;
+	u8State = SIM_BUS_SB;
+	SimI2cReg_Sr1(I2C_SR1_SB, 0);
+	SimI2cReg_Irqs();
+}
+
+static void SimI2cReg_Start(void)
+{
+	if (!(SimI2c1.CR1 & I2C_CR1_PE)) {
+		return;
+	}
+	if (u8Wedged) {
+		SimI2c1.SR2 |= I2C_SR2_BUSY;
+		u8State = SIM_BUS_WAIT_FREE;
+		return;
+	}
+	u8State = SIM_BUS_START;
+	u64StartAt = SimClock_Now();
+	SimI2cReg_At(u64BitNs, SimI2cReg_StartDone);
+}
+
+/* Entry of the event interrupt, logs the flags the handler finds */
+static void SimI2cReg_EvEntry(void)
+{
+	static const char *pszFlags[] = {"SB", "ADDR", "BTF", 0, 0, 0, "RXNE", "TXE"};
+	char sz[48] = "[";
+	uint16_t u16Seen;
+	int i;
+
+	SimI2cReg_Sr1(0, 0);
+	u16Seen = u16Sr1;
+	for (i = 0; i < 8; i++) {
+		if ((u16Seen & (1 << i)) && pszFlags[i]) {
+			if (sz[1]) {
+				strcat(sz, " ");
+			}
+			strcat(sz, pszFlags[i]);
+		}
+	}
+	strcat(sz, "]");
+	SimI2cReg_Log(sz);
+	++Stats.u32EvIrqs;
+
+	I2C1_EV_IRQHandler();
+
+	if ((u16Seen & I2C_SR1_ADDR) && (u16Sr1 & I2C_SR1_ADDR)) {
+		SimI2cReg_Sr1(0, I2C_SR1_ADDR);
+		SimI2cReg_Addressed();
+	}
+
+	//Still asserted: it runs again, a storm when it never stops
+	if (u64StormAt != SimClock_Now()) {
+		u64StormAt = SimClock_Now();
+		u32StormRuns = 0;
+	}
+	if (++u32StormRuns == SIM_I2C_REG_STORM) {
+		++Stats.u32Storms;
+		SimI2cReg_Log("storm");
+		return;
+	}
+	if (u32StormRuns < SIM_I2C_REG_STORM) {
+		SimI2cReg_Irqs();
+	}
+}
+
+static void SimI2cReg_ErEntry(void)
+{
+	char sz[48];
+
+	SimI2cReg_Sr1(0, 0);
+	snprintf(sz, sizeof(sz), "{%s%s%s}", (u16Sr1 & I2C_SR1_AF) ? "AF" : "", (u16Sr1 & I2C_SR1_BERR) ? " BERR" : "",
+		(u16Sr1 & I2C_SR1_ARLO) ? " ARLO" : "");
+	SimI2cReg_Log(sz);
+	++Stats.u32ErIrqs;
+	I2C1_ER_IRQHandler();
+	SimI2cReg_Sr1(0, 0);
+}
+
+static void SimI2cReg_Dma7Entry(void)
+{
+	SimI2cReg_Log("{TC7}");
+	DMA1_Channel7_IRQHandler();
+}
+
+static void SimI2cReg_SclWrite(uint16_t u16Pin, uint8_t u8Level)
+{
+	if (u8Scl && !u8Level) {
+		++Stats.u32SclPulses;
+		if (u8Wedged && u8WedgeEdges != SIM_I2C_REG_FOREVER && !--u8WedgeEdges) {
+			u8Wedged = 0;
+			SimGpio_SetInput(GPIOB, SIM_I2C_REG_SDA, 1);
+			SimI2cReg_Log("free");
+		}
+	}
+	u8Scl = u8Level;
+}
+
+static void SimI2cReg_SdaWrite(uint16_t u16Pin, uint8_t u8Level)
+{
+	if (u8Wedged) {
+		SimGpio_SetInput(GPIOB, SIM_I2C_REG_SDA, 0);
+	}
+}
+
+static void SimI2cReg_Idle(void)
+{
+	SimClock_SetEvent(0, 0);
+	u8State = SIM_BUS_IDLE;
+	u8DrFull = 0;
+	u8Shifting = 0;
+	pDev = 0;
+	SimI2c1.SR2 = u8Wedged ? I2C_SR2_BUSY : 0;
+}
+
+void SimI2cReg_Open(void)
+{
+	memset(&SimI2c1, 0, sizeof(SimI2c1));
+	u16Sr1 = 0;
+	u8Wedged = 0;
+	u8Scl = 1;
+	SimI2cReg_Idle();
+	SimI2cReg_ResetStats();
+	SimI2cReg_ClearTrace();
+	SimNvic_SetVector(I2C1_EV_IRQn, SimI2cReg_EvEntry);
+	SimNvic_SetVector(I2C1_ER_IRQn, SimI2cReg_ErEntry);
+	SimNvic_SetVector(DMA1_Channel7_IRQn, SimI2cReg_Dma7Entry);
+	SimGpio_Attach(GPIOB, SIM_I2C_REG_SCL, SimI2cReg_SclWrite);
+	SimGpio_Attach(GPIOB, SIM_I2C_REG_SDA, SimI2cReg_SdaWrite);
+	SimGpio_SetInput(GPIOB, SIM_I2C_REG_SCL | SIM_I2C_REG_SDA, 1);
+}
+
+void SimI2cReg_Wedge(uint8_t u8Edges)
+{
+	u8Wedged = 1;
+	u8WedgeEdges = u8Edges;
+	SimGpio_SetInput(GPIOB, SIM_I2C_REG_SDA, 0);
+	SimI2c1.SR2 |= I2C_SR2_BUSY;
+	if (u8State != SIM_BUS_IDLE) {
+		SimClock_SetEvent(0, 0);
+		u8State = SIM_BUS_STALLED;
+	}
+	SimI2cReg_Log("wedge");
+}
+
+uint8_t SimI2cReg_IsWedged(void)
+{
+	return u8Wedged;
+}
+
+uint32_t SimI2cReg_SclHz(void)
+{
+	return (uint32_t)(1000000000ULL / u64BitNs);
+}
+
+const char *SimI2cReg_Trace(void)
+{
+	return szTrace;
+}
+
+void SimI2cReg_ClearTrace(void)
+{
+	szTrace[0] = 0;
+	TraceLen = 0;
+}
+
+void SimI2cReg_GetStats(SimI2cReg_Stats_t *pStats)
+{
+	*pStats = Stats;
+}
+
+void SimI2cReg_ResetStats(void)
+{
+	memset(&Stats, 0, sizeof(Stats));
+}
+
+/* Device API of sim_i2c.h */
+
+void SimI2c_Attach(const SimI2c_Device_t *pDevice)
+{
+	SimI2c_Device_t *p = SimI2cReg_Find(pDevice->u8Addr);
+	int i;
+
+	for (i = 0; !p && i < SIM_I2C_DEVICES; i++) {
+		if (!Devices[i].pfAck) {
+			p = &Devices[i];
+		}
+	}
+	if (p) {
+		*p = *pDevice;
+		p->u8Addr &= 0xFE;
+	}
+}
+
+void SimI2c_Reset(void)
+{
+	memset(Devices, 0, sizeof(Devices));
+}
+
+uint64_t SimI2c_ByteTime(uint16_t u16Index)
+{
+	return (u16Index < u16Count) ? u64AckAt[u16Index] : SimClock_Now();
+}
+
+/* Standard peripheral library */
+
+void I2C_StructInit(I2C_InitTypeDef *I2C_InitStruct)
+{
+	I2C_InitStruct->I2C_ClockSpeed = 5000;
+	I2C_InitStruct->I2C_Mode = I2C_Mode_I2C;
+	I2C_InitStruct->I2C_DutyCycle = I2C_DutyCycle_2;
+	I2C_InitStruct->I2C_OwnAddress1 = 0;
+	I2C_InitStruct->I2C_Ack = I2C_Ack_Disable;
+	I2C_InitStruct->I2C_AcknowledgedAddress = I2C_AcknowledgedAddress_7bit;
+}
+
+/* The CCR and TRISE of the library, see stm32f10x_i2c.c */
+void I2C_Init(I2C_TypeDef *I2Cx, I2C_InitTypeDef *I2C_InitStruct)
+{
+	RCC_ClocksTypeDef Clocks;
+	uint32_t u32Freq, u32Ccr;
+
+	RCC_GetClocksFreq(&Clocks);
+	u32Freq = Clocks.PCLK1_Frequency / 1000000;
+	I2Cx->CR2 = (I2Cx->CR2 & ~I2C_CR2_FREQ) | u32Freq;
+	I2Cx->CR1 &= ~I2C_CR1_PE;
+	if (I2C_InitStruct->I2C_ClockSpeed <= 100000) {
+		u32Ccr = Clocks.PCLK1_Frequency / (I2C_InitStruct->I2C_ClockSpeed << 1);
+		if (u32Ccr < 4) {
+			u32Ccr = 4;
+		}
+		I2Cx->TRISE = u32Freq + 1;
+	} else {
+		if (I2C_InitStruct->I2C_DutyCycle == I2C_DutyCycle_2) {
+			u32Ccr = Clocks.PCLK1_Frequency / (I2C_InitStruct->I2C_ClockSpeed * 3);
+		} else {
+			u32Ccr = (Clocks.PCLK1_Frequency / (I2C_InitStruct->I2C_ClockSpeed * 25)) | I2C_CCR_DUTY;
+		}
+		if (!(u32Ccr & I2C_CCR_CCR)) {
+			u32Ccr |= 1;
+		}
+		u32Ccr |= I2C_CCR_FS;
+		I2Cx->TRISE = u32Freq * 300 / 1000 + 1;
+	}
+	I2Cx->CCR = u32Ccr;
+	I2Cx->CR1 = (I2Cx->CR1 & 0xFBF5) | I2C_InitStruct->I2C_Mode | I2C_InitStruct->I2C_Ack;
+	I2Cx->OAR1 = I2C_InitStruct->I2C_AcknowledgedAddress | I2C_InitStruct->I2C_OwnAddress1;
+	I2C_Cmd(I2Cx, ENABLE);
+}
+
+/* The rate is latched here: CCR written with PE set has no effect */
+void I2C_Cmd(I2C_TypeDef *I2Cx, FunctionalState NewState)
+{
+	RCC_ClocksTypeDef Clocks;
+	uint32_t u32Ccr = I2Cx->CCR & I2C_CCR_CCR;
+	uint32_t u32Periods = 2;
+
+	if (!NewState) {
+		I2Cx->CR1 &= ~I2C_CR1_PE;
+		if (I2Cx == I2C1) {
+			SimI2cReg_Idle();
+		}
+		return;
+	}
+	if ((I2Cx->CR1 & I2C_CR1_PE) || I2Cx != I2C1) {
+		I2Cx->CR1 |= I2C_CR1_PE;
+		return;
+	}
+	I2Cx->CR1 |= I2C_CR1_PE;
+	RCC_GetClocksFreq(&Clocks);
+	if (I2Cx->CCR & I2C_CCR_FS) {
+		u32Periods = (I2Cx->CCR & I2C_CCR_DUTY) ? 25 : 3;
+	}
+	if (!u32Ccr) {
+		u32Ccr = 1;
+	}
+	u64BitNs = (uint64_t)u32Periods * u32Ccr * 1000000000ULL / Clocks.PCLK1_Frequency;
+	if (SimI2c1.CR1 & I2C_CR1_START) {
+		SimI2cReg_Start();
+	}
+}
+
+void I2C_ITConfig(I2C_TypeDef *I2Cx, uint16_t I2C_IT, FunctionalState NewState)
+{
+	if (NewState) {
+		I2Cx->CR2 |= I2C_IT;
+		SimI2cReg_Irqs();
+	} else {
+		I2Cx->CR2 &= ~I2C_IT;
+	}
+}
+
+void I2C_DMACmd(I2C_TypeDef *I2Cx, FunctionalState NewState)
+{
+	if (NewState) {
+		I2Cx->CR2 |= I2C_CR2_DMAEN;
+		if (u8State == SIM_BUS_TX) {
+			SimI2cReg_TxFill();
+		}
+	} else {
+		I2Cx->CR2 &= ~I2C_CR2_DMAEN;
+	}
+}
+
+void I2C_DMALastTransferCmd(I2C_TypeDef *I2Cx, FunctionalState NewState)
+{
+	if (NewState) {
+		I2Cx->CR2 |= I2C_CR2_LAST;
+	} else {
+		I2Cx->CR2 &= ~I2C_CR2_LAST;
+	}
+}
+
+void I2C_NACKPositionConfig(I2C_TypeDef *I2Cx, uint16_t I2C_NACKPosition)
+{
+	if (I2C_NACKPosition == I2C_NACKPosition_Next) {
+		I2Cx->CR1 |= I2C_CR1_POS;
+	} else {
+		I2Cx->CR1 &= I2C_NACKPosition_Current;
+	}
+}
+
+void I2C_AcknowledgeConfig(I2C_TypeDef *I2Cx, FunctionalState NewState)
+{
+	if (NewState) {
+		I2Cx->CR1 |= I2C_CR1_ACK;
+	} else {
+		if (I2Cx->CR1 & I2C_CR1_ACK) {
+			SimI2cReg_Log("A-");
+		}
+		I2Cx->CR1 &= ~I2C_CR1_ACK;
+	}
+}
+
+void I2C_GenerateSTART(I2C_TypeDef *I2Cx, FunctionalState NewState)
+{
+	if (!NewState) {
+		I2Cx->CR1 &= ~I2C_CR1_START;
+		return;
+	}
+	if (I2Cx->CR1 & I2C_CR1_STOP) {
+		++Stats.u32StartInStop;
+		SimI2cReg_Log("S!");
+	} else {
+		SimI2cReg_Log("S");
+	}
+	I2Cx->CR1 |= I2C_CR1_START;
+	if (u8State == SIM_BUS_IDLE) {
+		SimI2cReg_Start();
+	}
+}
+
+void I2C_GenerateSTOP(I2C_TypeDef *I2Cx, FunctionalState NewState)
+{
+	if (!NewState) {
+		I2Cx->CR1 &= ~I2C_CR1_STOP;
+		return;
+	}
+	SimI2cReg_Log("P");
+	I2Cx->CR1 |= I2C_CR1_STOP;
+	switch (u8State) {
+	case SIM_BUS_HOLD:
+		SimI2cReg_Stop();
+		break;
+	case SIM_BUS_TX:
+		if (!u8Shifting) {
+			SimI2cReg_Stop();
+		}
+		break;
+	case SIM_BUS_IDLE:
+		//Not master, nothing to stop
+		I2Cx->CR1 &= ~I2C_CR1_STOP;
+		break;
+	default:
+		//After the byte or the address on the bus; stuck on a wedged bus
+		break;
+	}
+}
+
+void I2C_Send7bitAddress(I2C_TypeDef *I2Cx, uint8_t Address, uint8_t I2C_Direction)
+{
+	u8Addr = (I2C_Direction == I2C_Direction_Receiver) ? (Address | 1) : (Address & 0xFE);
+	I2Cx->DR = u8Addr;
+	SimI2cReg_Log("a");
+	SimI2cReg_Sr1(0, I2C_SR1_SB);
+	if (u8State == SIM_BUS_SB) {
+		u8State = SIM_BUS_ADDRESS;
+		SimI2cReg_At(9 * u64BitNs, SimI2cReg_AddressDone);
+	}
+}
+
+void I2C_SendData(I2C_TypeDef *I2Cx, uint8_t Data)
+{
+	I2Cx->DR = Data;
+	SimI2cReg_Log("w");
+	u8Dr = Data;
+	u8DrFull = 1;
+	SimI2cReg_Sr1(0, I2C_SR1_TXE | I2C_SR1_BTF);
+	if (u8State == SIM_BUS_TX) {
+		SimI2cReg_TxShift();
+	}
+}
+
+uint8_t I2C_ReceiveData(I2C_TypeDef *I2Cx)
+{
+	SimI2cReg_Log("r");
+	SimI2cReg_Sr1(0, I2C_SR1_RXNE | I2C_SR1_BTF);
+	I2Cx->DR = u8Dr;
+	return u8Dr;
+}
+
+void I2C_SoftwareResetCmd(I2C_TypeDef *I2Cx, FunctionalState NewState)
+{
+	if (!NewState) {
+		I2Cx->CR1 &= ~I2C_CR1_SWRST;
+		return;
+	}
+	memset(I2Cx, 0, sizeof(*I2Cx));
+	I2Cx->CR1 = I2C_CR1_SWRST;
+	I2Cx->TRISE = 2;
+	if (I2Cx == I2C1) {
+		u16Sr1 = 0;
+		SimI2cReg_Idle();
+	}
+}
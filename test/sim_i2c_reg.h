@@ -0,0 +1,74 @@
+#ifndef SIM_I2C_REG_H_
+#define SIM_I2C_REG_H_
+
+#include "stm32f10x_i2c.h"
+
+/*
+ * I2C1 at register level, for i2c.c itself
+ *
+ * The bus runs on the virtual clock at the SCL rate of CCR and PCLK1, as
+ * latched when PE is set. SR1/SR2 go through the master event sequences
+ * of RM0008: SB one SCL period after START, ADDR or AF after the address
+ * byte, TXE and BTF per byte sent, RXNE per byte received. The event and
+ * error interrupts are level triggered through sim_nvic.c. With DMAEN,
+ * DMA1 channel 6 feeds DR and channel 7 empties it, LAST NACKs the byte
+ * that ends channel 7. STOP goes on the bus after the byte in progress and
+ * clears CR1_STOP and BUSY one SCL period later; no interrupt marks it.
+ *
+ * The devices of sim_i2c.h attach to it unchanged: pfAck at the address
+ * byte, pfRead for every byte received, pfWrite with the bytes written
+ * after the STOP. A device NACKs its address above its rate.
+ *
+ * The host cannot see the read of SR2, ADDR clears when the handler that
+ * found it set returns.
+ *
+ * A device can wedge the bus by holding SDA low: BUSY stays set, a START
+ * is never sent and a transfer on the bus stops where it is. SDA is let go
+ * after a number of falling edges on SCL (PB6) driven as GPIO.
+ */
+
+#define SIM_I2C_REG_FOREVER		0xFF	/* SDA never released */
+#define SIM_I2C_REG_STORM		64		/* Handler runs at one instant that make a storm */
+
+typedef struct {
+	uint32_t u32Transactions;			/* STOPs on the bus */
+	uint32_t u32Bytes;					/* Data bytes, the address bytes not counted */
+	uint32_t u32Nacks;					/* Address bytes nobody ACKed */
+	uint32_t u32EvIrqs;
+	uint32_t u32ErIrqs;
+	uint32_t u32StartInStop;			/* START set while the STOP before it was still pending */
+	uint32_t u32Overruns;				/* Byte received with the one before still in DR */
+	uint32_t u32Storms;					/* An event flag left set, the handler ran SIM_I2C_REG_STORM times */
+	uint32_t u32SclPulses;				/* Falling edges of SCL driven as GPIO */
+	uint64_t u64BusNs;					/* From START to STOP, summed */
+} SimI2cReg_Stats_t;
+
+/* Peripheral reset, bus free, interrupt vectors of i2c.c set, trace and stats cleared */
+void SimI2cReg_Open(void);
+
+/* Hold SDA low until u8Edges SCL falling edges, SIM_I2C_REG_FOREVER for never */
+void SimI2cReg_Wedge(uint8_t u8Edges);
+uint8_t SimI2cReg_IsWedged(void);
+
+/* SCL rate latched when PE was last set */
+uint32_t SimI2cReg_SclHz(void);
+
+/*
+ * What happened on the bus and in the handlers since the last clear:
+ *
+ *   S / S!      START set / set while a STOP was pending
+ *   [SB ADDR]   event handler entered with these SR1 flags
+ *   {AF}        error handler entered with these SR1 flags
+ *   {TC7}       DMA channel 7 handler entered
+ *   a w r       address written, data byte written, data byte read by the CPU
+ *   A-          ACK cleared
+ *   nack        address byte not ACKed
+ *   P / p       STOP set / STOP on the bus
+ */
+const char *SimI2cReg_Trace(void);
+void SimI2cReg_ClearTrace(void);
+
+void SimI2cReg_GetStats(SimI2cReg_Stats_t *pStats);
+void SimI2cReg_ResetStats(void);
+
+#endif
@@ -0,0 +1,98 @@
+#include "sim_nvic.h"
+#include <string.h>
+
+static void (*pfVectors[SIM_IRQ_COUNT])(void);
+static uint8_t u8Enabled[SIM_IRQ_COUNT];
+static uint8_t u8Pending[SIM_IRQ_COUNT];
+static uint32_t u32Count[SIM_IRQ_COUNT];
+static uint32_t u32Total;
+static uint32_t u32Primask;
+static uint8_t u8InHandler;
+
+/* Runs the pending handlers, lowest channel first like equal priorities on the NVIC */
+static void SimNvic_Dispatch(void)
+{
+	int i;
+
+	while (!u32Primask && !u8InHandler) {
+		for (i = 0; i < SIM_IRQ_COUNT && !(u8Pending[i] && u8Enabled[i] && pfVectors[i]); i++) {
+		}
+		if (i == SIM_IRQ_COUNT) {
+			return;
+		}
+		u8Pending[i] = 0;
+		++u32Count[i];
+		++u32Total;
+		u8InHandler = 1;
+		pfVectors[i]();
+		u8InHandler = 0;
+	}
+}
+
+void SimNvic_Reset(void)
+{
+	memset(pfVectors, 0, sizeof(pfVectors));
+	memset(u8Enabled, 0, sizeof(u8Enabled));
+	memset(u8Pending, 0, sizeof(u8Pending));
+	memset(u32Count, 0, sizeof(u32Count));
+	u32Total = 0;
+	u32Primask = 0;
+}
+
+void SimNvic_SetVector(IRQn_Type IRQn, void (*pfHandler)(void))
+{
+	pfVectors[IRQn] = pfHandler;
+}
+
+uint8_t SimNvic_IsEnabled(IRQn_Type IRQn)
+{
+	return u8Enabled[IRQn];
+}
+
+void SimNvic_Raise(IRQn_Type IRQn)
+{
+	u8Pending[IRQn] = 1;
+	SimNvic_Dispatch();
+}
+
+uint32_t SimNvic_Count(IRQn_Type IRQn)
+{
+	return u32Count[IRQn];
+}
+
+uint32_t SimNvic_Total(void)
+{
+	return u32Total;
+}
+
+void NVIC_Init(NVIC_InitTypeDef *NVIC_InitStruct)
+{
+	u8Enabled[NVIC_InitStruct->NVIC_IRQChannel] = NVIC_InitStruct->NVIC_IRQChannelCmd == ENABLE;
+	SimNvic_Dispatch();
+}
+
+void NVIC_DisableIRQ(IRQn_Type IRQn)
+{
+	u8Enabled[IRQn] = 0;
+}
+
+uint32_t __get_PRIMASK(void)
+{
+	return u32Primask;
+}
+
+void __set_PRIMASK(uint32_t u32PriMask)
+{
+	u32Primask = u32PriMask & 1;
+	SimNvic_Dispatch();
+}
+
+void __disable_irq(void)
+{
+	u32Primask = 1;
+}
+
+void __enable_irq(void)
+{
+	__set_PRIMASK(0);
+}
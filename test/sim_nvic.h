@@ -0,0 +1,27 @@
+#ifndef SIM_NVIC_H_
+#define SIM_NVIC_H_
+
+#include "stm32f10x.h"
+
+/*
+ * NVIC and PRIMASK of the host builds
+ *
+ * A simulated peripheral raises its interrupt with SimNvic_Raise. The
+ * handler of the vector runs at once when its channel was enabled with
+ * NVIC_Init, PRIMASK is clear and no other handler runs; otherwise it
+ * stays pending until __enable_irq, __set_PRIMASK or the end of the
+ * running handler. Priorities are not modelled, handlers never nest.
+ * TIM2 of sim_tim.c only asks whether its channel is enabled.
+ */
+
+/* Every channel disabled, nothing pending, no vector */
+void SimNvic_Reset(void);
+void SimNvic_SetVector(IRQn_Type IRQn, void (*pfHandler)(void));
+uint8_t SimNvic_IsEnabled(IRQn_Type IRQn);
+void SimNvic_Raise(IRQn_Type IRQn);
+
+/* Handler runs of a channel, and of all of them, since the reset */
+uint32_t SimNvic_Count(IRQn_Type IRQn);
+uint32_t SimNvic_Total(void);
+
+#endif
@@ -0,0 +1,137 @@
+#include "sim_tim.h"
+#include "sim_clock.h"
+#include "sim_nvic.h"
+#include <string.h>
+
+#define SIM_TIM_CEN				0x0001
+
+void TIM2_IRQHandler(void);
+
+TIM_TypeDef SimTim2;
+TIM_TypeDef SimTim3;
+
+static SimTim_Stats_t Stats;
+static uint16_t u16Compare;
+static void (*pfObserver)(uint16_t u16Compare);
+
+static void SimTim_Update(void)
+{
+	++Stats.u32Updates;
+	u16Compare = SimTim2.CCR1;
+	if (pfObserver) {
+		pfObserver(u16Compare);
+	}
+	if ((SimTim2.DIER & TIM_IT_Update) && SimNvic_IsEnabled(TIM2_IRQn)) {
+		if (SimTim2.SR & TIM_IT_Update) {
+			++Stats.u32Missed;
+		}
+		SimTim2.SR |= TIM_IT_Update;
+		++Stats.u32Irqs;
+		TIM2_IRQHandler();
+	} else {
+		SimTim2.SR |= TIM_IT_Update;
+	}
+}
+
+void SimTim_Reset(void)
+{
+	memset(&SimTim2, 0, sizeof(SimTim2));
+	memset(&SimTim3, 0, sizeof(SimTim3));
+	memset(&Stats, 0, sizeof(Stats));
+	u16Compare = 0;
+	pfObserver = 0;
+	SimClock_SetTimer(0, 0);
+}
+
+void SimTim_SetObserver(void (*pfUpdate)(uint16_t u16Compare))
+{
+	pfObserver = pfUpdate;
+}
+
+uint16_t SimTim_Compare(void)
+{
+	return u16Compare;
+}
+
+void SimTim_GetStats(SimTim_Stats_t *pStats)
+{
+	*pStats = Stats;
+}
+
+void TIM_TimeBaseInit(TIM_TypeDef *TIMx, TIM_TimeBaseInitTypeDef *TIM_TimeBaseInitStruct)
+{
+	TIMx->PSC = TIM_TimeBaseInitStruct->TIM_Prescaler;
+	TIMx->ARR = TIM_TimeBaseInitStruct->TIM_Period;
+}
+
+void TIM_OC1Init(TIM_TypeDef *TIMx, TIM_OCInitTypeDef *TIM_OCInitStruct)
+{
+	TIMx->CCMR1 = (TIMx->CCMR1 & ~0x0070) | TIM_OCInitStruct->TIM_OCMode;
+	TIMx->CCER = TIM_OCInitStruct->TIM_OutputState;
+	TIMx->CCR1 = TIM_OCInitStruct->TIM_Pulse;
+}
+
+void TIM_OC1PreloadConfig(TIM_TypeDef *TIMx, uint16_t TIM_OCPreload)
+{
+	TIMx->CCMR1 = (TIMx->CCMR1 & ~0x0008) | TIM_OCPreload;
+}
+
+void TIM_Cmd(TIM_TypeDef *TIMx, FunctionalState NewState)
+{
+	//TIM3 is run by sim_wave.c from its registers
+	if (TIMx != TIM2) {
+		if (NewState) {
+			TIMx->CR1 |= SIM_TIM_CEN;
+		} else {
+			TIMx->CR1 &= ~SIM_TIM_CEN;
+		}
+		return;
+	}
+	if (NewState) {
+		TIMx->CR1 |= SIM_TIM_CEN;
+		SimClock_SetTimer((uint64_t)(TIMx->PSC + 1) * (TIMx->ARR + 1) * 1000000000ULL / SIM_TIM_CLOCK_HZ,
+			SimTim_Update);
+	} else {
+		TIMx->CR1 &= ~SIM_TIM_CEN;
+		SimClock_SetTimer(0, 0);
+	}
+}
+
+void TIM_ITConfig(TIM_TypeDef *TIMx, uint16_t TIM_IT, FunctionalState NewState)
+{
+	if (NewState) {
+		TIMx->DIER |= TIM_IT;
+	} else {
+		TIMx->DIER &= ~TIM_IT;
+	}
+}
+
+ITStatus TIM_GetITStatus(TIM_TypeDef *TIMx, uint16_t TIM_IT)
+{
+	return ((TIMx->SR & TIM_IT) && (TIMx->DIER & TIM_IT)) ? SET : RESET;
+}
+
+void TIM_ClearITPendingBit(TIM_TypeDef *TIMx, uint16_t TIM_IT)
+{
+	TIMx->SR &= ~TIM_IT;
+}
+
+void TIM_DMACmd(TIM_TypeDef *TIMx, uint16_t TIM_DMASource, FunctionalState NewState)
+{
+	if (NewState) {
+		TIMx->DIER |= TIM_DMASource;
+	} else {
+		TIMx->DIER &= ~TIM_DMASource;
+	}
+}
+
+/* The count itself is not modelled, only what was written */
+void TIM_SetCounter(TIM_TypeDef *TIMx, uint16_t Counter)
+{
+	TIMx->CNT = Counter;
+}
+
+uint16_t TIM_GetCounter(TIM_TypeDef *TIMx)
+{
+	return TIMx->CNT;
+}
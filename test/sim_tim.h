@@ -0,0 +1,34 @@
+#ifndef SIM_TIM_H_
+#define SIM_TIM_H_
+
+#include "stm32f10x_tim.h"
+
+/*
+ * TIM2 on the virtual clock
+ *
+ * TIM_Cmd starts the update events at the rate set by the prescaler and
+ * period of a 72 MHz timer clock. At each update CCR1 is loaded into the
+ * compare register, UIF is set and TIM2_IRQHandler runs when the update
+ * interrupt and its NVIC channel are enabled, preempting the firmware.
+ */
+
+#define SIM_TIM_CLOCK_HZ		72000000
+
+typedef struct {
+	uint32_t u32Updates;
+	uint32_t u32Irqs;					/* TIM2_IRQHandler calls */
+	uint32_t u32Missed;					/* Updates with UIF still set, an interrupt lost */
+} SimTim_Stats_t;
+
+/* Stopped, registers cleared, no observer */
+void SimTim_Reset(void);
+
+/* Called at each update with the compare value of the period that starts */
+void SimTim_SetObserver(void (*pfUpdate)(uint16_t u16Compare));
+
+/* Compare value of the running period, the pulse width on PA0 */
+uint16_t SimTim_Compare(void);
+
+void SimTim_GetStats(SimTim_Stats_t *pStats);
+
+#endif
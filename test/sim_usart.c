@@ -0,0 +1,302 @@
+#include "sim_usart.h"
+#include "sim_clock.h"
+#include "sim_dma.h"
+#include "sim_nvic.h"
+#include <string.h>
+
+#define SIM_USART_CR1_UE		0x2000
+#define SIM_USART_CR1_IDLEIE	0x0010
+#define SIM_USART_CR1_RXNEIE	0x0020
+#define SIM_USART_CR3_DMAR		0x0040
+#define SIM_USART_CR3_DMAT		0x0080
+#define SIM_USART_GAP			0x0100	/* Feed item of one idle frame */
+
+void USART1_IRQHandler(void);
+
+USART_TypeDef SimUsart1;
+USART_TypeDef SimUsart2;
+
+static uint16_t u16Feed[SIM_USART_FEED];
+static uint32_t u32Head;
+static uint32_t u32Tail;
+static uint16_t u16Frame;				/* On the line now */
+static uint8_t u8Busy;
+static uint64_t u64RxEnd;
+static uint8_t u8TxBusy;
+static uint8_t u8TxByte;
+static uint64_t u64TxEnd;
+static void (*pfTxWire)(uint8_t u8Byte);
+static uint8_t u8AfterByte;				/* Last frame was a byte, the next idle one sets IDLE */
+static uint8_t u8IdleSeen;
+static SimUsart_Stats_t Stats;
+
+static void SimUsart_Irq(void)
+{
+	u8IdleSeen = 0;
+	USART1_IRQHandler();
+	if (u8IdleSeen) {
+		SimUsart1.SR &= ~USART_FLAG_IDLE;
+	}
+}
+
+static void SimUsart_Receive(uint8_t u8Byte)
+{
+	uint32_t u32Data = u8Byte;
+
+	++Stats.u32Bytes;
+	if (SimUsart1.SR & USART_FLAG_RXNE) {
+		SimUsart1.SR |= USART_FLAG_ORE;
+		++Stats.u32Overruns;
+		return;
+	}
+	//DMAR: the DMA reads DR as soon as RXNE is set
+	if ((SimUsart1.CR3 & SIM_USART_CR3_DMAR) && SimDma_Request(5, &u32Data)) {
+		++Stats.u32ToDma;
+		return;
+	}
+	SimUsart1.DR = u8Byte;
+	SimUsart1.SR |= USART_FLAG_RXNE;
+	if (SimUsart1.CR1 & SIM_USART_CR1_RXNEIE) {
+		SimNvic_Raise(USART1_IRQn);
+	}
+}
+
+static void SimUsart_Event(void);
+
+/* One event slot for both lines, the frame that ends first */
+static void SimUsart_Schedule(void)
+{
+	if (u8Busy && (!u8TxBusy || u64RxEnd <= u64TxEnd)) {
+		SimClock_SetEvent(u64RxEnd, SimUsart_Event);
+	} else if (u8TxBusy) {
+		SimClock_SetEvent(u64TxEnd, SimUsart_Event);
+	} else {
+		SimClock_SetEvent(0, 0);
+	}
+}
+
+/* Next frame on the line, an idle one after a byte even when nothing is queued */
+static void SimUsart_Next(void)
+{
+	if (u32Tail != u32Head) {
+		u16Frame = u16Feed[u32Tail];
+		u32Tail = (u32Tail + 1) % SIM_USART_FEED;
+	} else if (u8AfterByte) {
+		u16Frame = SIM_USART_GAP;
+	} else {
+		u8Busy = 0;
+		return;
+	}
+	u8Busy = 1;
+	u64RxEnd = SimClock_Now() + SimUsart_FrameNs();
+	SimUsart_Schedule();
+}
+
+static void SimUsart_FrameEnd(void)
+{
+	if (u16Frame != SIM_USART_GAP) {
+		u8AfterByte = 1;
+		if ((SimUsart1.CR1 & SIM_USART_CR1_UE) && (SimUsart1.CR1 & USART_Mode_Rx)) {
+			SimUsart_Receive((uint8_t)u16Frame);
+		}
+	} else if (u8AfterByte) {
+		u8AfterByte = 0;
+		SimUsart1.SR |= USART_FLAG_IDLE;
+		++Stats.u32Idles;
+		if (SimUsart1.CR1 & SIM_USART_CR1_IDLEIE) {
+			SimNvic_Raise(USART1_IRQn);
+		}
+	}
+	SimUsart_Next();
+}
+
+/*
+ * TXE with DMAT requests channel 4 while nothing is on the line. The byte
+ * the DMA writes goes out at once, the next is requested as it ends.
+ */
+static void SimUsart_TxNext(void)
+{
+	uint32_t u32Data;
+
+	if (u8TxBusy || !(SimUsart1.CR1 & SIM_USART_CR1_UE) || !(SimUsart1.CR1 & USART_Mode_Tx) ||
+		!(SimUsart1.CR3 & SIM_USART_CR3_DMAT)) {
+		return;
+	}
+	//Busy first: the transfer complete handler may run in the request and enable the channel again
+	u8TxBusy = 1;
+	if (!SimDma_Request(4, &u32Data)) {
+		u8TxBusy = 0;
+		return;
+	}
+	u8TxByte = (uint8_t)u32Data;
+	u64TxEnd = SimClock_Now() + SimUsart_FrameNs();
+	SimUsart_Schedule();
+}
+
+static void SimUsart_TxEnd(void)
+{
+	u8TxBusy = 0;
+	++Stats.u32Sent;
+	if (pfTxWire) {
+		pfTxWire(u8TxByte);
+	}
+	SimUsart_TxNext();
+}
+
+static void SimUsart_Event(void)
+{
+	uint64_t u64Now = SimClock_Now();
+
+	if (u8TxBusy && u64TxEnd <= u64Now) {
+		SimUsart_TxEnd();
+	}
+	if (u8Busy && u64RxEnd <= u64Now) {
+		SimUsart_FrameEnd();
+	}
+	SimUsart_Schedule();
+}
+
+static void SimUsart_DmaStart(uint8_t u8Channel)
+{
+	if (u8Channel == 4) {
+		SimUsart_TxNext();
+	}
+}
+
+static uint8_t SimUsart_Push(uint16_t u16Item)
+{
+	uint32_t u32Next = (u32Head + 1) % SIM_USART_FEED;
+
+	if (u32Next == u32Tail) {
+		return 0;
+	}
+	u16Feed[u32Head] = u16Item;
+	u32Head = u32Next;
+	if (!u8Busy) {
+		SimUsart_Next();
+	}
+	return 1;
+}
+
+void SimUsart_Open(void)
+{
+	memset(&SimUsart1, 0, sizeof(SimUsart1));
+	memset(&Stats, 0, sizeof(Stats));
+	SimUsart1.SR = USART_FLAG_TXE | USART_FLAG_TC;
+	u32Head = u32Tail = 0;
+	u8Busy = 0;
+	u8AfterByte = 0;
+	u8TxBusy = 0;
+	pfTxWire = 0;
+	SimClock_SetEvent(0, 0);
+	SimNvic_SetVector(USART1_IRQn, SimUsart_Irq);
+	SimDma_SetStart(SimUsart_DmaStart);
+}
+
+void SimUsart_SetWire(void (*pfWire)(uint8_t u8Byte))
+{
+	pfTxWire = pfWire;
+}
+
+uint8_t SimUsart_Feed(const uint8_t *pData, uint16_t u16Len)
+{
+	while (u16Len--) {
+		if (!SimUsart_Push(*pData++)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+uint8_t SimUsart_Idle(uint16_t u16Frames)
+{
+	while (u16Frames--) {
+		if (!SimUsart_Push(SIM_USART_GAP)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+uint8_t SimUsart_Done(void)
+{
+	return !u8Busy;
+}
+
+uint8_t SimUsart_TxDone(void)
+{
+	return !u8TxBusy;
+}
+
+uint64_t SimUsart_FrameNs(void)
+{
+	return 10ULL * SimUsart1.BRR * 1000000000ULL / SIM_USART_PCLK2_HZ;
+}
+
+void SimUsart_GetStats(SimUsart_Stats_t *pStats)
+{
+	*pStats = Stats;
+}
+
+void USART_Init(USART_TypeDef *USARTx, USART_InitTypeDef *USART_InitStruct)
+{
+	USARTx->BRR = (SIM_USART_PCLK2_HZ + USART_InitStruct->USART_BaudRate / 2) / USART_InitStruct->USART_BaudRate;
+	USARTx->CR1 = (USARTx->CR1 & ~(USART_Mode_Rx | USART_Mode_Tx)) | USART_InitStruct->USART_Mode;
+}
+
+void USART_Cmd(USART_TypeDef *USARTx, FunctionalState NewState)
+{
+	if (NewState) {
+		USARTx->CR1 |= SIM_USART_CR1_UE;
+		SimUsart_TxNext();
+	} else {
+		USARTx->CR1 &= ~SIM_USART_CR1_UE;
+	}
+}
+
+void USART_ITConfig(USART_TypeDef *USARTx, uint16_t USART_IT, FunctionalState NewState)
+{
+	if (NewState) {
+		USARTx->CR1 |= USART_IT & 0xFF;
+	} else {
+		USARTx->CR1 &= ~(USART_IT & 0xFF);
+	}
+}
+
+void USART_DMACmd(USART_TypeDef *USARTx, uint16_t USART_DMAReq, FunctionalState NewState)
+{
+	if (NewState) {
+		USARTx->CR3 |= USART_DMAReq;
+		SimUsart_TxNext();
+	} else {
+		USARTx->CR3 &= ~USART_DMAReq;
+	}
+}
+
+ITStatus USART_GetITStatus(USART_TypeDef *USARTx, uint16_t USART_IT)
+{
+	if ((USARTx->SR & (USART_IT >> 8)) && (USARTx->CR1 & (USART_IT & 0xFF))) {
+		if (USART_IT == USART_IT_IDLE) {
+			u8IdleSeen = 1;
+		}
+		return SET;
+	}
+	return RESET;
+}
+
+FlagStatus USART_GetFlagStatus(USART_TypeDef *USARTx, uint16_t USART_FLAG)
+{
+	return (USARTx->SR & USART_FLAG) ? SET : RESET;
+}
+
+void USART_SendData(USART_TypeDef *USARTx, uint16_t Data)
+{
+	(void)Data;
+	++Stats.u32Sent;
+}
+
+uint16_t USART_ReceiveData(USART_TypeDef *USARTx)
+{
+	USARTx->SR &= ~(USART_FLAG_RXNE | USART_FLAG_ORE);
+	return USARTx->DR;
+}
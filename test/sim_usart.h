@@ -0,0 +1,59 @@
+#ifndef SIM_USART_H_
+#define SIM_USART_H_
+
+#include "stm32f10x_usart.h"
+
+/*
+ * USART1 on the virtual clock
+ *
+ * The test queues what arrives on RX: bytes, and idle frames between them.
+ * A frame takes 10 bit times at the rate of BRR on a 72 MHz PCLK2. A byte
+ * that is in goes to DMA1 channel 5 through sim_dma.c with DMAR set,
+ * otherwise it waits in DR with RXNE; a byte arriving with RXNE still set
+ * is an overrun, ORE is set and the byte lost. IDLE is set by one idle
+ * frame after a byte. RXNE and IDLE interrupt through sim_nvic.c.
+ *
+ * The host cannot see the reads of SR and DR that clear IDLE, it clears
+ * when the handler that found it set returns; USART_ReceiveData clears
+ * RXNE.
+ *
+ * TX only goes through DMA1 channel 4: with DMAT set the line takes a byte
+ * from the channel whenever it is idle, and the next one as that frame
+ * ends, so transfers chained from the transfer complete interrupt leave
+ * no gap. Each byte goes to the wire callback when its frame ends. TXE is
+ * always set, USART_SendData only counts.
+ */
+
+#define SIM_USART_PCLK2_HZ		72000000
+#define SIM_USART_FEED			65536	/* Bytes and idle frames queued */
+
+typedef struct {
+	uint32_t u32Bytes;					/* Frames received */
+	uint32_t u32ToDma;
+	uint32_t u32Overruns;
+	uint32_t u32Idles;
+	uint32_t u32Sent;					/* By the DMA or USART_SendData */
+} SimUsart_Stats_t;
+
+/* Peripheral reset, feed and stats cleared, interrupt vector of USART1 set */
+void SimUsart_Open(void);
+
+/* Frames sent on TX, as each one ends */
+void SimUsart_SetWire(void (*pfWire)(uint8_t u8Byte));
+
+/* Queue bytes, and idle frames; 0 when the feed is full */
+uint8_t SimUsart_Feed(const uint8_t *pData, uint16_t u16Len);
+uint8_t SimUsart_Idle(uint16_t u16Frames);
+
+/* Nothing left to receive and the line idle */
+uint8_t SimUsart_Done(void);
+
+/* Nothing on the TX line */
+uint8_t SimUsart_TxDone(void);
+
+/* One frame at the rate of BRR */
+uint64_t SimUsart_FrameNs(void);
+
+void SimUsart_GetStats(SimUsart_Stats_t *pStats);
+
+#endif
@@ -0,0 +1,132 @@
+#include "sim_wave.h"
+#include "sim_dma.h"
+#include "sim_tim.h"
+#include <string.h>
+
+#define SIM_WAVE_TIM_CEN		0x0001
+
+uint32_t SystemCoreClock = SIM_WAVE_CORE_HZ;
+CoreDebug_Type SimCoreDebug;
+
+static DWT_Type Dwt;
+static uint32_t u32Given;				/* CYCCNT as the last access left it, a write differs */
+static uint64_t u64Now;
+static uint32_t u32StallAccess;
+static uint32_t u32StallCycles;
+static uint8_t u8Tim3Running;
+static uint64_t u64NextUpdate;
+static SimWave_Edge_t Edges[SIM_WAVE_EDGES];
+static uint32_t u32Edges;
+
+static void SimWave_Record(uint64_t u64Cycle)
+{
+	if (u32Edges < SIM_WAVE_EDGES) {
+		Edges[u32Edges].u64Cycle = u64Cycle;
+		Edges[u32Edges].u16Levels = (uint16_t)SimGpioA.u32Port;
+		++u32Edges;
+	}
+}
+
+static void SimWave_Sample(uint64_t u64Cycle)
+{
+	uint32_t u32Set = SimGpioA.BSRR & 0xFFFF;
+	uint32_t u32Reset = (SimGpioA.BSRR >> 16) | SimGpioA.BRR;
+	uint32_t u32Port;
+
+	if (!u32Set && !u32Reset) {
+		return;
+	}
+	SimGpioA.BSRR = 0;
+	SimGpioA.BRR = 0;
+	u32Port = (SimGpioA.u32Port & ~u32Reset) | u32Set;
+	if (u32Port != SimGpioA.u32Port) {
+		SimGpioA.u32Port = u32Port;
+		SimWave_Record(u64Cycle);
+	}
+}
+
+/* One access worth of code, then the TIM3 updates that fell in it */
+static void SimWave_Run(void)
+{
+	uint32_t u32Word;
+	uint64_t u64Period;
+
+	u64Now += SIM_WAVE_READ_CYCLES;
+	SimWave_Sample(u64Now);
+	//The interrupt comes after the writes, before the read
+	if (u32StallAccess && !--u32StallAccess) {
+		u64Now += u32StallCycles;
+	}
+
+	if (!(TIM3->CR1 & SIM_WAVE_TIM_CEN) || !(TIM3->DIER & TIM_DMA_Update)) {
+		u8Tim3Running = 0;
+		return;
+	}
+	u64Period = (uint64_t)(TIM3->PSC + 1) * (TIM3->ARR + 1);
+	if (!u8Tim3Running) {
+		//Started by the code this access stands for
+		u8Tim3Running = 1;
+		u64NextUpdate = u64Now + u64Period;
+	}
+	while (u64NextUpdate <= u64Now) {
+		if (SimDma_Request(3, &u32Word)) {
+			*(volatile uint32_t *)(uintptr_t)DMA1_Channel3->CPAR = u32Word;
+			SimWave_Sample(u64NextUpdate);
+		}
+		u64NextUpdate += u64Period;
+	}
+}
+
+DWT_Type *SimWave_Dwt(void)
+{
+	uint64_t u64Before = u64Now;
+
+	//The firmware wrote CYCCNT after the last access
+	if (Dwt.CYCCNT != u32Given) {
+		u32Given = Dwt.CYCCNT;
+	}
+	SimWave_Run();
+	if ((Dwt.CTRL & DWT_CTRL_CYCCNTENA_Msk) && (SimCoreDebug.DEMCR & CoreDebug_DEMCR_TRCENA_Msk)) {
+		u32Given += (uint32_t)(u64Now - u64Before);
+	}
+	Dwt.CYCCNT = u32Given;
+	return &Dwt;
+}
+
+void SimWave_Reset(void)
+{
+	memset(&Dwt, 0, sizeof(Dwt));
+	memset(&SimCoreDebug, 0, sizeof(SimCoreDebug));
+	memset(&SimGpioA, 0, sizeof(SimGpioA));
+	u32Given = 0;
+	u64Now = 0;
+	u32StallAccess = 0;
+	u32StallCycles = 0;
+	u8Tim3Running = 0;
+	u32Edges = 0;
+	SimDma_Reset();
+	SimTim_Reset();
+	SimDma_SetPoll(SimWave_Run);
+}
+
+void SimWave_StallAt(uint32_t u32Access, uint32_t u32Cycles)
+{
+	u32StallAccess = u32Access;
+	u32StallCycles = u32Cycles;
+}
+
+void SimWave_Flush(void)
+{
+	SimWave_Run();
+}
+
+uint64_t SimWave_Now(void)
+{
+	return u64Now;
+}
+
+uint32_t SimWave_Edges(const SimWave_Edge_t **ppEdges)
+{
+	*ppEdges = Edges;
+	return u32Edges;
+}
@@ -0,0 +1,44 @@
+#ifndef SIM_WAVE_H_
+#define SIM_WAVE_H_
+
+#include "stm32f10x.h"
+
+/*
+ * Waveform capture of the bit-banged examples on GPIOA
+ *
+ * Time is counted in core cycles at 72 MHz. Every access to DWT stands for
+ * SIM_WAVE_READ_CYCLES of code: the read of CYCCNT and the instructions
+ * around it, so a busy wait on the counter moves in steps of that size. A
+ * DMA_GetFlagStatus poll costs the same. Writes to BSRR/BRR reach the pins
+ * at the next access, stamped at its end; BSRR wins over BRR for a pin set
+ * and reset in between, as it does in the port.
+ *
+ * While TIM3 runs with its update DMA request enabled, every update moves
+ * one word of DMA1 channel 3 to the peripheral address of the channel,
+ * stamped at the update, (PSC + 1) * (ARR + 1) cycles apart.
+ */
+
+#define SIM_WAVE_CORE_HZ		72000000
+#define SIM_WAVE_READ_CYCLES	5
+#define SIM_WAVE_EDGES			1024
+
+typedef struct {
+	uint64_t u64Cycle;
+	uint16_t u16Levels;					/* GPIOA pins after the change */
+} SimWave_Edge_t;
+
+/* Cycle 0, GPIOA low, counter stopped, capture and stalls cleared, DMA1 and TIM3 reset */
+void SimWave_Reset(void);
+
+/* The u32Access-th access from now comes u32Cycles later, an interrupt taken before it */
+void SimWave_StallAt(uint32_t u32Access, uint32_t u32Cycles);
+
+/* Pins written since the last access, the firmware returned without reading DWT */
+void SimWave_Flush(void);
+
+uint64_t SimWave_Now(void);
+
+/* Pin changes since the reset, in time order */
+uint32_t SimWave_Edges(const SimWave_Edge_t **ppEdges);
+
+#endif
@@ -0,0 +1,218 @@
+/*
+ * Waveform of SPI/spi_sw_send captured cycle by cycle
+ *
+ * The example's SPI_Master_Transmit sends its 8 bytes of DataTrans back to
+ * back, paced from the DWT cycle counter or, built with SPI_USE_DMA, by
+ * TIM3 and DMA1 channel 3 writing BSRR. From the pin changes of sim_wave.c:
+ *
+ * - Decoded as a mode 0 slave does, MOSI at each rising SCK edge while CS
+ *   is low, the bytes are DataTrans.
+ * - No SCK high or low phase and no MOSI setup before a rising edge is
+ *   shorter than half a period, less one poll of the cycle counter. With
+ *   the DMA every phase is exactly half a period.
+ * - The mean SCK rate is SPI_SCK_HZ where the pacing can reach it: half a
+ *   period of at least two polls of the counter, or the DMA.
+ * - The same with an interrupt of SPI_WAVE_STALL_CYCLES in the middle of a
+ *   byte: the phase it lands in is longer, none after it shorter.
+ *
+ * Prints SCK and bits/s within a frame and back to back.
+ */
+
+#include "sim_wave.h"
+#include <stdio.h>
+#include <stdarg.h>
+
+#define SPI_WAVE_SCK			GPIO_Pin_0
+#define SPI_WAVE_MOSI			GPIO_Pin_2
+#define SPI_WAVE_CS				GPIO_Pin_3
+#define SPI_WAVE_BYTES			8
+#define SPI_WAVE_STALL_CYCLES	100		/* An interrupt handler of 1.4 us */
+#define SPI_WAVE_STALL_BYTE		3
+#define SPI_WAVE_STALL_ACCESS	7		/* DWT reads into the byte, in the 3rd bit */
+
+#define SPI_WAVE_HALF			(SIM_WAVE_CORE_HZ / (2 * SPI_SCK_HZ))
+#define SPI_WAVE_PACED			(SPI_USE_DMA || SPI_WAVE_HALF >= 2 * SIM_WAVE_READ_CYCLES)
+
+/* SPI/spi_sw_send/main.c, its main renamed */
+extern uint8_t DataTrans[];
+void DWT_Config(void);
+void GPIO_Config(void);
+void SPISetup(void);
+void SPI_DMA_Config(void);
+void SPI_Master_Transmit(uint8_t u8Data);
+
+typedef struct {
+	uint8_t u8Bytes[SPI_WAVE_BYTES];
+	uint8_t u8Frames;
+	uint8_t u8BadBits;					/* Frames without exactly 8 rising edges */
+	uint32_t u32MinHigh;
+	uint32_t u32MaxHigh;
+	uint32_t u32MinLow;					/* CS fall or SCK fall to the next rise */
+	uint32_t u32MaxLow;
+	uint32_t u32MinSetup;				/* MOSI change to the next rise */
+	uint64_t u64Periods;				/* First to last rise of each frame, summed */
+	uint64_t u64FrameCycles;			/* CS low, summed */
+	uint64_t u64Span;					/* First CS fall to last CS rise */
+} SpiWave_Result_t;
+
+static int iFailed;
+
+/* sim_tim.c calls it, the example leaves the TIM2 interrupt off */
+void TIM2_IRQHandler(void)
+{
+}
+
+static void Wave_Fail(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	fprintf(stderr, "FAIL: ");
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	++iFailed;
+}
+
+static void Wave_Min(uint32_t *pu32Min, uint32_t *pu32Max, uint64_t u64Cycles)
+{
+	if (u64Cycles < *pu32Min) {
+		*pu32Min = (uint32_t)u64Cycles;
+	}
+	if (pu32Max && u64Cycles > *pu32Max) {
+		*pu32Max = (uint32_t)u64Cycles;
+	}
+}
+
+static void Wave_Decode(SpiWave_Result_t *pResult)
+{
+	const SimWave_Edge_t *pEdges;
+	uint32_t u32Edges = SimWave_Edges(&pEdges);
+	uint16_t u16Prev = SPI_WAVE_CS;		//SPISetup leaves CS high, SCK and MOSI low
+	uint64_t u64CsFall = 0, u64Fall = 0, u64Rise = 0, u64Mosi = 0, u64FirstRise = 0, u64First = 0;
+	uint8_t u8Bits = 0, u8Byte = 0;
+	uint32_t i;
+
+	pResult->u8Frames = 0;
+	pResult->u8BadBits = 0;
+	pResult->u32MinHigh = pResult->u32MinLow = pResult->u32MinSetup = UINT32_MAX;
+	pResult->u32MaxHigh = pResult->u32MaxLow = 0;
+	pResult->u64Periods = pResult->u64FrameCycles = pResult->u64Span = 0;
+
+	for (i = 0; i < u32Edges; i++) {
+		uint16_t u16Now = pEdges[i].u16Levels, u16Changed = u16Now ^ u16Prev;
+		uint64_t u64At = pEdges[i].u64Cycle;
+
+		if ((u16Changed & SPI_WAVE_CS) && !(u16Now & SPI_WAVE_CS)) {
+			u64CsFall = u64Fall = u64At;
+			u8Bits = 0;
+			u8Byte = 0;
+			if (!pResult->u8Frames) {
+				u64First = u64At;
+			}
+		}
+		if (!(u16Now & SPI_WAVE_CS)) {
+			if (u16Changed & SPI_WAVE_MOSI) {
+				u64Mosi = u64At;
+			}
+			if ((u16Changed & SPI_WAVE_SCK) && (u16Now & SPI_WAVE_SCK)) {
+				//Two half periods after CS before the first
+				Wave_Min(&pResult->u32MinLow, u8Bits ? &pResult->u32MaxLow : 0, u64At - u64Fall);
+				if (u64Mosi > u64CsFall) {
+					Wave_Min(&pResult->u32MinSetup, 0, u64At - u64Mosi);
+				}
+				if (!u8Bits) {
+					u64FirstRise = u64At;
+				}
+				u8Byte = (u8Byte << 1) | ((u16Now & SPI_WAVE_MOSI) ? 1 : 0);
+				++u8Bits;
+				u64Rise = u64At;
+			} else if ((u16Changed & SPI_WAVE_SCK) && u8Bits) {
+				Wave_Min(&pResult->u32MinHigh, &pResult->u32MaxHigh, u64At - u64Rise);
+				u64Fall = u64At;
+			}
+		}
+		if ((u16Changed & SPI_WAVE_CS) && (u16Now & SPI_WAVE_CS)) {
+			if (u8Bits != 8) {
+				++pResult->u8BadBits;
+			}
+			if (pResult->u8Frames < SPI_WAVE_BYTES) {
+				pResult->u8Bytes[pResult->u8Frames] = u8Byte;
+			}
+			++pResult->u8Frames;
+			pResult->u64Periods += u64Rise - u64FirstRise;
+			pResult->u64FrameCycles += u64At - u64CsFall;
+			pResult->u64Span = u64At - u64First;
+		}
+		u16Prev = u16Now;
+	}
+}
+
+static void Wave_Run(const char *pszName, uint8_t u8Stall)
+{
+	SpiWave_Result_t Result;
+	uint32_t u32Floor = SPI_WAVE_HALF - (SPI_USE_DMA ? 0 : SIM_WAVE_READ_CYCLES);
+	double fSck;
+	uint8_t i;
+
+	SimWave_Reset();
+	DWT_Config();
+	GPIO_Config();
+	SPISetup();
+#if SPI_USE_DMA
+	SPI_DMA_Config();
+#endif
+	for (i = 0; i < SPI_WAVE_BYTES; i++) {
+		if (u8Stall && i == SPI_WAVE_STALL_BYTE) {
+			SimWave_StallAt(SPI_WAVE_STALL_ACCESS, SPI_WAVE_STALL_CYCLES);
+		}
+		SPI_Master_Transmit(DataTrans[i]);
+		SimWave_Flush();
+	}
+	Wave_Decode(&Result);
+
+	fSck = Result.u8Frames ? (double)SIM_WAVE_CORE_HZ * 7 * Result.u8Frames / Result.u64Periods : 0;
+	printf("  %-10s %8.3f %9lu %4lu %8lu %4lu %9lu %13.0f %13.0f\n", pszName, fSck / 1e6,
+		(unsigned long)Result.u32MinHigh, (unsigned long)Result.u32MaxHigh, (unsigned long)Result.u32MinLow,
+		(unsigned long)Result.u32MaxLow, (unsigned long)Result.u32MinSetup,
+		Result.u64FrameCycles ? 8.0 * Result.u8Frames * SIM_WAVE_CORE_HZ / Result.u64FrameCycles : 0,
+		Result.u64Span ? 8.0 * Result.u8Frames * SIM_WAVE_CORE_HZ / Result.u64Span : 0);
+
+	if (Result.u8Frames != SPI_WAVE_BYTES || Result.u8BadBits) {
+		Wave_Fail("%s: %u frames, %u without 8 bits", pszName, Result.u8Frames, Result.u8BadBits);
+		return;
+	}
+	for (i = 0; i < SPI_WAVE_BYTES; i++) {
+		if (Result.u8Bytes[i] != DataTrans[i]) {
+			Wave_Fail("%s: byte %u is 0x%02X, sent 0x%02X", pszName, i, Result.u8Bytes[i], DataTrans[i]);
+		}
+	}
+	if (Result.u32MinHigh < u32Floor || Result.u32MinLow < u32Floor || Result.u32MinSetup < u32Floor) {
+		Wave_Fail("%s: phase of %lu/%lu cycles, setup %lu, half a period is %u", pszName,
+			(unsigned long)Result.u32MinHigh, (unsigned long)Result.u32MinLow, (unsigned long)Result.u32MinSetup,
+			SPI_WAVE_HALF);
+	}
+	if (SPI_USE_DMA && (Result.u32MaxHigh != SPI_WAVE_HALF || Result.u32MaxLow != SPI_WAVE_HALF)) {
+		Wave_Fail("%s: DMA phase up to %lu/%lu cycles, not %u", pszName, (unsigned long)Result.u32MaxHigh,
+			(unsigned long)Result.u32MaxLow, SPI_WAVE_HALF);
+	}
+	if (!u8Stall && SPI_WAVE_PACED && (fSck < SPI_SCK_HZ * 0.97 || fSck > SPI_SCK_HZ * 1.03)) {
+		Wave_Fail("%s: SCK %.3f MHz, set to %.3f", pszName, fSck / 1e6, SPI_SCK_HZ / 1e6);
+	}
+}
+
+int main(void)
+{
+	printf("SPI_SCK_HZ %u, %s, half a period %u cycles%s\n", SPI_SCK_HZ,
+		SPI_USE_DMA ? "TIM3 + DMA to BSRR" : "DWT paced", SPI_WAVE_HALF,
+		SPI_WAVE_PACED ? "" : ", shorter than the pacing loop");
+	printf("  %-10s %8s %9s %4s %8s %4s %9s %13s %13s\n", "run", "SCK MHz", "high min", "max", "low min", "max",
+		"setup min", "frame bits/s", "bytes bits/s");
+	Wave_Run("plain", 0);
+	Wave_Run("interrupt", 1);
+
+	if (iFailed) {
+		fprintf(stderr, "%d failures\n", iFailed);
+	}
+	return iFailed != 0;
+}
@@ -0,0 +1,398 @@
+/*
+ * uart_tx.c and the DMA interrupt of UART/HardWareUart_Send on the USART1
+ * and DMA1 models, a second writer preempting main inside its LDREX/STREX
+ * loops
+ *
+ * SimStrex_Preempt raises the USART1 interrupt at every n-th STREX of
+ * main, n from 2 to RACE_EVERY_MAX (every one would retry forever). Its
+ * handler writes too, and the STREX of main fails as it does on the core.
+ * The word stored tells the loop that was hit: txState gaining a writer
+ * (TX_Reserve) or losing one (TX_Release), txCommit (TX_Commit) or a
+ * counter (TX_Count).
+ *
+ * - Frames: both writers frame_send numbered frames of 5..RACE_FRAME_MAX
+ *   bytes. Every frame accepted is decoded off the line whole and in the
+ *   order of its writer, seq without gaps and none bad; frameSent and
+ *   frameDropped match what frame_send returned.
+ * - Bytes: both writers uart_write numbered 8 byte records. The line
+ *   carries every record whole and in the order of its writer, nothing
+ *   is dropped.
+ * - The STREX of each of the four loops was failed at least once.
+ * - Throughput at 115200 and 921600 baud: main sends 64 byte frames as
+ *   fast as the ring takes them, alone and preempted every 3rd STREX. The
+ *   DMA chaining has to keep the line busy 99% of the time or more.
+ *
+ * Prints the failed STREX per loop, and payload, frames/s and DMA
+ * interrupts per KB at both rates.
+ */
+
+#include "uart_tx.h"
+#include "frame_decode.h"
+#include "sim_usart.h"
+#include "sim_clock.h"
+#include "sim_dma.h"
+#include "sim_nvic.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define RACE_ITEMS				2000	/* Writes of main per run */
+#define RACE_EVERY_MAX			7
+#define RACE_FRAME_MAX			32		/* Frames of the race runs, 5 bytes of writer and number first */
+#define RACE_RECORD				8
+#define RACE_BAUD				115200
+#define RACE_TPUT_FRAMES		2000
+#define RACE_TPUT_LEN			64
+#define RACE_TPUT_EVERY			3
+#define RACE_BUSY_MIN			0.99
+
+enum { RACE_MAIN, RACE_ISR, RACE_WRITERS };
+enum { RACE_RESERVE, RACE_RELEASE, RACE_COMMIT, RACE_COUNT, RACE_LOOPS };
+
+/* UART/HardWareUart_Send/main.c, its main renamed */
+extern volatile uint16_t txDmaLen;
+void RCC_Config(void);
+void GPIO_Config(void);
+void UART_Config(void);
+void DMA_Config(void);
+void DMA1_Channel4_IRQHandler(void);
+
+extern volatile uint32_t txState;		/* Private to uart_tx.c, cleared between runs */
+
+typedef struct {
+	uint32_t u32Next;					/* Items accepted, the number of the next one */
+	uint32_t u32Refused;
+	uint32_t u32Expect;					/* Number of the next one off the line */
+} Race_Writer_t;
+
+static const char *pszLoops[RACE_LOOPS] = {"reserve", "release", "commit", "count"};
+
+static Race_Writer_t Writers[RACE_WRITERS];
+static uint8_t u8Bytes;					/* 1: uart_write records, 0: frames */
+static uint8_t u8Len;					/* Frame length, 0 for the mix of the race runs */
+static uint32_t u32Every;				/* STREX of main between two preemptions, 0 for none */
+static uint32_t u32Strex;
+static uint32_t u32Hits[RACE_LOOPS];
+static uint8_t u8InIsr;
+static FrameRx_t Rx;
+static uint8_t u8Record[RACE_RECORD];
+static uint8_t u8RecordLen;
+static uint32_t u32Mismatch;			/* Frames or records off the line not as written */
+static uint32_t u32Short;				/* uart_write that took part of a record */
+static uint64_t u64LastByte;			/* End of the last frame on the line */
+static int iFailed;
+
+/* sim_tim.c calls it, the example leaves the TIM2 interrupt off */
+void TIM2_IRQHandler(void)
+{
+}
+
+static void Race_Fail(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	fprintf(stderr, "FAIL: ");
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	++iFailed;
+}
+
+/* Frame u32Num of writer u8Writer: writer, number, then data with zeros in plenty */
+static uint8_t Race_Data(uint8_t u8Writer, uint32_t u32Num, uint8_t *p)
+{
+	uint8_t len = u8Len ? u8Len : 5 + (u32Num * 7 + u8Writer) % (RACE_FRAME_MAX - 4);
+	uint8_t i;
+
+	if (len > FRAME_DATA_MAX) {
+		len = FRAME_DATA_MAX;
+	}
+
+	p[0] = u8Writer;
+	memcpy(&p[1], &u32Num, 4);
+	for (i = 5; i < len; i++) {
+		p[i] = (i % 5 == 0) ? 0 : (uint8_t)(u32Num * 31 + i * 7 + u8Writer * 101);
+	}
+	return len;
+}
+
+static void Race_Record(uint8_t u8Writer, uint32_t u32Num, uint8_t *p)
+{
+	p[0] = u8Writer;
+	memcpy(&p[1], &u32Num, 4);
+	p[5] = (uint8_t)~u8Writer;
+	p[6] = (uint8_t)(u32Num * 13);
+	p[7] = 0x5A;
+}
+
+/* One frame or record of a writer */
+static uint8_t Race_Put(uint8_t u8Writer)
+{
+	Race_Writer_t *w = &Writers[u8Writer];
+	uint8_t data[FRAME_DATA_MAX];
+	uint16_t u16Taken;
+	uint8_t u8Ok;
+
+	if (u8Bytes) {
+		Race_Record(u8Writer, w->u32Next, data);
+		u16Taken = uart_write(data, RACE_RECORD);
+		if (u16Taken && u16Taken != RACE_RECORD) {
+			++u32Short;
+		}
+		u8Ok = u16Taken == RACE_RECORD;
+	} else {
+		u8Ok = frame_send(FRAME_TYPE_DATA, data, Race_Data(u8Writer, w->u32Next, data));
+	}
+	if (u8Ok) {
+		++w->u32Next;
+	} else {
+		++w->u32Refused;
+	}
+	return u8Ok;
+}
+
+/* The interrupt between LDREX and STREX, a writer of its own */
+uint8_t SimStrex_Preempt(uint32_t value, volatile uint32_t *addr)
+{
+	uint32_t u32Runs = SimNvic_Count(USART1_IRQn);
+	uint8_t u8Loop;
+
+	if (!u32Every || u8InIsr || ++u32Strex % u32Every) {
+		return 0;
+	}
+	if (addr == &txState) {
+		u8Loop = ((value >> 16) & 0xFF) > ((*addr >> 16) & 0xFF) ? RACE_RESERVE : RACE_RELEASE;
+	} else if (addr == &txCommit) {
+		u8Loop = RACE_COMMIT;
+	} else {
+		u8Loop = RACE_COUNT;
+	}
+	SimNvic_Raise(USART1_IRQn);
+	if (SimNvic_Count(USART1_IRQn) == u32Runs) {
+		return 0;
+	}
+	++u32Hits[u8Loop];
+	return 1;
+}
+
+void USART1_IRQHandler(void)
+{
+	u8InIsr = 1;
+	Race_Put(RACE_ISR);
+	u8InIsr = 0;
+}
+
+/* uart_tx.c pends the DMA interrupt, it runs once no other handler does */
+void NVIC_SetPendingIRQ(IRQn_Type IRQn)
+{
+	SimNvic_Raise(IRQn);
+}
+
+static void Race_Frame(void *pCtx, uint8_t u8Seq, uint8_t u8Type, const uint8_t *pData, uint16_t u16Len)
+{
+	uint8_t expect[FRAME_DATA_MAX];
+	uint32_t u32Num;
+
+	(void)pCtx;
+	(void)u8Seq;
+	if (u16Len < 5 || pData[0] >= RACE_WRITERS) {
+		++u32Mismatch;
+		return;
+	}
+	memcpy(&u32Num, &pData[1], 4);
+	if (u8Type != FRAME_TYPE_DATA || u32Num != Writers[pData[0]].u32Expect ||
+		u16Len != Race_Data(pData[0], u32Num, expect) || memcmp(pData, expect, u16Len)) {
+		++u32Mismatch;
+	}
+	Writers[pData[0]].u32Expect = u32Num + 1;
+}
+
+static void Race_Wire(uint8_t u8Byte)
+{
+	uint8_t expect[RACE_RECORD];
+	uint32_t u32Num;
+
+	u64LastByte = SimClock_Now();
+	if (!u8Bytes) {
+		FrameRx_Feed(&Rx, &u8Byte, 1);
+		return;
+	}
+	u8Record[u8RecordLen++] = u8Byte;
+	if (u8RecordLen < RACE_RECORD) {
+		return;
+	}
+	u8RecordLen = 0;
+	memcpy(&u32Num, &u8Record[1], 4);
+	if (u8Record[0] >= RACE_WRITERS) {
+		++u32Mismatch;
+		return;
+	}
+	Race_Record(u8Record[0], u32Num, expect);
+	if (u32Num != Writers[u8Record[0]].u32Expect || memcmp(u8Record, expect, RACE_RECORD)) {
+		++u32Mismatch;
+	}
+	Writers[u8Record[0]].u32Expect = u32Num + 1;
+}
+
+static void Race_Open(uint32_t u32Baud, uint8_t u8WithBytes, uint8_t u8FrameLen, uint32_t u32EveryStrex)
+{
+	NVIC_InitTypeDef NVICInitStruct;
+
+	SimClock_Reset();
+	SimNvic_Reset();
+	SimDma_Reset();
+	SimUsart_Open();
+	SimUsart_SetWire(Race_Wire);
+	SimNvic_SetVector(DMA1_Channel4_IRQn, DMA1_Channel4_IRQHandler);
+	txState = 0;
+	txCommit = 0;
+	txTail = 0;
+	txDmaLen = 0;
+	txDropped = frameSent = frameDropped = 0;
+	RCC_Config();
+	GPIO_Config();
+	UART_Config();
+	DMA_Config();
+	USART1->BRR = (SIM_USART_PCLK2_HZ + u32Baud / 2) / u32Baud;
+
+	//The preempting writer, the example itself has no USART1 interrupt
+	NVICInitStruct.NVIC_IRQChannel = USART1_IRQn;
+	NVICInitStruct.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVICInitStruct);
+
+	memset(Writers, 0, sizeof(Writers));
+	u8Bytes = u8WithBytes;
+	u8Len = u8FrameLen;
+	u32Every = u32EveryStrex;
+	u32Strex = 0;
+	u8RecordLen = 0;
+	u32Mismatch = 0;
+	u32Short = 0;
+	u64LastByte = 0;
+	FrameRx_Init(&Rx, 1, Race_Frame, 0);
+}
+
+/* Until the ring is empty and the last frame off the line */
+static void Race_Drain(void)
+{
+	while (txTail != (uint16_t)txCommit || !SimUsart_TxDone()) {
+		SimClock_Advance(SimUsart_FrameNs());
+	}
+}
+
+static void Race_Check(const char *what)
+{
+	uint8_t i;
+
+	for (i = 0; i < RACE_WRITERS; i++) {
+		if (Writers[i].u32Expect != Writers[i].u32Next) {
+			Race_Fail("%s: writer %u got %lu of %lu through", what, i, (unsigned long)Writers[i].u32Expect,
+				(unsigned long)Writers[i].u32Next);
+		}
+	}
+	if (u32Mismatch || u32Short) {
+		Race_Fail("%s: %lu torn or out of order, %lu partial writes", what, (unsigned long)u32Mismatch,
+			(unsigned long)u32Short);
+	}
+	if (!u8Bytes && (Rx.Stats.u32BadCrc || Rx.Stats.u32BadCobs || Rx.Stats.u32Lost)) {
+		Race_Fail("%s: %lu bad crc, %lu bad cobs, %lu lost", what, (unsigned long)Rx.Stats.u32BadCrc,
+			(unsigned long)Rx.Stats.u32BadCobs, (unsigned long)Rx.Stats.u32Lost);
+	}
+	if (!u8Bytes && (frameSent != Writers[RACE_MAIN].u32Next + Writers[RACE_ISR].u32Next ||
+		frameDropped != Writers[RACE_MAIN].u32Refused + Writers[RACE_ISR].u32Refused)) {
+		Race_Fail("%s: frameSent %lu, frameDropped %lu", what, (unsigned long)frameSent, (unsigned long)frameDropped);
+	}
+	if (u8Bytes && txDropped) {
+		Race_Fail("%s: %lu bytes dropped", what, (unsigned long)txDropped);
+	}
+}
+
+static void Race_Run(uint8_t u8WithBytes, uint32_t u32EveryStrex)
+{
+	uint32_t u32Before[RACE_LOOPS];
+	char what[32];
+	uint32_t i;
+
+	memcpy(u32Before, u32Hits, sizeof(u32Before));
+	Race_Open(RACE_BAUD, u8WithBytes, 0, u32EveryStrex);
+	//Paced so the ring never fills, the line still sends while the next write runs
+	for (i = 0; i < RACE_ITEMS; i++) {
+		Race_Put(RACE_MAIN);
+		SimClock_Advance((uint16_t)((uint16_t)txCommit - txTail) * SimUsart_FrameNs());
+	}
+	Race_Drain();
+
+	snprintf(what, sizeof(what), "%s every %lu", u8WithBytes ? "bytes" : "frames", (unsigned long)u32EveryStrex);
+	printf("  %-16s %6lu %6lu %8lu", what, (unsigned long)Writers[RACE_MAIN].u32Next,
+		(unsigned long)Writers[RACE_ISR].u32Next, (unsigned long)(Writers[RACE_MAIN].u32Refused +
+		Writers[RACE_ISR].u32Refused));
+	for (i = 0; i < RACE_LOOPS; i++) {
+		printf(" %8lu", (unsigned long)(u32Hits[i] - u32Before[i]));
+	}
+	printf("\n");
+	Race_Check(what);
+	if (!Writers[RACE_ISR].u32Next) {
+		Race_Fail("%s: the interrupt wrote nothing", what);
+	}
+}
+
+static void Race_Throughput(uint32_t u32Baud, uint32_t u32EveryStrex)
+{
+	SimUsart_Stats_t Stats;
+	char what[32];
+	double dSecs, dBusy;
+
+	Race_Open(u32Baud, 0, RACE_TPUT_LEN, u32EveryStrex);
+	//Main retries a frame the ring has no room for after one frame time on the line
+	while (Writers[RACE_MAIN].u32Next < RACE_TPUT_FRAMES) {
+		if (!Race_Put(RACE_MAIN)) {
+			SimClock_Advance(SimUsart_FrameNs());
+		}
+	}
+	Race_Drain();
+
+	SimUsart_GetStats(&Stats);
+	dSecs = u64LastByte / 1e9;
+	dBusy = Stats.u32Sent * (double)SimUsart_FrameNs() / u64LastByte;
+	snprintf(what, sizeof(what), "%lu %s", (unsigned long)u32Baud, u32EveryStrex ? "preempted" : "alone");
+	printf("  %-18s %10.0f %9.1f %7.2f%% %10.2f %8lu\n", what, Rx.Stats.u64Payload / dSecs,
+		Rx.Stats.u32Frames / dSecs, dBusy * 100, SimNvic_Count(DMA1_Channel4_IRQn) * 1024.0 / Stats.u32Sent,
+		(unsigned long)Writers[RACE_ISR].u32Next);
+
+	Race_Check(what);
+	if (dBusy < RACE_BUSY_MIN) {
+		Race_Fail("%s: line busy %.2f%% of the time", what, dBusy * 100);
+	}
+}
+
+int main(void)
+{
+	uint32_t n;
+	uint8_t i;
+
+	printf("writer preempted at every n-th STREX of main, STREX failed per loop:\n");
+	printf("  %-16s %6s %6s %8s %8s %8s %8s %8s\n", "run", "main", "isr", "refused", pszLoops[0], pszLoops[1],
+		pszLoops[2], pszLoops[3]);
+	for (n = 2; n <= RACE_EVERY_MAX; n++) {
+		Race_Run(0, n);
+		Race_Run(1, n);
+	}
+	for (i = 0; i < RACE_LOOPS; i++) {
+		if (!u32Hits[i]) {
+			Race_Fail("no STREX of the %s loop failed", pszLoops[i]);
+		}
+	}
+
+	printf("%u byte frames back to back:\n", RACE_TPUT_LEN);
+	printf("  %-18s %10s %9s %8s %10s %8s\n", "baud", "payload/s", "frames/s", "busy", "dma irq/KB", "isr");
+	Race_Throughput(115200, 0);
+	Race_Throughput(115200, RACE_TPUT_EVERY);
+	Race_Throughput(921600, 0);
+	Race_Throughput(921600, RACE_TPUT_EVERY);
+
+	if (iFailed) {
+		fprintf(stderr, "%d failures\n", iFailed);
+	}
+	return iFailed != 0;
+}
@@ -0,0 +1,109 @@
+#include "frame_decode.h"
+#include <string.h>
+
+#define FRAME_RX_HDR			2		/* seq, type */
+#define FRAME_RX_CRC			2
+
+uint16_t FrameRx_Crc16(const uint8_t *pData, size_t len)
+{
+	uint16_t crc = 0xFFFF;
+	uint8_t i;
+
+	while (len--) {
+		crc ^= (uint16_t)*pData++ << 8;
+		for (i = 0; i < 8; i++) {
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+void FrameRx_Init(FrameRx_t *pRx, uint8_t u8AtFrame, FrameRx_Handler_t pfFrame, void *pCtx)
+{
+	memset(pRx, 0, sizeof(*pRx));
+	pRx->u8Synced = u8AtFrame;
+	pRx->pfFrame = pfFrame;
+	pRx->pCtx = pCtx;
+}
+
+/* Decode in place, returns the decoded length or -1 if a code byte runs past the end */
+static int FrameRx_Cobs(uint8_t *p, uint16_t len)
+{
+	uint16_t in = 0, out = 0;
+	uint8_t code, i;
+
+	while (in < len) {
+		code = p[in++];
+		if (code == 0 || in + code - 1 > len) {
+			return -1;
+		}
+		for (i = 1; i < code; i++) {
+			p[out++] = p[in++];
+		}
+		//A full block of 254 bytes has no zero behind it, neither has the last block
+		if (code != 0xFF && in < len) {
+			p[out++] = 0;
+		}
+	}
+	return out;
+}
+
+static void FrameRx_End(FrameRx_t *pRx)
+{
+	uint8_t *p = pRx->u8Raw;
+	uint16_t crc;
+	int len;
+
+	if (pRx->u8Overflow) {
+		++pRx->Stats.u32BadCobs;
+		return;
+	}
+	len = FrameRx_Cobs(p, pRx->u16Len);
+	if (len < FRAME_RX_HDR + FRAME_RX_CRC) {
+		++pRx->Stats.u32BadCobs;
+		return;
+	}
+	len -= FRAME_RX_CRC;
+	crc = FrameRx_Crc16(p, len);
+	if (p[len] != (uint8_t)crc || p[len + 1] != (uint8_t)(crc >> 8)) {
+		++pRx->Stats.u32BadCrc;
+		return;
+	}
+
+	if (pRx->u8HaveSeq) {
+		pRx->Stats.u32Lost += (uint8_t)(p[0] - pRx->u8NextSeq);
+	}
+	pRx->u8HaveSeq = 1;
+	pRx->u8NextSeq = p[0] + 1;
+	++pRx->Stats.u32Frames;
+	pRx->Stats.u64Payload += len - FRAME_RX_HDR;
+	if (pRx->pfFrame) {
+		pRx->pfFrame(pRx->pCtx, p[0], p[1], p + FRAME_RX_HDR, len - FRAME_RX_HDR);
+	}
+}
+
+void FrameRx_Feed(FrameRx_t *pRx, const uint8_t *pData, size_t len)
+{
+	uint8_t b;
+
+	pRx->Stats.u64Wire += len;
+	while (len--) {
+		b = *pData++;
+		if (b != 0) {
+			if (pRx->u16Len < FRAME_RX_MAX) {
+				pRx->u8Raw[pRx->u16Len++] = b;
+			} else {
+				pRx->u8Overflow = 1;
+			}
+			continue;
+		}
+
+		//Delimiter, an empty frame is only a resync
+		if (pRx->u8Synced && pRx->u16Len) {
+			FrameRx_End(pRx);
+		}
+		pRx->u8Synced = 1;
+		pRx->u16Len = 0;
+		pRx->u8Overflow = 0;
+	}
+}
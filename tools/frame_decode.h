@@ -0,0 +1,52 @@
+#ifndef FRAME_DECODE_H_
+#define FRAME_DECODE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Receiver of the UART frames of UART/HardWareUart_Send (uart_tx.h):
+ *
+ *   COBS( seq | type | data[len] | crc16 ) 0x00
+ *
+ * Bytes are fed as they arrive, every 0x00 ends a frame. A frame is COBS
+ * decoded and its CRC-16/CCITT (0x1021, start 0xFFFF, low byte first)
+ * checked, good frames are handed to the callback. Frames lost on the
+ * line show up as gaps in seq between two good frames, bad frames are
+ * counted as lost as well as bad. A stream joined in the middle of a frame
+ * is read from its first 0x00 on.
+ */
+
+#define FRAME_RX_MAX			256		/* COBS bytes of the longest frame */
+
+typedef struct {
+	uint32_t u32Frames;					/* Good frames */
+	uint32_t u32BadCrc;
+	uint32_t u32BadCobs;				/* Code byte past the end, too short or too long */
+	uint32_t u32Lost;					/* Sequence numbers skipped */
+	uint64_t u64Payload;				/* Data bytes of the good frames */
+	uint64_t u64Wire;					/* Bytes received, delimiters included */
+} FrameRx_Stats_t;
+
+typedef void (*FrameRx_Handler_t)(void *pCtx, uint8_t u8Seq, uint8_t u8Type, const uint8_t *pData, uint16_t u16Len);
+
+typedef struct {
+	FrameRx_Handler_t pfFrame;
+	void *pCtx;
+	uint8_t u8Raw[FRAME_RX_MAX];
+	uint16_t u16Len;
+	uint8_t u8Synced;					/* At a frame start, bytes before it are dropped */
+	uint8_t u8HaveSeq;					/* A good frame was seen, u8NextSeq is valid */
+	uint8_t u8NextSeq;
+	uint8_t u8Overflow;					/* Current frame is too long, dropped at its delimiter */
+	FrameRx_Stats_t Stats;
+} FrameRx_t;
+
+/* u8AtFrame is 1 when the first byte fed is the start of a frame */
+void FrameRx_Init(FrameRx_t *pRx, uint8_t u8AtFrame, FrameRx_Handler_t pfFrame, void *pCtx);
+void FrameRx_Feed(FrameRx_t *pRx, const uint8_t *pData, size_t len);
+
+/* Bitwise reference of the CRC the firmware computes a byte at a time */
+uint16_t FrameRx_Crc16(const uint8_t *pData, size_t len);
+
+#endif
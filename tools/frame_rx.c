@@ -0,0 +1,211 @@
+/*
+ * Decode the UART frames of UART/HardWareUart_Send on a Linux tty or pty
+ *
+ *   frame_rx [-b baud] [-t seconds] [-q] /dev/ttyUSB0
+ *   frame_rx [-t seconds] [-q] -p
+ *
+ * Every good frame is printed, STATS frames with their counters. At the
+ * end (Ctrl-C or -t) the totals: good and bad frames, frames lost by the
+ * gaps in seq, payload against bytes on the wire, and with -b how busy the
+ * line was. -p opens a pty and prints the path of its slave side, so the
+ * encoder can be run on the host against the decoder.
+ */
+
+#define _XOPEN_SOURCE 700
+#define _DEFAULT_SOURCE
+
+#include "frame_decode.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FRAME_TYPE_STATS		0x02
+
+static volatile sig_atomic_t iStop;
+static int iQuiet;
+
+static void Rx_Signal(int sig)
+{
+	(void)sig;
+	iStop = 1;
+}
+
+static speed_t Rx_Speed(unsigned long baud)
+{
+	static const struct {
+		unsigned long baud;
+		speed_t speed;
+	} Speeds[] = {
+		{1200, B1200}, {2400, B2400}, {4800, B4800}, {9600, B9600}, {19200, B19200},
+		{38400, B38400}, {57600, B57600}, {115200, B115200}, {230400, B230400}
+	};
+	size_t i;
+
+	for (i = 0; i < sizeof(Speeds) / sizeof(Speeds[0]); i++) {
+		if (Speeds[i].baud == baud) {
+			return Speeds[i].speed;
+		}
+	}
+	return 0;
+}
+
+static uint32_t Rx_U32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void Rx_Frame(void *pCtx, uint8_t u8Seq, uint8_t u8Type, const uint8_t *pData, uint16_t u16Len)
+{
+	uint16_t i;
+
+	(void)pCtx;
+	if (iQuiet) {
+		return;
+	}
+	if (u8Type == FRAME_TYPE_STATS && u16Len == 12) {
+		printf("seq %3u stats txDropped %lu frameSent %lu frameDropped %lu\n", u8Seq,
+			(unsigned long)Rx_U32(pData), (unsigned long)Rx_U32(pData + 4), (unsigned long)Rx_U32(pData + 8));
+		return;
+	}
+	printf("seq %3u type 0x%02X len %2u:", u8Seq, u8Type, u16Len);
+	for (i = 0; i < u16Len; i++) {
+		printf(" %02X", pData[i]);
+	}
+	printf("\n");
+}
+
+static int Rx_Open(const char *pszPath, unsigned long baud, int iPty)
+{
+	struct termios tio;
+	int fd;
+
+	if (iPty) {
+		fd = posix_openpt(O_RDWR | O_NOCTTY);
+		if (fd < 0 || grantpt(fd) || unlockpt(fd)) {
+			perror("pty");
+			return -1;
+		}
+		printf("%s\n", ptsname(fd));
+		fflush(stdout);
+	} else {
+		fd = open(pszPath, O_RDONLY | O_NOCTTY);
+		if (fd < 0) {
+			perror(pszPath);
+			return -1;
+		}
+	}
+
+	//Raw 8N1, the frames are binary
+	if (tcgetattr(fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		tio.c_cflag |= CLOCAL | CREAD;
+		if (!iPty) {
+			cfsetispeed(&tio, Rx_Speed(baud));
+			cfsetospeed(&tio, Rx_Speed(baud));
+		}
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+	return fd;
+}
+
+static double Rx_Now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	FrameRx_t Rx;
+	const FrameRx_Stats_t *s = &Rx.Stats;
+	unsigned long baud = 0;
+	double dLimit = 0, dStart, dSecs;
+	uint8_t buf[4096];
+	struct timeval tv;
+	fd_set fds;
+	ssize_t n;
+	int opt, fd, iPty = 0;
+
+	while ((opt = getopt(argc, argv, "b:t:qp")) != -1) {
+		switch (opt) {
+		case 'b':
+			baud = strtoul(optarg, 0, 0);
+			break;
+		case 't':
+			dLimit = atof(optarg);
+			break;
+		case 'q':
+			iQuiet = 1;
+			break;
+		case 'p':
+			iPty = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-b baud] [-t seconds] [-q] tty | -p\n", argv[0]);
+			return 2;
+		}
+	}
+	if (!iPty && optind != argc - 1) {
+		fprintf(stderr, "usage: %s [-b baud] [-t seconds] [-q] tty | -p\n", argv[0]);
+		return 2;
+	}
+	if (baud && !Rx_Speed(baud)) {
+		fprintf(stderr, "unsupported baud rate %lu\n", baud);
+		return 2;
+	}
+
+	fd = Rx_Open(iPty ? 0 : argv[optind], baud ? baud : 9600, iPty);
+	if (fd < 0) {
+		return 1;
+	}
+	signal(SIGINT, Rx_Signal);
+	signal(SIGTERM, Rx_Signal);
+
+	//A tty may be joined mid frame, a new pty starts with the first byte written
+	FrameRx_Init(&Rx, iPty, Rx_Frame, 0);
+	dStart = Rx_Now();
+	while (!iStop && (dLimit <= 0 || Rx_Now() - dStart < dLimit)) {
+		FD_ZERO(&fds);
+		FD_SET(fd, &fds);
+		tv.tv_sec = 0;
+		tv.tv_usec = 100000;
+		if (select(fd + 1, &fds, 0, 0, &tv) <= 0) {
+			continue;
+		}
+		n = read(fd, buf, sizeof(buf));
+		if (n < 0 && errno == EIO) {
+			//pty with no writer attached yet
+			usleep(100000);
+			continue;
+		}
+		if (n < 0 && errno != EINTR && errno != EAGAIN) {
+			perror("read");
+			break;
+		}
+		if (n > 0) {
+			FrameRx_Feed(&Rx, buf, n);
+		}
+	}
+	dSecs = Rx_Now() - dStart;
+	close(fd);
+
+	printf("frames %lu, bad crc %lu, bad cobs %lu, lost %lu\n", (unsigned long)s->u32Frames,
+		(unsigned long)s->u32BadCrc, (unsigned long)s->u32BadCobs, (unsigned long)s->u32Lost);
+	printf("payload %llu of %llu bytes on the wire (%.1f%%), %.1f s, %.0f payload B/s\n",
+		(unsigned long long)s->u64Payload, (unsigned long long)s->u64Wire,
+		s->u64Wire ? 100.0 * s->u64Payload / s->u64Wire : 0.0, dSecs, dSecs > 0 ? s->u64Payload / dSecs : 0.0);
+	if (baud && dSecs > 0) {
+		//10 bits a byte at 8N1
+		printf("line busy %.1f%% at %lu baud\n", 100.0 * s->u64Wire * 10 / (baud * dSecs), baud);
+	}
+	return 0;
+}